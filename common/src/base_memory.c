@@ -57,6 +57,24 @@ global_function B32 MemoryCommit(void *base, size_t size)
 }
 
 
+// Note (Aaron): Returns committed memory to its reserved state. Its contents are discarded.
+global_function B32 MemoryDecommit(void *base, size_t size)
+{
+#if __linux__
+    void *result = mmap(base, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    return (result != MAP_FAILED);
+
+#elif _WIN32
+    B32 result = (VirtualFree(base, size, MEM_DECOMMIT) != 0);
+    return result;
+
+#endif
+
+    Assert(FALSE && "Platform not supported");
+    return 0;
+}
+
+
 global_function B32 MemoryFree(void* memory, size_t size)
 {
     #if __linux__
@@ -0,0 +1,172 @@
+#if __linux__
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if _WIN32
+#include <windows.h>
+#endif
+
+#include "base.h"
+#include "base_types.h"
+#include "base_threads.h"
+
+
+#if __linux__
+static void *ThreadEntryPoint(void *data)
+{
+    os_thread *thread = (os_thread *)data;
+    thread->Proc(thread->Data);
+    return 0;
+}
+#elif _WIN32
+static DWORD WINAPI ThreadEntryPoint(LPVOID data)
+{
+    os_thread *thread = (os_thread *)data;
+    thread->Proc(thread->Data);
+    return 0;
+}
+#endif
+
+
+global_function B32 ThreadCreate(os_thread *thread, thread_proc *proc, void *data)
+{
+    thread->Proc = proc;
+    thread->Data = data;
+    thread->Handle = 0;
+
+#if __linux__
+    pthread_t handle;
+    if (pthread_create(&handle, 0, ThreadEntryPoint, thread) != 0)
+    {
+        return 0;
+    }
+
+    thread->Handle = (U64)handle;
+    return 1;
+
+#elif _WIN32
+    HANDLE handle = CreateThread(0, 0, ThreadEntryPoint, thread, 0, 0);
+    if (!handle)
+    {
+        return 0;
+    }
+
+    thread->Handle = (U64)handle;
+    return 1;
+
+#endif
+
+    Assert(FALSE && "Platform not supported");
+    return 0;
+}
+
+
+global_function void ThreadJoin(os_thread *thread)
+{
+#if __linux__
+    pthread_join((pthread_t)thread->Handle, 0);
+
+#elif _WIN32
+    WaitForSingleObject((HANDLE)thread->Handle, INFINITE);
+    CloseHandle((HANDLE)thread->Handle);
+
+#endif
+
+    thread->Handle = 0;
+}
+
+
+global_function U32 GetLogicalCoreCount(void)
+{
+#if __linux__
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (U32)count : 1;
+
+#elif _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (U32)info.dwNumberOfProcessors : 1;
+
+#endif
+
+    return 1;
+}
+
+
+global_function U32 AtomicIncrementU32(U32 volatile *value)
+{
+#if _MSC_VER
+    return (U32)InterlockedIncrement((LONG volatile *)value);
+#else
+    return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+global_function U64 AtomicAddU64(U64 volatile *value, U64 add)
+{
+#if _MSC_VER
+    return (U64)InterlockedAdd64((LONG64 volatile *)value, (LONG64)add);
+#else
+    return __atomic_add_fetch(value, add, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+global_function B32 AtomicCompareExchangeU64(U64 volatile *value, U64 expected, U64 newValue)
+{
+#if _MSC_VER
+    return ((U64)InterlockedCompareExchange64((LONG64 volatile *)value, (LONG64)newValue, (LONG64)expected) == expected);
+#else
+    return __atomic_compare_exchange_n(value, &expected, newValue, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+// Note (Aaron): Aligned loads and stores of these sizes are atomic on x64. MSVC gives volatile accesses acquire
+// and release semantics there, so only the compiler needs to be kept from reordering them.
+global_function U32 AtomicLoadU32(U32 volatile *value)
+{
+#if _MSC_VER
+    U32 result = *value;
+    _ReadWriteBarrier();
+    return result;
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+
+global_function void AtomicStoreU32(U32 volatile *value, U32 newValue)
+{
+#if _MSC_VER
+    _ReadWriteBarrier();
+    *value = newValue;
+#else
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
+
+
+global_function U64 AtomicLoadU64(U64 volatile *value)
+{
+#if _MSC_VER
+    U64 result = *value;
+    _ReadWriteBarrier();
+    return result;
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+
+global_function void AtomicStoreU64(U64 volatile *value, U64 newValue)
+{
+#if _MSC_VER
+    _ReadWriteBarrier();
+    *value = newValue;
+#else
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef BASE_THREADS_H
+#define BASE_THREADS_H
+
+#include "base.h"
+#include "base_types.h"
+
+
+// +------------------------------+
+// Note (Aaron): Threads
+
+typedef void thread_proc(void *data);
+
+typedef struct
+{
+    U64 Handle;
+    thread_proc *Proc;
+    void *Data;
+} os_thread;
+
+
+// Note (Aaron): 'thread' must stay valid until ThreadJoin() returns
+global_function B32 ThreadCreate(os_thread *thread, thread_proc *proc, void *data);
+global_function void ThreadJoin(os_thread *thread);
+global_function U32 GetLogicalCoreCount(void);
+
+
+// +------------------------------+
+// Note (Aaron): Atomics (sequentially consistent)
+
+global_function U32 AtomicIncrementU32(U32 volatile *value);    // Returns the incremented value
+global_function U64 AtomicAddU64(U64 volatile *value, U64 add);  // Returns the value after the add
+global_function B32 AtomicCompareExchangeU64(U64 volatile *value, U64 expected, U64 newValue);  // Returns TRUE if it stored newValue
+
+// Note (Aaron): Loads acquire and stores release, for publishing data from one thread to another
+global_function U32 AtomicLoadU32(U32 volatile *value);
+global_function void AtomicStoreU32(U32 volatile *value, U32 newValue);
+global_function U64 AtomicLoadU64(U64 volatile *value);
+global_function void AtomicStoreU64(U64 volatile *value, U64 newValue);
+
+#endif // BASE_THREADS_H
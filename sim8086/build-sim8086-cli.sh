@@ -46,5 +46,5 @@ mkdir -p "$SCRIPT_DIR/$BUILD_FOLDER"
 pushd $SCRIPT_DIR/$BUILD_FOLDER > /dev/null 2>&1
 
 # Compile
-g++ $COMPILER_FLAGS $INCLUDES $SOURCES -o $OUT_EXE
+g++ $COMPILER_FLAGS $INCLUDES $SOURCES -pthread -o $OUT_EXE
 popd > /dev/null 2>&1
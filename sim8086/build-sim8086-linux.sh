@@ -16,7 +16,7 @@ OUT_LIB="sim8086_application.so"
 INCLUDES="-I$SCRIPT_DIR/../common/src -I$SCRIPT_DIR/$SRC_FOLDER/imgui -I$SCRIPT_DIR/$SRC_FOLDER/imgui/backends"
 SOURCES="$SCRIPT_DIR/$SRC_FOLDER/sim8086_linux.cpp"
 LIB_SOURCES="$SCRIPT_DIR/$SRC_FOLDER/sim8086_application.cpp"
-LINKER_FLAGS="-lGL -lglfw"
+LINKER_FLAGS="-lGL -lglfw -pthread"
 
 # Optionally set debug mode here:
 DEBUG=0
@@ -50,7 +50,7 @@ pushd $SCRIPT_DIR/$BUILD_FOLDER > /dev/null 2>&1
 
 # Compile
 echo WAITING FOR APPLICATION CODE TO COMPILE > sim8086_lock.tmp
-g++ -fPIC $COMPILER_FLAGS $INCLUDES $LIB_SOURCES --shared -o $OUT_LIB
+g++ -fPIC $COMPILER_FLAGS $INCLUDES $LIB_SOURCES --shared -pthread -o $OUT_LIB
 rm sim8086_lock.tmp
 g++ $COMPILER_FLAGS $INCLUDES $SOURCES -o $OUT_EXE $LINKER_FLAGS
 
@@ -47,9 +47,9 @@ IF NOT %ERRORLEVEL% == 0 (
 del *.pdb > NUL 2> NUL
 echo WAITING FOR PDB > %GUI_LOCK_FILE%
 :: Compile application layer
-cl %COMPILER_FLAGS% %INCLUDES% ..\src\sim8086_application.cpp %IMGUI_SOURCES% -Fmsim8086_application.map -LD /link %LINKER_FLAGS% -PDB:sim8086_application_%random%.pdb -EXPORT:SetImGuiContext -EXPORT:UpdateAndRender
+cl %COMPILER_FLAGS% %INCLUDES% ..\src\sim8086_application.cpp %IMGUI_SOURCES% -Fmsim8086_application.map -LD /link %LINKER_FLAGS% -PDB:sim8086_application_%random%.pdb -EXPORT:SetImGuiContext -EXPORT:UpdateAndRender -EXPORT:UnloadApplication
 :: Execute this line instead to view application layer after the pre-processor has been applied
-:: cl -E %COMPILER_FLAGS% %INCLUDES% ..\src\sim8086_application.cpp %IMGUI_SOURCES% -Fmsim8086_application.map -LD /link %LINKER_FLAGS% -PDB:sim8086_application_%random%.pdb -EXPORT:SetImGuiContext -EXPORT:UpdateAndRender | clang-format -style="Microsoft" > temp.txt
+:: cl -E %COMPILER_FLAGS% %INCLUDES% ..\src\sim8086_application.cpp %IMGUI_SOURCES% -Fmsim8086_application.map -LD /link %LINKER_FLAGS% -PDB:sim8086_application_%random%.pdb -EXPORT:SetImGuiContext -EXPORT:UpdateAndRender -EXPORT:UnloadApplication | clang-format -style="Microsoft" > temp.txt
 del %GUI_LOCK_FILE%
 
 :: Compile platform layer
@@ -0,0 +1,48 @@
+# Build script for test_decode_throughput.
+
+# Note: Uncomment to debug commands
+# set -ex
+
+# Note: Save the script's folder in order to construct full paths for each source.
+# Some compilers seem to only output full paths on errors if this is done.
+SCRIPT_DIR=$( cd -- "$( dirname -- "${BASH_SOURCE[0]}" )" &> /dev/null && pwd )
+
+# Note: Configure these variables
+SRC_FOLDER="src"
+BUILD_FOLDER="bin"
+OUT_EXE="test_decode_throughput"
+
+INCLUDES="-I $SCRIPT_DIR/../common/src"
+SOURCES="$SCRIPT_DIR/$SRC_FOLDER/test_decode_throughput.cpp"
+
+# Optionally set debug mode here:
+# DEBUG=1
+
+# Sets DEBUG environment variable to 0 if
+# it isn't already defined
+if [ -z $DEBUG ]
+then
+    DEBUG=0
+fi
+
+# Set DEBUG environment variable to 1 for debug builds
+if [ $DEBUG = "1" ]
+then
+    # Making debug build
+    COMPILER_FLAGS="-g -DSIM8086_SLOW=1 -Wno-null-dereference"
+    OUT_EXE="${OUT_EXE}_debug"
+else
+    # Making release build
+    # Note: Benchmarks are only meaningful with optimizations enabled.
+    COMPILER_FLAGS="-O2 -DSIM8086_SLOW=0"
+fi
+
+# Create build folder if it doesn't exist
+mkdir -p "$SCRIPT_DIR/$BUILD_FOLDER"
+
+# Change to the build folder (and redirect stdout to /dev/null and the redirect stderr to stdout)
+pushd $SCRIPT_DIR/$BUILD_FOLDER > /dev/null 2>&1
+
+# Compile
+g++ $COMPILER_FLAGS $INCLUDES $SOURCES -pthread -o $OUT_EXE
+popd > /dev/null 2>&1
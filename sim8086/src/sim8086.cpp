@@ -7,11 +7,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if __linux__
+#include <signal.h>
+#include <sys/mman.h>
+#endif
+
+#if _WIN32
+#include <windows.h>
+#endif
+
 #include "base_memory.h"
 #include "base_arena.h"
 #include "base_string.h"
+#include "base_threads.h"
 #include "sim8086.h"
 #include "sim8086_mnemonics.h"
+#include "sim8086_trace.h"
 
 
 // #pragma clang diagnostic ignored "-Wnull-dereference"
@@ -96,17 +107,13 @@ global_function B32 DumpMemoryToFile(processor_8086 *processor, const char *file
         return FALSE;
     }
 
-    // loop over memory and write character to file stream one at a time
-    for (U32 i = 0; i < processor->MemorySize; ++i)
-    {
-        U8 value = (U8)*(processor->Memory + i);
-        fputc(value, file);
-    }
+    fwrite(processor->Memory, 1, processor->MemorySize, file);
 
     // error handling for file write
     if (ferror(file))
     {
         printf("ERROR: Encountered error while writing memory to '%s'", filename);
+        fclose(file);
         return FALSE;
     }
 
@@ -115,6 +122,208 @@ global_function B32 DumpMemoryToFile(processor_8086 *processor, const char *file
 }
 
 
+global_variable const U8 ProcessorDumpSignature[8] = { 'S', 'I', 'M', '8', '0', '8', '6', 'D' };
+
+
+inline global_function B32 IsDumpPageEmpty(U8 *page)
+{
+    U64 *words = (U64 *)page;
+    U64 combined = 0;
+    for (U32 i = 0; i < PROCESSOR_DUMP_PAGE_SIZE / sizeof(U64); ++i)
+    {
+        combined |= words[i];
+    }
+
+    return combined == 0;
+}
+
+
+// Note (Aaron): Writes a processor_dump_header, the indices of the pages of memory that aren't all zero,
+// and then those pages. Runs of neighbouring pages are written together.
+global_function B32 WriteProcessorDump(processor_8086 *processor, FILE *file)
+{
+    U32 pageCount = processor->MemorySize / PROCESSOR_DUMP_PAGE_SIZE;
+    U32 *pageIndices = (U32 *)malloc(sizeof(U32) * pageCount);
+    if (!pageIndices)
+    {
+        return FALSE;
+    }
+
+    processor_dump_header header = {};
+    MemoryCopy(header.Signature, ProcessorDumpSignature, sizeof(header.Signature));
+    header.Version = PROCESSOR_DUMP_VERSION;
+    MemoryCopy(header.Registers, processor->Registers, sizeof(header.Registers));
+    header.Flags = GetProcessorFlags(processor);
+    header.IP = processor->IP;
+    header.ProgramSize = processor->ProgramSize;
+    header.MemorySize = processor->MemorySize;
+    header.InstructionCount = processor->InstructionCount;
+    header.TotalClockCount = processor->TotalClockCount;
+
+    for (U32 page = 0; page < pageCount; ++page)
+    {
+        if (!IsDumpPageEmpty(processor->Memory + ((U64)page * PROCESSOR_DUMP_PAGE_SIZE)))
+        {
+            pageIndices[header.PageCount++] = page;
+        }
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(pageIndices, sizeof(U32), header.PageCount, file);
+
+    U32 runStart = 0;
+    for (U32 i = 1; i <= header.PageCount; ++i)
+    {
+        if (i == header.PageCount || pageIndices[i] != pageIndices[i - 1] + 1)
+        {
+            fwrite(processor->Memory + ((U64)pageIndices[runStart] * PROCESSOR_DUMP_PAGE_SIZE),
+                   PROCESSOR_DUMP_PAGE_SIZE, i - runStart, file);
+            runStart = i;
+        }
+    }
+
+    free(pageIndices);
+
+    B32 result = !ferror(file);
+    return result;
+}
+
+
+global_function B32 DumpProcessorToFile(processor_8086 *processor, const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        printf("ERROR: Unable to open '%s'\n", filename);
+        return FALSE;
+    }
+
+    B32 result = WriteProcessorDump(processor, file);
+    if (!result)
+    {
+        printf("ERROR: Encountered error while writing processor state to '%s'\n", filename);
+    }
+
+    fclose(file);
+    return result;
+}
+
+
+global_function B32 IsProcessorDumpFile(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    U8 signature[sizeof(ProcessorDumpSignature)] = {};
+    B32 result = fread(signature, 1, sizeof(signature), file) == sizeof(signature)
+        && memcmp(signature, ProcessorDumpSignature, sizeof(signature)) == 0;
+
+    fclose(file);
+    return result;
+}
+
+
+// Note (Aaron): Restores the registers, flags, instruction pointer and memory from a dump written by
+// WriteProcessorDump() that starts at 'data'. Memory that isn't in the dump is zeroed. 'dumpSize' is set to
+// the size of the dump, which may be followed by other data.
+global_function B32 LoadProcessorFromDump(processor_8086 *processor, U8 const *data, U64 size, U64 *dumpSize)
+{
+    processor_dump_header header = {};
+    U32 pageCount = processor->MemorySize / PROCESSOR_DUMP_PAGE_SIZE;
+    if (size < sizeof(header))
+    {
+        return FALSE;
+    }
+
+    MemoryCopy(&header, data, sizeof(header));
+    if (memcmp(header.Signature, ProcessorDumpSignature, sizeof(header.Signature)) != 0
+        || header.Version != PROCESSOR_DUMP_VERSION
+        || header.MemorySize != processor->MemorySize
+        || header.PageCount > pageCount
+        || header.ProgramSize > processor->MemorySize)
+    {
+        return FALSE;
+    }
+
+    U64 totalSize = sizeof(header) + ((U64)header.PageCount * (sizeof(U32) + PROCESSOR_DUMP_PAGE_SIZE));
+    if (size < totalSize)
+    {
+        return FALSE;
+    }
+
+    U8 const *pageIndexData = data + sizeof(header);
+    U8 const *pageData = pageIndexData + ((U64)header.PageCount * sizeof(U32));
+
+    // Note (Aaron): Pages are in ascending order, the gaps between them are zeroed
+    U32 nextPage = 0;
+    for (U32 i = 0; i < header.PageCount; ++i)
+    {
+        U32 page = 0;
+        MemoryCopy(&page, pageIndexData + ((U64)i * sizeof(U32)), sizeof(page));
+        if (page < nextPage || page >= pageCount)
+        {
+            return FALSE;
+        }
+
+        if (page > nextPage)
+        {
+            MemorySet(processor->Memory + ((U64)nextPage * PROCESSOR_DUMP_PAGE_SIZE), 0, (U64)(page - nextPage) * PROCESSOR_DUMP_PAGE_SIZE);
+        }
+
+        MemoryCopy(processor->Memory + ((U64)page * PROCESSOR_DUMP_PAGE_SIZE), pageData + ((U64)i * PROCESSOR_DUMP_PAGE_SIZE), PROCESSOR_DUMP_PAGE_SIZE);
+        nextPage = page + 1;
+    }
+
+    if (pageCount > nextPage)
+    {
+        MemorySet(processor->Memory + ((U64)nextPage * PROCESSOR_DUMP_PAGE_SIZE), 0, (U64)(pageCount - nextPage) * PROCESSOR_DUMP_PAGE_SIZE);
+    }
+
+    MemoryCopy(processor->Registers, header.Registers, sizeof(processor->Registers));
+    processor->Flags = header.Flags;
+    processor->LazyFlags = {};
+    processor->IP = header.IP;
+    processor->PrevIP = header.IP;
+    processor->ProgramSize = header.ProgramSize;
+    processor->InstructionCount = header.InstructionCount;
+    processor->TotalClockCount = header.TotalClockCount;
+    ClearProcessorFault(processor);
+
+    if (processor->InstructionCache)
+    {
+        ClearInstructionCache(processor->InstructionCache);
+    }
+
+    *dumpSize = totalSize;
+    return TRUE;
+}
+
+
+global_function B32 LoadProcessorFromFile(processor_8086 *processor, const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    // Note (Aaron): Dumps are at most the size of the processor's memory, plus their page indices
+    U64 maxSize = sizeof(processor_dump_header) + ((U64)processor->MemorySize / PROCESSOR_DUMP_PAGE_SIZE) * (sizeof(U32) + PROCESSOR_DUMP_PAGE_SIZE);
+    U8 *data = (U8 *)malloc(maxSize);
+    U64 size = data ? fread(data, 1, maxSize, file) : 0;
+    fclose(file);
+
+    U64 dumpSize = 0;
+    B32 result = (size != 0) && LoadProcessorFromDump(processor, data, size, &dumpSize);
+
+    free(data);
+    return result;
+}
+
+
 // Note (Aaron): Reads the next N bytes of the instruction stream into an instruction's bits.
 // Advances both the instruction bits pointer and the processor's instruction pointer.
 global_function void ReadInstructionStream(processor_8086 *processor, instruction *instruction, U8 byteCount)
@@ -123,20 +332,8 @@ global_function void ReadInstructionStream(processor_8086 *processor, instructio
     // In practice, we never read this many bytes at once.
     assert_8086(byteCount < 6);
 
-    // error out if we attempt to read outside of program memory
-    if ((processor->IP + byteCount) > processor->ProgramSize)
-    {
-        printf("ERROR: Attempted to read outside of program memory (%i)\n", (processor->IP + byteCount));
-        printf("\tprogram size: %i\n", processor->ProgramSize);
-        printf("\tip: 0x%x (%i)\n",
-               processor->IP,
-               processor->IP);
-        printf("\tbyteCount: %i\n", byteCount);
-
-        Assert(FALSE && "Attempted to read outside of program memory");
-        // TODO (Aaron): Need to support Win32 and not immediately exit
-        exit(1);
-    }
+    // Note (Aaron): Reads past the end of the program aren't checked for here, DecodeInstructionFromMemory()
+    // checks once the whole instruction has been read. Reads past the end of memory fault into its guard pages.
 
     // load instruction bytes out of memory
     U8 *readStartPtr = processor->Memory + processor->IP;
@@ -145,7 +342,7 @@ global_function void ReadInstructionStream(processor_8086 *processor, instructio
     // advance pointers and counters
     instruction->Bits.BytePtr += byteCount;
     processor->IP += byteCount;
-    instruction->Bits.ByteCount++;
+    instruction->Bits.ByteCount += byteCount;
 }
 
 
@@ -177,14 +374,8 @@ global_function void ParseRmBits(processor_8086 *processor, instruction *instruc
             operand->Memory.Flags |= Memory_HasDirectAddress;
 
             // read direct address
-            if (instruction->WidthBit == 0)
-            {
-                // Note (Aaron): Casey said that this special case is always a 16-bit displacement in Q&A #5 (at 27m30s)
-                // but I think he meant the direct address value is always 16 bits. Putting an assert here to catch
-                // it in case we ever do hit a width bit of 0 in this case.
-                assert_8086(FALSE);
-            }
-
+            // Note (Aaron): Casey said that this special case is always a 16-bit displacement in Q&A #5 (at 27m30s).
+            // The direct address is 16 bits whatever the width bit is, e.g. 'mov al, [1234]'.
             U8 *readStartPtr = instruction->Bits.BytePtr;
             ReadInstructionStream(processor, instruction, 2);
             operand->Memory.DirectAddress = (U16)(*(U16 *)readStartPtr);
@@ -278,726 +469,1803 @@ global_function U8 CalculateEffectiveAddressClocks(instruction_operand *operand)
 }
 
 
-global_function instruction DecodeNextInstruction(processor_8086 *processor)
+global_function B32 InitializeInstructionCache(instruction_cache *cache, memory_arena *arena, U32 memorySize)
 {
-    processor->PrevIP = processor->IP;
-    instruction instruction = {};
-    instruction.Address = processor->IP;
+    *cache = {};
+    ArenaClear(arena);
 
-    // read initial instruction byte for parsing
-    processor->InstructionCount++;
-    ReadInstructionStream(processor, &instruction, 1);
+    cache->Slots = (U32 *)ArenaPushSizeZero(arena, sizeof(U32) * memorySize);
+    if (!cache->Slots)
+    {
+        return FALSE;
+    }
 
-    // mov instruction - register/memory to/from register (0b100010)
-    if ((instruction.Bits.Byte0 >> 2) == 0b100010)
+    cache->SlotCount = memorySize;
+
+    // Note (Aaron): The remainder of the arena holds the decoded instructions
+    cache->InstructionCapacity = (U32)((arena->Size - arena->Used) / sizeof(packed_instruction));
+    cache->Instructions = ArenaPushArray(arena, packed_instruction, cache->InstructionCapacity);
+    if (!cache->Instructions || cache->InstructionCapacity == 0)
     {
-        instruction.OpType = Op_mov;
+        return FALSE;
+    }
 
-        instruction_operand operandReg = {};
-        instruction_operand operandRm = {};
+    cache->LowAddress = memorySize;
+    cache->HighAddress = 0;
 
-        // parse initial instruction byte
-        instruction.DirectionBit = (instruction.Bits.Byte0 >> 1) & 0b1;
-        instruction.WidthBit = instruction.Bits.Byte0 & 0b1;
+    return TRUE;
+}
 
-        // read second instruction byte and parse it
-        ReadInstructionStream(processor, &instruction, 1);
 
-        instruction.ModBits = (instruction.Bits.Byte1 >> 6);
-        instruction.RegBits = (instruction.Bits.Byte1 >> 3) & 0b111;
-        instruction.RmBits = instruction.Bits.Byte1 & 0b111;
+global_function void ClearInstructionCache(instruction_cache *cache)
+{
+    // Note (Aaron): Only the range of slots that could have been written needs to be cleared
+    for (U32 address = cache->LowAddress; address < cache->HighAddress; ++address)
+    {
+        cache->Slots[address] = 0;
+    }
 
-        // decode reg
-        operandReg.Type = Operand_Register;
-        operandReg.Register = RegMemTables[instruction.WidthBit][instruction.RegBits];
+    cache->InstructionCount = 0;
+    cache->LowAddress = cache->SlotCount;
+    cache->HighAddress = 0;
+    cache->InvalidationCount++;
+}
 
-        // parse r/m
-        ParseRmBits(processor, &instruction, &operandRm);
 
-        // set dest and source strings
-        // destination is in RM field, source is in REG field
-        if (instruction.DirectionBit == 0)
-        {
-            instruction.Operands[0] = operandRm;
-            instruction.Operands[1] = operandReg;
-        }
-        // destination is in REG field, source is in RM field
-        else
-        {
-            instruction.Operands[0] = operandReg;
-            instruction.Operands[1] = operandRm;
-        }
+// Note (Aaron): Drops cached instructions that may overlap the written range so that
+// self-modifying code gets re-decoded.
+global_function void InvalidateInstructionCache(instruction_cache *cache, U32 address, U32 byteCount)
+{
+    U32 endAddress = address + byteCount;
+    if (endAddress <= cache->LowAddress || address >= cache->HighAddress)
+    {
+        return;
+    }
 
-        // estimate clock cycles
-        // register to register
-        if (instruction.Operands[0].Type == Operand_Register
-            && instruction.Operands[1].Type == Operand_Register)
-        {
-            instruction.ClockCount = 2;
-        }
-        // register to memory
-        else if (instruction.Operands[0].Type == Operand_Memory
-                 && instruction.Operands[1].Type == Operand_Register)
-        {
-            instruction.ClockCount = 9;
-            instruction.EAClockCount = CalculateEffectiveAddressClocks(&instruction.Operands[0]);
-        }
-        // memory to register
-        else if (instruction.Operands[0].Type == Operand_Register
-            && instruction.Operands[1].Type == Operand_Memory)
-        {
-            instruction.ClockCount = 8;
-            instruction.EAClockCount = CalculateEffectiveAddressClocks(&instruction.Operands[1]);
-        }
-        else
-        {
-            assert_8086(FALSE && "Unreachable case");
-        }
+    // an instruction starting up to (MAX_INSTRUCTION_SIZE - 1) bytes before the write can contain it
+    U32 startAddress = (address > cache->LowAddress + (MAX_INSTRUCTION_SIZE - 1))
+        ? address - (MAX_INSTRUCTION_SIZE - 1)
+        : cache->LowAddress;
+    endAddress = Min(endAddress, cache->HighAddress);
+
+    for (U32 slotAddress = startAddress; slotAddress < endAddress; ++slotAddress)
+    {
+        cache->Slots[slotAddress] = 0;
     }
 
-    // mov instruction - immediate to register/memory (0b1100011)
-    else if ((instruction.Bits.Byte0 >> 1) == 0b1100011)
+    cache->InvalidationCount++;
+}
+
+
+global_function void CacheInstruction(instruction_cache *cache, packed_instruction *packed)
+{
+    if (packed->Address >= cache->SlotCount)
     {
-        instruction.OpType = Op_mov;
-        instruction_operand operandSource = {};
-        instruction_operand operandDest = {};
-        operandSource.Type = Operand_Immediate;
+        return;
+    }
 
-        instruction.WidthBit = instruction.Bits.Byte0 & 0b1;
+    // Note (Aaron): Start over when full. Only happens when self-modifying code keeps invalidating entries.
+    if (cache->InstructionCount == cache->InstructionCapacity)
+    {
+        ClearInstructionCache(cache);
+    }
 
-        // read second instruction byte and parse it
-        ReadInstructionStream(processor, &instruction, 1);
+    cache->Instructions[cache->InstructionCount] = *packed;
+    cache->InstructionCount++;
+    cache->Slots[packed->Address] = cache->InstructionCount;
 
-        instruction.ModBits = (instruction.Bits.Byte1 >> 6);
-        instruction.RmBits = (instruction.Bits.Byte1) & 0b111;
+    U32 endAddress = packed->Address + packed->ByteCount;
+    if (packed->Address < cache->LowAddress) { cache->LowAddress = packed->Address; }
+    if (endAddress > cache->HighAddress) { cache->HighAddress = endAddress; }
+}
 
-        // Note (Aaron): No reg in this instruction
 
-        // parse r/m
-        ParseRmBits(processor, &instruction, &operandDest);
+inline static packed_operand PackOperand(instruction_operand *operand)
+{
+    packed_operand result = {};
+    result.Kind = (U8)operand->Type;
 
-        // read data. guaranteed to be at least 8-bits.
-        if (instruction.WidthBit == 0b0)
-        {
-            U8 *readStartPtr = instruction.Bits.BytePtr;
-            ReadInstructionStream(processor, &instruction, 1);
-            operandSource.Immediate.Value = (U16)(*(U8 *)readStartPtr);
-        }
-        else if (instruction.WidthBit == 0b1)
-        {
-            U8 *readStartPtr = instruction.Bits.BytePtr;
-            ReadInstructionStream(processor, &instruction, 2);
-            operandSource.Immediate.Value = (U16)(*(U16 *)readStartPtr);
-        }
-        else
+    switch (operand->Type)
+    {
+        case Operand_Register:
         {
-            assert_8086(FALSE && "Unhandled case");
+            result.Register = (U8)operand->Register;
+            break;
         }
 
-        instruction.Operands[0] = operandDest;
-        instruction.Operands[1] = operandSource;
-
-        // estimate clock cycles
-        // immediate to register
-        if (instruction.Operands[0].Type == Operand_Register
-            && instruction.Operands[1].Type == Operand_Immediate)
+        case Operand_Memory:
         {
-            instruction.ClockCount = 4;
+            // Note (Aaron): A memory operand has a direct address or a displacement, never both
+            result.Kind |= (U8)(operand->Memory.Flags << 2);
+            result.Register = (U8)operand->Memory.Register;
+            result.Value = (operand->Memory.Flags & Memory_HasDirectAddress)
+                ? operand->Memory.DirectAddress
+                : (U16)operand->Memory.Displacement;
+            break;
         }
-        // immediate to memory
-        else if (instruction.Operands[0].Type == Operand_Memory
-            && instruction.Operands[1].Type == Operand_Immediate)
+
+        case Operand_Immediate:
         {
-            instruction.ClockCount = 10;
-            instruction.EAClockCount = CalculateEffectiveAddressClocks(&instruction.Operands[0]);
+            result.Kind |= (U8)(operand->Immediate.Flags << 2);
+            result.Value = operand->Immediate.Value;
+            break;
         }
-        else
+
+        default:
         {
-            assert_8086(FALSE && "Unreachable case");
+            break;
         }
     }
 
-    // mov instruction - immediate to register (0b1011)
-    else if ((instruction.Bits.Byte0 >> 4) == 0b1011)
-    {
-        instruction.OpType = Op_mov;
-        instruction_operand operandSource = {};
-        instruction_operand operandDest = {};
-        operandSource.Type = Operand_Immediate;
-        operandDest.Type = Operand_Register;
+    return result;
+}
 
-        // parse width and reg
-        instruction.WidthBit = (instruction.Bits.Byte0 >> 3) & (0b1);
-        instruction.RegBits = instruction.Bits.Byte0 & 0b111;
 
-        if (instruction.WidthBit == 0b0)
-        {
-            // read 8-bit data
-            ReadInstructionStream(processor, &instruction, 1);
-            operandSource.Immediate.Value = *(U8 *)(&instruction.Bits.Byte1);
-        }
-        else if (instruction.WidthBit == 0b1)
-        {
-            // read 16-bit data
-            ReadInstructionStream(processor, &instruction, 2);
-            operandSource.Immediate.Value = *(U16 *)(&instruction.Bits.Byte1);
-        }
-        else
-        {
-            assert_8086(FALSE && "Unhandled case");
-        }
+static_assert_8086(sizeof(instruction_operand) == 16
+                   && offsetof(instruction_operand, Register) == 4
+                   && offsetof(instruction_operand, Memory) + offsetof(operand_memory, Displacement) == 8
+                   && offsetof(instruction_operand, Memory) + offsetof(operand_memory, DirectAddress) == 10
+                   && offsetof(instruction_operand, Memory) + offsetof(operand_memory, Flags) == 12
+                   && offsetof(instruction_operand, Immediate) + offsetof(operand_immediate, Flags) == 6,
+                   "UnpackOperand() builds operands with this layout");
 
-        operandDest.Register = RegMemTables[instruction.WidthBit][instruction.RegBits];
-        instruction.Operands[0] = operandDest;
-        instruction.Operands[1] = operandSource;
+// Note (Aaron): Operands are passed around by value, which reads them 8 bytes at a time. Writing them a field at a
+// time would leave those reads waiting for the stores to reach the cache instead of being forwarded from them, so
+// the operand is put together in two 8 byte words and written with them.
+inline static void UnpackOperand(instruction_operand *result, packed_operand *packed)
+{
+    U64 type = packed->Kind & 0b11;
+    U64 flags = packed->Kind >> 2;
+    U64 value = packed->Value;
 
-        // estimate clock cycles
-        // immediate to register
-        if (instruction.Operands[0].Type == Operand_Register
-            && instruction.Operands[1].Type == Operand_Immediate)
-        {
-            instruction.ClockCount = 4;
-        }
-        else
-        {
-            assert_8086(FALSE && "Unreachable case");
-        }
+    U64 low = type;
+    U64 high = 0;
+    if (type == Operand_Immediate)
+    {
+        low |= (value | (flags << 16)) << 32;
     }
-
-    // mov - memory to accumulator and accumulator to memory
-    else if (((instruction.Bits.Byte0 >> 1) == 0b1010000) || ((instruction.Bits.Byte0 >> 1) == 0b1010001))
+    else
     {
-        instruction.OpType = Op_mov;
-        instruction_operand operandAccumulator = {};
-        instruction_operand operandMemory = {};
-        operandAccumulator.Type = Operand_Register;
-        operandAccumulator.Register = Reg_ax;
-        operandMemory.Type = Operand_Memory;
-        operandMemory.Memory.Flags |= Memory_HasDirectAddress;
+        low |= (U64)packed->Register << 32;
+    }
 
-        instruction.WidthBit = instruction.Bits.Byte0 & 0b1;
-        if (instruction.WidthBit == 0)
-        {
-            ReadInstructionStream(processor, &instruction, 1);
-            operandMemory.Memory.DirectAddress = (U16)(*(&instruction.Bits.Byte1));
-        }
-        else if (instruction.WidthBit == 1)
-        {
-            ReadInstructionStream(processor, &instruction, 2);
-            operandMemory.Memory.DirectAddress = (U16)(*(U16 *)(&instruction.Bits.Byte1));
-        }
-        else
-        {
-            assert_8086(FALSE && "Unhandled case");
-        }
+    if (type == Operand_Memory)
+    {
+        high = ((flags & Memory_HasDirectAddress) ? (value << 16) : value) | (flags << 32);
+    }
 
-        if ((instruction.Bits.Byte0 >> 1) == 0b1010000)
-        {
-            instruction.Operands[0] = operandAccumulator;
-            instruction.Operands[1] = operandMemory;
-        }
-        else if ((instruction.Bits.Byte0 >> 1) == 0b1010001)
-        {
-            instruction.Operands[0] = operandMemory;
-            instruction.Operands[1] = operandAccumulator;
-        }
-        else
-        {
-            assert_8086(FALSE && "Unhandled case");
-        }
+    U64 words[2] = { low, high };
+    memcpy(result, words, sizeof(words));
+}
 
-        // estimate clock cycles
-        // Note (Aaron): Both memory to accumulator and accumulator to memory share
-        // the same clock count
-        instruction.ClockCount = 10;
-    }
 
-    // add / sub / cmp - reg/memory with register to either
-    else if (((instruction.Bits.Byte0 >> 2) == 0b000000)
-        || ((instruction.Bits.Byte0 >> 2) == 0b001010)
-        || ((instruction.Bits.Byte0 >> 2) == 0b001110))
-    {
-        instruction_operand operandReg = {};
-        operandReg.Type = Operand_Register;
-        instruction_operand operandRm = {};
+global_function packed_instruction PackInstruction(instruction *instruction)
+{
+    packed_instruction result = {};
+    result.Address = instruction->Address;
+    result.OpType = (U8)instruction->OpType;
+    result.ByteCount = instruction->Bits.ByteCount;
+    result.WidthBit = instruction->WidthBit;
+    result.RepPrefix = instruction->RepPrefix;
+    result.ClockCount = instruction->ClockCount;
+    result.EAClockCount = instruction->EAClockCount;
+    result.Operands[0] = PackOperand(&instruction->Operands[0]);
+    result.Operands[1] = PackOperand(&instruction->Operands[1]);
 
-        // decode direction and width
-        instruction.DirectionBit = (instruction.Bits.Byte0 >> 1) & 0b1;
-        instruction.WidthBit = instruction.Bits.Byte0 & 0b1;
+    return result;
+}
 
-        // decode mod, reg and r/m
-        ReadInstructionStream(processor, &instruction, 1);
-        instruction.ModBits = (instruction.Bits.Byte1 >> 6) & 0b11;
-        instruction.RegBits = (instruction.Bits.Byte1 >> 3) & 0b111;
-        instruction.RmBits = instruction.Bits.Byte1 & 0b111;
 
-        // decode instruction type
-        // add = 0b000
-        if (((instruction.Bits.Byte0 >> 3) & 0b111) == 0b000)
-        {
-            instruction.OpType = Op_add;
-        }
-        // sub = 0b101
-        else if (((instruction.Bits.Byte0 >> 3) & 0b111) == 0b101)
-        {
-            instruction.OpType = Op_sub;
-        }
-        // cmp = 0b111
-        else if (((instruction.Bits.Byte0 >> 3) & 0b111) == 0b111)
-        {
-            instruction.OpType = Op_cmp;
-        }
-        else
-        {
-            assert_8086(FALSE && "Unhandled case");
-        }
+// Note (Aaron): The instruction's bytes aren't kept in the packed form, and execution doesn't look at them. They are
+// copied back from the processor's memory when one is given, which holds them for as long as the instruction is
+// cached; otherwise only Bits.ByteCount is set.
+global_function instruction UnpackInstruction(packed_instruction *packed, processor_8086 *processor)
+{
+    instruction result = {};
+    result.Address = packed->Address;
+    result.OpType = (operation_types)packed->OpType;
+    result.WidthBit = packed->WidthBit;
+    result.RepPrefix = packed->RepPrefix;
+    result.ClockCount = packed->ClockCount;
+    result.EAClockCount = packed->EAClockCount;
+    UnpackOperand(&result.Operands[0], &packed->Operands[0]);
+    UnpackOperand(&result.Operands[1], &packed->Operands[1]);
+
+    result.Bits.ByteCount = packed->ByteCount;
+    if (processor && packed->Address + packed->ByteCount <= processor->MemorySize)
+    {
+        MemoryCopy(result.Bits.Bytes, processor->Memory + packed->Address, packed->ByteCount);
+    }
+    result.Bits.BytePtr = result.Bits.Bytes + result.Bits.ByteCount;
 
-        // decode reg
-        operandReg.Register = RegMemTables[instruction.WidthBit][instruction.RegBits];
+    return result;
+}
 
-        // parse r/m
-        ParseRmBits(processor, &instruction, &operandRm);
 
-        // set dest and source strings
-        // destination is in RM field, source is in REG field
-        if (instruction.DirectionBit == 0)
-        {
-            instruction.Operands[0] = operandRm;
-            instruction.Operands[1] = operandReg;
-        }
-        // destination is in REG field, source is in RM field
-        else
-        {
-            instruction.Operands[0] = operandReg;
-            instruction.Operands[1] = operandRm;
-        }
+global_function B32 InitializeSnapshotHistory(snapshot_history *history, memory_arena *arena, U32 memorySize, U32 interval)
+{
+    *history = {};
+    ArenaClear(arena);
 
-        // estimate clock cycles
-        // register to register
-        if (instruction.Operands[0].Type == Operand_Register
-            && instruction.Operands[1].Type == Operand_Register)
-        {
-            // Note (Aaron): add, sub, and cmp share the same clock count for this operation
-            instruction.ClockCount = 3;
-        }
-        // register to memory
-        else if (instruction.Operands[0].Type == Operand_Memory
-            && instruction.Operands[1].Type == Operand_Register)
-        {
-            instruction.ClockCount = 16;
-            switch (instruction.OpType)
-            {
-                case Op_add:
-                case Op_sub:
-                    instruction.ClockCount = 16;
-                    break;
-                case Op_cmp:
-                    instruction.ClockCount = 9;
-                    break;
-                default:
-                    assert_8086(FALSE && "Unhandled case");
-            }
+    history->MemoryPageCount = (memorySize + SNAPSHOT_PAGE_SIZE - 1) >> SNAPSHOT_PAGE_SHIFT;
+    history->Interval = interval;
 
-            instruction.EAClockCount = CalculateEffectiveAddressClocks(&instruction.Operands[0]);
-        }
-        // memory to register
-        else if (instruction.Operands[0].Type == Operand_Register
-            && instruction.Operands[1].Type == Operand_Memory)
-        {
-            // Note (Aaron): add, sub, and cmp share the same clock count for this operation
-            instruction.ClockCount = 9;
-            instruction.EAClockCount = CalculateEffectiveAddressClocks(&instruction.Operands[1]);
-        }
-        else
-        {
-            assert_8086(FALSE && "Unreachable case");
-        }
+    history->CapturedPages = (U64 *)ArenaPushSizeZero(arena, sizeof(U64) * ((history->MemoryPageCount + 63) / 64));
+    history->SnapshotCapacity = Kilobytes(4);
+    history->Snapshots = ArenaPushArray(arena, processor_snapshot, history->SnapshotCapacity);
+    if (!history->CapturedPages || !history->Snapshots)
+    {
+        return FALSE;
     }
 
-    // add / sub / cmp - immediate to register/memory
-    else if ((instruction.Bits.Byte0 >> 2) == 0b100000)
+    // Note (Aaron): The remainder of the arena holds pages. There must be room for every page of memory
+    // so that the newest snapshot can always capture the pages it needs.
+    U64 remainingSize = arena->MaxSize - arena->Used;
+    history->PageSlotCapacity = (U32)(remainingSize / (sizeof(U32) + SNAPSHOT_PAGE_SIZE));
+    history->PageAddresses = ArenaPushArray(arena, U32, history->PageSlotCapacity);
+    history->PageData = (U8 *)ArenaPushSize(arena, (U64)history->PageSlotCapacity * SNAPSHOT_PAGE_SIZE);
+    if (!history->PageAddresses || !history->PageData || history->PageSlotCapacity < history->MemoryPageCount)
     {
-        instruction_operand operandSource = {};
-        instruction_operand operandDest = {};
-        operandSource.Type = Operand_Immediate;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+global_function void ClearSnapshotHistory(snapshot_history *history)
+{
+    history->FirstSnapshot = 0;
+    history->SnapshotCount = 0;
+    history->FirstPageSlot = 0;
+    history->PageSlotCount = 0;
+    MemorySet(history->CapturedPages, 0, sizeof(U64) * ((history->MemoryPageCount + 63) / 64));
+}
+
+
+inline global_function processor_snapshot *GetSnapshot(snapshot_history *history, U32 index)
+{
+    return &history->Snapshots[(history->FirstSnapshot + index) % history->SnapshotCapacity];
+}
+
+
+global_function void DropOldestSnapshot(snapshot_history *history)
+{
+    assert_8086(history->SnapshotCount > 0);
+
+    processor_snapshot *oldest = GetSnapshot(history, 0);
+    history->FirstPageSlot = (history->FirstPageSlot + oldest->PageCount) % history->PageSlotCapacity;
+    history->PageSlotCount -= oldest->PageCount;
+
+    history->FirstSnapshot = (history->FirstSnapshot + 1) % history->SnapshotCapacity;
+    history->SnapshotCount--;
+}
+
+
+global_function void TakeSnapshot(snapshot_history *history, processor_8086 *processor)
+{
+    if (history->SnapshotCount == history->SnapshotCapacity)
+    {
+        DropOldestSnapshot(history);
+    }
+
+    processor_snapshot *snapshot = GetSnapshot(history, history->SnapshotCount++);
+    MemoryCopy(snapshot->Registers, processor->Registers, sizeof(snapshot->Registers));
+    snapshot->Flags = processor->Flags;
+    snapshot->LazyFlags = processor->LazyFlags;
+    snapshot->IP = processor->IP;
+    snapshot->PrevIP = processor->PrevIP;
+    snapshot->InstructionCount = processor->InstructionCount;
+    snapshot->TotalClockCount = processor->TotalClockCount;
+    snapshot->FirstPageSlot = (history->FirstPageSlot + history->PageSlotCount) % history->PageSlotCapacity;
+    snapshot->PageCount = 0;
+
+    // Note (Aaron): Every page has to be copied again before it's next written
+    MemorySet(history->CapturedPages, 0, sizeof(U64) * ((history->MemoryPageCount + 63) / 64));
+}
+
+
+// Note (Aaron): Takes a snapshot if Interval instructions have executed since the newest one
+global_function void UpdateSnapshots(snapshot_history *history, processor_8086 *processor)
+{
+    if (history->SnapshotCount == 0
+        || processor->InstructionCount - GetSnapshot(history, history->SnapshotCount - 1)->InstructionCount >= history->Interval)
+    {
+        TakeSnapshot(history, processor);
+    }
+}
+
+
+// Note (Aaron): Copies the pages touched by a write of 'byteCount' bytes at 'address' into the newest
+// snapshot, unless they were already copied since it was taken. Must be called before the write.
+global_function void CaptureMemoryPages(snapshot_history *history, U8 *memory, U32 memorySize, U32 address, U32 byteCount)
+{
+    if (history->SnapshotCount == 0)
+    {
+        return;
+    }
+
+    U32 lastAddress = (Min(address + byteCount, memorySize)) - 1;
+    for (U32 page = address >> SNAPSHOT_PAGE_SHIFT; page <= (lastAddress >> SNAPSHOT_PAGE_SHIFT); ++page)
+    {
+        U64 pageBit = 1ull << (page & 63);
+        if (history->CapturedPages[page >> 6] & pageBit)
+        {
+            continue;
+        }
+
+        // Note (Aaron): Never drops the newest snapshot, there is a slot for every page of memory
+        while (history->PageSlotCount == history->PageSlotCapacity)
+        {
+            DropOldestSnapshot(history);
+        }
+
+        U32 slot = (history->FirstPageSlot + history->PageSlotCount) % history->PageSlotCapacity;
+        U32 pageAddress = page << SNAPSHOT_PAGE_SHIFT;
+        U32 pageSize = Min((U32)SNAPSHOT_PAGE_SIZE, memorySize - pageAddress);
+
+        history->PageAddresses[slot] = pageAddress;
+        MemoryCopy(history->PageData + ((U64)slot * SNAPSHOT_PAGE_SIZE), memory + pageAddress, pageSize);
+        history->PageSlotCount++;
+        GetSnapshot(history, history->SnapshotCount - 1)->PageCount++;
+
+        history->CapturedPages[page >> 6] |= pageBit;
+    }
+}
+
+
+// Note (Aaron): Returns the processor to the newest snapshot taken at or before 'instructionCount'
+// instructions. Snapshots after it are discarded. Returns FALSE if there is no such snapshot.
+global_function B32 RestoreSnapshot(snapshot_history *history, processor_8086 *processor, U32 instructionCount)
+{
+    U32 snapshotIndex = history->SnapshotCount;
+    while (snapshotIndex > 0 && GetSnapshot(history, snapshotIndex - 1)->InstructionCount > instructionCount)
+    {
+        --snapshotIndex;
+    }
+
+    if (snapshotIndex == 0)
+    {
+        return FALSE;
+    }
+
+    processor_snapshot *snapshot = GetSnapshot(history, snapshotIndex - 1);
+
+    // Note (Aaron): Each snapshot holds its pages as they were when it was taken, so undoing the newest
+    // snapshots first leaves every page as it was at the target snapshot
+    for (U32 index = history->SnapshotCount; index >= snapshotIndex; --index)
+    {
+        processor_snapshot *undo = GetSnapshot(history, index - 1);
+        for (U32 pageIndex = undo->PageCount; pageIndex > 0; --pageIndex)
+        {
+            U32 slot = (undo->FirstPageSlot + pageIndex - 1) % history->PageSlotCapacity;
+            U32 pageAddress = history->PageAddresses[slot];
+            U32 pageSize = Min((U32)SNAPSHOT_PAGE_SIZE, processor->MemorySize - pageAddress);
+
+            MemoryCopy(processor->Memory + pageAddress, history->PageData + ((U64)slot * SNAPSHOT_PAGE_SIZE), pageSize);
+            if (processor->InstructionCache)
+            {
+                InvalidateInstructionCache(processor->InstructionCache, pageAddress, pageSize);
+            }
+        }
+    }
+
+    // Note (Aaron): Memory now matches the snapshot again, so it starts over without any pages
+    history->SnapshotCount = snapshotIndex;
+    history->PageSlotCount = (snapshot->FirstPageSlot + history->PageSlotCapacity - history->FirstPageSlot) % history->PageSlotCapacity;
+    snapshot->PageCount = 0;
+    MemorySet(history->CapturedPages, 0, sizeof(U64) * ((history->MemoryPageCount + 63) / 64));
+
+    MemoryCopy(processor->Registers, snapshot->Registers, sizeof(processor->Registers));
+    processor->Flags = snapshot->Flags;
+    processor->LazyFlags = snapshot->LazyFlags;
+    processor->IP = snapshot->IP;
+    processor->PrevIP = snapshot->PrevIP;
+    processor->InstructionCount = snapshot->InstructionCount;
+    processor->TotalClockCount = snapshot->TotalClockCount;
+    ClearProcessorFault(processor);
+
+    return TRUE;
+}
+
+
+global_function B32 InitializeBreakpoints(breakpoint_set *breakpoints, memory_arena *arena, U32 memorySize)
+{
+    *breakpoints = {};
+    ArenaClear(arena);
+
+    U32 pageCount = (memorySize + (1 << WATCH_PAGE_SHIFT) - 1) >> WATCH_PAGE_SHIFT;
+    breakpoints->AddressBits = (U64 *)ArenaPushSizeZero(arena, sizeof(U64) * ((memorySize + 63) / 64));
+    breakpoints->WatchPageFlags = (U8 *)ArenaPushSizeZero(arena, pageCount);
+    if (!breakpoints->AddressBits || !breakpoints->WatchPageFlags)
+    {
+        return FALSE;
+    }
+
+    breakpoints->AddressCount = memorySize;
+    breakpoints->WatchPageCount = pageCount;
+
+    // Note (Aaron): Engines start out at generation 0, so they rebuild their blocks the first time they see these
+    breakpoints->Generation = 1;
+    return TRUE;
+}
+
+
+global_function void ClearBreakpoints(breakpoint_set *breakpoints)
+{
+    MemorySet(breakpoints->AddressBits, 0, sizeof(U64) * ((breakpoints->AddressCount + 63) / 64));
+    MemorySet(breakpoints->WatchPageFlags, 0, breakpoints->WatchPageCount);
+    breakpoints->BreakpointCount = 0;
+    breakpoints->WatchpointCount = 0;
+    breakpoints->StopReason = StopReason_None;
+    breakpoints->Generation++;
+}
+
+
+global_function B32 HasBreakpoint(breakpoint_set *breakpoints, U32 address)
+{
+    B32 result = (address < breakpoints->AddressCount)
+        && (breakpoints->AddressBits[address / 64] & ((U64)1 << (address % 64)));
+    return result;
+}
+
+
+global_function void SetBreakpoint(breakpoint_set *breakpoints, U32 address, B32 enabled)
+{
+    if (address >= breakpoints->AddressCount || HasBreakpoint(breakpoints, address) == enabled)
+    {
+        return;
+    }
+
+    breakpoints->AddressBits[address / 64] ^= ((U64)1 << (address % 64));
+    if (enabled)
+    {
+        breakpoints->BreakpointCount++;
+    }
+    else
+    {
+        breakpoints->BreakpointCount--;
+    }
+    breakpoints->Generation++;
+}
+
+
+static void FlagWatchpointPages(breakpoint_set *breakpoints, watchpoint *watchpoint)
+{
+    U32 firstPage = ((watchpoint->Address > 0) ? watchpoint->Address - 1 : 0) >> WATCH_PAGE_SHIFT;
+    U32 lastPage = (watchpoint->Address + watchpoint->Size - 1) >> WATCH_PAGE_SHIFT;
+    for (U32 page = firstPage; page <= lastPage; ++page)
+    {
+        breakpoints->WatchPageFlags[page] |= watchpoint->Access;
+    }
+}
+
+
+global_function B32 AddWatchpoint(breakpoint_set *breakpoints, U32 address, U32 size, U8 access)
+{
+    if (breakpoints->WatchpointCount == MAX_WATCHPOINTS
+        || size == 0
+        || address >= breakpoints->AddressCount
+        || size > breakpoints->AddressCount - address
+        || !(access & (WatchAccess_Read | WatchAccess_Write)))
+    {
+        return FALSE;
+    }
+
+    watchpoint *watchpoint = &breakpoints->Watchpoints[breakpoints->WatchpointCount++];
+    watchpoint->Address = address;
+    watchpoint->Size = size;
+    watchpoint->Access = access;
+
+    FlagWatchpointPages(breakpoints, watchpoint);
+    breakpoints->Generation++;
+    return TRUE;
+}
+
+
+global_function void RemoveWatchpoint(breakpoint_set *breakpoints, U32 index)
+{
+    if (index >= breakpoints->WatchpointCount)
+    {
+        return;
+    }
+
+    breakpoints->Watchpoints[index] = breakpoints->Watchpoints[--breakpoints->WatchpointCount];
+
+    // Note (Aaron): Pages may be shared between watchpoints, so the flags are rebuilt from the ones left
+    MemorySet(breakpoints->WatchPageFlags, 0, breakpoints->WatchPageCount);
+    for (U32 i = 0; i < breakpoints->WatchpointCount; ++i)
+    {
+        FlagWatchpointPages(breakpoints, &breakpoints->Watchpoints[i]);
+    }
+
+    breakpoints->Generation++;
+}
+
+
+// Note (Aaron): Records the first access to a watched address as the reason to stop. The access itself
+// goes ahead; execution stops once the instruction making it has finished.
+global_function void CheckWatchpoints(breakpoint_set *breakpoints, U32 address, U32 byteCount, U8 access, U16 value)
+{
+    // Note (Aaron): Accesses outside of memory are checked before they fault
+    if ((address >> WATCH_PAGE_SHIFT) >= breakpoints->WatchPageCount
+        || !(breakpoints->WatchPageFlags[address >> WATCH_PAGE_SHIFT] & access)
+        || breakpoints->StopReason != StopReason_None)
+    {
+        return;
+    }
+
+    for (U32 i = 0; i < breakpoints->WatchpointCount; ++i)
+    {
+        watchpoint *watchpoint = &breakpoints->Watchpoints[i];
+        if ((watchpoint->Access & access)
+            && address < watchpoint->Address + watchpoint->Size
+            && address + byteCount > watchpoint->Address)
+        {
+            breakpoints->StopReason = StopReason_Watchpoint;
+            breakpoints->StopAddress = address;
+            breakpoints->StopValue = value;
+            breakpoints->StopAccess = access;
+            return;
+        }
+    }
+}
+
+
+// Note (Aaron): Returns TRUE if a watchpoint would stop execution for any 'access' of the 'byteCount' bytes
+// at 'address'
+global_function B32 IsWatchedRange(breakpoint_set *breakpoints, U32 address, U32 byteCount, U8 access)
+{
+    for (U32 i = 0; i < breakpoints->WatchpointCount; ++i)
+    {
+        watchpoint *watchpoint = &breakpoints->Watchpoints[i];
+        if ((watchpoint->Access & access)
+            && address < watchpoint->Address + watchpoint->Size
+            && address + byteCount > watchpoint->Address)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+// Note (Aaron): Clears the reason execution last stopped, as it starts again from 'ip'. Returns TRUE if it
+// stopped at a breakpoint at 'ip', which should then be ignored until an instruction has executed.
+global_function B32 ResumeExecution(breakpoint_set *breakpoints, U32 ip)
+{
+    B32 result = (breakpoints->StopReason == StopReason_Breakpoint) && (breakpoints->StopAddress == ip);
+    breakpoints->StopReason = StopReason_None;
+    return result;
+}
+
+
+// Note (Aaron): Checked before executing the instruction at 'ip'. A breakpoint there is ignored while
+// 'ignoreBreakpoint' is set, so that execution can resume from the breakpoint it stopped at.
+global_function B32 ShouldStopExecution(breakpoint_set *breakpoints, U32 ip, B32 ignoreBreakpoint)
+{
+    if (breakpoints->StopReason != StopReason_None)
+    {
+        return TRUE;
+    }
+
+    if (!ignoreBreakpoint && HasBreakpoint(breakpoints, ip))
+    {
+        breakpoints->StopReason = StopReason_Breakpoint;
+        breakpoints->StopAddress = ip;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+// Note (Aaron): Decode handlers are dispatched on the first instruction byte through OpcodeTable.
+// Byte0 has already been read and OpType is pre-filled from the table when it is implied by Byte0.
+typedef void decode_handler(processor_8086 *processor, instruction *instruction);
+
+
+// Note (Aaron): Reads the mod/reg/rm byte that follows the opcode for most instructions
+inline global_function void ReadModRegRmByte(processor_8086 *processor, instruction *instruction)
+{
+    ReadInstructionStream(processor, instruction, 1);
+
+    instruction->ModBits = (instruction->Bits.Byte1 >> 6) & 0b11;
+    instruction->RegBits = (instruction->Bits.Byte1 >> 3) & 0b111;
+    instruction->RmBits = instruction->Bits.Byte1 & 0b111;
+}
+
+
+// Note (Aaron): Reads an 8 or 16-bit immediate value depending on the instruction's width bit
+inline global_function U16 ReadImmediateValue(processor_8086 *processor, instruction *instruction)
+{
+    U8 *readStartPtr = instruction->Bits.BytePtr;
+    if (instruction->WidthBit == 0b0)
+    {
+        ReadInstructionStream(processor, instruction, 1);
+        return (U16)(*(U8 *)readStartPtr);
+    }
+
+    ReadInstructionStream(processor, instruction, 2);
+    return (U16)(*(U16 *)readStartPtr);
+}
+
+
+// Note (Aaron): Maps the reg field used by the immediate arithmetic opcodes to an operation
+global_function operation_types GetArithmeticOpType(U8 opBits)
+{
+    switch (opBits)
+    {
+        // add = 0b000
+        case 0b000: return Op_add;
+        // sub = 0b101
+        case 0b101: return Op_sub;
+        // cmp = 0b111
+        case 0b111: return Op_cmp;
+        // Note (Aaron): adc, sbb, and, or and xor aren't supported
+        default:    return Op_unknown;
+    }
+}
+
+
+// mov instruction - register/memory to/from register (0b100010dw)
+global_function void DecodeMovRegMem(processor_8086 *processor, instruction *instruction)
+{
+    instruction_operand operandReg = {};
+    instruction_operand operandRm = {};
+
+    // parse initial instruction byte
+    instruction->DirectionBit = (instruction->Bits.Byte0 >> 1) & 0b1;
+    instruction->WidthBit = instruction->Bits.Byte0 & 0b1;
+
+    // read second instruction byte and parse it
+    ReadModRegRmByte(processor, instruction);
+
+    // decode reg
+    operandReg.Type = Operand_Register;
+    operandReg.Register = RegMemTables[instruction->WidthBit][instruction->RegBits];
+
+    // parse r/m
+    ParseRmBits(processor, instruction, &operandRm);
+
+    // set dest and source strings
+    // destination is in RM field, source is in REG field
+    if (instruction->DirectionBit == 0)
+    {
+        instruction->Operands[0] = operandRm;
+        instruction->Operands[1] = operandReg;
+    }
+    // destination is in REG field, source is in RM field
+    else
+    {
+        instruction->Operands[0] = operandReg;
+        instruction->Operands[1] = operandRm;
+    }
+
+    // estimate clock cycles
+    // register to register
+    if (instruction->Operands[0].Type == Operand_Register
+        && instruction->Operands[1].Type == Operand_Register)
+    {
+        instruction->ClockCount = 2;
+    }
+    // register to memory
+    else if (instruction->Operands[0].Type == Operand_Memory
+             && instruction->Operands[1].Type == Operand_Register)
+    {
+        instruction->ClockCount = 9;
+        instruction->EAClockCount = CalculateEffectiveAddressClocks(&instruction->Operands[0]);
+    }
+    // memory to register
+    else if (instruction->Operands[0].Type == Operand_Register
+        && instruction->Operands[1].Type == Operand_Memory)
+    {
+        instruction->ClockCount = 8;
+        instruction->EAClockCount = CalculateEffectiveAddressClocks(&instruction->Operands[1]);
+    }
+    else
+    {
+        assert_8086(FALSE && "Unreachable case");
+    }
+}
+
+
+// mov instruction - immediate to register/memory (0b1100011w)
+global_function void DecodeMovImmediateToRegMem(processor_8086 *processor, instruction *instruction)
+{
+    instruction_operand operandSource = {};
+    instruction_operand operandDest = {};
+    operandSource.Type = Operand_Immediate;
+
+    instruction->WidthBit = instruction->Bits.Byte0 & 0b1;
+
+    // read second instruction byte and parse it
+    // Note (Aaron): No reg in this instruction
+    ReadModRegRmByte(processor, instruction);
+    instruction->RegBits = 0;
+
+    // parse r/m
+    ParseRmBits(processor, instruction, &operandDest);
+
+    // read data. guaranteed to be at least 8-bits.
+    operandSource.Immediate.Value = ReadImmediateValue(processor, instruction);
+
+    instruction->Operands[0] = operandDest;
+    instruction->Operands[1] = operandSource;
+
+    // estimate clock cycles
+    // immediate to register
+    if (instruction->Operands[0].Type == Operand_Register)
+    {
+        instruction->ClockCount = 4;
+    }
+    // immediate to memory
+    else if (instruction->Operands[0].Type == Operand_Memory)
+    {
+        instruction->ClockCount = 10;
+        instruction->EAClockCount = CalculateEffectiveAddressClocks(&instruction->Operands[0]);
+    }
+    else
+    {
+        assert_8086(FALSE && "Unreachable case");
+    }
+}
+
+
+// mov instruction - immediate to register (0b1011wreg)
+global_function void DecodeMovImmediateToReg(processor_8086 *processor, instruction *instruction)
+{
+    instruction_operand operandSource = {};
+    instruction_operand operandDest = {};
+    operandSource.Type = Operand_Immediate;
+    operandDest.Type = Operand_Register;
+
+    // parse width and reg
+    instruction->WidthBit = (instruction->Bits.Byte0 >> 3) & (0b1);
+    instruction->RegBits = instruction->Bits.Byte0 & 0b111;
+
+    operandSource.Immediate.Value = ReadImmediateValue(processor, instruction);
+
+    operandDest.Register = RegMemTables[instruction->WidthBit][instruction->RegBits];
+    instruction->Operands[0] = operandDest;
+    instruction->Operands[1] = operandSource;
+
+    // estimate clock cycles
+    // immediate to register
+    instruction->ClockCount = 4;
+}
+
+
+// mov - memory to accumulator (0b1010000w) and accumulator to memory (0b1010001w)
+global_function void DecodeMovAccumulator(processor_8086 *processor, instruction *instruction)
+{
+    instruction_operand operandAccumulator = {};
+    instruction_operand operandMemory = {};
+    instruction->WidthBit = instruction->Bits.Byte0 & 0b1;
+
+    operandAccumulator.Type = Operand_Register;
+    operandAccumulator.Register = instruction->WidthBit ? Reg_ax : Reg_al;
+    operandMemory.Type = Operand_Memory;
+    operandMemory.Memory.Flags |= Memory_HasDirectAddress;
+    if (instruction->WidthBit)
+    {
+        operandMemory.Memory.Flags |= Memory_IsWide;
+    }
+
+    // Note (Aaron): The address is always 16 bits, the width bit only selects al or ax
+    U8 *readStartPtr = instruction->Bits.BytePtr;
+    ReadInstructionStream(processor, instruction, 2);
+    operandMemory.Memory.DirectAddress = (U16)(*(U16 *)readStartPtr);
+
+    if ((instruction->Bits.Byte0 >> 1) == 0b1010000)
+    {
+        instruction->Operands[0] = operandAccumulator;
+        instruction->Operands[1] = operandMemory;
+    }
+    else
+    {
+        instruction->Operands[0] = operandMemory;
+        instruction->Operands[1] = operandAccumulator;
+    }
+
+    // estimate clock cycles
+    // Note (Aaron): Both memory to accumulator and accumulator to memory share
+    // the same clock count
+    instruction->ClockCount = 10;
+}
+
+
+// add / sub / cmp - reg/memory with register to either (0b00ooo0dw)
+global_function void DecodeArithmeticRegMem(processor_8086 *processor, instruction *instruction)
+{
+    instruction_operand operandReg = {};
+    operandReg.Type = Operand_Register;
+    instruction_operand operandRm = {};
+
+    // decode direction and width
+    instruction->DirectionBit = (instruction->Bits.Byte0 >> 1) & 0b1;
+    instruction->WidthBit = instruction->Bits.Byte0 & 0b1;
+
+    // decode mod, reg and r/m
+    ReadModRegRmByte(processor, instruction);
+
+    // decode reg
+    operandReg.Register = RegMemTables[instruction->WidthBit][instruction->RegBits];
+
+    // parse r/m
+    ParseRmBits(processor, instruction, &operandRm);
+
+    // set dest and source strings
+    // destination is in RM field, source is in REG field
+    if (instruction->DirectionBit == 0)
+    {
+        instruction->Operands[0] = operandRm;
+        instruction->Operands[1] = operandReg;
+    }
+    // destination is in REG field, source is in RM field
+    else
+    {
+        instruction->Operands[0] = operandReg;
+        instruction->Operands[1] = operandRm;
+    }
+
+    // estimate clock cycles
+    // register to register
+    if (instruction->Operands[0].Type == Operand_Register
+        && instruction->Operands[1].Type == Operand_Register)
+    {
+        // Note (Aaron): add, sub, and cmp share the same clock count for this operation
+        instruction->ClockCount = 3;
+    }
+    // register to memory
+    else if (instruction->Operands[0].Type == Operand_Memory
+        && instruction->Operands[1].Type == Operand_Register)
+    {
+        instruction->ClockCount = (instruction->OpType == Op_cmp) ? 9 : 16;
+        instruction->EAClockCount = CalculateEffectiveAddressClocks(&instruction->Operands[0]);
+    }
+    // memory to register
+    else if (instruction->Operands[0].Type == Operand_Register
+        && instruction->Operands[1].Type == Operand_Memory)
+    {
+        // Note (Aaron): add, sub, and cmp share the same clock count for this operation
+        instruction->ClockCount = 9;
+        instruction->EAClockCount = CalculateEffectiveAddressClocks(&instruction->Operands[1]);
+    }
+    else
+    {
+        assert_8086(FALSE && "Unreachable case");
+    }
+}
+
+
+// add / sub / cmp - immediate to register/memory (0b100000sw)
+global_function void DecodeArithmeticImmediateToRegMem(processor_8086 *processor, instruction *instruction)
+{
+    instruction_operand operandSource = {};
+    instruction_operand operandDest = {};
+    operandSource.Type = Operand_Immediate;
+
+    instruction->SignBit = (instruction->Bits.Byte0 >> 1) & 0b1;
+    instruction->WidthBit = instruction->Bits.Byte0 & 0b1;
+
+    // decode mod and r/m
+    // Note (Aaron): The reg field selects the operation for these opcodes
+    ReadModRegRmByte(processor, instruction);
+    instruction->OpType = GetArithmeticOpType(instruction->RegBits);
+    instruction->RegBits = 0;
+
+    // parse r/m string
+    ParseRmBits(processor, instruction, &operandDest);
+
+    // read data.
+    U8 *readStartPtr = instruction->Bits.BytePtr;
+    if (instruction->SignBit == 0b0 && instruction->WidthBit == 1)
+    {
+        // read 16-bit unsigned
+        ReadInstructionStream(processor, instruction, 2);
+        operandSource.Immediate.Value = (U16)(*(U16 *)readStartPtr);
+    }
+    else if (instruction->SignBit == 0b0)
+    {
+        // read 8-bit unsigned
+        ReadInstructionStream(processor, instruction, 1);
+        operandSource.Immediate.Value = (U16)(*readStartPtr);
+    }
+    else
+    {
+        // read 8-bit signed (and sign-extend to 16-bits for wide instructions)
+        ReadInstructionStream(processor, instruction, 1);
+        operandSource.Immediate.Value = (U16)((S8)(*readStartPtr));
+        operandSource.Immediate.Flags |= Immediate_IsSigned;
+    }
+
+    instruction->Operands[0] = operandDest;
+    instruction->Operands[1] = operandSource;
+
+    // estimate clock cycles
+    // immediate to register
+    if (instruction->Operands[0].Type == Operand_Register)
+    {
+        // Note (Aaron): add, sub, and cmp share the same clock count
+        instruction->ClockCount = 4;
+    }
+    // immediate to memory
+    else if (instruction->Operands[0].Type == Operand_Memory)
+    {
+        instruction->ClockCount = (instruction->OpType == Op_cmp) ? 10 : 17;
+        instruction->EAClockCount = CalculateEffectiveAddressClocks(&instruction->Operands[0]);
+    }
+    else
+    {
+        assert_8086(FALSE && "Unreachable case");
+    }
+}
+
+
+// add / sub / cmp - immediate to/from/with accumulator (0b00ooo10w)
+global_function void DecodeArithmeticImmediateToAccumulator(processor_8086 *processor, instruction *instruction)
+{
+    instruction->WidthBit = instruction->Bits.Byte0 & 0b1;
+
+    instruction_operand operandSource = {};
+    instruction_operand operandDest = {};
+    operandSource.Type = Operand_Immediate;
+    operandDest.Type = Operand_Register;
+
+    // read data
+    operandSource.Immediate.Value = ReadImmediateValue(processor, instruction);
+    operandDest.Register = (instruction->WidthBit == 0b0) ? Reg_al : Reg_ax;
+
+    instruction->Operands[0] = operandDest;
+    instruction->Operands[1] = operandSource;
+
+    // estimate clock cycles
+    // Note (Aaron): add, sub, and cmp share the same clock count
+    instruction->ClockCount = 4;
+}
+
+
+// control transfer instructions - conditional jumps and loops with an 8-bit offset
+global_function void DecodeJump(processor_8086 *processor, instruction *instruction)
+{
+    // TODO (Aaron): Add clock count estimation for these jumps
+
+    // read 8-bit signed offset for jumps
+    ReadInstructionStream(processor, instruction, 1);
+    S8 offset = *(S8 *)(&instruction->Bits.Byte1);
+
+    instruction_operand operand0 = {};
+    operand0.Type = Operand_Immediate;
+    operand0.Immediate.Flags |= Immediate_IsJump;
+    // Note (Aaron): A signed 8-bit value will need to be extracted from
+    // the unsigned 16-bit ImmediateValue when instructions are executed.
+    operand0.Immediate.Value = offset;
+    operand0.Immediate.Flags |= Immediate_IsSigned;
+    instruction->Operands[0] = operand0;
+}
+
+
+// return instructions
+global_function void DecodeReturn(processor_8086 *processor, instruction *instruction)
+{
+    if (instruction->Bits.Byte0 == 0b11000010
+        || instruction->Bits.Byte0 == 0b11001010)
+    {
+        // Note (Aaron): Some of these instructions include a 16-bit value to add to SP. Because we are stopping
+        // the sim on ret instructions, it isn't used, but it is decoded so that it can be printed.
+        instruction_operand operand0 = {};
+        operand0.Type = Operand_Immediate;
+        instruction->WidthBit = 1;
+        operand0.Immediate.Value = ReadImmediateValue(processor, instruction);
+        instruction->Operands[0] = operand0;
+    }
+}
+
+
+// Note (Aaron): Maps a string instruction opcode to an operation, ignoring its width bit. Returns Op_unknown
+// for any other opcode.
+global_function operation_types GetStringOpType(U8 opcode)
+{
+    switch (opcode & 0b11111110)
+    {
+        case 0b10100100: return Op_movs;
+        case 0b10100110: return Op_cmps;
+        case 0b10101010: return Op_stos;
+        case 0b10101100: return Op_lods;
+        case 0b10101110: return Op_scas;
+        default:         return Op_unknown;
+    }
+}
+
+
+// string instructions - movs, cmps, stos, lods and scas (0b1010xxxw)
+global_function void DecodeString(processor_8086 *processor, instruction *instruction)
+{
+    // Note (Aaron): The opcode is the last byte read, it follows the rep prefix if there is one
+    U8 opcode = instruction->Bits.Bytes[instruction->Bits.ByteCount - 1];
+    instruction->WidthBit = opcode & 0b1;
+
+    // estimate clock cycles
+    // Note (Aaron): Repeated instructions add the clocks of each repetition when they are executed
+    instruction->ClockCount = (instruction->RepPrefix != Rep_None)
+        ? 9
+        : (U8)GetStringClocks(instruction->OpType, FALSE);
+}
+
+
+// repeat prefixes - rep / repe (0b11110011) and repne (0b11110010)
+global_function void DecodeRepPrefix(processor_8086 *processor, instruction *instruction)
+{
+    // Note (Aaron): Only string instructions are supported after a prefix. Otherwise the prefix is decoded as
+    // an unknown instruction of its own, and the instruction after it is decoded separately.
+    operation_types opType = (processor->IP < processor->ProgramSize)
+        ? GetStringOpType(processor->Memory[processor->IP])
+        : Op_unknown;
+    if (opType == Op_unknown)
+    {
+        return;
+    }
+
+    instruction->RepPrefix = (instruction->Bits.Byte0 & 0b1) ? Rep_RepE : Rep_RepNE;
+    instruction->OpType = opType;
+
+    ReadInstructionStream(processor, instruction, 1);
+    DecodeString(processor, instruction);
+}
 
-        instruction.SignBit = (instruction.Bits.Byte0 >> 1) & 0b1;
-        instruction.WidthBit = instruction.Bits.Byte0 & 0b1;
 
-        // decode mod and r/m
-        ReadInstructionStream(processor, &instruction, 1);
+// flag instructions - cld and std
+global_function void DecodeFlagInstruction(processor_8086 *processor, instruction *instruction)
+{
+    // estimate clock cycles
+    instruction->ClockCount = 2;
+}
 
-        instruction.ModBits = (instruction.Bits.Byte1 >> 6) & 0b11;
-        instruction.RmBits = instruction.Bits.Byte1 & 0b111;
 
-        // decode instruction type
-        // add = 0b000
-        if (((instruction.Bits.Byte1 >> 3) & 0b111) == 0b000)
+// unsupported instruction
+global_function void DecodeUnsupported(processor_8086 *processor, instruction *instruction)
+{
+}
+
+
+struct opcode_entry
+{
+    decode_handler *Handler;
+    operation_types OpType;
+};
+
+
+struct opcode_table
+{
+    opcode_entry Entries[256];
+};
+
+
+constexpr void SetOpcodeRange(opcode_table *table, U32 first, U32 last, decode_handler *handler, operation_types opType)
+{
+    for (U32 opcode = first; opcode <= last; ++opcode)
+    {
+        table->Entries[opcode] = { handler, opType };
+    }
+}
+
+
+// Note (Aaron): Builds the first-byte dispatch table for DecodeInstructionFromMemory()
+constexpr opcode_table BuildOpcodeTable()
+{
+    opcode_table table = {};
+    SetOpcodeRange(&table, 0x00, 0xff, DecodeUnsupported, Op_unknown);
+
+    // add / sub / cmp
+    SetOpcodeRange(&table, 0b00000000, 0b00000011, DecodeArithmeticRegMem, Op_add);
+    SetOpcodeRange(&table, 0b00101000, 0b00101011, DecodeArithmeticRegMem, Op_sub);
+    SetOpcodeRange(&table, 0b00111000, 0b00111011, DecodeArithmeticRegMem, Op_cmp);
+    SetOpcodeRange(&table, 0b00000100, 0b00000101, DecodeArithmeticImmediateToAccumulator, Op_add);
+    SetOpcodeRange(&table, 0b00101100, 0b00101101, DecodeArithmeticImmediateToAccumulator, Op_sub);
+    SetOpcodeRange(&table, 0b00111100, 0b00111101, DecodeArithmeticImmediateToAccumulator, Op_cmp);
+    SetOpcodeRange(&table, 0b10000000, 0b10000011, DecodeArithmeticImmediateToRegMem, Op_unknown);
+
+    // mov
+    SetOpcodeRange(&table, 0b10001000, 0b10001011, DecodeMovRegMem, Op_mov);
+    SetOpcodeRange(&table, 0b11000110, 0b11000111, DecodeMovImmediateToRegMem, Op_mov);
+    SetOpcodeRange(&table, 0b10110000, 0b10111111, DecodeMovImmediateToReg, Op_mov);
+    SetOpcodeRange(&table, 0b10100000, 0b10100011, DecodeMovAccumulator, Op_mov);
+
+    // control transfer
+    SetOpcodeRange(&table, 0b01110000, 0b01110000, DecodeJump, Op_jo);
+    SetOpcodeRange(&table, 0b01110001, 0b01110001, DecodeJump, Op_jno);
+    SetOpcodeRange(&table, 0b01110010, 0b01110010, DecodeJump, Op_jb);       // jb / jnae
+    SetOpcodeRange(&table, 0b01110011, 0b01110011, DecodeJump, Op_jnb);      // jnb / jae
+    SetOpcodeRange(&table, 0b01110100, 0b01110100, DecodeJump, Op_je);       // je / jz
+    SetOpcodeRange(&table, 0b01110101, 0b01110101, DecodeJump, Op_jne);      // jne / jnz
+    SetOpcodeRange(&table, 0b01110110, 0b01110110, DecodeJump, Op_jbe);      // jbe / jna
+    SetOpcodeRange(&table, 0b01110111, 0b01110111, DecodeJump, Op_ja);       // jnbe / ja
+    SetOpcodeRange(&table, 0b01111000, 0b01111000, DecodeJump, Op_js);
+    SetOpcodeRange(&table, 0b01111001, 0b01111001, DecodeJump, Op_jns);
+    SetOpcodeRange(&table, 0b01111010, 0b01111010, DecodeJump, Op_jp);       // jp / jpe
+    SetOpcodeRange(&table, 0b01111011, 0b01111011, DecodeJump, Op_jnp);      // jnp / jpo
+    SetOpcodeRange(&table, 0b01111100, 0b01111100, DecodeJump, Op_jl);       // jl / jnge
+    SetOpcodeRange(&table, 0b01111101, 0b01111101, DecodeJump, Op_jnl);      // jnl / jge
+    SetOpcodeRange(&table, 0b01111110, 0b01111110, DecodeJump, Op_jle);      // jle / jng
+    SetOpcodeRange(&table, 0b01111111, 0b01111111, DecodeJump, Op_jg);       // jnle / jg
+    SetOpcodeRange(&table, 0b11100000, 0b11100000, DecodeJump, Op_loopnz);
+    SetOpcodeRange(&table, 0b11100001, 0b11100001, DecodeJump, Op_loopz);
+    SetOpcodeRange(&table, 0b11100010, 0b11100010, DecodeJump, Op_loop);
+    SetOpcodeRange(&table, 0b11100011, 0b11100011, DecodeJump, Op_jcxz);
+
+    // string
+    SetOpcodeRange(&table, 0b10100100, 0b10100101, DecodeString, Op_movs);
+    SetOpcodeRange(&table, 0b10100110, 0b10100111, DecodeString, Op_cmps);
+    SetOpcodeRange(&table, 0b10101010, 0b10101011, DecodeString, Op_stos);
+    SetOpcodeRange(&table, 0b10101100, 0b10101101, DecodeString, Op_lods);
+    SetOpcodeRange(&table, 0b10101110, 0b10101111, DecodeString, Op_scas);
+    SetOpcodeRange(&table, 0b11110010, 0b11110011, DecodeRepPrefix, Op_unknown);
+
+    // flags
+    SetOpcodeRange(&table, 0b11111100, 0b11111100, DecodeFlagInstruction, Op_cld);
+    SetOpcodeRange(&table, 0b11111101, 0b11111101, DecodeFlagInstruction, Op_std);
+
+    // return
+    SetOpcodeRange(&table, 0b11000010, 0b11000011, DecodeReturn, Op_ret);    // ret within segment (optionally adding immediate to SP)
+    SetOpcodeRange(&table, 0b11001010, 0b11001011, DecodeReturn, Op_ret);    // ret inter-segment (optionally adding immediate to SP)
+
+    return table;
+}
+
+
+global_variable constexpr opcode_table OpcodeTable = BuildOpcodeTable();
+
+
+// Note (Aaron): Decodes the instruction at the processor's instruction pointer out of memory
+global_function instruction DecodeInstructionFromMemory(processor_8086 *processor)
+{
+    instruction instruction = {};
+    instruction.Address = processor->IP;
+
+    // read initial instruction byte and dispatch on it
+    ReadInstructionStream(processor, &instruction, 1);
+
+    opcode_entry entry = OpcodeTable.Entries[instruction.Bits.Byte0];
+    instruction.OpType = entry.OpType;
+    entry.Handler(processor, &instruction);
+
+    // Note (Aaron): An instruction that ran past the end of the program was decoded from whatever follows it in
+    // memory. It's kept as an unknown instruction, which raises Fault_InstructionStream if it's executed.
+    if (processor->IP > processor->ProgramSize)
+    {
+        instruction.OpType = Op_unknown;
+    }
+
+    return instruction;
+}
+
+
+// Note (Aaron): Returns the instruction at 'address' without advancing execution. Consults (and fills)
+// the instruction cache when present; instructions from the cache come without their bytes (see UnpackInstruction()).
+global_function instruction FetchInstruction(processor_8086 *processor, U32 address)
+{
+    instruction_cache *cache = processor->InstructionCache;
+    U32 slot = (cache && address < cache->SlotCount) ? cache->Slots[address] : 0;
+    if (slot)
+    {
+        return UnpackInstruction(&cache->Instructions[slot - 1]);
+    }
+
+    U32 ip = processor->IP;
+    processor->IP = address;
+    instruction result = DecodeInstructionFromMemory(processor);
+    processor->IP = ip;
+
+    if (cache)
+    {
+        packed_instruction packed = PackInstruction(&result);
+        CacheInstruction(cache, &packed);
+    }
+
+    return result;
+}
+
+
+global_function instruction DecodeNextInstruction(processor_8086 *processor)
+{
+    processor->PrevIP = processor->IP;
+    processor->InstructionCount++;
+
+    instruction result = FetchInstruction(processor, processor->IP);
+    processor->IP += result.Bits.ByteCount;
+
+    return result;
+}
+
+
+// Note (Aaron): High byte registers (ah, ch, dh, bh) live in the upper 8 bits of their register
+inline global_function U8 GetRegisterShift(register_info info)
+{
+    U8 result = (info.Mask == 0xff00) ? 8 : 0;
+    return result;
+}
+
+
+global_function U16 GetRegisterValue(processor_8086 *processor, register_id targetRegister)
+{
+    U16 result = 0;
+    register_info info = RegisterLookup[targetRegister];
+
+    switch (info.Register)
+    {
+        case (Reg_bx_si):
         {
-            instruction.OpType = Op_add;
+            U16 bxValue = GetRegisterValue(processor, Reg_bx);
+            U16 siValue = GetRegisterValue(processor, Reg_si);
+            result = bxValue + siValue;
+            break;
         }
-        // sub = 0b101
-        else if (((instruction.Bits.Byte1 >> 3) & 0b111) == 0b101)
+        case (Reg_bx_di):
         {
-            instruction.OpType = Op_sub;
+            U16 bxValue = GetRegisterValue(processor, Reg_bx);
+            U16 diValue = GetRegisterValue(processor, Reg_di);
+            result = bxValue + diValue;
+            break;
         }
-        // cmp = 0b111
-        else if (((instruction.Bits.Byte1 >> 3) & 0b111) == 0b111)
+        case (Reg_bp_si):
         {
-            instruction.OpType = Op_cmp;
+            U16 bpValue = GetRegisterValue(processor, Reg_bp);
+            U16 siValue = GetRegisterValue(processor, Reg_si);
+            result = bpValue + siValue;
+            break;
         }
-        else
+        case (Reg_bp_di):
+        {
+            U16 bpValue = GetRegisterValue(processor, Reg_bp);
+            U16 diValue = GetRegisterValue(processor, Reg_di);
+            result = bpValue + diValue;
+            break;
+        }
+        default:
+        {
+            result = (processor->Registers[info.RegisterIndex] & info.Mask) >> GetRegisterShift(info);
+            break;
+        }
+    }
+
+    return result;
+}
+
+
+global_function void SetRegisterValue(processor_8086 *processor, register_id targetRegister, U16 value)
+{
+    register_info info = RegisterLookup[targetRegister];
+
+    // Note (Aaron): Writing an 8-bit register preserves the other half of the 16-bit register
+    U16 *registerValue = &processor->Registers[info.RegisterIndex];
+    *registerValue = (U16)((*registerValue & ~info.Mask) | ((value << GetRegisterShift(info)) & info.Mask));
+}
+
+
+global_function void SetLazyFlags(processor_8086 *processor, lazy_flags_op op, B32 wide, U16 operand0, U16 operand1, U16 result)
+{
+    lazy_flags *lazyFlags = &processor->LazyFlags;
+    lazyFlags->Operand0 = operand0;
+    lazyFlags->Operand1 = operand1;
+    lazyFlags->Result = result;
+    lazyFlags->Op = op;
+    lazyFlags->IsWide = wide ? TRUE : FALSE;
+}
+
+
+// Note (Aaron): Derives a single arithmetic flag from the last arithmetic operation. Returns 1 if the flag is set.
+global_function U8 EvaluateLazyFlag(lazy_flags *lazyFlags, register_flags flag)
+{
+    U16 a = lazyFlags->Operand0;
+    U16 b = lazyFlags->Operand1;
+    U16 r = lazyFlags->Result;
+    U16 signBit = lazyFlags->IsWide ? 0x8000 : 0x80;
+    B32 isAdd = (lazyFlags->Op == LazyFlags_Add);
+
+    B32 result = FALSE;
+    switch (flag)
+    {
+        case RegisterFlag_CF:
+        {
+            result = isAdd ? (r < a) : (a < b);
+            break;
+        }
+        case RegisterFlag_PF:
+        {
+            // set when the low 8 bits of the result have an even number of 1 bits
+            U8 parity = (U8)r;
+            parity ^= parity >> 4;
+            parity ^= parity >> 2;
+            parity ^= parity >> 1;
+            result = !(parity & 1);
+            break;
+        }
+        case RegisterFlag_AF:
+        {
+            // carry out of / borrow into bit 3
+            result = ((a ^ b ^ r) & 0x10) != 0;
+            break;
+        }
+        case RegisterFlag_ZF:
+        {
+            result = (r == 0);
+            break;
+        }
+        case RegisterFlag_SF:
+        {
+            result = (r & signBit) != 0;
+            break;
+        }
+        case RegisterFlag_OF:
+        {
+            // the operands' signs make the result's sign impossible
+            result = isAdd
+                ? ((a ^ r) & (b ^ r) & signBit) != 0
+                : ((a ^ b) & (a ^ r) & signBit) != 0;
+            break;
+        }
+        default:
+        {
+            assert_8086(FALSE && "Not an arithmetic flag");
+            break;
+        }
+    }
+
+    return result ? 1 : 0;
+}
+
+
+// Note (Aaron): Brings processor->Flags up to date and returns it
+global_function U8 GetProcessorFlags(processor_8086 *processor)
+{
+    lazy_flags *lazyFlags = &processor->LazyFlags;
+    if (lazyFlags->Op != LazyFlags_None)
+    {
+        U8 flags = 0;
+        register_flags arithmeticFlags[] = { RegisterFlag_CF, RegisterFlag_PF, RegisterFlag_AF, RegisterFlag_ZF, RegisterFlag_SF, RegisterFlag_OF };
+        for (int i = 0; i < ArrayCount(arithmeticFlags); ++i)
+        {
+            flags |= EvaluateLazyFlag(lazyFlags, arithmeticFlags[i]) ? arithmeticFlags[i] : 0;
+        }
+
+        processor->Flags = (U8)((processor->Flags & ~ARITHMETIC_FLAGS_MASK) | flags);
+        lazyFlags->Op = LazyFlags_None;
+    }
+
+    return processor->Flags;
+}
+
+
+global_function U8 GetRegisterFlag(processor_8086 *processor, register_flags flag)
+{
+    if (processor->LazyFlags.Op != LazyFlags_None && (flag & ARITHMETIC_FLAGS_MASK))
+    {
+        return EvaluateLazyFlag(&processor->LazyFlags, flag);
+    }
+
+    U8 result = (processor->Flags & flag) ? 1 : 0;
+    return result;
+}
+
+
+global_function void SetRegisterFlag(processor_8086 *processor, register_flags flag, B32 set)
+{
+    // Note (Aaron): Pending flags must be evaluated first so that they don't overwrite this one later
+    GetProcessorFlags(processor);
+
+    if (set)
+    {
+        processor->Flags |= flag;
+        return;
+    }
+
+    processor->Flags &= ~flag;
+}
+
+
+// Note (Aaron): Returns TRUE if a conditional jump or loop instruction should be taken. The loop
+// instructions decrement CX as part of their evaluation.
+global_function B32 EvaluateJumpCondition(processor_8086 *processor, operation_types opType)
+{
+    switch (opType)
+    {
+        case Op_je:     return GetRegisterFlag(processor, RegisterFlag_ZF);
+        case Op_jne:    return !GetRegisterFlag(processor, RegisterFlag_ZF);
+        case Op_jl:     return GetRegisterFlag(processor, RegisterFlag_SF) != GetRegisterFlag(processor, RegisterFlag_OF);
+        case Op_jnl:    return GetRegisterFlag(processor, RegisterFlag_SF) == GetRegisterFlag(processor, RegisterFlag_OF);
+        case Op_jle:    return GetRegisterFlag(processor, RegisterFlag_ZF)
+                            || (GetRegisterFlag(processor, RegisterFlag_SF) != GetRegisterFlag(processor, RegisterFlag_OF));
+        case Op_jg:     return !GetRegisterFlag(processor, RegisterFlag_ZF)
+                            && (GetRegisterFlag(processor, RegisterFlag_SF) == GetRegisterFlag(processor, RegisterFlag_OF));
+        case Op_jb:     return GetRegisterFlag(processor, RegisterFlag_CF);
+        case Op_jnb:    return !GetRegisterFlag(processor, RegisterFlag_CF);
+        case Op_jbe:    return GetRegisterFlag(processor, RegisterFlag_CF) || GetRegisterFlag(processor, RegisterFlag_ZF);
+        case Op_ja:     return !GetRegisterFlag(processor, RegisterFlag_CF) && !GetRegisterFlag(processor, RegisterFlag_ZF);
+        case Op_jp:     return GetRegisterFlag(processor, RegisterFlag_PF);
+        case Op_jnp:    return !GetRegisterFlag(processor, RegisterFlag_PF);
+        case Op_jo:     return GetRegisterFlag(processor, RegisterFlag_OF);
+        case Op_jno:    return !GetRegisterFlag(processor, RegisterFlag_OF);
+        case Op_js:     return GetRegisterFlag(processor, RegisterFlag_SF);
+        case Op_jns:    return !GetRegisterFlag(processor, RegisterFlag_SF);
+
+        case Op_loop:
+        case Op_loopz:
+        case Op_loopnz:
+        {
+            U16 cx = (U16)(GetRegisterValue(processor, Reg_cx) - 1);
+            SetRegisterValue(processor, Reg_cx, cx);
+
+            if (opType == Op_loopz) { return (cx != 0) && GetRegisterFlag(processor, RegisterFlag_ZF); }
+            if (opType == Op_loopnz) { return (cx != 0) && !GetRegisterFlag(processor, RegisterFlag_ZF); }
+            return (cx != 0);
+        }
+
+        case Op_jcxz:   return GetRegisterValue(processor, Reg_cx) == 0;
+
+        default:
         {
-            assert_8086(FALSE && "Unhandled case");
+            assert_8086(FALSE && "Not a jump instruction");
+            return FALSE;
         }
+    }
+}
+
+
+global_function B32 IsStringOperation(operation_types opType)
+{
+    B32 result = (opType >= Op_movs && opType <= Op_stos);
+    return result;
+}
 
-        // parse r/m string
-        ParseRmBits(processor, &instruction, &operandDest);
 
-        // read data.
-        if (instruction.SignBit == 0b0 && instruction.WidthBit == 0)
+global_function U32 CalculateEffectiveAddress(processor_8086 *processor, instruction_operand operand)
+{
+    assert_8086(operand.Type == Operand_Memory);
+
+    U32 effectiveAddress = 0;
+    // direct address assignment
+    if (operand.Memory.Flags & Memory_HasDirectAddress)
+    {
+        effectiveAddress = operand.Memory.DirectAddress;
+    }
+    // effective address calculation
+    else
+    {
+        effectiveAddress = GetRegisterValue(processor, operand.Memory.Register);
+        if (operand.Memory.Flags & Memory_HasDisplacement)
         {
-            // read 8-bit unsigned
-            U8 *readStartPtr = instruction.Bits.BytePtr;
-            ReadInstructionStream(processor, &instruction, 1);
-            operandSource.Immediate.Value = (U16)(*readStartPtr);
+            effectiveAddress += operand.Memory.Displacement;
         }
-        else if (instruction.SignBit == 0b0 && instruction.WidthBit == 1)
+    }
+
+    return effectiveAddress;
+}
+
+
+// +------------------------------+
+// Note (Aaron): Guarded memory
+
+// Note (Aaron): Processors with guarded memory, for the fault handler to find the one an address belongs to
+global_variable U64 volatile GuardedProcessors[MAX_GUARDED_PROCESSORS];
+global_variable U32 volatile MemoryFaultHandlerClaimed;
+global_variable U32 volatile MemoryFaultHandlerInstalled;
+
+#if __linux__
+global_variable struct sigaction PreviousMemoryFaultAction;
+#endif
+
+
+// Note (Aaron): Raises Fault_MemoryAccess on the processor whose guard pages 'address' is in, and makes that side's
+// guard pages accessible so that the faulting access completes (reads see 0). Execution stops once the instruction
+// has finished. ClearProcessorFault() makes them inaccessible again. Returns FALSE if the address isn't guarded.
+static B32 HandleMemoryFault(U8 *address)
+{
+    for (U32 i = 0; i < MAX_GUARDED_PROCESSORS; ++i)
+    {
+        processor_8086 *processor = (processor_8086 *)AtomicLoadU64(&GuardedProcessors[i]);
+        if (!processor
+            || address < processor->Memory - PROCESSOR_GUARD_SIZE
+            || address >= processor->Memory + processor->MemorySize + PROCESSOR_GUARD_SIZE)
         {
-            // read 16-bit unsigned
-            U8 *readStartPtr = instruction.Bits.BytePtr;
-            ReadInstructionStream(processor, &instruction, 2);
-            operandSource.Immediate.Value = (U16)(*(U16 *)readStartPtr);
+            continue;
         }
-        else if (instruction.SignBit == 0b1 && instruction.WidthBit == 0)
+
+        U8 *guard = (address < processor->Memory)
+            ? processor->Memory - PROCESSOR_GUARD_SIZE
+            : processor->Memory + processor->MemorySize;
+        if (!MemoryCommit(guard, PROCESSOR_GUARD_SIZE))
         {
-            // read 8-bit signed
-            U8 *readStartPtr = instruction.Bits.BytePtr;
-            ReadInstructionStream(processor, &instruction, 1);
-            operandSource.Immediate.Value = (U16)((S8)(*readStartPtr));
-            operandSource.Immediate.Flags |= Immediate_IsSigned;
+            return FALSE;
         }
-        else if (instruction.SignBit == 0b1 && instruction.WidthBit == 1)
+
+        RaiseProcessorFault(processor, Fault_MemoryAccess, (U32)(address - processor->Memory));
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+#if __linux__
+static void MemoryFaultSignalHandler(int signal, siginfo_t *info, void *context)
+{
+    if (HandleMemoryFault((U8 *)info->si_addr))
+    {
+        return;
+    }
+
+    // Note (Aaron): Not a guard page, so the access faults again and is handled as it was before
+    sigaction(SIGSEGV, &PreviousMemoryFaultAction, 0);
+}
+#endif
+
+
+#if _WIN32
+static LONG CALLBACK MemoryFaultExceptionHandler(EXCEPTION_POINTERS *exception)
+{
+    EXCEPTION_RECORD *record = exception->ExceptionRecord;
+    if (record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION
+        && record->NumberParameters >= 2
+        && HandleMemoryFault((U8 *)record->ExceptionInformation[1]))
+    {
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+#endif
+
+
+// Note (Aaron): The first caller installs the handler, any others wait until it has been
+static void InstallMemoryFaultHandler(void)
+{
+    if (AtomicLoadU32(&MemoryFaultHandlerInstalled))
+    {
+        return;
+    }
+
+    if (AtomicIncrementU32(&MemoryFaultHandlerClaimed) != 1)
+    {
+        while (!AtomicLoadU32(&MemoryFaultHandlerInstalled))
         {
-            // read 8-bits and sign-extend to 16-bits
-            U8 *readStartPtr = instruction.Bits.BytePtr;
-            ReadInstructionStream(processor, &instruction, 1);
-            operandSource.Immediate.Value = (U16)((S8)(*readStartPtr));
-            operandSource.Immediate.Flags |= Immediate_IsSigned;
         }
+        return;
+    }
 
-        instruction.Operands[0] = operandDest;
-        instruction.Operands[1] = operandSource;
+#if __linux__
+    struct sigaction action = {};
+    action.sa_sigaction = MemoryFaultSignalHandler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &PreviousMemoryFaultAction);
 
-        // estimate clock cycles
-        // immediate to register
-        if (instruction.Operands[0].Type == Operand_Register)
-        {
-            // Note (Aaron): add, sub, and cmp share the same clock count
-            instruction.ClockCount = 4;
-        }
-        // immediate to memory
-        else if (instruction.Operands[0].Type == Operand_Memory)
-        {
-            switch (instruction.OpType)
-            {
-                case Op_add:
-                case Op_sub:
-                    instruction.ClockCount = 17;
-                    break;
-                case Op_cmp:
-                    instruction.ClockCount = 10;
-                    break;
-                default:
-                    assert_8086(FALSE && "Unhandled case");
-            }
+#elif _WIN32
+    AddVectoredExceptionHandler(1, MemoryFaultExceptionHandler);
 
-            instruction.EAClockCount = CalculateEffectiveAddressClocks(&instruction.Operands[0]);
-        }
-        else
-        {
-            assert_8086(FALSE && "Unreachable case");
-        }
-    }
+#endif
 
-    // add / sub / cmp - immediate to/from/with accumulator
-    else if (((instruction.Bits.Byte0 >> 1) == 0b0000010)
-        || ((instruction.Bits.Byte0 >> 1) == 0b0010110)
-        || ((instruction.Bits.Byte0 >> 1) == 0b0011110))
-    {
-        instruction.WidthBit = instruction.Bits.Byte0 & 0b1;
+    AtomicStoreU32(&MemoryFaultHandlerInstalled, TRUE);
+}
 
-        instruction_operand operandSource = {};
-        instruction_operand operandDest = {};
-        operandSource.Type = Operand_Immediate;
-        operandDest.Type = Operand_Register;
 
-        // decode instruction type
-        // add = 0b000
-        if (((instruction.Bits.Byte0 >> 3) & 0b111) == 0b000)
-        {
-            instruction.OpType = Op_add;
-        }
-        // sub = 0b101
-        else if (((instruction.Bits.Byte0 >> 3) & 0b111) == 0b101)
-        {
-            instruction.OpType = Op_sub;
-        }
-        // cmp = 0b111
-        else if (((instruction.Bits.Byte0 >> 3) & 0b111) == 0b111)
-        {
-            instruction.OpType = Op_cmp;
-        }
-        else
-        {
-            assert_8086(FALSE && "Unhandled case");
-        }
+// Note (Aaron): Reserves the processor's memory between PROCESSOR_GUARD_SIZE bytes of inaccessible pages on either
+// side and commits the memory itself, zeroed. Accesses that fall outside of memory fault into the guard pages
+// instead of being bounds checked. The processor must stay where it is until FreeProcessorMemory().
+global_function B32 AllocateProcessorMemory(processor_8086 *processor)
+{
+    assert_8086((processor->MemorySize % PROCESSOR_GUARD_SIZE) == 0);
+    InstallMemoryFaultHandler();
 
-        // read data
-        if (instruction.WidthBit == 0b0)
-        {
-            ReadInstructionStream(processor, &instruction, 1);
-            operandSource.Immediate.Value = (U16)(*(U8 *)(&instruction.Bits.Byte1));
-        }
-        else if (instruction.WidthBit == 0b1)
+    U64 reserveSize = (U64)processor->MemorySize + (2 * PROCESSOR_GUARD_SIZE);
+    U8 *base = (U8 *)MemoryReserve(reserveSize);
+    if (!base)
+    {
+        return FALSE;
+    }
+
+    if (MemoryCommit(base + PROCESSOR_GUARD_SIZE, processor->MemorySize))
+    {
+        processor->Memory = base + PROCESSOR_GUARD_SIZE;
+        for (U32 i = 0; i < MAX_GUARDED_PROCESSORS; ++i)
         {
-            ReadInstructionStream(processor, &instruction, 2);
-            operandSource.Immediate.Value = (U16)(*(U16 *)(&instruction.Bits.Byte1));
+            if (AtomicCompareExchangeU64(&GuardedProcessors[i], 0, (U64)processor))
+            {
+                return TRUE;
+            }
         }
+    }
 
-        operandDest.Register = (instruction.WidthBit == 0b0) ? Reg_al : Reg_ax;
+    processor->Memory = 0;
+    MemoryFree(base, reserveSize);
+    return FALSE;
+}
 
-        instruction.Operands[0] = operandDest;
-        instruction.Operands[1] = operandSource;
 
-        // estimate clock cycles
-        // Note (Aaron): add, sub, and cmp share the same clock count
-        instruction.ClockCount = 4;
-    }
-
-    // control transfer instructions
-    else if ((instruction.Bits.Byte0 == 0b01110101)     // jnz / jne
-             || (instruction.Bits.Byte0 == 0b01110100)  // je
-             || (instruction.Bits.Byte0 == 0b01111100)  // jl
-             || (instruction.Bits.Byte0 == 0b01111110)  // jle
-             || (instruction.Bits.Byte0 == 0b01110010)  // jb
-             || (instruction.Bits.Byte0 == 0b01110110)  // jbe
-             || (instruction.Bits.Byte0 == 0b01111010)  // jp
-             || (instruction.Bits.Byte0 == 0b01110000)  // jo
-             || (instruction.Bits.Byte0 == 0b01111000)  // js
-             || (instruction.Bits.Byte0 == 0b01111101)  // jnl
-             || (instruction.Bits.Byte0 == 0b01111111)  // jg
-             || (instruction.Bits.Byte0 == 0b01110011)  // jnb
-             || (instruction.Bits.Byte0 == 0b01110111)  // ja
-             || (instruction.Bits.Byte0 == 0b01111011)  // jnp
-             || (instruction.Bits.Byte0 == 0b01110001)  // jno
-             || (instruction.Bits.Byte0 == 0b01111001)  // jns
-             || (instruction.Bits.Byte0 == 0b11100010)  // loop
-             || (instruction.Bits.Byte0 == 0b11100001)  // loopz
-             || (instruction.Bits.Byte0 == 0b11100000)  // loopnz
-             || (instruction.Bits.Byte0 == 0b11100011)) // jcxz
-    {
-        // TODO (Aaron): Add clock count estimation for these jumps
+// Note (Aaron): Other threads may take or free slots at any time, so this is only a snapshot
+global_function U32 GetFreeGuardedProcessorCount(void)
+{
+    U32 result = 0;
+    for (U32 i = 0; i < MAX_GUARDED_PROCESSORS; ++i)
+    {
+        if (!AtomicLoadU64(&GuardedProcessors[i]))
+        {
+            ++result;
+        }
+    }
 
-        instruction.OpType = Op_unknown;
-        char instructionStr[32] = "";
+    return result;
+}
 
-        // read 8-bit signed offset for jumps
-        ReadInstructionStream(processor, &instruction, 1);
-        S8 offset = *(S8 *)(&instruction.Bits.Byte1);
 
-        instruction_operand operand0 = {};
-        operand0.Type = Operand_Immediate;
-        operand0.Immediate.Flags |= Immediate_IsJump;
-        // Note (Aaron): A signed 8-bit value will need to be extracted from
-        // the unsigned 16-bit ImmediateValue when instructions are executed.
-        operand0.Immediate.Value = offset;
-        operand0.Immediate.Flags |= Immediate_IsSigned;
-        instruction.Operands[0] = operand0;
-
-        instruction_operand operand1 = {};
-        operand1.Type = Operand_None;
-        instruction.Operands[1] = operand1;
-
-        switch(instruction.Bits.Byte0)
-        {
-            // je / jz
-            case 0b01110100:
-                instruction.OpType = Op_je;
-                break;
+global_function void FreeProcessorMemory(processor_8086 *processor)
+{
+    for (U32 i = 0; i < MAX_GUARDED_PROCESSORS; ++i)
+    {
+        if (AtomicCompareExchangeU64(&GuardedProcessors[i], (U64)processor, 0))
+        {
+            break;
+        }
+    }
 
-            // jl / jnge
-            case 0b01111100:
-                instruction.OpType = Op_jl;
-                break;
+    if (processor->Memory)
+    {
+        MemoryFree(processor->Memory - PROCESSOR_GUARD_SIZE, (U64)processor->MemorySize + (2 * PROCESSOR_GUARD_SIZE));
+        processor->Memory = 0;
+    }
+}
 
-            // jle / jng
-            case 0b01111110:
-                instruction.OpType = Op_jle;
-                break;
 
-            // jb / jnae
-            case 0b01110010:
-                instruction.OpType = Op_jb;
-                break;
+// Note (Aaron): Only the first fault is kept, later ones are caused by it
+global_function void RaiseProcessorFault(processor_8086 *processor, processor_fault fault, U32 address)
+{
+    if (processor->Fault == Fault_None)
+    {
+        processor->Fault = fault;
+        processor->FaultAddress = address;
+    }
+}
 
-            // jbe / jna
-            case 0b01110110:
-                instruction.OpType = Op_jbe;
-                break;
 
-            // jp / jpe
-            case 0b01111010:
-                instruction.OpType = Op_jp;
-                break;
+global_function void ClearProcessorFault(processor_8086 *processor)
+{
+    // Note (Aaron): Only memory faults leave guard pages accessible, and anything written to them is discarded
+    if (processor->Fault == Fault_MemoryAccess)
+    {
+        MemoryDecommit(processor->Memory - PROCESSOR_GUARD_SIZE, PROCESSOR_GUARD_SIZE);
+        MemoryDecommit(processor->Memory + processor->MemorySize, PROCESSOR_GUARD_SIZE);
+    }
 
-            // jo
-            case 0b01110000:
-                instruction.OpType = Op_jo;
-                break;
+    processor->Fault = Fault_None;
+    processor->FaultAddress = 0;
+}
 
-            // js
-            case 0b01111000:
-                instruction.OpType = Op_js;
-                break;
 
-            // jne / jnz
-            case 0b01110101:
-                instruction.OpType = Op_jne;
-                break;
+global_function char const *GetProcessorFaultName(processor_fault fault)
+{
+    switch (fault)
+    {
+        case Fault_MemoryAccess:        return "memory access out of bounds";
+        case Fault_InstructionStream:   return "instruction runs past the end of the program";
+        default:                        return "none";
+    }
+}
 
-            // jnl / jge
-            case 0b01111101:
-                instruction.OpType = Op_jnl;
-                break;
 
-            // jnle / jg
-            case 0b01111111:
-                instruction.OpType = Op_jg;
-                break;
+// Note (Aaron): Marked before the write is made, so a write outside of memory that is about to fault into the
+// guard pages only marks the part of it inside memory
+global_function void MarkDirtyPages(U64 *dirtyPages, U32 address, U32 byteCount, U32 memorySize)
+{
+    if (address >= memorySize || byteCount == 0)
+    {
+        return;
+    }
 
-            // jnb / jae
-            case 0b01110011:
-                instruction.OpType = Op_jnb;
-                break;
+    U32 lastAddress = (Min(address + byteCount, memorySize)) - 1;
+    for (U32 page = address >> DIRTY_PAGE_SHIFT; page <= (lastAddress >> DIRTY_PAGE_SHIFT); ++page)
+    {
+        dirtyPages[page >> 6] |= 1ull << (page & 63);
+    }
+}
 
-            // jnbe / ja
-            case 0b01110111:
-                instruction.OpType = Op_ja;
-                break;
 
-            // jnp / jpo
-            case 0b01111011:
-                instruction.OpType = Op_jnp;
-                break;
+// Note (Aaron): Memory accesses aren't bounds checked. Addresses outside of memory fault into its guard pages
+// (see AllocateProcessorMemory()), and read as 0 once the fault has been raised. A negative displacement can
+// wrap an effective address around, so addresses are offset from memory as signed.
+global_function U16 GetMemory(processor_8086 *processor, U32 effectiveAddress, B32 wide)
+{
+    U8 *address = processor->Memory + (S32)effectiveAddress;
 
-            // jno
-            case 0b01110001:
-                instruction.OpType = Op_jno;
-                break;
+    U16 result = 0;
+    if (wide)
+    {
+        U16 *memoryRead = (U16 *)address;
+        result = *memoryRead;
+    }
+    else
+    {
+        U8 *memoryRead = address;
+        result = (U16)*memoryRead;
+    }
 
-            // jns
-            case 0b01111001:
-                instruction.OpType = Op_jns;
-                break;
+    if (processor->Breakpoints && processor->Breakpoints->WatchpointCount)
+    {
+        CheckWatchpoints(processor->Breakpoints, effectiveAddress, wide ? 2 : 1, WatchAccess_Read, result);
+    }
 
-            // loop
-            case 0b11100010:
-                instruction.OpType = Op_loop;
-                break;
+    return result;
+}
 
-            // loopz
-            case 0b11100001:
-                instruction.OpType = Op_loopz;
-                break;
 
-            // loopnz
-            case 0b11100000:
-                instruction.OpType = Op_loopnz;
-                break;
+global_function void SetMemory(processor_8086 *processor, U32 effectiveAddress, U16 value, B32 wide)
+{
+    if (processor->InstructionCache)
+    {
+        InvalidateInstructionCache(processor->InstructionCache, effectiveAddress, wide ? 2 : 1);
+    }
 
-            // jcxz
-            case 0b11100011:
-                instruction.OpType = Op_jcxz;
-                break;
-            default:
-                assert_8086(FALSE && "Unhandled instruction");
-        }
+    if (processor->SnapshotHistory)
+    {
+        CaptureMemoryPages(processor->SnapshotHistory, processor->Memory, processor->MemorySize, effectiveAddress, wide ? 2 : 1);
     }
 
-    // return instructions
-    else if ((instruction.Bits.Byte0 == 0b11000011) // ret within segment
-        || (instruction.Bits.Byte0 == 0b11000010)   // ret with segment adding immediate to SP
-        || (instruction.Bits.Byte0 == 0b11001011)   // ret with inter-segment
-        || (instruction.Bits.Byte0 == 0b11001010))  // ret with inter-segment adding immediate to SP
+    if (processor->Breakpoints && processor->Breakpoints->WatchpointCount)
     {
-        instruction.OpType = Op_ret;
-        instruction_operand operand_none = {};
+        CheckWatchpoints(processor->Breakpoints, effectiveAddress, wide ? 2 : 1, WatchAccess_Write, wide ? value : (value & 0xff));
+    }
 
-        if (instruction.Bits.Byte0 == 0b11000010
-            || instruction.Bits.Byte0 == 0b11001010)
-        {
-            // Note (Aaron): Some of these instructions include additional bytes. Because we are stopping the sim
-            // on ret instructions, they do not need to be implemented at the moment.
-            ReadInstructionStream(processor, &instruction, 2);
-        }
+    if (processor->Trace)
+    {
+        RecordTraceWrite(processor->Trace, effectiveAddress, wide ? 2 : 1, processor->MemorySize);
+    }
 
-        operand_none.Type = Operand_None;
-        instruction.Operands[0] = operand_none;
-        instruction.Operands[1] = operand_none;
+    if (processor->DirtyPages)
+    {
+        MarkDirtyPages(processor->DirtyPages, effectiveAddress, wide ? 2 : 1, processor->MemorySize);
     }
 
-    // unsupported instruction
-    else
+    // this should be valid as well but I'm not sure about the syntax
+    // processor->Memory[effectiveAddress] = value;
+
+    if (wide)
     {
-        instruction.OpType = Op_unknown;
-        instruction_operand unknown = {};
-        instruction.Operands[0] = unknown;
-        instruction.Operands[1] = unknown;
+        U16 *memoryWrite = (U16 *)(processor->Memory + (S32)effectiveAddress);
+        *memoryWrite = value;
+        return;
     }
 
-    return instruction;
+    U8 *memoryWrite = processor->Memory + (S32)effectiveAddress;
+    *memoryWrite = (U8)value;
 }
 
 
-global_function U16 GetRegisterValue(processor_8086 *processor, register_id targetRegister)
+global_function U16 GetOperandValue(processor_8086 *processor, instruction_operand operand)
 {
     U16 result = 0;
-    register_info info = RegisterLookup[targetRegister];
-
-    switch (info.Register)
+    switch (operand.Type)
     {
-        case (Reg_bx_si):
-        {
-            U16 bxValue = GetRegisterValue(processor, Reg_bx);
-            U16 siValue = GetRegisterValue(processor, Reg_si);
-            result = bxValue + siValue;
-            break;
-        }
-        case (Reg_bx_di):
+        case Operand_Register:
         {
-            U16 bxValue = GetRegisterValue(processor, Reg_bx);
-            U16 diValue = GetRegisterValue(processor, Reg_di);
-            result = bxValue + diValue;
+            result = GetRegisterValue(processor, operand.Register);
             break;
         }
-        case (Reg_bp_si):
+        case Operand_Immediate:
         {
-            U16 bpValue = GetRegisterValue(processor, Reg_bp);
-            U16 siValue = GetRegisterValue(processor, Reg_si);
-            result = bpValue + siValue;
+            result = operand.Immediate.Value;
             break;
         }
-        case (Reg_bp_di):
+        case Operand_Memory:
         {
-            U16 bpValue = GetRegisterValue(processor, Reg_bp);
-            U16 diValue = GetRegisterValue(processor, Reg_di);
-            result = bpValue + diValue;
+            U32 effectiveAddress = CalculateEffectiveAddress(processor, operand);
+            B32 wide = (operand.Memory.Flags & Memory_IsWide);
+            result = GetMemory(processor, effectiveAddress, wide);
+
             break;
         }
         default:
         {
-            result = (processor->Registers[info.RegisterIndex] & info.Mask);
+            assert_8086(FALSE && "Invalid instruction");
             break;
         }
     }
@@ -1006,232 +2274,583 @@ global_function U16 GetRegisterValue(processor_8086 *processor, register_id targ
 }
 
 
-global_function void SetRegisterValue(processor_8086 *processor, register_id targetRegister, U16 value)
+global_function void SetOperandValue(processor_8086 *processor, instruction_operand *operand, U16 value)
 {
-    register_info info = RegisterLookup[targetRegister];
-    // TODO (Aaron): I don't think this preserves values in a lower or higher segment of the register
-    // if you are only wanting to write to one segment.
-    //  - Can retrieve the register value first, invert the mask and then combine the values to fix this
-    processor->Registers[info.RegisterIndex] = (value & info.Mask);
+    // Only these two operand types are assignable
+    assert_8086((operand->Type == Operand_Register) || operand->Type == Operand_Memory);
+
+    if (operand->Type == Operand_Register)
+    {
+        SetRegisterValue(processor, operand->Register, value);
+        return;
+    }
+
+    if (operand->Type == Operand_Memory)
+    {
+        U32 effectiveAddress = 0;
+        B32 wide = (operand->Memory.Flags & Memory_IsWide);
+
+        // direct address assignment
+        if (operand->Memory.Flags & Memory_HasDirectAddress)
+        {
+            effectiveAddress = operand->Memory.DirectAddress;
+            SetMemory(processor, effectiveAddress, value, wide);
+            return;
+        }
+
+        // effective address calculation
+        effectiveAddress = GetRegisterValue(processor, operand->Memory.Register);
+        if (operand->Memory.Flags & Memory_HasDisplacement)
+        {
+            effectiveAddress += operand->Memory.Displacement;
+        }
+
+        SetMemory(processor, effectiveAddress, value, wide);
+        return;
+    }
+
+    assert_8086(FALSE && "Unreachable case");
+}
+
+
+global_function void PrintFlagDiffs(U8 oldFlags, U8 newFlags, memory_arena *outputArena)
+{
+    if (oldFlags == newFlags)
+    {
+        return;
+    }
+
+    U8 *startPtr = outputArena->PositionPtr;
+    ArenaPushCStringf(outputArena, FALSE, (char *)" flags:");
+
+    // Flags that are changing to 0
+    if ((oldFlags & RegisterFlag_CF) && !(newFlags & RegisterFlag_CF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"C"); }
+    if ((oldFlags & RegisterFlag_PF) && !(newFlags & RegisterFlag_PF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"P"); }
+    if ((oldFlags & RegisterFlag_AF) && !(newFlags & RegisterFlag_AF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"A"); }
+    if ((oldFlags & RegisterFlag_ZF) && !(newFlags & RegisterFlag_ZF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"Z"); }
+    if ((oldFlags & RegisterFlag_SF) && !(newFlags & RegisterFlag_SF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"S"); }
+    if ((oldFlags & RegisterFlag_OF) && !(newFlags & RegisterFlag_OF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"O"); }
+    if ((oldFlags & RegisterFlag_DF) && !(newFlags & RegisterFlag_DF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"D"); }
+
+    ArenaPushCStringf(outputArena, FALSE, (char *)"->");
+
+    // Flags that are changing to 1
+    if (!(oldFlags & RegisterFlag_CF) && (newFlags & RegisterFlag_CF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"C"); }
+    if (!(oldFlags & RegisterFlag_PF) && (newFlags & RegisterFlag_PF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"P"); }
+    if (!(oldFlags & RegisterFlag_AF) && (newFlags & RegisterFlag_AF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"A"); }
+    if (!(oldFlags & RegisterFlag_ZF) && (newFlags & RegisterFlag_ZF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"Z"); }
+    if (!(oldFlags & RegisterFlag_SF) && (newFlags & RegisterFlag_SF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"S"); }
+    if (!(oldFlags & RegisterFlag_OF) && (newFlags & RegisterFlag_OF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"O"); }
+    if (!(oldFlags & RegisterFlag_DF) && (newFlags & RegisterFlag_DF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"D"); }
+}
+
+
+global_function B32 IsOperandWide(instruction_operand *operand)
+{
+    switch (operand->Type)
+    {
+        case Operand_Register: return RegisterLookup[operand->Register].IsWide;
+        case Operand_Memory: return (operand->Memory.Flags & Memory_IsWide) ? TRUE : FALSE;
+        default: return TRUE;
+    }
+}
+
+
+global_function void InitializeBusTiming(bus_timing *timing, bus_timing_model model)
+{
+    *timing = {};
+    timing->Model = model;
+    timing->QueueSize = (model == BusTiming_8088) ? 4 : 6;
+}
+
+
+// Note (Aaron): Empties the prefetch queue and starts prefetching again from 'address'
+global_function void ResetBusTiming(bus_timing *timing, U32 address)
+{
+    timing->QueueBytes = 0;
+    timing->FetchAddress = address;
+    timing->IdleClocks = 0;
+}
+
+
+// Note (Aaron): The 8086 prefetches a word at a time, or a byte from an odd address, and waits until
+// the queue has room for a word. The 8088 prefetches a byte at a time.
+inline global_function U32 GetPrefetchByteCount(bus_timing *timing)
+{
+    U32 byteCount = (timing->Model == BusTiming_8088 || (timing->FetchAddress & 1)) ? 1 : 2;
+    return byteCount;
 }
 
 
-global_function U8 GetRegisterFlag(processor_8086 *processor, register_flags flag)
+inline global_function B32 CanPrefetch(bus_timing *timing)
 {
-    U8 result = (processor->Flags & flag) ? 1 : 0;
+    U32 requiredSpace = (timing->Model == BusTiming_8088) ? 1 : 2;
+    B32 result = (timing->QueueBytes + requiredSpace) <= timing->QueueSize;
     return result;
 }
 
 
-global_function void SetRegisterFlag(processor_8086 *processor, register_flags flag, B32 set)
+// Note (Aaron): Jump clocks from the 8086 manual, which include restarting the prefetch at the target
+global_function U32 GetJumpClocks(operation_types opType, B32 taken)
 {
-    if (set)
+    switch (opType)
     {
-        processor->Flags |= flag;
-        return;
+        case Op_loop:   return taken ? 17 : 5;
+        case Op_loopz:  return taken ? 18 : 6;
+        case Op_loopnz: return taken ? 19 : 5;
+        case Op_jcxz:   return taken ? 18 : 6;
+        default:        return taken ? 16 : 4;
     }
-
-    processor->Flags &= ~flag;
 }
 
 
-global_function void UpdateSignedRegisterFlag(processor_8086 *processor, register_id targetRegister, U16 value)
+// Note (Aaron): String instruction clocks from the 8086 manual. A repeated instruction takes 9 clocks, plus
+// these for each repetition.
+global_function U32 GetStringClocks(operation_types opType, B32 repeated)
 {
-    register_info info = RegisterLookup[targetRegister];
-    if (info.IsWide)
-    {
-        // use 16 bit mask
-        SetRegisterFlag(processor, RegisterFlag_SF, (value >> 15) == 1);
-    }
-    else
+    switch (opType)
     {
-        // use 8 bit mask
-        SetRegisterFlag(processor, RegisterFlag_SF, (value >> 7) == 1);
+        case Op_movs:   return repeated ? 17 : 18;
+        case Op_cmps:   return 22;
+        case Op_scas:   return 15;
+        case Op_lods:   return repeated ? 13 : 12;
+        case Op_stos:   return repeated ? 10 : 11;
+        default:
+        {
+            assert_8086(FALSE && "Not a string instruction");
+            return 0;
+        }
     }
 }
 
 
-global_function U32 CalculateEffectiveAddress(processor_8086 *processor, instruction_operand operand)
+// Note (Aaron): Advances the bus model over an executed instruction and returns the clocks it adds to the
+// instruction's base and effective address clocks. 'dataAddress' is the address of the instruction's
+// memory operand, if it has one, and 'nextIP' is where execution continues.
+global_function U32 UpdateBusTiming(bus_timing *timing, instruction *instruction, U32 dataAddress, U32 nextIP)
 {
-    assert_8086(operand.Type == Operand_Memory);
+    U32 byteCount = instruction->Bits.ByteCount;
 
-    U32 effectiveAddress = 0;
-    // direct address assignment
-    if (operand.Memory.Flags & Memory_HasDirectAddress)
+    // Note (Aaron): Execution didn't continue from where the queue was filling (e.g. a reset), so it starts empty
+    if (timing->FetchAddress - timing->QueueBytes != instruction->Address)
     {
-        effectiveAddress = operand.Memory.DirectAddress;
+        ResetBusTiming(timing, instruction->Address);
     }
-    // effective address calculation
-    else
+
+    // wait for the rest of the instruction's bytes
+    // Note (Aaron): Decoding frees up queue space as it goes, so these fetches don't wait for room
+    timing->StallClockCount = 0;
+    while (timing->QueueBytes < byteCount)
     {
-        effectiveAddress = GetRegisterValue(processor, operand.Memory.Register);
-        if (operand.Memory.Flags & Memory_HasDisplacement)
-        {
-            effectiveAddress += operand.Memory.Displacement;
-        }
+        U32 fetchByteCount = GetPrefetchByteCount(timing);
+        timing->StallClockCount += 4 - timing->IdleClocks;
+        timing->IdleClocks = 0;
+        timing->QueueBytes += fetchByteCount;
+        timing->FetchAddress += fetchByteCount;
     }
 
-    return effectiveAddress;
-}
+    timing->QueueBytes -= byteCount;
 
+    // data transfers
+    instruction_operand *dest = &instruction->Operands[0];
+    instruction_operand *source = &instruction->Operands[1];
+    instruction_operand *memoryOperand = (dest->Type == Operand_Memory) ? dest
+                                       : (source->Type == Operand_Memory) ? source
+                                       : 0;
 
-global_function U16 GetMemory(processor_8086 *processor, U32 effectiveAddress, B32 wide)
-{
-    if (effectiveAddress >= processor->MemorySize)
+    U32 busCycleCount = 0;
+    timing->PenaltyClockCount = 0;
+    if (memoryOperand)
     {
-        printf("[ERROR] Attempted to load out-of-bounds memory: 0x%x (out of 0x%x)", effectiveAddress, processor->MemorySize);
-        Assert(FALSE && "Attempted to load out-of-bounds memory");
-        // TODO (Aaron): Need to support Win32 and not immediately exit
-        exit(1);
+        // Note (Aaron): Arithmetic with a memory destination reads and then writes it
+        U32 transferCount = (memoryOperand == dest && (instruction->OpType == Op_add || instruction->OpType == Op_sub)) ? 2 : 1;
+        B32 wide = (memoryOperand->Memory.Flags & Memory_IsWide);
+        U32 cyclesPerTransfer = (wide && (timing->Model == BusTiming_8088 || (dataAddress & 1))) ? 2 : 1;
+
+        busCycleCount = transferCount * cyclesPerTransfer;
+        timing->PenaltyClockCount = transferCount * (cyclesPerTransfer - 1) * 4;
     }
 
-    if (wide)
+    B32 jumped = (nextIP != instruction->Address + byteCount);
+    timing->JumpClockCount = (instruction->OpType >= Op_jne && instruction->OpType <= Op_jcxz)
+        ? GetJumpClocks(instruction->OpType, jumped)
+        : 0;
+
+    // prefetch while the bus isn't transferring data
+    U32 executionClocks = instruction->ClockCount + instruction->EAClockCount + timing->PenaltyClockCount + timing->JumpClockCount;
+    U32 busClocks = busCycleCount * 4;
+    timing->IdleClocks += (executionClocks > busClocks) ? (executionClocks - busClocks) : 0;
+    while (timing->IdleClocks >= 4 && CanPrefetch(timing))
     {
-        U16 *memoryRead = (U16 *)(processor->Memory + effectiveAddress);
-        U16 result = *memoryRead;
+        U32 fetchByteCount = GetPrefetchByteCount(timing);
+        timing->QueueBytes += fetchByteCount;
+        timing->FetchAddress += fetchByteCount;
+        timing->IdleClocks -= 4;
+    }
 
-        return result;
+    // Note (Aaron): The bus sits idle while the queue is full
+    if (!CanPrefetch(timing))
+    {
+        timing->IdleClocks = 0;
     }
 
-    U8 *memoryRead = (processor->Memory + effectiveAddress);
-    U16 result = (U16)*memoryRead;
+    if (jumped)
+    {
+        // Note (Aaron): The jump clocks cover the first fetch from the target
+        ResetBusTiming(timing, nextIP);
+        U32 fetchByteCount = GetPrefetchByteCount(timing);
+        timing->QueueBytes += fetchByteCount;
+        timing->FetchAddress += fetchByteCount;
+    }
 
+    U32 result = timing->StallClockCount + timing->PenaltyClockCount + timing->JumpClockCount;
     return result;
 }
 
 
-global_function void SetMemory(processor_8086 *processor, U32 effectiveAddress, U16 value, B32 wide)
+global_function B32 InitializeExecutionProfile(execution_profile *profile, memory_arena *arena, U32 addressCount)
 {
-    if (effectiveAddress >= processor->MemorySize)
+    *profile = {};
+    ArenaClear(arena);
+
+    profile->ExecutionCounts = (U32 *)ArenaPushSizeZero(arena, sizeof(U32) * addressCount);
+    profile->ClockCounts = (U32 *)ArenaPushSizeZero(arena, sizeof(U32) * addressCount);
+    profile->TakenCounts = (U32 *)ArenaPushSizeZero(arena, sizeof(U32) * addressCount);
+    profile->NotTakenCounts = (U32 *)ArenaPushSizeZero(arena, sizeof(U32) * addressCount);
+    if (!profile->ExecutionCounts || !profile->ClockCounts || !profile->TakenCounts || !profile->NotTakenCounts)
     {
-        printf("[ERROR] Attempted to set out-of-bounds memory: 0x%x (out of 0x%x)", effectiveAddress, processor->MemorySize);
-        Assert(FALSE && "Attempted to set out-of-bounds memory");
-        // TODO (Aaron): Need to support Win32 and not immediately exit
-        exit(1);
+        return FALSE;
     }
 
-    // this should be valid as well but I'm not sure about the syntax
-    // processor->Memory[effectiveAddress] = value;
+    profile->AddressCount = addressCount;
+    return TRUE;
+}
 
-    if (wide)
+
+global_function void ClearExecutionProfile(execution_profile *profile)
+{
+    if (profile->AddressCount)
+    {
+        MemorySet(profile->ExecutionCounts, 0, sizeof(U32) * profile->AddressCount);
+        MemorySet(profile->ClockCounts, 0, sizeof(U32) * profile->AddressCount);
+        MemorySet(profile->TakenCounts, 0, sizeof(U32) * profile->AddressCount);
+        MemorySet(profile->NotTakenCounts, 0, sizeof(U32) * profile->AddressCount);
+    }
+
+    MemorySet(profile->OpExecutionCounts, 0, sizeof(profile->OpExecutionCounts));
+    MemorySet(profile->OpClockCounts, 0, sizeof(profile->OpClockCounts));
+    profile->TotalInstructionCount = 0;
+    profile->TotalClockCount = 0;
+}
+
+
+// Note (Aaron): 'nextIP' is where execution continues, it tells whether a conditional jump was taken
+inline global_function void RecordExecutionProfile(execution_profile *profile, instruction *instruction, U32 clockCount, U32 nextIP)
+{
+    profile->TotalInstructionCount++;
+    profile->TotalClockCount += clockCount;
+    profile->OpExecutionCounts[instruction->OpType]++;
+    profile->OpClockCounts[instruction->OpType] += clockCount;
+
+    U32 address = instruction->Address;
+    if (address >= profile->AddressCount)
     {
-        U16 *memoryWrite = (U16 *)(processor->Memory + effectiveAddress);
-        *memoryWrite = value;
         return;
     }
 
-    U8 *memoryWrite = processor->Memory + effectiveAddress;
-    *memoryWrite = (U8)value;
+    profile->ExecutionCounts[address]++;
+    profile->ClockCounts[address] += clockCount;
+
+    if (instruction->OpType >= Op_jne && instruction->OpType <= Op_jcxz)
+    {
+        B32 taken = (nextIP != address + instruction->Bits.ByteCount);
+        if (taken)
+        {
+            profile->TakenCounts[address]++;
+        }
+        else
+        {
+            profile->NotTakenCounts[address]++;
+        }
+    }
 }
 
 
-global_function U16 GetOperandValue(processor_8086 *processor, instruction_operand operand)
+// Note (Aaron): Executes one repetition of a string instruction, stepping SI and / or DI by 'delta'
+global_function void ExecuteStringOperation(processor_8086 *processor, operation_types opType, B32 wide, U16 delta)
 {
-    U16 result = 0;
-    switch (operand.Type)
+    U16 widthMask = wide ? 0xffff : 0xff;
+    U16 source = GetRegisterValue(processor, Reg_si);
+    U16 dest = GetRegisterValue(processor, Reg_di);
+
+    switch (opType)
     {
-        case Operand_Register:
+        case Op_movs:
         {
-            result = GetRegisterValue(processor, operand.Register);
+            U16 value = GetMemory(processor, source, wide);
+            SetMemory(processor, dest, value, wide);
+            SetRegisterValue(processor, Reg_si, source + delta);
+            SetRegisterValue(processor, Reg_di, dest + delta);
             break;
         }
-        case Operand_Immediate:
+
+        case Op_cmps:
         {
-            result = operand.Immediate.Value;
+            U16 value0 = GetMemory(processor, source, wide);
+            U16 value1 = GetMemory(processor, dest, wide);
+            SetLazyFlags(processor, LazyFlags_Sub, wide, value0, value1, (value0 - value1) & widthMask);
+            SetRegisterValue(processor, Reg_si, source + delta);
+            SetRegisterValue(processor, Reg_di, dest + delta);
             break;
         }
-        case Operand_Memory:
+
+        case Op_scas:
         {
-            U32 effectiveAddress = CalculateEffectiveAddress(processor, operand);
-            B32 wide = (operand.Memory.Flags & Memory_IsWide);
-            result = GetMemory(processor, effectiveAddress, wide);
+            U16 value0 = GetRegisterValue(processor, Reg_ax) & widthMask;
+            U16 value1 = GetMemory(processor, dest, wide);
+            SetLazyFlags(processor, LazyFlags_Sub, wide, value0, value1, (value0 - value1) & widthMask);
+            SetRegisterValue(processor, Reg_di, dest + delta);
+            break;
+        }
+
+        case Op_lods:
+        {
+            U16 value = GetMemory(processor, source, wide);
+            SetRegisterValue(processor, wide ? Reg_ax : Reg_al, value);
+            SetRegisterValue(processor, Reg_si, source + delta);
+            break;
+        }
 
+        case Op_stos:
+        {
+            SetMemory(processor, dest, GetRegisterValue(processor, Reg_ax), wide);
+            SetRegisterValue(processor, Reg_di, dest + delta);
             break;
         }
+
         default:
         {
-            assert_8086(FALSE && "Invalid instruction");
+            assert_8086(FALSE && "Not a string instruction");
             break;
         }
     }
-
-    return result;
 }
 
 
-global_function void SetOperandValue(processor_8086 *processor, instruction_operand *operand, U16 value)
+// Note (Aaron): Runs every repetition of a rep prefixed movs, stos, cmps or scas directly over memory, when that
+// can't be told apart from running them one at a time: DF is clear, SI and DI don't wrap around, a movs doesn't
+// overlap its source and destination, and no watchpoint covers the memory involved. Returns FALSE without
+// executing anything otherwise. 'repetitionCount' is set to the number of repetitions executed.
+global_function B32 ExecuteBulkStringInstruction(processor_8086 *processor, instruction *instruction, U32 *repetitionCount)
 {
-    // Only these two operand types are assignable
-    assert_8086((operand->Type == Operand_Register) || operand->Type == Operand_Memory);
+    operation_types opType = instruction->OpType;
+    if (opType == Op_lods || GetRegisterFlag(processor, RegisterFlag_DF))
+    {
+        return FALSE;
+    }
 
-    if (operand->Type == Operand_Register)
+    B32 wide = instruction->WidthBit;
+    U32 elementSize = wide ? 2 : 1;
+    U32 count = GetRegisterValue(processor, Reg_cx);
+    U32 byteCount = count * elementSize;
+    U32 source = GetRegisterValue(processor, Reg_si);
+    U32 dest = GetRegisterValue(processor, Reg_di);
+    B32 readsSource = (opType == Op_movs || opType == Op_cmps);
+    B32 writesDest = (opType == Op_movs || opType == Op_stos);
+
+    U32 addressLimit = Min((U32)0x10000, processor->MemorySize);
+    if (count == 0
+        || dest + byteCount > addressLimit
+        || (readsSource && source + byteCount > addressLimit)
+        || (opType == Op_movs && source < dest + byteCount && dest < source + byteCount))
     {
-        SetRegisterValue(processor, operand->Register, value);
-        return;
+        return FALSE;
     }
 
-    if (operand->Type == Operand_Memory)
+    breakpoint_set *breakpoints = processor->Breakpoints;
+    if (breakpoints && breakpoints->WatchpointCount
+        && (IsWatchedRange(breakpoints, dest, byteCount, writesDest ? WatchAccess_Write : WatchAccess_Read)
+            || (readsSource && IsWatchedRange(breakpoints, source, byteCount, WatchAccess_Read))))
     {
-        U32 effectiveAddress = 0;
-        B32 wide = (operand->Memory.Flags & Memory_IsWide);
+        return FALSE;
+    }
 
-        // direct address assignment
-        if (operand->Memory.Flags & Memory_HasDirectAddress)
+    U8 *memory = processor->Memory;
+    if (writesDest)
+    {
+        if (processor->InstructionCache)
         {
-            effectiveAddress = operand->Memory.DirectAddress;
-            SetMemory(processor, effectiveAddress, value, wide);
-            return;
+            InvalidateInstructionCache(processor->InstructionCache, dest, byteCount);
         }
 
-        // effective address calculation
-        effectiveAddress = GetRegisterValue(processor, operand->Memory.Register);
-        if (operand->Memory.Flags & Memory_HasDisplacement)
+        if (processor->SnapshotHistory)
         {
-            effectiveAddress += operand->Memory.Displacement;
+            CaptureMemoryPages(processor->SnapshotHistory, memory, processor->MemorySize, dest, byteCount);
         }
 
-        SetMemory(processor, effectiveAddress, value, wide);
-        return;
+        if (processor->Trace)
+        {
+            RecordTraceWrite(processor->Trace, dest, byteCount, processor->MemorySize);
+        }
+
+        if (processor->DirtyPages)
+        {
+            MarkDirtyPages(processor->DirtyPages, dest, byteCount, processor->MemorySize);
+        }
     }
 
-    assert_8086(FALSE && "Unreachable case");
+    switch (opType)
+    {
+        case Op_movs:
+        {
+            MemoryCopy(memory + dest, memory + source, byteCount);
+            *repetitionCount = count;
+            break;
+        }
+
+        case Op_stos:
+        {
+            U16 value = GetRegisterValue(processor, Reg_ax);
+            U8 low = (U8)value;
+            U8 high = (U8)(value >> 8);
+            if (!wide || low == high)
+            {
+                MemorySet(memory + dest, low, byteCount);
+            }
+            else
+            {
+                for (U32 i = 0; i < byteCount; i += 2)
+                {
+                    memory[dest + i] = low;
+                    memory[dest + i + 1] = high;
+                }
+            }
+
+            *repetitionCount = count;
+            break;
+        }
+
+        case Op_cmps:
+        case Op_scas:
+        {
+            // Note (Aaron): Stop at the first repetition that clears ZF (repe) or sets it (repne)
+            B32 continueWhileEqual = (instruction->RepPrefix == Rep_RepE);
+            U16 widthMask = wide ? 0xffff : 0xff;
+            U16 accumulator = GetRegisterValue(processor, Reg_ax) & widthMask;
+
+            U16 value0 = 0;
+            U16 value1 = 0;
+            U32 executed = 0;
+            while (executed < count)
+            {
+                U32 offset = executed * elementSize;
+                value0 = (opType == Op_scas) ? accumulator
+                       : wide ? *(U16 *)(memory + source + offset) : memory[source + offset];
+                value1 = wide ? *(U16 *)(memory + dest + offset) : memory[dest + offset];
+                executed++;
+
+                if ((value0 == value1) != continueWhileEqual)
+                {
+                    break;
+                }
+            }
+
+            SetLazyFlags(processor, LazyFlags_Sub, wide, value0, value1, (value0 - value1) & widthMask);
+            *repetitionCount = executed;
+            break;
+        }
+
+        default:
+        {
+            assert_8086(FALSE && "Unhandled bulk string instruction");
+            return FALSE;
+        }
+    }
+
+    U32 stepCount = *repetitionCount * elementSize;
+    SetRegisterValue(processor, Reg_cx, (U16)(count - *repetitionCount));
+    SetRegisterValue(processor, Reg_di, (U16)(dest + stepCount));
+    if (readsSource)
+    {
+        SetRegisterValue(processor, Reg_si, (U16)(source + stepCount));
+    }
+
+    return TRUE;
 }
 
 
-global_function void PrintFlagDiffs(U8 oldFlags, U8 newFlags, memory_arena *outputArena)
+// Note (Aaron): Executes a string instruction, repeating it while its prefix says to. Returns the clocks of its
+// repetitions, which are on top of the instruction's own. A repetition that hits a watchpoint leaves IP on the
+// instruction, so that the remaining repetitions run when execution resumes (as they would after an interrupt).
+global_function U32 ExecuteStringInstruction(processor_8086 *processor, instruction *instruction)
 {
-    if (oldFlags == newFlags)
+    operation_types opType = instruction->OpType;
+    B32 wide = instruction->WidthBit;
+    U16 step = wide ? 2 : 1;
+    U16 delta = GetRegisterFlag(processor, RegisterFlag_DF) ? (U16)(0 - step) : step;
+
+    if (instruction->RepPrefix == Rep_None)
     {
-        return;
+        ExecuteStringOperation(processor, opType, wide, delta);
+        return 0;
     }
 
-    U8 *startPtr = outputArena->PositionPtr;
-    ArenaPushCStringf(outputArena, FALSE, (char *)" flags:");
+    U32 repetitionCount = 0;
+    if (!ExecuteBulkStringInstruction(processor, instruction, &repetitionCount))
+    {
+        breakpoint_set *breakpoints = processor->Breakpoints;
+        B32 watching = breakpoints && breakpoints->WatchpointCount && breakpoints->StopReason == StopReason_None;
+        B32 testsZero = (opType == Op_cmps || opType == Op_scas);
+        B32 continueWhileEqual = (instruction->RepPrefix == Rep_RepE);
 
-    // Flags that are changing to 0
-    if ((oldFlags & RegisterFlag_CF) && !(newFlags & RegisterFlag_CF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"C"); }
-    if ((oldFlags & RegisterFlag_PF) && !(newFlags & RegisterFlag_PF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"P"); }
-    if ((oldFlags & RegisterFlag_AF) && !(newFlags & RegisterFlag_AF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"A"); }
-    if ((oldFlags & RegisterFlag_ZF) && !(newFlags & RegisterFlag_ZF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"Z"); }
-    if ((oldFlags & RegisterFlag_SF) && !(newFlags & RegisterFlag_SF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"S"); }
-    if ((oldFlags & RegisterFlag_OF) && !(newFlags & RegisterFlag_OF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"O"); }
+        U16 cx = GetRegisterValue(processor, Reg_cx);
+        while (cx != 0)
+        {
+            ExecuteStringOperation(processor, opType, wide, delta);
+            SetRegisterValue(processor, Reg_cx, --cx);
+            repetitionCount++;
 
-    ArenaPushCStringf(outputArena, FALSE, (char *)"->");
+            if (testsZero && (GetRegisterFlag(processor, RegisterFlag_ZF) != (continueWhileEqual ? 1 : 0)))
+            {
+                break;
+            }
 
-    // Flags that are changing to 1
-    if (!(oldFlags & RegisterFlag_CF) && (newFlags & RegisterFlag_CF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"C"); }
-    if (!(oldFlags & RegisterFlag_PF) && (newFlags & RegisterFlag_PF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"P"); }
-    if (!(oldFlags & RegisterFlag_AF) && (newFlags & RegisterFlag_AF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"A"); }
-    if (!(oldFlags & RegisterFlag_ZF) && (newFlags & RegisterFlag_ZF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"Z"); }
-    if (!(oldFlags & RegisterFlag_SF) && (newFlags & RegisterFlag_SF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"S"); }
-    if (!(oldFlags & RegisterFlag_OF) && (newFlags & RegisterFlag_OF)) { ArenaPushCStringf(outputArena, FALSE, (char *)"O"); }
+            if (watching && breakpoints->StopReason != StopReason_None)
+            {
+                if (cx != 0)
+                {
+                    processor->IP = instruction->Address;
+                }
+                break;
+            }
+        }
+    }
+
+    return repetitionCount * GetStringClocks(opType, TRUE);
 }
 
 
-global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *instruction, memory_arena *outputArena)
+global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *instruction, memory_arena *outputArena, trace_level traceLevel)
 {
-    U8 oldFlags = processor->Flags;
-    U8 *outputStartPtr = outputArena->PositionPtr;
+    // Note (Aaron): The bus model needs the address of the memory operand before execution changes registers
+    U32 dataAddress = 0;
+    if (processor->BusTiming)
+    {
+        if (instruction->Operands[0].Type == Operand_Memory)
+        {
+            dataAddress = CalculateEffectiveAddress(processor, instruction->Operands[0]);
+        }
+        else if (instruction->Operands[1].Type == Operand_Memory)
+        {
+            dataAddress = CalculateEffectiveAddress(processor, instruction->Operands[1]);
+        }
+    }
+
+    // Note (Aaron): Flags are only evaluated when they are going to be traced
+    U8 oldFlags = (traceLevel != TraceLevel_None) ? GetProcessorFlags(processor) : 0;
+    B32 traceFull = (traceLevel == TraceLevel_Full);
+    U8 *outputStartPtr = outputArena ? outputArena->PositionPtr : 0;
+    U32 repetitionClockCount = 0;
 
     // TODO (Aaron): A lot of redundant code here
     //  - Re-write switch statement with if-statements?
@@ -1242,14 +2861,16 @@ global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *
             instruction_operand operand0 = instruction->Operands[0];
             instruction_operand operand1 = instruction->Operands[1];
 
-            U16 oldValue = GetOperandValue(processor, operand0);
+            // Note (Aaron): Only a register's old value is traced. A memory destination isn't read, as far as
+            // watchpoints are concerned.
+            U16 oldValue = (operand0.Type == Operand_Register) ? GetOperandValue(processor, operand0) : 0;
             U16 sourceValue = GetOperandValue(processor, operand1);
 
             SetOperandValue(processor, &operand0, sourceValue);
 
-            // Note (Aaron): mov does not modify the zero flag or the signed flag
+            // Note (Aaron): mov does not modify any flags
 
-            if (operand0.Type == Operand_Register && oldValue != sourceValue)
+            if (traceFull && operand0.Type == Operand_Register && oldValue != sourceValue)
             {
                 ArenaPushCStringf(outputArena, FALSE,
                                   (char *)" %s:0x%x->0x%x",
@@ -1266,27 +2887,22 @@ global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *
             instruction_operand operand0 = instruction->Operands[0];
             instruction_operand operand1 = instruction->Operands[1];
 
-            U16 oldValue = GetOperandValue(processor, operand0);
-            U16 value0 = GetOperandValue(processor, operand0);
-            U16 value1 = GetOperandValue(processor, operand1);
-            U16 finalValue = value1 + value0;
+            B32 wide = IsOperandWide(&operand0);
+            U16 widthMask = wide ? 0xffff : 0xff;
+            U16 value0 = GetOperandValue(processor, operand0) & widthMask;
+            U16 value1 = GetOperandValue(processor, operand1) & widthMask;
+            U16 finalValue = (value0 + value1) & widthMask;
 
             SetOperandValue(processor, &operand0, finalValue);
-            SetRegisterFlag(processor, RegisterFlag_ZF, (finalValue == 0));
+            SetLazyFlags(processor, LazyFlags_Add, wide, value0, value1, finalValue);
 
-            // TODO (Aaron): Does the signed flag still get set if we are assigning to memory?
-            if (operand0.Type == Operand_Register)
+            if (traceFull && operand0.Type == Operand_Register && value0 != finalValue)
             {
-                UpdateSignedRegisterFlag(processor, operand0.Register, finalValue);
-
-                if (oldValue != finalValue)
-                {
-                    ArenaPushCStringf(outputArena, FALSE,
-                                      (char *)" %s:0x%x->0x%x",
-                                      GetRegisterMnemonic(operand0.Register),
-                                      value0,
-                                      finalValue);
-                }
+                ArenaPushCStringf(outputArena, FALSE,
+                                  (char *)" %s:0x%x->0x%x",
+                                  GetRegisterMnemonic(operand0.Register),
+                                  value0,
+                                  finalValue);
             }
 
             break;
@@ -1297,27 +2913,22 @@ global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *
             instruction_operand operand0 = instruction->Operands[0];
             instruction_operand operand1 = instruction->Operands[1];
 
-            U16 oldValue = GetOperandValue(processor, operand0);
-            U16 value0 = GetOperandValue(processor, operand0);
-            U16 value1 = GetOperandValue(processor, operand1);
-            U16 finalValue = value0 - value1;
+            B32 wide = IsOperandWide(&operand0);
+            U16 widthMask = wide ? 0xffff : 0xff;
+            U16 value0 = GetOperandValue(processor, operand0) & widthMask;
+            U16 value1 = GetOperandValue(processor, operand1) & widthMask;
+            U16 finalValue = (value0 - value1) & widthMask;
 
             SetOperandValue(processor, &operand0, finalValue);
-            SetRegisterFlag(processor, RegisterFlag_ZF, (finalValue == 0));
+            SetLazyFlags(processor, LazyFlags_Sub, wide, value0, value1, finalValue);
 
-            // TODO (Aaron): Does the signed flag still get set if we are assigning to memory?
-            if (operand0.Type == Operand_Register)
+            if (traceFull && operand0.Type == Operand_Register && value0 != finalValue)
             {
-                UpdateSignedRegisterFlag(processor, operand0.Register, finalValue);
-
-                if (oldValue != finalValue)
-                {
-                    ArenaPushCStringf(outputArena, FALSE,
-                                      (char *)" %s:0x%x->0x%x",
-                                      GetRegisterMnemonic(operand0.Register),
-                                      value0,
-                                      finalValue);
-                }
+                ArenaPushCStringf(outputArena, FALSE,
+                                  (char *)" %s:0x%x->0x%x",
+                                  GetRegisterMnemonic(operand0.Register),
+                                  value0,
+                                  finalValue);
             }
 
             break;
@@ -1328,20 +2939,39 @@ global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *
             instruction_operand operand0 = instruction->Operands[0];
             instruction_operand operand1 = instruction->Operands[1];
 
-            U16 value0 = GetOperandValue(processor, operand0);
-            U16 value1 = GetOperandValue(processor, operand1);
-            U16 finalValue = value0 - value1;
+            B32 wide = IsOperandWide(&operand0);
+            U16 widthMask = wide ? 0xffff : 0xff;
+            U16 value0 = GetOperandValue(processor, operand0) & widthMask;
+            U16 value1 = GetOperandValue(processor, operand1) & widthMask;
+            U16 finalValue = (value0 - value1) & widthMask;
 
-            SetRegisterFlag(processor, RegisterFlag_ZF, (finalValue == 0));
-            UpdateSignedRegisterFlag(processor, operand0.Register, finalValue);
+            SetLazyFlags(processor, LazyFlags_Sub, wide, value0, value1, finalValue);
 
             break;
         }
 
         case Op_jne:
+        case Op_je:
+        case Op_jl:
+        case Op_jle:
+        case Op_jb:
+        case Op_jbe:
+        case Op_jp:
+        case Op_jo:
+        case Op_js:
+        case Op_jnl:
+        case Op_jg:
+        case Op_jnb:
+        case Op_ja:
+        case Op_jnp:
+        case Op_jno:
+        case Op_jns:
+        case Op_loop:
+        case Op_loopz:
+        case Op_loopnz:
+        case Op_jcxz:
         {
-            // jump if not equal to zero
-            if (!GetRegisterFlag(processor, RegisterFlag_ZF))
+            if (EvaluateJumpCondition(processor, instruction->OpType))
             {
                 instruction_operand operand0 = instruction->Operands[0];
                 S8 offset = (S8)(operand0.Immediate.Value & 0xff);
@@ -1353,21 +2983,41 @@ global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *
             break;
         }
 
-        case Op_loop:
+        case Op_movs:
+        case Op_cmps:
+        case Op_scas:
+        case Op_lods:
+        case Op_stos:
         {
-            // decrement CX register by 1
-            U16 cx = GetRegisterValue(processor, Reg_cx);
-            --cx;
-            SetRegisterValue(processor, Reg_cx, cx);
+            U16 oldRegisters[ArrayCount(processor->Registers)];
+            MemoryCopy(oldRegisters, processor->Registers, sizeof(oldRegisters));
 
-            // jump if CX not equal to zero
-            if (cx != 0)
-            {
-                instruction_operand operand0 = instruction->Operands[0];
-                S8 offset = (S8)(operand0.Immediate.Value & 0xff);
+            repetitionClockCount = ExecuteStringInstruction(processor, instruction);
 
-                processor->IP += offset;
+            if (traceFull)
+            {
+                register_id tracedRegisters[] = { Reg_ax, Reg_cx, Reg_si, Reg_di };
+                for (int i = 0; i < ArrayCount(tracedRegisters); ++i)
+                {
+                    U8 registerIndex = RegisterLookup[tracedRegisters[i]].RegisterIndex;
+                    if (oldRegisters[registerIndex] != processor->Registers[registerIndex])
+                    {
+                        ArenaPushCStringf(outputArena, FALSE,
+                                          (char *)" %s:0x%x->0x%x",
+                                          GetRegisterMnemonic(tracedRegisters[i]),
+                                          oldRegisters[registerIndex],
+                                          processor->Registers[registerIndex]);
+                    }
+                }
             }
+
+            break;
+        }
+
+        case Op_cld:
+        case Op_std:
+        {
+            SetRegisterFlag(processor, RegisterFlag_DF, instruction->OpType == Op_std);
             break;
         }
 
@@ -1379,12 +3029,48 @@ global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *
 
         default:
         {
-            ArenaPushCStringf(outputArena, FALSE, (char *)"unsupported instruction");
+            if (instruction->Address + instruction->Bits.ByteCount > processor->ProgramSize)
+            {
+                RaiseProcessorFault(processor, Fault_InstructionStream, instruction->Address);
+            }
+
+            if (traceFull)
+            {
+                ArenaPushCStringf(outputArena, FALSE, (char *)"unsupported instruction");
+            }
         }
     }
 
-    ArenaPushCStringf(outputArena, FALSE, (char *)" ip:0x%x->0x%x", processor->PrevIP, processor->IP);
-    PrintFlagDiffs(oldFlags, processor->Flags, outputArena);
+    U32 clockCount = instruction->ClockCount + instruction->EAClockCount + repetitionClockCount;
+    if (processor->BusTiming)
+    {
+        clockCount += UpdateBusTiming(processor->BusTiming, instruction, dataAddress, processor->IP);
+    }
+
+    processor->TotalClockCount += clockCount;
+
+    if (processor->Profile)
+    {
+        RecordExecutionProfile(processor->Profile, instruction, clockCount, processor->IP);
+    }
+
+    if (processor->Trace)
+    {
+        RecordTraceInstruction(processor->Trace, processor, clockCount);
+    }
+
+    // Note (Aaron): Headless runs skip formatting entirely
+    if (traceLevel == TraceLevel_None)
+    {
+        return String8(0, 0);
+    }
+
+    if (traceFull)
+    {
+        ArenaPushCStringf(outputArena, FALSE, (char *)" ip:0x%x->0x%x", processor->PrevIP, processor->IP);
+    }
+
+    PrintFlagDiffs(oldFlags, GetProcessorFlags(processor), outputArena);
 
     // Note (Aaron): Append the null-terminator character
     ArenaPushSizeZero(outputArena, 1);
@@ -1392,8 +3078,6 @@ global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *
     U64 outputLength = outputArena->PositionPtr - outputStartPtr;
     Str8 result = String8(outputStartPtr, outputLength);
 
-    processor->TotalClockCount += (instruction->ClockCount + instruction->EAClockCount);
-
     return result;
 }
 
@@ -1405,13 +3089,40 @@ global_function void ResetProcessorExecution(processor_8086 *processor)
     processor->PrevIP = 0;
     MemorySet(&processor->Registers, 0, sizeof(processor->Registers));
     processor->Flags = 0;
+    processor->LazyFlags = {};
     processor->InstructionCount = 0;
     processor->TotalClockCount = 0;
+    ClearProcessorFault(processor);
+}
+
+
+// Note (Aaron): Copies everything a program can observe, including all of memory, so that both processors
+// continue identically. The optional parts (instruction cache, breakpoints...) are left as they are.
+global_function void CopyProcessorState(processor_8086 *dest, processor_8086 *source)
+{
+    assert_8086(dest->MemorySize == source->MemorySize);
+
+    MemoryCopy(dest->Registers, source->Registers, sizeof(dest->Registers));
+    dest->Flags = source->Flags;
+    dest->LazyFlags = source->LazyFlags;
+    dest->IP = source->IP;
+    dest->PrevIP = source->PrevIP;
+    dest->ProgramSize = source->ProgramSize;
+    dest->InstructionCount = source->InstructionCount;
+    dest->TotalClockCount = source->TotalClockCount;
+    dest->Fault = source->Fault;
+    dest->FaultAddress = source->FaultAddress;
+    MemoryCopy(dest->Memory, source->Memory, source->MemorySize);
+
+    if (dest->InstructionCache)
+    {
+        ClearInstructionCache(dest->InstructionCache);
+    }
 }
 
 
 global_function B32 HasProcessorFinishedExecution(processor_8086 *processor)
 {
-    B32 result = processor->IP >= processor->ProgramSize;
+    B32 result = (processor->IP >= processor->ProgramSize) || (processor->Fault != Fault_None);
     return result;
 }
@@ -6,6 +6,7 @@
 #define SIM8086_H
 
 #include <assert.h>
+#include <stdio.h>
 
 #include "base.h"
 #include "base_types.h"
@@ -59,14 +60,23 @@ struct register_info
 };
 
 
+struct instruction_cache;
+struct snapshot_history;
+struct bus_timing;
+struct execution_profile;
+struct breakpoint_set;
+struct trace_recorder;
+
+
 // Flags:
-// OF | SF | ZF | AF | PF | CF
+// DF | OF | SF | ZF | AF | PF | CF
 //     CF - Carry flag
 //     PF - Parity flag
 //     AF - Auxiliary Carry flag
 //     ZF - Zero flag
 //     SF - Sign flag
 //     OF - Overflow flag
+//     DF - Direction flag
 enum register_flags : U8
 {
     RegisterFlag_CF = 0x1,
@@ -75,6 +85,65 @@ enum register_flags : U8
     RegisterFlag_ZF = 0x8,          // Did an arithmetic operation produce a value of 0?
     RegisterFlag_SF = 0x10,         // Did an arithmetic operation produce a negative value?
     RegisterFlag_OF = 0x20,
+    RegisterFlag_DF = 0x40,         // Do string instructions step SI and DI down rather than up?
+};
+
+
+// Note (Aaron): Flags written by arithmetic instructions. These are evaluated lazily (see lazy_flags).
+#define ARITHMETIC_FLAGS_MASK (RegisterFlag_CF | RegisterFlag_PF | RegisterFlag_AF | RegisterFlag_ZF | RegisterFlag_SF | RegisterFlag_OF)
+
+
+// Note (Aaron): The arithmetic operation that last wrote the flags
+enum lazy_flags_op : U8
+{
+    LazyFlags_None,                 // processor_8086::Flags is up to date
+    LazyFlags_Add,
+    LazyFlags_Sub,                  // sub and cmp
+};
+
+
+// Note (Aaron): Arithmetic instructions record their operands and result instead of computing flags.
+// Flags are only derived from these when something reads them (e.g. conditional jumps or tracing).
+// Operands and result are masked to the width of the operation.
+struct lazy_flags
+{
+    U16 Operand0;
+    U16 Operand1;
+    U16 Result;
+    lazy_flags_op Op;
+    B8 IsWide;
+};
+
+
+// Note (Aaron): Controls how much of an instruction's effect ExecuteInstruction() formats into its output
+enum trace_level
+{
+    TraceLevel_None,                // No output is formatted; the output arena may be null
+    TraceLevel_Flags,               // Only flag changes are formatted
+    TraceLevel_Full,                // Register changes, instruction pointer, and flag changes are formatted
+};
+
+
+// Note (Aaron): Simulated memory is reserved with this many bytes of inaccessible pages on either side of it.
+// Effective addresses are a 16-bit base plus a signed 16-bit displacement, so every address an instruction can
+// form that falls outside of memory lands in one of them.
+#define PROCESSOR_GUARD_SIZE Kilobytes(64)
+
+// Note (Aaron): Most processors that can have guarded memory at once. Callers that allocate one per thread
+// should check GetFreeGuardedProcessorCount() first.
+#define MAX_GUARDED_PROCESSORS 256
+
+// Note (Aaron): Granularity of processor_8086::DirtyPages
+#define DIRTY_PAGE_SHIFT 12
+#define DIRTY_PAGE_SIZE (1 << DIRTY_PAGE_SHIFT)
+
+
+// Note (Aaron): Why the processor stopped with an error
+enum processor_fault : U8
+{
+    Fault_None,
+    Fault_MemoryAccess,             // An instruction accessed memory outside of MemorySize
+    Fault_InstructionStream,        // An instruction ran past the end of the program
 };
 
 
@@ -95,7 +164,8 @@ struct processor_8086
             U16 RegisterDI;
         };
     };
-    U8 Flags = 0;            // Note (Aaron): Register flags
+    U8 Flags = 0;            // Note (Aaron): Register flags, read them through GetProcessorFlags()
+    lazy_flags LazyFlags = {};  // Note (Aaron): Pending arithmetic flags, Flags is stale until they are evaluated
     U32 IP = 0;              // Note (Aaron): Instruction pointer
     U32 PrevIP = 0;          // Note (Aaron): Previous instruction pointer
 
@@ -112,6 +182,34 @@ struct processor_8086
 
     // Note (Aaron): Number of clock cycles used by the loaded program
     U32 TotalClockCount = 0;
+
+    // Note (Aaron): Optional cache of decoded instructions. Decoding consults it when present.
+    instruction_cache *InstructionCache = 0;
+
+    // Note (Aaron): Optional snapshot history. Memory writes copy the pages they touch into it when present.
+    snapshot_history *SnapshotHistory = 0;
+
+    // Note (Aaron): Optional bus interface model. Clocks include prefetch and bus penalties when present.
+    bus_timing *BusTiming = 0;
+
+    // Note (Aaron): Optional execution profile. Executed instructions are recorded into it when present.
+    execution_profile *Profile = 0;
+
+    // Note (Aaron): Optional breakpoints and watchpoints. Execution stops at them when present.
+    breakpoint_set *Breakpoints = 0;
+
+    // Note (Aaron): Optional trace recorder. Executed instructions and the changes they make are recorded into it
+    // when present.
+    trace_recorder *Trace = 0;
+
+    // Note (Aaron): Optional bit per DIRTY_PAGE_SIZE page of memory. Memory writes set the bits of the pages they
+    // touch when present, except for those the JIT makes from its generated code.
+    U64 *DirtyPages = 0;
+
+    // Note (Aaron): Execution stops once a fault is raised, until ResetProcessorExecution() clears it.
+    // FaultAddress is the memory address accessed, or the address of the instruction that ran over.
+    processor_fault Fault = Fault_None;
+    U32 FaultAddress = 0;
 };
 
 
@@ -143,6 +241,13 @@ enum operation_types
     Op_loopz,
     Op_loopnz,
     Op_jcxz,
+    Op_movs,
+    Op_cmps,
+    Op_scas,
+    Op_lods,
+    Op_stos,
+    Op_cld,
+    Op_std,
     Op_unknown,
     Op_ret,
 
@@ -224,6 +329,16 @@ struct instruction_bits
 };
 
 
+// Note (Aaron): Repeat prefixes of string instructions. The same prefix byte is rep for movs, lods and stos,
+// and repe for cmps and scas.
+enum rep_prefix : U8
+{
+    Rep_None,
+    Rep_RepE,                       // 0xf3: repeat while CX != 0 (and ZF = 1 for cmps / scas)
+    Rep_RepNE,                      // 0xf2: repeat while CX != 0 (and ZF = 0 for cmps / scas)
+};
+
+
 struct instruction
 {
     U32 Address;
@@ -238,27 +353,294 @@ struct instruction
     U8 RegBits = 0;
     U8 RmBits = 0;
     U8 SignBit = 0;
+    U8 RepPrefix = Rep_None;
 
     U8 ClockCount = 0;
     U8 EAClockCount = 0;
+};
+
+
+// Note (Aaron): 8086 instructions are at most 6 bytes long
+#define MAX_INSTRUCTION_SIZE 6
+
+
+// Note (Aaron): An instruction_operand packed into 4 bytes
+struct packed_operand
+{
+    U8 Kind;                        // operand_types in the low 2 bits, the memory or immediate flags above them
+    U8 Register;                    // register_id, or the base register of a memory operand
+    U16 Value;                      // Immediate value, displacement or direct address
+};
+
+
+// Note (Aaron): The compact form decoded instructions are stored in, so that the instruction cache and the
+// GUI's disassembly hold 5 times as many instructions in the same memory and a loop's instructions share a
+// few cache lines. Only what executing and printing an instruction needs is kept. The instruction bytes are
+// read back from the memory the instruction was decoded from, and mnemonics are formatted when they're shown.
+// The fields only used while decoding (direction, sign, mod, reg and r/m bits) aren't kept.
+struct packed_instruction
+{
+    U32 Address;
+    U8 OpType;                      // operation_types
+    U8 ByteCount : 3;
+    U8 WidthBit : 1;
+    U8 RepPrefix : 2;               // rep_prefix
+    U8 ClockCount;
+    U8 EAClockCount;
+    packed_operand Operands[2];
+};
+
+static_assert_8086(sizeof(packed_instruction) == 16, "packed_instruction should fit 4 to a cache line");
+
+
+// Note (Aaron): Decoded instructions indexed by the address they were decoded from. Lets loops
+// skip re-parsing their instruction bytes every time they are executed.
+struct instruction_cache
+{
+    // Note (Aaron): One entry per memory address; index into Instructions offset by 1, 0 if nothing is cached
+    U32 *Slots;
+    U32 SlotCount;
+
+    packed_instruction *Instructions;
+    U32 InstructionCount;
+    U32 InstructionCapacity;
+
+    // Note (Aaron): Range of memory occupied by cached instructions, used to skip invalidation for data writes
+    U32 LowAddress;
+    U32 HighAddress;
 
-    Str8 InstructionMnemonic;
-    Str8 BitsMnemonic;
+    // Note (Aaron): Incremented whenever cached instructions are dropped. Lets anything built on top of
+    // the cache (e.g. the threaded engine) notice that it needs to be rebuilt.
+    U32 InvalidationCount;
+};
+
+
+// Note (Aaron): Memory is copied into snapshots in pages of this size
+#define SNAPSHOT_PAGE_SHIFT 10
+#define SNAPSHOT_PAGE_SIZE (1 << SNAPSHOT_PAGE_SHIFT)
+
+
+// Note (Aaron): Processor state at a point in execution. Memory isn't copied when the snapshot is taken.
+// Instead each page is copied the first time it's written afterwards, so a snapshot only holds the
+// pages that changed before the next one was taken.
+struct processor_snapshot
+{
+    U16 Registers[8];
+    U8 Flags;
+    lazy_flags LazyFlags;
+    U32 IP;
+    U32 PrevIP;
+    U32 InstructionCount;
+    U32 TotalClockCount;
+
+    // Note (Aaron): Pages of memory as they were when the snapshot was taken, a range of snapshot_history's page slots
+    U32 FirstPageSlot;
+    U32 PageCount;
+};
+
+
+// Note (Aaron): Snapshots taken every Interval instructions, and the memory pages they saved. Both are
+// ring buffers; the oldest snapshots are dropped to make room for new ones.
+struct snapshot_history
+{
+    processor_snapshot *Snapshots;
+    U32 SnapshotCapacity;
+    U32 FirstSnapshot;
+    U32 SnapshotCount;
+
+    U32 *PageAddresses;
+    U8 *PageData;
+    U32 PageSlotCapacity;
+    U32 FirstPageSlot;
+    U32 PageSlotCount;
+
+    // Note (Aaron): Bit per page of memory, set once the page has been copied into the newest snapshot
+    U64 *CapturedPages;
+    U32 MemoryPageCount;
+
+    U32 Interval;
+};
+
+
+enum bus_timing_model
+{
+    BusTiming_8086,                 // 16-bit bus, 6 byte prefetch queue
+    BusTiming_8088,                 // 8-bit bus, 4 byte prefetch queue
+};
+
+
+// Note (Aaron): Models the bus interface unit, which prefetches instruction bytes into a queue whenever
+// the bus isn't busy moving data. Instructions wait for bytes that haven't been fetched yet, words at
+// odd addresses (or any word on the 8088) take two bus cycles, and taken jumps flush the queue.
+// Bus cycles are modelled as taking 4 clocks with no wait states.
+struct bus_timing
+{
+    bus_timing_model Model;
+    U32 QueueSize;
+    U32 QueueBytes;                 // Bytes of the upcoming instructions already in the queue
+    U32 FetchAddress;               // Address of the next prefetch
+    U32 IdleClocks;                 // Clocks spent on a prefetch that hasn't completed yet
+
+    // Note (Aaron): Clocks the last instruction took on top of its base and effective address clocks
+    U32 StallClockCount;            // Waiting for instruction bytes
+    U32 PenaltyClockCount;          // Extra bus cycles for unaligned or 8-bit bus word transfers
+    U32 JumpClockCount;             // Jumps, which have no base clocks
+};
+
+
+// Note (Aaron): Processor dumps store memory in pages of this size, skipping pages that are all zero
+#define PROCESSOR_DUMP_PAGE_SIZE Kilobytes(4)
+#define PROCESSOR_DUMP_VERSION 1
+
+
+// Note (Aaron): Start of a processor dump file. Followed by PageCount U32 page indices in ascending
+// order, then the pages themselves in the same order.
+struct processor_dump_header
+{
+    U8 Signature[8];
+    U32 Version;
+    U16 Registers[8];
+    U8 Flags;
+    U32 IP;
+    U32 ProgramSize;
+    U32 MemorySize;
+    U32 InstructionCount;
+    U32 TotalClockCount;
+    U32 PageCount;
+};
+
+
+// Note (Aaron): Where a simulated program spends its time. Per address arrays are indexed by instruction
+// address so that recording an instruction is a few increments.
+struct execution_profile
+{
+    U32 AddressCount;
+    U32 *ExecutionCounts;
+    U32 *ClockCounts;
+    U32 *TakenCounts;               // Conditional jumps only
+    U32 *NotTakenCounts;
+
+    U64 OpExecutionCounts[Op_count];
+    U64 OpClockCounts[Op_count];
+
+    U64 TotalInstructionCount;
+    U64 TotalClockCount;
+};
+
+
+// Note (Aaron): Watchpoints are found through flags per page of memory, so that accesses to other pages
+// only cost a lookup
+#define WATCH_PAGE_SHIFT 8
+#define MAX_WATCHPOINTS 16
+
+
+enum watch_access : U8
+{
+    WatchAccess_Read = 0x1,
+    WatchAccess_Write = 0x2,
+};
+
+
+struct watchpoint
+{
+    U32 Address;
+    U32 Size;
+    U8 Access;                      // watch_access flags
+};
+
+
+enum stop_reason
+{
+    StopReason_None,
+    StopReason_Breakpoint,          // IP is at a breakpoint that hasn't executed yet
+    StopReason_Watchpoint,          // The instruction at PrevIP accessed a watched address
+};
+
+
+// Note (Aaron): Breakpoints are a bit per address, checked between instructions (or between blocks, which
+// end early at breakpoints). Watchpoints are checked by GetMemory() / SetMemory() once their page is flagged.
+// The flags of a watchpoint's pages also cover the byte before it, so that a word access only needs the
+// page of its first byte checked.
+struct breakpoint_set
+{
+    U64 *AddressBits;
+    U32 AddressCount;
+    U32 BreakpointCount;
+
+    U8 *WatchPageFlags;
+    U32 WatchPageCount;
+    watchpoint Watchpoints[MAX_WATCHPOINTS];
+    U32 WatchpointCount;
+
+    // Note (Aaron): Incremented whenever breakpoints or watchpoints change. Lets the threaded engine and JIT
+    // notice that their blocks need to be rebuilt.
+    U32 Generation;
+
+    // Note (Aaron): Why execution last stopped. Cleared whenever execution starts.
+    stop_reason StopReason;
+    U32 StopAddress;                // The breakpoint, or the watched address that was accessed
+    U16 StopValue;                  // The value read or written
+    U8 StopAccess;
 };
 
 
 global_function B32 DumpMemoryToFile(processor_8086 *processor, const char *filename);
+global_function B32 WriteProcessorDump(processor_8086 *processor, FILE *file);
+global_function B32 DumpProcessorToFile(processor_8086 *processor, const char *filename);
+global_function B32 IsProcessorDumpFile(const char *filename);
+global_function B32 LoadProcessorFromDump(processor_8086 *processor, U8 const *data, U64 size, U64 *dumpSize);
+global_function B32 LoadProcessorFromFile(processor_8086 *processor, const char *filename);
 global_function void ReadInstructionStream(processor_8086 *processor, instruction *instruction, U8 byteCount);
 global_function void ParseRmBits(processor_8086 *processor, instruction *instruction, instruction_operand *operand);
 global_function U8 CalculateEffectiveAddressClocks(instruction_operand *operand);
+global_function B32 InitializeInstructionCache(instruction_cache *cache, memory_arena *arena, U32 memorySize);
+global_function void ClearInstructionCache(instruction_cache *cache);
+global_function void InvalidateInstructionCache(instruction_cache *cache, U32 address, U32 byteCount);
+global_function void CacheInstruction(instruction_cache *cache, packed_instruction *packed);
+global_function packed_instruction PackInstruction(instruction *instruction);
+global_function instruction UnpackInstruction(packed_instruction *packed, processor_8086 *processor = 0);
+global_function B32 InitializeSnapshotHistory(snapshot_history *history, memory_arena *arena, U32 memorySize, U32 interval);
+global_function void ClearSnapshotHistory(snapshot_history *history);
+global_function void TakeSnapshot(snapshot_history *history, processor_8086 *processor);
+global_function void UpdateSnapshots(snapshot_history *history, processor_8086 *processor);
+global_function B32 RestoreSnapshot(snapshot_history *history, processor_8086 *processor, U32 instructionCount);
+global_function void InitializeBusTiming(bus_timing *timing, bus_timing_model model);
+global_function void ResetBusTiming(bus_timing *timing, U32 address);
+global_function B32 InitializeExecutionProfile(execution_profile *profile, memory_arena *arena, U32 addressCount);
+global_function void ClearExecutionProfile(execution_profile *profile);
+global_function B32 InitializeBreakpoints(breakpoint_set *breakpoints, memory_arena *arena, U32 memorySize);
+global_function void ClearBreakpoints(breakpoint_set *breakpoints);
+global_function void SetBreakpoint(breakpoint_set *breakpoints, U32 address, B32 enabled);
+global_function B32 HasBreakpoint(breakpoint_set *breakpoints, U32 address);
+global_function B32 AddWatchpoint(breakpoint_set *breakpoints, U32 address, U32 size, U8 access);
+global_function void RemoveWatchpoint(breakpoint_set *breakpoints, U32 index);
+global_function void CheckWatchpoints(breakpoint_set *breakpoints, U32 address, U32 byteCount, U8 access, U16 value);
+global_function B32 ResumeExecution(breakpoint_set *breakpoints, U32 ip);
+global_function B32 ShouldStopExecution(breakpoint_set *breakpoints, U32 ip, B32 ignoreBreakpoint);
+global_function instruction FetchInstruction(processor_8086 *processor, U32 address);
 global_function instruction DecodeNextInstruction(processor_8086 *processor);
-global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *instruction, memory_arena *outputArena);
+global_function Str8 ExecuteInstruction(processor_8086 *processor, instruction *instruction, memory_arena *outputArena, trace_level traceLevel = TraceLevel_Full);
 
 global_function U16 GetMemory(processor_8086 *processor, U32 effectiveAddress, B32 wide);
 global_function U16 GetRegisterValue(processor_8086 *processor, register_id targetRegister);
 global_function U8 GetRegisterFlag(processor_8086 *processor, register_flags flag);
+global_function U8 GetProcessorFlags(processor_8086 *processor);
+global_function void SetLazyFlags(processor_8086 *processor, lazy_flags_op op, B32 wide, U16 operand0, U16 operand1, U16 result);
+global_function B32 EvaluateJumpCondition(processor_8086 *processor, operation_types opType);
+global_function B32 IsStringOperation(operation_types opType);
+global_function U32 GetStringClocks(operation_types opType, B32 repeated);
+
+global_function B32 AllocateProcessorMemory(processor_8086 *processor);
+global_function void FreeProcessorMemory(processor_8086 *processor);
+global_function void RaiseProcessorFault(processor_8086 *processor, processor_fault fault, U32 address);
+global_function void ClearProcessorFault(processor_8086 *processor);
+global_function char const *GetProcessorFaultName(processor_fault fault);
+
+global_function U32 GetFreeGuardedProcessorCount(void);
+global_function void MarkDirtyPages(U64 *dirtyPages, U32 address, U32 byteCount, U32 memorySize);
 
 global_function B32 HasProcessorFinishedExecution(processor_8086 *processor);
 global_function void ResetProcessorExecution(processor_8086 *processor);
+global_function void CopyProcessorState(processor_8086 *dest, processor_8086 *source);
 
 #endif //SIM8086_H
@@ -11,17 +11,29 @@
 #include "sim8086_platform.h"
 #include "sim8086.h"
 #include "sim8086_mnemonics.h"
+#include "sim8086_disassembly.h"
+#include "sim8086_channel.h"
+#include "sim8086_simulation.h"
 #include "sim8086_gui.h"
 
 #include "base_types.c"
 #include "base_memory.c"
+#include "base_arena.c"
 #include "base_string.c"
+#include "base_threads.c"
 #include "sim8086.cpp"
 #include "sim8086_mnemonics.cpp"
+#include "sim8086_trace.cpp"
+#include "sim8086_disassembly.cpp"
+#include "sim8086_channel.cpp"
+#include "sim8086_simulation.cpp"
 #include "sim8086_gui.cpp"
 
 
-#define HALT_GUARD_COUNT 100000
+#define SNAPSHOT_INTERVAL 1000
+
+// Note (Aaron): How often the instructions per second readout is updated
+#define SIMULATION_RATE_INTERVAL 0.5
 
 
 // Note (Aaron): Push output string into a memory arena that behaves like a circular buffer
@@ -117,6 +129,37 @@ global_function void PushOutputToArena(memory_arena *arena, Str8List *outputList
 }
 
 
+// Note (Aaron): Drains what the simulation thread has sent into the output list and the state shown by the GUI.
+// Stops after a channel's worth of messages so that a fast simulation can't hold up the frame.
+static void ReceiveSimulationMessages(application_state *applicationState, application_memory *memory)
+{
+    message_channel *channel = &applicationState->Simulation.Channel;
+    U64 receivedSize = 0;
+
+    channel_message_header header;
+    U8 buffer[SIMULATION_MAX_MESSAGE_SIZE];
+    while (receivedSize < channel->Size && ReadChannelMessage(channel, &header, buffer, sizeof(buffer)))
+    {
+        receivedSize += sizeof(header) + header.Size;
+
+        switch (header.Type)
+        {
+            case SimulationMessage_Output:
+            {
+                PushOutputToArena(&memory->Output.Arena, &applicationState->OutputList, String8(buffer, header.Size));
+                break;
+            }
+
+            case SimulationMessage_State:
+            {
+                MemoryCopy(&applicationState->SimulationState, buffer, sizeof(simulation_state));
+                break;
+            }
+        }
+    }
+}
+
+
 C_LINKAGE SET_IMGUI_CONTEXT(SetImGuiContext)
 {
     ImGui::SetCurrentContext(context);
@@ -138,7 +181,7 @@ C_LINKAGE UPDATE_AND_RENDER(UpdateAndRender)
         }
 
         // load program into 8086
-        processor->ProgramSize = (U16)fread(processor->Memory, 1, processor->MemorySize, file);
+        processor->ProgramSize = (U32)fread(processor->Memory, 1, processor->MemorySize, file);
 
         // error handling for file read
         if (ferror(file))
@@ -158,16 +201,24 @@ C_LINKAGE UPDATE_AND_RENDER(UpdateAndRender)
         fclose(file);
 
         // generate instructions from loaded program
+        // Note (Aaron): Mnemonics are formatted by the disassembly window for the lines it shows
         ArenaClearZero(&memory->Instructions.Arena);
-        ArenaClearZero(&memory->InstructionStrings.Arena);
+
+        // Note (Aaron): Decoding the program for display also primes the instruction cache for execution
+        if (InitializeInstructionCache(&applicationState->InstructionCache, &memory->InstructionCache.Arena, processor->MemorySize))
+        {
+            processor->InstructionCache = &applicationState->InstructionCache;
+        }
+
+        // Note (Aaron): Most of a large program is decoded on every core, the rest one instruction at a time
+        U32 decodedCount = 0;
+        DecodeProgramInParallel(processor, &memory->Instructions.Arena, GetLogicalCoreCount(), &decodedCount);
 
         while (processor->IP < processor->ProgramSize)
         {
             instruction nextInstruction = DecodeNextInstruction(processor);
-            instruction *nextInstructionPtr = ArenaPushStruct(&memory->Instructions.Arena, instruction);
-            nextInstruction.InstructionMnemonic = GetInstructionMnemonic(&nextInstruction, &memory->InstructionStrings.Arena);
-            nextInstruction.BitsMnemonic = GetInstructionBitsMnemonic(&nextInstruction, &memory->InstructionStrings.Arena);
-            MemoryCopy(nextInstructionPtr, &nextInstruction, sizeof(instruction));
+            packed_instruction *nextInstructionPtr = ArenaPushStruct(&memory->Instructions.Arena, packed_instruction);
+            *nextInstructionPtr = PackInstruction(&nextInstruction);
         }
 
         applicationState->LoadedProgramInstructionCount = processor->InstructionCount;
@@ -176,54 +227,223 @@ C_LINKAGE UPDATE_AND_RENDER(UpdateAndRender)
         // Reset processor state to prepare for simulated execution
         ResetProcessorExecution(processor);
         applicationState->ProgramLoaded = TRUE;
+
+        // Note (Aaron): Executed instructions are profiled for the disassembly window's heat overlay
+        if (InitializeExecutionProfile(&applicationState->Profile, &memory->Profile.Arena, processor->ProgramSize))
+        {
+            processor->Profile = &applicationState->Profile;
+        }
+
+        // Note (Aaron): Execution can be stepped backwards when snapshots are available
+        if (InitializeSnapshotHistory(&applicationState->SnapshotHistory, &memory->Snapshots.Arena, processor->MemorySize, SNAPSHOT_INTERVAL))
+        {
+            processor->SnapshotHistory = &applicationState->SnapshotHistory;
+            TakeSnapshot(processor->SnapshotHistory, processor);
+        }
+
+        // Note (Aaron): F9 toggles breakpoints in the disassembly window, watchpoints are set in the memory window
+        if (InitializeBreakpoints(&applicationState->Breakpoints, &memory->Breakpoints.Arena, processor->MemorySize))
+        {
+            processor->Breakpoints = &applicationState->Breakpoints;
+        }
+        applicationState->Watch_Size = 1;
+        applicationState->Watch_Write = true;
+
+        ArenaClear(&memory->Simulation.Arena);
+        if (!InitializeSimulationWorker(&applicationState->Simulation, &memory->Simulation.Arena, Megabytes(1), Kilobytes(64)))
+        {
+            fprintf(stderr, "Unable to allocate the simulation thread's memory\n");
+            applicationState->LoadFailure = TRUE;
+            return;
+        }
+    }
+
+    // receive output from the simulation thread
+    simulation_worker *simulation = &applicationState->Simulation;
+    if (simulation->IsRunning)
+    {
+        // Note (Aaron): Checked first, so that everything the thread sent before stopping gets received below
+        B32 stopped = HasSimulationStopped(simulation);
+        ReceiveSimulationMessages(applicationState, memory);
+
+        F64 time = ImGui::GetTime();
+        F64 elapsed = time - applicationState->Simulation_RateTime;
+        if (elapsed >= SIMULATION_RATE_INTERVAL)
+        {
+            U32 instructionCount = applicationState->SimulationState.InstructionCount;
+            applicationState->Simulation_InstructionsPerSecond = (F64)(instructionCount - applicationState->Simulation_RateInstructionCount) / elapsed;
+            applicationState->Simulation_RateInstructionCount = instructionCount;
+            applicationState->Simulation_RateTime = time;
+        }
+
+        if (stopped)
+        {
+            JoinSimulation(simulation);
+            applicationState->Simulation_InstructionsPerSecond = 0;
+        }
+    }
+    else
+    {
+        ReceiveSimulationMessages(applicationState, memory);
     }
 
     // handle input
     if (ImGui::IsKeyPressed(ImGuiKey_F5))
     {
-        // execute entire program
-        U32 safetyCounter = 0;
-        applicationState->Diagnostics_ExecutionStalled = false;
-
-        while(!HasProcessorFinishedExecution(processor))
+        // run (or continue) the program on the simulation thread
+        if (!simulation->IsRunning && !HasProcessorFinishedExecution(processor))
         {
-            instruction inst = DecodeNextInstruction(processor);
-            Str8 output = ExecuteInstruction(processor, &inst, &memory->Scratch.Arena);
-            PushOutputToArena(&memory->Output.Arena, &applicationState->OutputList, output);
-            ArenaClear(&memory->Scratch.Arena);
+            GetSimulationState(processor, &applicationState->SimulationState);
+            applicationState->Simulation_RateTime = ImGui::GetTime();
+            applicationState->Simulation_RateInstructionCount = processor->InstructionCount;
+            applicationState->Simulation_InstructionsPerSecond = 0;
 
-            // TODO (Aaron): How to better handle programs that do not halt?
-            safetyCounter++;
-            if (safetyCounter > HALT_GUARD_COUNT)
+            if (!StartSimulation(simulation, processor))
             {
-                applicationState->Diagnostics_ExecutionStalled = true;
-                break;
+                PushOutputToArena(&memory->Output.Arena, &applicationState->OutputList, STR8_LIT("unable to start the simulation thread"));
             }
         }
     }
+    else if (ImGui::IsKeyPressed(ImGuiKey_F6))
+    {
+        // pause the program
+        StopSimulation(simulation);
+        applicationState->Simulation_InstructionsPerSecond = 0;
+    }
     // TODO (Aaron): Change this to shift + F5?
     // else if(ImGui::IsKeyPressed(ImGuiKey_F5) && ImGui::IsKeyDown(ImGuiKey_ModShift))
     else if(ImGui::IsKeyPressed(ImGuiKey_F8))
     {
         // reset program
-        ResetProcessorExecution(processor);
-        applicationState->Diagnostics_ExecutionStalled = false;
+        StopSimulation(simulation);
+        ResetChannel(&simulation->Channel);
+        applicationState->Simulation_InstructionsPerSecond = 0;
+
+        // Note (Aaron): Restoring the first snapshot also undoes writes to memory, when it is still held
+        if (!processor->SnapshotHistory || !RestoreSnapshot(processor->SnapshotHistory, processor, 0))
+        {
+            ResetProcessorExecution(processor);
+            if (processor->SnapshotHistory)
+            {
+                ClearSnapshotHistory(processor->SnapshotHistory);
+                TakeSnapshot(processor->SnapshotHistory, processor);
+            }
+        }
+
+        if (processor->Breakpoints)
+        {
+            processor->Breakpoints->StopReason = StopReason_None;
+        }
+
         applicationState->OutputList = {0};
+        if (processor->Profile)
+        {
+            ClearExecutionProfile(processor->Profile);
+        }
+
         ArenaClearZero(&memory->Output.Arena);
     }
+    else if (ImGui::IsKeyPressed(ImGuiKey_F10) && ImGui::GetIO().KeyShift)
+    {
+        // step back a single instruction
+        // Note (Aaron): Restores the nearest snapshot and silently re-executes up to the previous instruction
+        if (!simulation->IsRunning && processor->SnapshotHistory && processor->InstructionCount > 0)
+        {
+            U32 targetCount = processor->InstructionCount - 1;
+            if (RestoreSnapshot(processor->SnapshotHistory, processor, targetCount))
+            {
+                // Note (Aaron): Re-executed instructions were already profiled (and stopped at) the first time through
+                execution_profile *profile = processor->Profile;
+                breakpoint_set *breakpoints = processor->Breakpoints;
+                processor->Profile = 0;
+                processor->Breakpoints = 0;
+                while (processor->InstructionCount < targetCount)
+                {
+                    UpdateSnapshots(processor->SnapshotHistory, processor);
+                    instruction inst = DecodeNextInstruction(processor);
+                    ExecuteInstruction(processor, &inst, 0, TraceLevel_None);
+                }
+                processor->Profile = profile;
+                processor->Breakpoints = breakpoints;
+
+                Str8 output = ArenaPushStr8f(&memory->Scratch.Arena, (char *)"rewound to instruction %" PRIu32, targetCount);
+                PushOutputToArena(&memory->Output.Arena, &applicationState->OutputList, output);
+                ArenaClear(&memory->Scratch.Arena);
+            }
+        }
+    }
     else if (ImGui::IsKeyPressed(ImGuiKey_F10))
     {
         // execute single instruction
-        if (!HasProcessorFinishedExecution(processor))
+        if (!simulation->IsRunning && !HasProcessorFinishedExecution(processor))
         {
+            if (processor->SnapshotHistory)
+            {
+                UpdateSnapshots(processor->SnapshotHistory, processor);
+            }
+
+            // Note (Aaron): Stepping doesn't stop at breakpoints, but still reports watchpoints
+            if (processor->Breakpoints)
+            {
+                ResumeExecution(processor->Breakpoints, processor->IP);
+            }
+
             instruction inst = DecodeNextInstruction(processor);
             Str8 output = ExecuteInstruction(processor, &inst, &memory->Scratch.Arena);
             PushOutputToArena(&memory->Output.Arena, &applicationState->OutputList, output);
+
+            if (processor->Breakpoints && processor->Breakpoints->StopReason == StopReason_Watchpoint)
+            {
+                breakpoint_set *breakpoints = processor->Breakpoints;
+                B32 isWrite = (breakpoints->StopAccess == WatchAccess_Write);
+                Str8 message = ArenaPushStr8f(&memory->Scratch.Arena, (char *)"watchpoint: %s 0x%x %s [0x%x]",
+                                              isWrite ? "write of" : "read of",
+                                              breakpoints->StopValue,
+                                              isWrite ? "to" : "from",
+                                              breakpoints->StopAddress);
+                PushOutputToArena(&memory->Output.Arena, &applicationState->OutputList, message);
+            }
+
+            if (processor->Fault != Fault_None)
+            {
+                Str8 message = ArenaPushStr8f(&memory->Scratch.Arena, (char *)"fault: %s [0x%x]",
+                                              GetProcessorFaultName(processor->Fault),
+                                              processor->FaultAddress);
+                PushOutputToArena(&memory->Output.Arena, &applicationState->OutputList, message);
+            }
             ArenaClear(&memory->Scratch.Arena);
         }
+    }
+    else if (ImGui::IsKeyPressed(ImGuiKey_F9))
+    {
+        // toggle breakpoint on the selected line
+        U32 instructionCount = (U32)(memory->Instructions.Arena.Used / sizeof(packed_instruction));
+        if (!simulation->IsRunning && processor->Breakpoints && applicationState->Disassembly_SelectedLine < instructionCount)
+        {
+            packed_instruction *instructions = (packed_instruction *)memory->Instructions.Arena.BasePtr;
+            U32 address = instructions[applicationState->Disassembly_SelectedLine].Address;
+            SetBreakpoint(processor->Breakpoints, address, !HasBreakpoint(processor->Breakpoints, address));
+        }
+    }
 
-        applicationState->Diagnostics_ExecutionStalled = false;
+    // Note (Aaron): While the simulation thread owns the processor, the GUI shows the state it last sent. Memory is
+    // shown as it is, mid-update or not.
+    processor_8086 simulationView = {};
+    if (simulation->IsRunning)
+    {
+        simulationView.Memory = processor->Memory;
+        simulationView.MemorySize = processor->MemorySize;
+        simulationView.ProgramSize = processor->ProgramSize;
+        ApplySimulationState(&simulationView, &applicationState->SimulationState);
+        processor = &simulationView;
     }
 
     DrawGui(applicationState, memory, processor);
 }
+
+
+C_LINKAGE UNLOAD_APPLICATION(UnloadApplication)
+{
+    // Note (Aaron): The simulation thread runs this code, so it has to be stopped before the code is unloaded
+    StopSimulation(&applicationState->Simulation);
+}
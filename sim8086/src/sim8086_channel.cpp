@@ -0,0 +1,115 @@
+#include "base_types.h"
+#include "base_memory.h"
+#include "base_arena.h"
+#include "base_threads.h"
+#include "sim8086_channel.h"
+
+
+// Note (Aaron): Messages take up whole multiples of the header size, so a header never wraps around the
+// end of the buffer
+inline static U64 GetChannelMessageSize(U32 size)
+{
+    U64 result = sizeof(channel_message_header) + (((U64)size + 7) & ~(U64)7);
+    return result;
+}
+
+
+global_function B32 InitializeChannel(message_channel *channel, memory_arena *arena, U64 size)
+{
+    *channel = {};
+    if (size < sizeof(channel_message_header) || (size & (size - 1)) != 0)
+    {
+        return FALSE;
+    }
+
+    channel->Data = (U8 *)ArenaPushSize(arena, size);
+    if (!channel->Data)
+    {
+        return FALSE;
+    }
+
+    channel->Size = size;
+    return TRUE;
+}
+
+
+// Note (Aaron): Only safe while neither side is using the channel
+global_function void ResetChannel(message_channel *channel)
+{
+    channel->WriteIndex = 0;
+    channel->ReadIndex = 0;
+}
+
+
+global_function U64 GetChannelFreeSize(message_channel *channel)
+{
+    U64 used = channel->WriteIndex - AtomicLoadU64(&channel->ReadIndex);
+    return channel->Size - used;
+}
+
+
+global_function B32 WriteChannelMessage(message_channel *channel, U32 type, void const *data, U32 size)
+{
+    U64 messageSize = GetChannelMessageSize(size);
+    if (messageSize > GetChannelFreeSize(channel))
+    {
+        return FALSE;
+    }
+
+    U64 mask = channel->Size - 1;
+    U64 writeIndex = channel->WriteIndex;
+
+    channel_message_header *header = (channel_message_header *)(channel->Data + (writeIndex & mask));
+    header->Type = type;
+    header->Size = size;
+
+    U64 dataOffset = (writeIndex + sizeof(channel_message_header)) & mask;
+    U64 firstPartSize = Min((U64)size, channel->Size - dataOffset);
+    if (firstPartSize)
+    {
+        MemoryCopy(channel->Data + dataOffset, data, firstPartSize);
+    }
+    if (size > firstPartSize)
+    {
+        MemoryCopy(channel->Data, (U8 const *)data + firstPartSize, size - firstPartSize);
+    }
+
+    AtomicStoreU64(&channel->WriteIndex, writeIndex + messageSize);
+    return TRUE;
+}
+
+
+global_function B32 ReadChannelMessage(message_channel *channel, channel_message_header *header, void *buffer, U32 bufferSize)
+{
+    U64 mask = channel->Size - 1;
+    U64 readIndex = channel->ReadIndex;
+    U64 writeIndex = AtomicLoadU64(&channel->WriteIndex);
+
+    while (readIndex != writeIndex)
+    {
+        *header = *(channel_message_header *)(channel->Data + (readIndex & mask));
+        U64 messageSize = GetChannelMessageSize(header->Size);
+
+        if (header->Size <= bufferSize)
+        {
+            U64 dataOffset = (readIndex + sizeof(channel_message_header)) & mask;
+            U64 firstPartSize = Min((U64)header->Size, channel->Size - dataOffset);
+            if (firstPartSize)
+            {
+                MemoryCopy(buffer, channel->Data + dataOffset, firstPartSize);
+            }
+            if (header->Size > firstPartSize)
+            {
+                MemoryCopy((U8 *)buffer + firstPartSize, channel->Data, header->Size - firstPartSize);
+            }
+
+            AtomicStoreU64(&channel->ReadIndex, readIndex + messageSize);
+            return TRUE;
+        }
+
+        readIndex += messageSize;
+        AtomicStoreU64(&channel->ReadIndex, readIndex);
+    }
+
+    return FALSE;
+}
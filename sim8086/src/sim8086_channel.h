@@ -0,0 +1,39 @@
+#ifndef SIM8086_CHANNEL_H
+#define SIM8086_CHANNEL_H
+
+#include "base_types.h"
+#include "base_arena.h"
+
+
+// Note (Aaron): Ring buffer of typed, variable sized messages from one producer thread to one consumer thread.
+// Neither side ever waits for the other: writes fail when there isn't room and reads fail when it is empty.
+// Indices only ever increase and are wrapped into the buffer when used, so the buffer size must be a power of 2.
+struct message_channel
+{
+    U8 *Data;
+    U64 Size;
+
+    // Note (Aaron): Written only by the producer and consumer respectively
+    alignas(64) U64 volatile WriteIndex;
+    alignas(64) U64 volatile ReadIndex;
+};
+
+
+struct channel_message_header
+{
+    U32 Type;
+    U32 Size;
+};
+
+
+global_function B32 InitializeChannel(message_channel *channel, memory_arena *arena, U64 size);
+global_function void ResetChannel(message_channel *channel);
+
+// Note (Aaron): Producer side
+global_function U64 GetChannelFreeSize(message_channel *channel);
+global_function B32 WriteChannelMessage(message_channel *channel, U32 type, void const *data, U32 size);
+
+// Note (Aaron): Consumer side. Messages larger than 'bufferSize' are skipped over.
+global_function B32 ReadChannelMessage(message_channel *channel, channel_message_header *header, void *buffer, U32 bufferSize);
+
+#endif // SIM8086_CHANNEL_H
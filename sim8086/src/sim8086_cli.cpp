@@ -1,199 +1,1103 @@
 #include "base_inc.h"
 
+#if __linux__
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
 #include "base_memory.c"
 #include "base_arena.c"
 #include "base_string.c"
+#include "base_threads.c"
 #include "sim8086.cpp"
 #include "sim8086_mnemonics.cpp"
+#include "sim8086_trace.cpp"
+#include "sim8086_threaded.cpp"
+#include "sim8086_jit.cpp"
+#include "sim8086_engine.cpp"
+#include "sim8086_lockstep.cpp"
+#include "sim8086_output.cpp"
+#include "sim8086_disassembly.cpp"
 #define PLATFORM_METRICS_IMPLEMENTATION
 #define PROFILER 0
 #include "platform_metrics.h"
 
 
-void PrintFlags(processor_8086 *processor, bool force = false)
+// Note (Aaron): Trace output is formatted into this and written out in large chunks
+global_variable output_buffer StandardOutput;
+
+
+static void FlushStandardOutput(void)
+{
+    FlushOutputBuffer(&StandardOutput);
+}
+
+
+void PrintFlags(output_buffer *output, processor_8086 *processor, bool force = false)
 {
     FUNCTION_TIMING;
 
-    if (processor->Flags == 0 && !force)
+    U8 flags = GetProcessorFlags(processor);
+    if (flags == 0 && !force)
     {
         return;
     }
 
-    printf(" flags:->");
+    OutputCString(output, " flags:->");
+
+    if (flags & RegisterFlag_CF) { OutputChar(output, 'C'); }
+    if (flags & RegisterFlag_PF) { OutputChar(output, 'P'); }
+    if (flags & RegisterFlag_AF) { OutputChar(output, 'A'); }
+    if (flags & RegisterFlag_ZF) { OutputChar(output, 'Z'); }
+    if (flags & RegisterFlag_SF) { OutputChar(output, 'S'); }
+    if (flags & RegisterFlag_OF) { OutputChar(output, 'O'); }
+    if (flags & RegisterFlag_DF) { OutputChar(output, 'D'); }
+}
+
+
+static void PrintInstruction(output_buffer *output, instruction *instruction)
+{
+    FUNCTION_TIMING;
+
+    U8 *at = ReserveOutput(output, INSTRUCTION_MNEMONIC_MAX_SIZE);
+    output->Used += FormatInstructionMnemonic(instruction, (char *)at);
+}
 
-    if (processor->Flags & RegisterFlag_CF) { printf("C"); }
-    if (processor->Flags & RegisterFlag_PF) { printf("P"); }
-    if (processor->Flags & RegisterFlag_AF) { printf("A"); }
-    if (processor->Flags & RegisterFlag_ZF) { printf("Z"); }
-    if (processor->Flags & RegisterFlag_SF) { printf("S"); }
-    if (processor->Flags & RegisterFlag_OF) { printf("O"); }
+static void PrintClocks(output_buffer *output, processor_8086 *processor, instruction *instruction)
+{
+    FUNCTION_TIMING;
+
+    OutputCString(output, " Clocks: +");
+    OutputU32(output, instruction->ClockCount + instruction->EAClockCount);
+
+    if (instruction->EAClockCount > 0)
+    {
+        OutputCString(output, " (");
+        OutputU32(output, instruction->ClockCount);
+        OutputCString(output, " + ");
+        OutputU32(output, instruction->EAClockCount);
+        OutputCString(output, "ea)");
+    }
+
+    OutputCString(output, " = ");
+    OutputU32(output, processor->TotalClockCount);
 }
 
+// Note (Aaron): Bus timing and repetitions are only known once the instruction has executed. 'clockCount' is
+// what it took and 'totalClockCount' is the total from before it. 'timing' is null without the bus model.
+static void PrintExecutedClocks(output_buffer *output, bus_timing *timing, instruction *instruction, U32 clockCount, U32 totalClockCount)
+{
+    FUNCTION_TIMING;
+
+    U32 baseClockCount = instruction->ClockCount + (timing ? timing->JumpClockCount : 0);
+    U32 busClockCount = timing ? (timing->StallClockCount + timing->PenaltyClockCount) : 0;
+    U32 repetitionClockCount = clockCount - (baseClockCount + instruction->EAClockCount + busClockCount);
 
-static void PrintInstruction(instruction *instruction)
+    OutputCString(output, " Clocks: +");
+    OutputU32(output, clockCount);
+    if (instruction->EAClockCount > 0 || busClockCount > 0 || repetitionClockCount > 0)
+    {
+        OutputCString(output, " (");
+        OutputU32(output, baseClockCount);
+        if (instruction->EAClockCount > 0)
+        {
+            OutputCString(output, " + ");
+            OutputU32(output, instruction->EAClockCount);
+            OutputCString(output, "ea");
+        }
+
+        if (repetitionClockCount > 0)
+        {
+            OutputCString(output, " + ");
+            OutputU32(output, repetitionClockCount);
+            OutputCString(output, "rep");
+        }
+
+        if (busClockCount > 0)
+        {
+            OutputCString(output, " + ");
+            OutputU32(output, busClockCount);
+            OutputCString(output, "bus");
+        }
+
+        OutputChar(output, ')');
+    }
+
+    OutputCString(output, " = ");
+    OutputU32(output, totalClockCount);
+}
+
+static void PrintRegisters(output_buffer *output, processor_8086 *processor)
 {
     FUNCTION_TIMING;
 
-    printf("%s ", GetOpMnemonic(instruction->OpType));
-    const char *Separator = "";
+    register_id toDisplay[] =
+    {
+        Reg_ax,
+        Reg_bx,
+        Reg_cx,
+        Reg_dx,
+        Reg_sp,
+        Reg_bp,
+        Reg_si,
+        Reg_di,
+    };
+
+    OutputCString(output, "Registers:\n");
 
-    for (int i = 0; i < ArrayCount(instruction->Operands); ++i)
+    for (int i = 0; i < ArrayCount(toDisplay); ++i)
     {
-        instruction_operand operand = instruction->Operands[i];
+        U16 value = GetRegisterValue(processor, toDisplay[i]);
 
-        // skip empty operands
-        if(operand.Type == Operand_None)
+        // Reduce noise by omitting registers with a value of 0
+        if (value == 0)
         {
             continue;
         }
 
-        printf("%s", Separator);
-        Separator = ", ";
+        OutputChar(output, '\t');
+        OutputCString(output, GetRegisterMnemonic(toDisplay[i]));
+        OutputCString(output, ": ");
+        OutputHex(output, value, 4);
+        OutputCString(output, " (");
+        OutputU32(output, value);
+        OutputCString(output, ")\n");
+    }
+
+    // print instruction pointer
+    OutputCString(output, "\tip: ");
+    OutputHex(output, processor->IP, 4);
+    OutputCString(output, " (");
+    OutputU32(output, processor->IP);
+    OutputCString(output, ")\n");
+
+    // align flags with register print out
+    OutputCString(output, "    ");
+    PrintFlags(output, processor);
+}
+
+struct hot_spot
+{
+    U32 Address;
+    U32 ClockCount;
+};
+
+
+static int CompareHotSpots(void const *a, void const *b)
+{
+    U32 clocksA = ((hot_spot const *)a)->ClockCount;
+    U32 clocksB = ((hot_spot const *)b)->ClockCount;
+    return (clocksA < clocksB) ? 1 : (clocksA > clocksB) ? -1 : 0;
+}
+
+
+// Note (Aaron): Reports the 'count' addresses that used the most clocks, then the instruction mix
+static void PrintHotSpots(output_buffer *output, processor_8086 *processor, execution_profile *profile, U32 count)
+{
+    FUNCTION_TIMING;
+
+    hot_spot *hotSpots = (hot_spot *)malloc(sizeof(hot_spot) * profile->AddressCount);
+    if (!hotSpots)
+    {
+        OutputCString(output, "ERROR: Unable to allocate memory for the hot spot report\n");
+        return;
+    }
+
+    U32 hotSpotCount = 0;
+    for (U32 address = 0; address < profile->AddressCount; ++address)
+    {
+        if (profile->ExecutionCounts[address])
+        {
+            hotSpots[hotSpotCount++] = { address, profile->ClockCounts[address] };
+        }
+    }
+
+    qsort(hotSpots, hotSpotCount, sizeof(hot_spot), CompareHotSpots);
+
+    F64 totalClocks = profile->TotalClockCount ? (F64)profile->TotalClockCount : 1.0;
+    F64 totalInstructions = profile->TotalInstructionCount ? (F64)profile->TotalInstructionCount : 1.0;
+
+    OutputFormat(output, "hot spots: %llu instructions, %llu clocks\n",
+                 (unsigned long long)profile->TotalInstructionCount, (unsigned long long)profile->TotalClockCount);
+    OutputCString(output, "  address      executions      clocks   share  instruction\n");
+
+    for (U32 i = 0; i < hotSpotCount && i < count; ++i)
+    {
+        U32 address = hotSpots[i].Address;
+        OutputFormat(output, "  0x%.8x  %10u  %10u  %5.1f%%  ",
+                     address,
+                     profile->ExecutionCounts[address],
+                     profile->ClockCounts[address],
+                     ((F64)profile->ClockCounts[address] / totalClocks) * 100.0);
+
+        instruction instruction = FetchInstruction(processor, address);
+        PrintInstruction(output, &instruction);
+
+        if (profile->TakenCounts[address] || profile->NotTakenCounts[address])
+        {
+            OutputFormat(output, " (taken %u, not taken %u)", profile->TakenCounts[address], profile->NotTakenCounts[address]);
+        }
+
+        OutputChar(output, '\n');
+    }
 
-        switch (operand.Type)
+    OutputCString(output, "\ninstruction mix:\n");
+    for (U32 opType = 0; opType < Op_count; ++opType)
+    {
+        if (!profile->OpExecutionCounts[opType])
         {
-            case Operand_None:
+            continue;
+        }
+
+        OutputFormat(output, "  %-8s %10llu  %5.1f%%  %10llu clocks  %5.1f%%\n",
+                     GetOpMnemonic((operation_types)opType),
+                     (unsigned long long)profile->OpExecutionCounts[opType],
+                     ((F64)profile->OpExecutionCounts[opType] / totalInstructions) * 100.0,
+                     (unsigned long long)profile->OpClockCounts[opType],
+                     ((F64)profile->OpClockCounts[opType] / totalClocks) * 100.0);
+    }
+
+    free(hotSpots);
+}
+
+// Note (Aaron): Clock estimate models. static adds up instruction clocks, the others follow bus_timing_model order.
+global_variable char const *TimingModelNames[]
+{
+    "static",
+    "8086",
+    "8088",
+};
+
+
+// Note (Aaron): Adds breakpoints listed as "address[,address...]". Addresses may be decimal or 0x prefixed hex.
+static B32 ParseBreakpoints(breakpoint_set *breakpoints, char const *list)
+{
+    char const *at = list;
+    for (;;)
+    {
+        char *end = 0;
+        unsigned long address = strtoul(at, &end, 0);
+        if (end == at || address >= breakpoints->AddressCount)
+        {
+            return FALSE;
+        }
+
+        SetBreakpoint(breakpoints, (U32)address, TRUE);
+
+        if (*end != ',')
+        {
+            return (*end == 0);
+        }
+        at = end + 1;
+    }
+}
+
+
+// Note (Aaron): Adds watchpoints listed as "address[+size][:r|w|rw][,...]". Watchpoints are a byte in size and
+// watch both reads and writes by default.
+static B32 ParseWatchpoints(breakpoint_set *breakpoints, char const *list)
+{
+    char const *at = list;
+    for (;;)
+    {
+        char *end = 0;
+        unsigned long address = strtoul(at, &end, 0);
+        if (end == at)
+        {
+            return FALSE;
+        }
+
+        unsigned long size = 1;
+        if (*end == '+')
+        {
+            at = end + 1;
+            size = strtoul(at, &end, 0);
+            if (end == at)
             {
-                break;
+                return FALSE;
             }
-            case Operand_Memory:
+        }
+
+        U8 access = WatchAccess_Read | WatchAccess_Write;
+        if (*end == ':')
+        {
+            access = 0;
+            for (++end; *end == 'r' || *end == 'w'; ++end)
             {
-                // prepend width hint if necessary
-                if (operand.Memory.Flags & Memory_PrependWidth)
-                {
-                    printf("%s ", (operand.Memory.Flags & Memory_IsWide) ? "word": "byte");
-                }
+                access |= (*end == 'r') ? WatchAccess_Read : WatchAccess_Write;
+            }
+        }
 
-                // print direct address
-                if (operand.Memory.Flags & Memory_HasDirectAddress)
-                {
-                    printf("[%i]", operand.Memory.DirectAddress);
-                    break;
-                }
+        if (address > 0xffffffff || size > 0xffffffff
+            || !AddWatchpoint(breakpoints, (U32)address, (U32)size, access))
+        {
+            return FALSE;
+        }
+
+        if (*end != ',')
+        {
+            return (*end == 0);
+        }
+        at = end + 1;
+    }
+}
+
+
+// Note (Aaron): Reports why execution stopped before the program finished, if it was a breakpoint or watchpoint
+static void PrintStopReason(output_buffer *output, processor_8086 *processor)
+{
+    breakpoint_set *breakpoints = processor->Breakpoints;
+    if (breakpoints->StopReason == StopReason_Breakpoint)
+    {
+        OutputFormat(output, "Stopped at breakpoint 0x%x after %u instructions\n",
+                     breakpoints->StopAddress, processor->InstructionCount);
+    }
+    else if (breakpoints->StopReason == StopReason_Watchpoint)
+    {
+        B32 isWrite = (breakpoints->StopAccess == WatchAccess_Write);
+        OutputFormat(output, "Stopped by watchpoint: %s 0x%x %s [0x%x] at 0x%x after %u instructions\n",
+                     isWrite ? "write of" : "read of",
+                     breakpoints->StopValue,
+                     isWrite ? "to" : "from",
+                     breakpoints->StopAddress,
+                     processor->PrevIP,
+                     processor->InstructionCount);
+    }
+}
 
-                // print memory with optional displacement
-                printf("[");
-                printf("%s", GetRegisterMnemonic(operand.Memory.Register));
 
-                if (operand.Memory.Flags & Memory_HasDisplacement)
+// Note (Aaron): Reports the fault that stopped execution, if there was one
+static void PrintProcessorFault(output_buffer *output, processor_8086 *processor)
+{
+    if (processor->Fault == Fault_MemoryAccess)
+    {
+        OutputFormat(output, "Stopped by fault: %s [0x%x] at 0x%x after %u instructions\n",
+                     GetProcessorFaultName(processor->Fault),
+                     processor->FaultAddress,
+                     processor->PrevIP,
+                     processor->InstructionCount);
+    }
+    else if (processor->Fault == Fault_InstructionStream)
+    {
+        OutputFormat(output, "Stopped by fault: %s at 0x%x\n",
+                     GetProcessorFaultName(processor->Fault),
+                     processor->FaultAddress);
+    }
+}
+
+
+// Note (Aaron): Finishes the trace, reporting its size or that it couldn't all be written
+static void PrintTraceSummary(output_buffer *output, trace_recorder *recorder, char const *filename)
+{
+    OutputChar(output, '\n');
+    if (!FinishTrace(recorder))
+    {
+        OutputFormat(output, "ERROR: Encountered error while writing trace to '%s'\n", filename);
+        return;
+    }
+
+    U64 recordByteCount = recorder->ByteCount - recorder->StateByteCount;
+    OutputFormat(output, "Trace: %llu instructions in %llu bytes (%.2f bytes per instruction, after %llu bytes of starting state) written to '%s'\n",
+                 (unsigned long long)recorder->RecordCount, (unsigned long long)recorder->ByteCount,
+                 recorder->RecordCount ? (F64)recordByteCount / (F64)recorder->RecordCount : 0.0,
+                 (unsigned long long)recorder->StateByteCount, filename);
+}
+
+
+// Note (Aaron): Simulates the loaded program 'runCount' times with tracing disabled and reports
+// simulated instructions per second and host CPU cycles per simulated instruction.
+static void RunBenchmark(processor_8086 *processor, U32 runCount, execution_engine *engine, bool stopOnReturn)
+{
+    FUNCTION_TIMING;
+
+    // Note (Aaron): Each run starts from the memory image that was loaded from file. Bytes a run
+    // modified are restored (and their cached instructions invalidated) outside of the timed region.
+    U8 *memoryImage = (U8 *)malloc(processor->MemorySize);
+    if (!memoryImage)
+    {
+        printf("ERROR: Unable to allocate benchmark memory for sim8086\n");
+        exit(1);
+    }
+    MemoryCopy(memoryImage, processor->Memory, processor->MemorySize);
+
+    U64 totalInstructionCount = 0;
+    U64 totalElapsed = 0;
+    U64 minElapsed = (U64)-1;
+
+    for (U32 run = 0; run < runCount; ++run)
+    {
+        ResetProcessorExecution(processor);
+
+        U64 start = ReadCPUTimer();
+        ExecuteEngine(engine, processor, stopOnReturn, 0);
+        U64 elapsed = ReadCPUTimer() - start;
+
+        totalElapsed += elapsed;
+        totalInstructionCount += processor->InstructionCount;
+        if (elapsed < minElapsed)
+        {
+            minElapsed = elapsed;
+        }
+
+        U32 blockSize = Kilobytes(4);
+        for (U32 blockStart = 0; blockStart < processor->MemorySize; blockStart += blockSize)
+        {
+            if (memcmp(processor->Memory + blockStart, memoryImage + blockStart, blockSize) == 0)
+            {
+                continue;
+            }
+
+            for (U32 address = blockStart; address < blockStart + blockSize; ++address)
+            {
+                if (processor->Memory[address] != memoryImage[address])
                 {
-                    if (operand.Memory.Displacement >= 0)
-                    {
-                        printf(" + %i", operand.Memory.Displacement);
-                    }
-                    else
+                    processor->Memory[address] = memoryImage[address];
+                    if (processor->InstructionCache)
                     {
-                        printf(" - %i", operand.Memory.Displacement * -1);
+                        InvalidateInstructionCache(processor->InstructionCache, address, 1);
                     }
                 }
+            }
+        }
+    }
 
-                printf("]");
+    free(memoryImage);
 
-                break;
-            }
-            case Operand_Register:
+    U64 cpuFrequency = GetCPUFrequency(CPU_FREQUENCY_MS);
+    F64 totalSeconds = (F64)totalElapsed / (F64)cpuFrequency;
+    F64 instructionsPerRun = (F64)totalInstructionCount / (F64)runCount;
+
+    printf("bench: %u runs, %.0f instructions per run (%s engine)\n", runCount, instructionsPerRun, EngineNames[engine->Type]);
+    printf("  total time:    %.4fms (CPU freq %llu)\n", totalSeconds * 1000.0, (unsigned long long)cpuFrequency);
+    printf("  best run:      %.4fms\n", 1000.0 * (F64)minElapsed / (F64)cpuFrequency);
+
+    if (totalInstructionCount > 0 && totalElapsed > 0)
+    {
+        printf("  throughput:    %.2f MIPS\n", ((F64)totalInstructionCount / totalSeconds) / 1000000.0);
+        printf("  host cycles:   %.2f per simulated instruction\n", (F64)totalElapsed / (F64)totalInstructionCount);
+    }
+}
+
+
+// Note (Aaron): Prints registers, ip and flags on a single line, without ending it
+static void PrintFinalState(char const *label, U16 *registers, U32 ip, U8 flags)
+{
+    printf("%s: ax %04x bx %04x cx %04x dx %04x sp %04x bp %04x si %04x di %04x ip %04x flags ",
+           label,
+           registers[0], registers[1], registers[2], registers[3],
+           registers[4], registers[5], registers[6], registers[7],
+           ip);
+
+    if (flags & RegisterFlag_CF) { printf("C"); }
+    if (flags & RegisterFlag_PF) { printf("P"); }
+    if (flags & RegisterFlag_AF) { printf("A"); }
+    if (flags & RegisterFlag_ZF) { printf("Z"); }
+    if (flags & RegisterFlag_SF) { printf("S"); }
+    if (flags & RegisterFlag_OF) { printf("O"); }
+    if (flags & RegisterFlag_DF) { printf("D"); }
+    if (flags == 0) { printf("-"); }
+}
+
+
+// Note (Aaron): A program in a batch run and the state it finished in
+struct batch_job
+{
+    char const *Filename;
+
+    B32 Loaded;
+    B32 Halted;
+    processor_fault Fault;
+    U32 FaultAddress;
+    U16 Registers[8];
+    U32 IP;
+    U8 Flags;
+    U32 InstructionCount;
+    U32 TotalClockCount;
+    U64 ElapsedTicks;
+};
+
+
+struct batch_queue
+{
+    batch_job *Jobs;
+    U32 JobCount;
+
+    // Note (Aaron): Workers claim jobs by incrementing this, so a worker that finishes early keeps
+    // pulling work instead of sitting idle behind a fixed partition.
+    U32 volatile NextJob;
+
+    engine_type EngineType;
+    bool StopOnReturn;
+    U64 InstructionLimit;
+};
+
+
+struct batch_worker
+{
+    os_thread Thread;
+    batch_queue *Queue;
+    B32 Started;
+    B32 Failed;
+    engine_type EngineType;     // Note (Aaron): The engine the worker ran, see InitializeExecutionEngine()
+};
+
+
+static void WarnOnEngineFallback(engine_type requestedType, engine_type engineType)
+{
+    if (engineType != requestedType)
+    {
+        printf("WARNING: The %s engine is unavailable on this host, using the %s engine instead\n",
+               EngineNames[requestedType], EngineNames[engineType]);
+    }
+}
+
+
+// Note (Aaron): Loads either a program or a processor dump written by --save-state
+static B32 LoadBatchProgram(processor_8086 *processor, char const *filename)
+{
+    if (IsProcessorDumpFile(filename))
+    {
+        return LoadProcessorFromFile(processor, filename);
+    }
+
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    processor->ProgramSize = (U32)fread(processor->Memory, 1, processor->MemorySize, file);
+    B32 result = !ferror(file) && feof(file);
+    fclose(file);
+
+    return result;
+}
+
+
+// Note (Aaron): Each worker owns a processor, its memory and everything the engines need, and reuses
+// them for every job it runs.
+static void BatchWorkerProc(void *data)
+{
+    batch_worker *worker = (batch_worker *)data;
+    batch_queue *queue = worker->Queue;
+
+    processor_8086 processor = {};
+    AllocateProcessorMemory(&processor);
+
+    U64 cacheMemorySize = (sizeof(U32) * processor.MemorySize) + (sizeof(packed_instruction) * Kilobytes(64));
+    memory_arena cacheArena = ArenaAllocate(cacheMemorySize, cacheMemorySize);
+    instruction_cache instructionCache = {};
+
+    if (!processor.Memory
+        || !ArenaIsValid(&cacheArena)
+        || !InitializeInstructionCache(&instructionCache, &cacheArena, processor.MemorySize))
+    {
+        FreeProcessorMemory(&processor);
+        worker->Failed = TRUE;
+        return;
+    }
+
+    processor.InstructionCache = &instructionCache;
+
+    execution_engine engine = {};
+    if (!InitializeExecutionEngine(&engine, queue->EngineType, processor.MemorySize))
+    {
+        FreeProcessorMemory(&processor);
+        worker->Failed = TRUE;
+        return;
+    }
+    worker->EngineType = engine.Type;
+
+    B32 memoryIsClean = TRUE;
+    for (;;)
+    {
+        U32 jobIndex = AtomicIncrementU32(&queue->NextJob) - 1;
+        if (jobIndex >= queue->JobCount)
+        {
+            break;
+        }
+
+        batch_job *job = &queue->Jobs[jobIndex];
+
+        // Note (Aaron): Programs expect to start with zeroed memory. The buffer is reused rather than
+        // reallocated, so its pages stay mapped between jobs.
+        if (!memoryIsClean)
+        {
+            MemorySet(processor.Memory, 0, processor.MemorySize);
+        }
+        memoryIsClean = FALSE;
+
+        ResetProcessorExecution(&processor);
+        ClearInstructionCache(&instructionCache);
+
+        job->Loaded = LoadBatchProgram(&processor, job->Filename);
+        if (!job->Loaded)
+        {
+            continue;
+        }
+
+        U64 start = ReadCPUTimer();
+        job->Halted = ExecuteEngine(&engine, &processor, queue->StopOnReturn, queue->InstructionLimit);
+        job->ElapsedTicks = ReadCPUTimer() - start;
+
+        MemoryCopy(job->Registers, processor.Registers, sizeof(job->Registers));
+        job->IP = processor.IP;
+        job->Flags = GetProcessorFlags(&processor);
+        job->InstructionCount = processor.InstructionCount;
+        job->TotalClockCount = processor.TotalClockCount;
+        job->Fault = processor.Fault;
+        job->FaultAddress = processor.FaultAddress;
+    }
+
+    FreeExecutionEngine(&engine);
+    FreeProcessorMemory(&processor);
+}
+
+
+static int CompareFilenames(void const *a, void const *b)
+{
+    return strcmp(*(char const **)a, *(char const **)b);
+}
+
+
+// Note (Aaron): Collects the programs to run from a directory (every regular file in it) or from a
+// file listing one path per line. Returns the number of files; the filenames are pushed onto 'listArena'.
+static U32 CollectBatchFiles(char const *path, memory_arena *listArena, memory_arena *stringArena)
+{
+    U32 count = 0;
+
+#if __linux__
+    DIR *directory = opendir(path);
+    if (directory)
+    {
+        for (struct dirent *entry = readdir(directory); entry; entry = readdir(directory))
+        {
+            char *filename = ArenaPushCStringf(stringArena, TRUE, (char *)"%s/%s", path, entry->d_name);
+
+            struct stat fileStat;
+            if (stat(filename, &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
             {
-                printf("%s", GetRegisterMnemonic(operand.Register));
-                break;
+                continue;
             }
-            case Operand_Immediate:
+
+            *ArenaPushStruct(listArena, char const *) = filename;
+            ++count;
+        }
+
+        closedir(directory);
+        qsort(listArena->BasePtr, count, sizeof(char const *), CompareFilenames);
+        return count;
+    }
+#elif _WIN32
+    DWORD attributes = GetFileAttributesA(path);
+    if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        char *pattern = ArenaPushCStringf(stringArena, TRUE, (char *)"%s\\*", path);
+
+        WIN32_FIND_DATAA findData;
+        HANDLE findHandle = FindFirstFileA(pattern, &findData);
+        if (findHandle != INVALID_HANDLE_VALUE)
+        {
+            do
             {
-                if (operand.Immediate.Flags & Immediate_IsJump)
+                if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
                 {
-                    S8 offset = (S8)(operand.Immediate.Value & 0xff);
+                    continue;
+                }
 
-                    // Note (Aaron): Offset the value to accommodate a NASM syntax peculiarity.
-                    // NASM expects an offset value from the start of the instruction rather than
-                    // the end (which is how the instructions are encoded).
-                    offset += instruction->Bits.ByteCount;
+                char *filename = ArenaPushCStringf(stringArena, TRUE, (char *)"%s\\%s", path, findData.cFileName);
+                *ArenaPushStruct(listArena, char const *) = filename;
+                ++count;
+            } while (FindNextFileA(findHandle, &findData));
 
-                    printf(offset >= 0 ? "$+%i" : "$%i", offset);
-                    break;
-                }
+            FindClose(findHandle);
+        }
 
-                // TODO (Aaron): Test this more
-                bool isSigned = operand.Immediate.Flags & Immediate_IsSigned;
-                printf("%i", isSigned
-                       ? (S16) operand.Immediate.Value
-                       : (U16) operand.Immediate.Value);
+        qsort(listArena->BasePtr, count, sizeof(char const *), CompareFilenames);
+        return count;
+    }
+#endif
 
-                break;
-            }
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return 0;
+    }
 
-            default:
-            {
-                printf("?");
-            }
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        size_t length = strcspn(line, "\r\n");
+        line[length] = 0;
+        if (length == 0 || line[0] == '#')
+        {
+            continue;
         }
+
+        char *filename = ArenaPushCStringf(stringArena, TRUE, (char *)"%s", line);
+        *ArenaPushStruct(listArena, char const *) = filename;
+        ++count;
     }
+
+    fclose(file);
+    return count;
 }
 
-static void PrintClocks(processor_8086 *processor, instruction *instruction)
+
+// Note (Aaron): Simulates every program listed by 'path' on 'threadCount' threads and prints the final
+// state of each, followed by totals for the whole batch.
+static void RunBatch(char const *path, U32 threadCount, engine_type engineType, bool stopOnReturn, U64 instructionLimit)
 {
     FUNCTION_TIMING;
 
-    if (instruction->EAClockCount > 0)
+    memory_arena listArena = ArenaAllocate(Megabytes(8), Megabytes(8));
+    memory_arena stringArena = ArenaAllocate(Megabytes(64), Megabytes(64));
+    if (!ArenaIsValid(&listArena) || !ArenaIsValid(&stringArena))
     {
-        printf(" Clocks: +%i (%i + %iea) = %i",
-               (instruction->ClockCount + instruction->EAClockCount),
-               instruction->ClockCount,
-               instruction->EAClockCount,
-               processor->TotalClockCount);
-        return;
+        printf("ERROR: Unable to allocate batch memory for sim8086\n");
+        exit(1);
+    }
+
+    U32 jobCount = CollectBatchFiles(path, &listArena, &stringArena);
+    if (jobCount == 0)
+    {
+        printf("ERROR: No programs found in '%s'\n", path);
+        exit(1);
+    }
+
+    char const **filenames = (char const **)listArena.BasePtr;
+    batch_queue queue = {};
+    queue.Jobs = (batch_job *)calloc(jobCount, sizeof(batch_job));
+    queue.JobCount = jobCount;
+    queue.EngineType = engineType;
+    queue.StopOnReturn = stopOnReturn;
+    queue.InstructionLimit = instructionLimit;
+
+    // Note (Aaron): Each worker needs a processor with guarded memory, and there are only so many of those
+    U32 freeProcessorCount = GetFreeGuardedProcessorCount();
+    U32 maxThreadCount = Min(jobCount, freeProcessorCount);
+    maxThreadCount = Max(maxThreadCount, 1u);
+    threadCount = Clamp(1, threadCount, maxThreadCount);
+    batch_worker *workers = (batch_worker *)calloc(threadCount, sizeof(batch_worker));
+    if (!queue.Jobs || !workers)
+    {
+        printf("ERROR: Unable to allocate batch memory for sim8086\n");
+        exit(1);
+    }
+
+    for (U32 jobIndex = 0; jobIndex < jobCount; ++jobIndex)
+    {
+        queue.Jobs[jobIndex].Filename = filenames[jobIndex];
+    }
+
+    U64 start = ReadCPUTimer();
+
+    // Note (Aaron): The main thread works the queue too. Workers only claim jobs once they have everything they
+    // need, so one that can't be started or fails to allocate leaves its share to the others.
+    for (U32 workerIndex = 0; workerIndex < threadCount; ++workerIndex)
+    {
+        workers[workerIndex].Queue = &queue;
+        workers[workerIndex].Started = (workerIndex == 0)
+            || ThreadCreate(&workers[workerIndex].Thread, BatchWorkerProc, &workers[workerIndex]);
+    }
+
+    BatchWorkerProc(&workers[0]);
+
+    U32 runningCount = 0;
+    engine_type ranEngineType = engineType;
+    for (U32 workerIndex = 0; workerIndex < threadCount; ++workerIndex)
+    {
+        batch_worker *worker = &workers[workerIndex];
+        if (workerIndex > 0 && worker->Started)
+        {
+            ThreadJoin(&worker->Thread);
+        }
+
+        if (worker->Started && !worker->Failed)
+        {
+            ++runningCount;
+            ranEngineType = worker->EngineType;
+        }
+    }
+
+    U64 elapsed = ReadCPUTimer() - start;
+
+    if (runningCount == 0)
+    {
+        printf("ERROR: Unable to allocate memory for any batch thread\n");
+        exit(1);
+    }
+
+    WarnOnEngineFallback(engineType, ranEngineType);
+
+    if (runningCount < threadCount)
+    {
+        printf("WARNING: %u of %u batch threads could not be started, continued on %u\n",
+               threadCount - runningCount, threadCount, runningCount);
+    }
+
+    U64 cpuFrequency = GetCPUFrequency(CPU_FREQUENCY_MS);
+    U64 totalInstructionCount = 0;
+    U32 failedCount = 0;
+
+    for (U32 jobIndex = 0; jobIndex < jobCount; ++jobIndex)
+    {
+        batch_job *job = &queue.Jobs[jobIndex];
+        if (!job->Loaded)
+        {
+            printf("%s: ERROR: unable to load program\n", job->Filename);
+            ++failedCount;
+            continue;
+        }
+
+        totalInstructionCount += job->InstructionCount;
+
+        PrintFinalState(job->Filename, job->Registers, job->IP, job->Flags);
+        printf(" | %u instructions, %u clocks, %.4fms%s",
+               job->InstructionCount,
+               job->TotalClockCount,
+               1000.0 * (F64)job->ElapsedTicks / (F64)cpuFrequency,
+               job->Halted ? "" : " (instruction limit reached)");
+        if (job->Fault != Fault_None)
+        {
+            printf(" (%s: 0x%x)", GetProcessorFaultName(job->Fault), job->FaultAddress);
+        }
+        printf("\n");
     }
 
-    printf(" Clocks: +%i = %i", instruction->ClockCount, processor->TotalClockCount);
+    F64 totalSeconds = (F64)elapsed / (F64)cpuFrequency;
+
+    printf("\nbatch: %u programs on %u threads (%s engine), %u failed to load\n", jobCount, runningCount, EngineNames[ranEngineType], failedCount);
+    printf("  wall time:     %.4fms\n", totalSeconds * 1000.0);
+    printf("  instructions:  %llu\n", (unsigned long long)totalInstructionCount);
+    if (elapsed > 0)
+    {
+        printf("  throughput:    %.2f programs/s, %.2f MIPS\n",
+               (F64)jobCount / totalSeconds,
+               ((F64)totalInstructionCount / totalSeconds) / 1000000.0);
+    }
+
+    free(workers);
+    free(queue.Jobs);
+    ArenaFree(&stringArena);
+    ArenaFree(&listArena);
 }
 
-static void PrintRegisters(processor_8086 *processor)
+
+// Note (Aaron): Simulates the program in 'filename' on 'laneCount' processors in lockstep. Lane 0 starts
+// from the usual zeroed state and the others from registers seeded by 'seed'.
+static void RunLockstep(char const *filename, U32 laneCount, U32 seed, bool stopOnReturn, U64 instructionLimit)
 {
     FUNCTION_TIMING;
 
-    register_id toDisplay[] =
+    processor_8086 lanes[LOCKSTEP_MAX_LANES] = {};
+    instruction_cache instructionCaches[LOCKSTEP_MAX_LANES] = {};
+    memory_arena cacheArenas[LOCKSTEP_MAX_LANES] = {};
+    U64 cacheMemorySize = (sizeof(U32) * lanes[0].MemorySize) + (sizeof(packed_instruction) * Kilobytes(64));
+
+    for (U32 lane = 0; lane < laneCount; ++lane)
     {
-        Reg_ax,
-        Reg_bx,
-        Reg_cx,
-        Reg_dx,
-        Reg_sp,
-        Reg_bp,
-        Reg_si,
-        Reg_di,
-    };
+        processor_8086 *processor = &lanes[lane];
+        AllocateProcessorMemory(processor);
 
-    printf("Registers:\n");
+        cacheArenas[lane] = ArenaAllocate(cacheMemorySize, cacheMemorySize);
+        if (!processor->Memory
+            || !ArenaIsValid(&cacheArenas[lane])
+            || !InitializeInstructionCache(&instructionCaches[lane], &cacheArenas[lane], processor->MemorySize))
+        {
+            printf("ERROR: Unable to allocate memory for lockstep lane %u\n", lane);
+            exit(1);
+        }
 
-    for (int i = 0; i < ArrayCount(toDisplay); ++i)
+        processor->InstructionCache = &instructionCaches[lane];
+    }
+
+    if (!LoadBatchProgram(&lanes[0], filename))
     {
-        U16 value = GetRegisterValue(processor, toDisplay[i]);
+        printf("ERROR: Unable to load '%s'\n", filename);
+        exit(1);
+    }
 
-        // Reduce noise by omitting registers with a value of 0
-        if (value == 0)
+    // Note (Aaron): xorshift32, so that a seed always produces the same initial states
+    U32 random = seed ? seed : 1;
+    for (U32 lane = 1; lane < laneCount; ++lane)
+    {
+        // Note (Aaron): Lane 0 may have been loaded from a processor dump, so all of memory, the
+        // instruction pointer and flags are copied
+        lanes[lane].ProgramSize = lanes[0].ProgramSize;
+        lanes[lane].IP = lanes[0].IP;
+        lanes[lane].PrevIP = lanes[0].PrevIP;
+        lanes[lane].Flags = lanes[0].Flags;
+        MemoryCopy(lanes[lane].Memory, lanes[0].Memory, lanes[0].MemorySize);
+
+        for (U32 registerIndex = 0; registerIndex < ArrayCount(lanes[lane].Registers); ++registerIndex)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            lanes[lane].Registers[registerIndex] = (U16)random;
+        }
+    }
+
+    lockstep_engine engine = {};
+    U64 start = ReadCPUTimer();
+    B32 halted = ExecuteLockstep(&engine, lanes, laneCount, stopOnReturn, instructionLimit);
+    U64 elapsed = ReadCPUTimer() - start;
+
+    U64 totalInstructionCount = 0;
+    for (U32 lane = 0; lane < laneCount; ++lane)
+    {
+        processor_8086 *processor = &lanes[lane];
+        totalInstructionCount += processor->InstructionCount;
+
+        char label[16];
+        snprintf(label, sizeof(label), "lane %2u", lane);
+        PrintFinalState(label, processor->Registers, processor->IP, GetProcessorFlags(processor));
+        printf(" | %u instructions, %u clocks", processor->InstructionCount, processor->TotalClockCount);
+        if (processor->Fault != Fault_None)
+        {
+            printf(" (%s: 0x%x)", GetProcessorFaultName(processor->Fault), processor->FaultAddress);
+        }
+        printf("\n");
+    }
+
+    F64 totalSeconds = (F64)elapsed / (F64)GetCPUFrequency(CPU_FREQUENCY_MS);
+
+    printf("\nlockstep: %u lanes (%s)%s\n", laneCount, LOCKSTEP_AVX2 ? "avx2" : "scalar lanes",
+           halted ? "" : ", instruction limit reached");
+    printf("  decoded once:  %llu instructions\n", (unsigned long long)engine.LockstepInstructionCount);
+    printf("  diverged:      %u times, %llu instructions run by single lanes\n",
+           engine.DivergenceCount, (unsigned long long)engine.ScalarInstructionCount);
+    printf("  wall time:     %.4fms\n", totalSeconds * 1000.0);
+    if (elapsed > 0)
+    {
+        printf("  throughput:    %.2f MIPS across all lanes\n", ((F64)totalInstructionCount / totalSeconds) / 1000000.0);
+    }
+
+    for (U32 lane = 0; lane < laneCount; ++lane)
+    {
+        FreeProcessorMemory(&lanes[lane]);
+        ArenaFree(&cacheArenas[lane]);
+    }
+}
+
+
+// Note (Aaron): Simulates the program in 'filename' with 'engineType', checking it against the interpreter
+// after every 'stepCount' instructions. Returns TRUE if the two never differed.
+static B32 RunDifferential(char const *filename, engine_type engineType, U64 stepCount, bool stopOnReturn, U64 instructionLimit)
+{
+    FUNCTION_TIMING;
+
+    processor_8086 processors[2] = {};
+    instruction_cache instructionCaches[2] = {};
+    memory_arena cacheArenas[2] = {};
+    U64 cacheMemorySize = (sizeof(U32) * processors[0].MemorySize) + (sizeof(packed_instruction) * Kilobytes(64));
+
+    for (U32 processorIndex = 0; processorIndex < ArrayCount(processors); ++processorIndex)
+    {
+        processor_8086 *processor = &processors[processorIndex];
+        AllocateProcessorMemory(processor);
+
+        cacheArenas[processorIndex] = ArenaAllocate(cacheMemorySize, cacheMemorySize);
+        if (!processor->Memory
+            || !ArenaIsValid(&cacheArenas[processorIndex])
+            || !InitializeInstructionCache(&instructionCaches[processorIndex], &cacheArenas[processorIndex], processor->MemorySize))
+        {
+            printf("ERROR: Unable to allocate memory for differential check\n");
+            exit(1);
+        }
+
+        processor->InstructionCache = &instructionCaches[processorIndex];
+    }
+
+    processor_8086 *candidate = &processors[0];
+    processor_8086 *reference = &processors[1];
+    if (!LoadBatchProgram(candidate, filename))
+    {
+        printf("ERROR: Unable to load '%s'\n", filename);
+        exit(1);
+    }
+    CopyProcessorState(reference, candidate);
+
+    execution_engine engine = {};
+    if (!InitializeExecutionEngine(&engine, engineType, candidate->MemorySize))
+    {
+        printf("ERROR: Unable to allocate %s engine for sim8086\n", EngineNames[engineType]);
+        exit(1);
+    }
+    WarnOnEngineFallback(engineType, engine.Type);
+
+    differential_check check = {};
+    U64 start = ReadCPUTimer();
+    B32 halted = ExecuteDifferential(&engine, candidate, reference, stepCount, stopOnReturn, instructionLimit, &check);
+    U64 elapsed = ReadCPUTimer() - start;
+
+    char const *labels[2] = {EngineNames[engine.Type], "interpreter"};
+    for (U32 processorIndex = 0; processorIndex < ArrayCount(processors); ++processorIndex)
+    {
+        processor_8086 *processor = &processors[processorIndex];
+
+        char label[16];
+        snprintf(label, sizeof(label), "%-11s", labels[processorIndex]);
+        PrintFinalState(label, processor->Registers, processor->IP, GetProcessorFlags(processor));
+        printf(" | %u instructions, %u clocks", processor->InstructionCount, processor->TotalClockCount);
+        if (processor->Fault != Fault_None)
+        {
+            printf(" (%s: 0x%x)", GetProcessorFaultName(processor->Fault), processor->FaultAddress);
+        }
+        printf("\n");
+    }
+
+    F64 totalSeconds = (F64)elapsed / (F64)GetCPUFrequency(CPU_FREQUENCY_MS);
+    B32 matched = (check.Mismatch == Mismatch_None);
+
+    if (matched)
+    {
+        printf("\ndifferential: %s engine matched the interpreter over %u instructions in %llu steps%s\n",
+               EngineNames[engine.Type], candidate->InstructionCount, (unsigned long long)check.StepCount,
+               halted ? "" : ", instruction limit reached");
+    }
+    else
+    {
+        printf("\ndifferential: %s engine differs from the interpreter in %s",
+               EngineNames[engine.Type], GetDifferentialMismatchName(check.Mismatch));
+        if (check.Mismatch == Mismatch_Register)
         {
-            continue;
+            char const *registerNames[] = {"ax", "bx", "cx", "dx", "sp", "bp", "si", "di"};
+            printf(" %s", registerNames[check.MismatchIndex & 7]);
         }
-
-        printf("\t%s: %04x (%i)\n",
-               GetRegisterMnemonic(toDisplay[i]),
-               value,
-               value);
+        else if (check.Mismatch == Mismatch_Memory)
+        {
+            printf(" at 0x%x", check.MismatchIndex);
+        }
+        printf(" (0x%x, interpreter 0x%x)\n", check.CandidateValue, check.ReferenceValue);
+        printf("  step:          %llu, starting at 0x%x\n", (unsigned long long)check.StepCount, check.StepAddress);
     }
 
-    // print instruction pointer
-    printf("\tip: %04x (%i)\n",
-           processor->IP,
-           processor->IP);
+    printf("  pages checked: %llu\n", (unsigned long long)check.ComparedPageCount);
+    printf("  wall time:     %.4fms\n", totalSeconds * 1000.0);
 
-    // align flags with register print out
-    printf("    ");
-    PrintFlags(processor);
+    FreeExecutionEngine(&engine);
+    for (U32 processorIndex = 0; processorIndex < ArrayCount(processors); ++processorIndex)
+    {
+        FreeProcessorMemory(&processors[processorIndex]);
+        ArenaFree(&cacheArenas[processorIndex]);
+    }
+
+    return matched;
 }
 
+
 void PrintUsage()
 {
     FUNCTION_TIMING;
 
-    printf("usage: sim8086 [--exec --show-clocks --dump --help] filename\n\n");
+    printf("usage: sim8086 [--exec --show-clocks --timing model --profile count --break list --watch list --dump --save-state path\n");
+    printf("                --trace path");
+    printf(" --bench count --engine name --help] filename\n");
+    printf("       sim8086 --batch path [--threads count --limit count --engine name --stop-on-ret]\n");
+    printf("       sim8086 --lockstep count [--seed value --limit count --stop-on-ret] filename\n");
+    printf("       sim8086 --differential count [--engine name --limit count --stop-on-ret] filename\n\n");
     printf("disassembles 8086/88 assembly and optionally simulates it. note: supports \na limited number of instructions.\n\n");
 
     printf("positional arguments:\n");
@@ -203,7 +1107,32 @@ void PrintUsage()
     printf("options:\n");
     printf("  --exec, -e\t\tsimulate execution of assembly\n");
     printf("  --show-clocks, -c\tshow clock count estimate for each instruction\n");
+    printf("  --timing model\t\tclock estimate model: static (default), 8086 or 8088. 8086 and 8088 simulate the\n");
+    printf("               \t\tprefetch queue and bus while executing, and require the interpreter engine\n");
+    printf("  --save-state path\tsave the processor's registers and memory to 'path' after execution. the saved\n");
+    printf("                   \tstate can be loaded in place of a program, including by --batch and --lockstep\n");
+    printf("  --trace path\t\trecord every executed instruction and the changes it makes into a compact binary\n");
+    printf("              \t\ttrace at 'path' instead of printing them. requires --exec and the interpreter engine\n");
+    printf("  --profile count\tcount executions and clocks per address while executing, then report the 'count'\n");
+    printf("                 \thottest addresses and the instruction mix. requires the interpreter engine\n");
+    printf("  --break list\t\tstop executing before any of the comma separated addresses in 'list'. requires --exec\n");
+    printf("  --watch list\t\tstop executing after an access to memory watched by 'list', a comma separated list of\n");
+    printf("              \t\taddress[+size][:r|w|rw] (default: a byte, read and write). requires --exec\n");
     printf("  --dump, -d\t\tdump simulation memory to file after execution (%s)\n", MemoryDumpFilename);
+    printf("  --bench, -b count\tsimulate the program 'count' times without output and report its speed\n");
+    printf("  --engine name\t\texecution engine to simulate with: interpreter (default), threaded or jit.\n");
+    printf("               \t\tengines other than the interpreter only print the final state with --exec\n");
+    printf("               \t\tjit falls back to threaded on hosts that deny it executable memory\n");
+    printf("  --batch path\t\tsimulate every program in directory 'path', or listed one per line in file 'path',\n");
+    printf("              \t\tin parallel and report the final state of each\n");
+    printf("  --threads count\tnumber of threads to use with --batch or to disassemble large programs without --exec\n");
+    printf("                 \t(default: one per logical core)\n");
+    printf("  --lockstep count\tsimulate the program on 'count' (up to %u) processors at once from different\n", LOCKSTEP_MAX_LANES);
+    printf("                 \tinitial registers, executing their shared instructions in lockstep\n");
+    printf("  --seed value\t\tseed for the initial registers of --lockstep processors (default: 1)\n");
+    printf("  --differential count\tsimulate the program with --engine and the interpreter side by side, comparing\n");
+    printf("                      \ttheir state after every 'count' instructions and stopping where they first differ\n");
+    printf("  --limit count\t\tstop each --batch, --lockstep or --differential program after 'count' instructions\n");
     printf("  --help, -h\t\tshow this message\n");
 }
 
@@ -221,7 +1150,7 @@ int main(int argc, char const *argv[])
 
     START_TIMING(ParseArgs);
 
-    if (argc < 2 ||  argc > 5)
+    if (argc < 2 ||  argc > 20)
     {
         PrintUsage();
         exit(1);
@@ -234,7 +1163,21 @@ int main(int argc, char const *argv[])
     bool dumpMemoryToFile = false;
     bool showClocks = false;
     bool stopOnReturn = false;
+    U32 benchRunCount = 0;
+    engine_type engineType = Engine_Interpreter;
     const char *filename = "";
+    const char *batchPath = 0;
+    U32 threadCount = 0;
+    U64 instructionLimit = 0;
+    U32 lockstepLaneCount = 0;
+    U32 lockstepSeed = 1;
+    U64 differentialStepCount = 0;
+    U32 timingModel = 0;
+    U32 hotSpotCount = 0;
+    const char *stateFilename = 0;
+    const char *breakpointList = 0;
+    const char *watchpointList = 0;
+    const char *traceFilename = 0;
 
     for (int i = 1; i < argc; ++i)
     {
@@ -266,6 +1209,121 @@ int main(int argc, char const *argv[])
             continue;
         }
 
+        if ((strncmp("--bench", argv[i], 7) == 0)
+            || (strncmp("-b", argv[i], 2) == 0))
+        {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            benchRunCount = (U32)atoi(argv[++i]);
+            continue;
+        }
+
+        if (strncmp("--timing", argv[i], 8) == 0)
+        {
+            timingModel = ArrayCount(TimingModelNames);
+            for (U32 modelIndex = 0; (i + 1 < argc) && modelIndex < ArrayCount(TimingModelNames); ++modelIndex)
+            {
+                if (strcmp(TimingModelNames[modelIndex], argv[i + 1]) == 0)
+                {
+                    timingModel = modelIndex;
+                }
+            }
+
+            if (timingModel == ArrayCount(TimingModelNames))
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            ++i;
+            continue;
+        }
+
+        if (strncmp("--save-state", argv[i], 12) == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            stateFilename = argv[++i];
+            continue;
+        }
+
+        if (strncmp("--break", argv[i], 7) == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            breakpointList = argv[++i];
+            continue;
+        }
+
+        if (strncmp("--watch", argv[i], 7) == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            watchpointList = argv[++i];
+            continue;
+        }
+
+        if (strncmp("--trace", argv[i], 7) == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            traceFilename = argv[++i];
+            continue;
+        }
+
+        if (strncmp("--profile", argv[i], 9) == 0)
+        {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            hotSpotCount = (U32)atoi(argv[++i]);
+            continue;
+        }
+
+        if (strncmp("--engine", argv[i], 8) == 0)
+        {
+            engineType = Engine_Count;
+            for (U32 engineIndex = 0; (i + 1 < argc) && engineIndex < Engine_Count; ++engineIndex)
+            {
+                if (strcmp(EngineNames[engineIndex], argv[i + 1]) == 0)
+                {
+                    engineType = (engine_type)engineIndex;
+                }
+            }
+
+            if (engineType == Engine_Count)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            ++i;
+            continue;
+        }
+
         if ((strncmp("--stop-on-ret", argv[i], 13) == 0)
             || (strncmp("-r", argv[i], 2) == 0))
         {
@@ -273,16 +1331,115 @@ int main(int argc, char const *argv[])
             continue;
         }
 
+        if (strncmp("--batch", argv[i], 7) == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            batchPath = argv[++i];
+            continue;
+        }
+
+        if (strncmp("--threads", argv[i], 9) == 0)
+        {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            threadCount = (U32)atoi(argv[++i]);
+            continue;
+        }
+
+        if (strncmp("--lockstep", argv[i], 10) == 0)
+        {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0 || atoi(argv[i + 1]) > LOCKSTEP_MAX_LANES)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            lockstepLaneCount = (U32)atoi(argv[++i]);
+            continue;
+        }
+
+        if (strncmp("--differential", argv[i], 14) == 0)
+        {
+            if (i + 1 >= argc || strtoull(argv[i + 1], 0, 10) == 0)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            differentialStepCount = strtoull(argv[++i], 0, 10);
+            continue;
+        }
+
+        if (strncmp("--seed", argv[i], 6) == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            lockstepSeed = (U32)strtoul(argv[++i], 0, 10);
+            continue;
+        }
+
+        if (strncmp("--limit", argv[i], 7) == 0)
+        {
+            if (i + 1 >= argc || strtoull(argv[i + 1], 0, 10) == 0)
+            {
+                PrintUsage();
+                exit(1);
+            }
+
+            instructionLimit = strtoull(argv[++i], 0, 10);
+            continue;
+        }
+
         filename = argv[i];
     }
     END_TIMING(ParseArgs);
 
+    if (batchPath)
+    {
+        RunBatch(batchPath,
+                 threadCount ? threadCount : GetLogicalCoreCount(),
+                 engineType, stopOnReturn, instructionLimit);
+
+        EndTimingsProfile();
+        PrintProfileTimings();
+        return 0;
+    }
+
+    if (lockstepLaneCount)
+    {
+        RunLockstep(filename, lockstepLaneCount, lockstepSeed, stopOnReturn, instructionLimit);
+
+        EndTimingsProfile();
+        PrintProfileTimings();
+        return 0;
+    }
+
+    if (differentialStepCount)
+    {
+        B32 matched = RunDifferential(filename, engineType, differentialStepCount, stopOnReturn, instructionLimit);
+
+        EndTimingsProfile();
+        PrintProfileTimings();
+        return matched ? 0 : 1;
+    }
+
     // initialize processor
     START_TIMING(InitProcessor)
     processor_8086 processor = {};
-    processor.Memory = (U8 *)calloc(processor.MemorySize, sizeof(U8));
-
-    if (!processor.Memory)
+    if (!AllocateProcessorMemory(&processor))
     {
         printf("ERROR: Unable to allocate main memory for 8086\n");
         exit(1);
@@ -298,70 +1455,312 @@ int main(int argc, char const *argv[])
         exit(1);
     }
 
-    START_TIMING(LoadProgramFromFile)
-    FILE *file = {};
-    file = fopen(filename, "rb");
-
-    if(!file)
+    // init instruction cache
+    // Note (Aaron): Only worth paying for when instructions get executed (and potentially revisited)
+    instruction_cache instructionCache = {};
+    if (simulateInstructions || benchRunCount)
     {
-        printf("ERROR: Unable to open '%s'\n", filename);
-        exit(1);
+        U64 cacheMemorySize = (sizeof(U32) * processor.MemorySize) + (sizeof(packed_instruction) * Kilobytes(64));
+        memory_arena cacheArena = ArenaAllocate(cacheMemorySize, cacheMemorySize);
+        if (!ArenaIsValid(&cacheArena)
+            || !InitializeInstructionCache(&instructionCache, &cacheArena, processor.MemorySize))
+        {
+            printf("ERROR: Unable to allocate instruction cache for sim8086\n");
+            exit(1);
+        }
+
+        processor.InstructionCache = &instructionCache;
     }
 
-    processor.ProgramSize = (U16)fread(processor.Memory, 1, processor.MemorySize, file);
+    // init bus timing model
+    bus_timing busTiming = {};
+    if (timingModel)
+    {
+        if (engineType != Engine_Interpreter)
+        {
+            printf("ERROR: --timing %s is only supported by the interpreter engine\n", TimingModelNames[timingModel]);
+            exit(1);
+        }
+
+        InitializeBusTiming(&busTiming, (bus_timing_model)(timingModel - 1));
+        processor.BusTiming = &busTiming;
+    }
 
-    // error handling for file read
-    if (ferror(file))
+    // init execution engine
+    execution_engine engine = {};
+    if ((simulateInstructions || benchRunCount)
+        && !InitializeExecutionEngine(&engine, engineType, processor.MemorySize))
     {
-        printf("ERROR: Encountered error while reading file '%s'", filename);
+        printf("ERROR: Unable to allocate %s engine for sim8086\n", EngineNames[engineType]);
         exit(1);
     }
 
-    if (!feof(file))
+    if (simulateInstructions || benchRunCount)
     {
-        printf("ERROR: Program size exceeds processor memory; unable to load\n\n");
-        exit(1);
+        WarnOnEngineFallback(engineType, engine.Type);
     }
 
-    fclose(file);
+    START_TIMING(LoadProgramFromFile)
+    // Note (Aaron): Processor dumps restore the state they were saved in, any other file is a program
+    bool loadedState = IsProcessorDumpFile(filename);
+    if (loadedState)
+    {
+        if (!LoadProcessorFromFile(&processor, filename))
+        {
+            printf("ERROR: Unable to load processor dump '%s'\n", filename);
+            exit(1);
+        }
+    }
+    else
+    {
+        FILE *file = {};
+        file = fopen(filename, "rb");
+
+        if(!file)
+        {
+            printf("ERROR: Unable to open '%s'\n", filename);
+            exit(1);
+        }
+
+        processor.ProgramSize = (U32)fread(processor.Memory, 1, processor.MemorySize, file);
+
+        // error handling for file read
+        if (ferror(file))
+        {
+            printf("ERROR: Encountered error while reading file '%s'", filename);
+            exit(1);
+        }
+
+        if (!feof(file))
+        {
+            printf("ERROR: Program size exceeds processor memory; unable to load\n\n");
+            exit(1);
+        }
+
+        fclose(file);
+    }
     END_TIMING(LoadProgramFromFile)
 
     // TODO (Aaron): Should I assert anything here?
     //  - Feedback for empty program?
 
-    printf("; %s:\n", filename);
-    printf("bits 16\n");
+    // init breakpoints and watchpoints
+    breakpoint_set breakpoints = {};
+    if (breakpointList || watchpointList)
+    {
+        if (!simulateInstructions || benchRunCount)
+        {
+            printf("ERROR: --break and --watch require --exec, and can't be used with --bench\n");
+            exit(1);
+        }
+
+        U64 breakpointMemorySize = (processor.MemorySize / 8) + (processor.MemorySize >> WATCH_PAGE_SHIFT) + Kilobytes(4);
+        memory_arena breakpointArena = ArenaAllocate(breakpointMemorySize, breakpointMemorySize);
+        if (!ArenaIsValid(&breakpointArena)
+            || !InitializeBreakpoints(&breakpoints, &breakpointArena, processor.MemorySize))
+        {
+            printf("ERROR: Unable to allocate breakpoints for sim8086\n");
+            exit(1);
+        }
+
+        if ((breakpointList && !ParseBreakpoints(&breakpoints, breakpointList))
+            || (watchpointList && !ParseWatchpoints(&breakpoints, watchpointList)))
+        {
+            PrintUsage();
+            exit(1);
+        }
+
+        // Note (Aaron): A saved state resumes from where it was saved, which may well be a breakpoint
+        if (loadedState && HasBreakpoint(&breakpoints, processor.IP))
+        {
+            breakpoints.StopReason = StopReason_Breakpoint;
+            breakpoints.StopAddress = processor.IP;
+        }
+
+        processor.Breakpoints = &breakpoints;
+    }
+
+    if (benchRunCount)
+    {
+        RunBenchmark(&processor, benchRunCount, &engine, stopOnReturn);
+
+        EndTimingsProfile();
+        PrintProfileTimings();
+
+        return 0;
+    }
+
+    // init execution profile
+    // Note (Aaron): Instructions only execute from the loaded program, so its addresses are all that's profiled
+    execution_profile profile = {};
+    memory_arena profileArena = {};
+    if (hotSpotCount && simulateInstructions)
+    {
+        if (engineType != Engine_Interpreter)
+        {
+            printf("ERROR: --profile is only supported by the interpreter engine\n");
+            exit(1);
+        }
+
+        U64 profileMemorySize = (U64)(4 * sizeof(U32)) * (processor.ProgramSize + 1);
+        profileArena = ArenaAllocate(profileMemorySize, profileMemorySize);
+        if (!ArenaIsValid(&profileArena)
+            || !InitializeExecutionProfile(&profile, &profileArena, processor.ProgramSize))
+        {
+            printf("ERROR: Unable to allocate execution profile for sim8086\n");
+            exit(1);
+        }
+
+        processor.Profile = &profile;
+    }
+
+    // init trace recorder
+    // Note (Aaron): Starts from the loaded state, so that the trace can be replayed from it
+    trace_recorder traceRecorder = {};
+    if (traceFilename)
+    {
+        if (!simulateInstructions || engineType != Engine_Interpreter)
+        {
+            printf("ERROR: --trace requires --exec and the interpreter engine\n");
+            exit(1);
+        }
+
+        U64 traceMemorySize = 2 * TRACE_BUFFER_SIZE;
+        memory_arena traceArena = ArenaAllocate(traceMemorySize, traceMemorySize);
+        if (!ArenaIsValid(&traceArena)
+            || !InitializeTraceRecorder(&traceRecorder, &traceArena))
+        {
+            printf("ERROR: Unable to allocate trace recorder for sim8086\n");
+            exit(1);
+        }
+
+        if (!StartTrace(&traceRecorder, &processor, traceFilename))
+        {
+            printf("ERROR: Unable to write trace to '%s'\n", traceFilename);
+            exit(1);
+        }
+
+        processor.Trace = &traceRecorder;
+    }
+
+    // init output buffer
+    // Note (Aaron): Flushed at exit as well, so output isn't lost when the simulation exits on an error
+    U64 outputMemorySize = Megabytes(8);
+    memory_arena outputArena = ArenaAllocate(outputMemorySize, outputMemorySize);
+    if (!ArenaIsValid(&outputArena)
+        || !InitializeOutputBuffer(&StandardOutput, &outputArena, outputMemorySize, stdout))
+    {
+        printf("ERROR: Unable to allocate output buffer for sim8086\n");
+        exit(1);
+    }
+    atexit(FlushStandardOutput);
+
+    output_buffer *output = &StandardOutput;
+    OutputCString(output, "; ");
+    OutputCString(output, filename);
+    OutputCString(output, ":\nbits 16\n");
+
+    // Note (Aaron): Other engines don't execute instruction by instruction, so there is nothing to trace. A binary
+    // trace replaces the text one.
+    bool traceInstructions = !simulateInstructions || (engineType == Engine_Interpreter && !processor.Trace);
+    if (!traceInstructions)
+    {
+        ExecuteEngine(&engine, &processor, stopOnReturn, 0);
+    }
+
+    // Note (Aaron): Without execution the program is decoded in address order, so most of it can be decoded up front
+    // on several threads. Whatever that leaves is decoded as the trace goes.
+    packed_instruction *decodedInstructions = 0;
+    U32 decodedCount = 0;
+    U32 decodedIndex = 0;
+    if (!simulateInstructions)
+    {
+        START_TIMING(DecodeProgram)
+        U64 decodeMemorySize = (U64)sizeof(packed_instruction) * processor.ProgramSize;
+        memory_arena decodeArena = ArenaAllocate(Megabytes(1), decodeMemorySize);
+        if (ArenaIsValid(&decodeArena))
+        {
+            decodedInstructions = DecodeProgramInParallel(&processor, &decodeArena,
+                                                          threadCount ? threadCount : GetLogicalCoreCount(), &decodedCount);
+        }
+        END_TIMING(DecodeProgram)
+    }
 
-    while (processor.IP < processor.ProgramSize)
+    // Note (Aaron): Other engines have already run, and left the reason they stopped in the breakpoints
+    B32 resumingFromBreakpoint = traceInstructions && processor.Breakpoints && ResumeExecution(processor.Breakpoints, processor.IP);
+    U32 startInstructionCount = processor.InstructionCount;
+    while (traceInstructions && (decodedIndex < decodedCount || !HasProcessorFinishedExecution(&processor)))
     {
+        if (processor.Breakpoints
+            && ShouldStopExecution(processor.Breakpoints, processor.IP, resumingFromBreakpoint && processor.InstructionCount == startInstructionCount))
+        {
+            break;
+        }
+
         START_TIMING(MainLoop)
 
-        instruction instruction = DecodeNextInstruction(&processor);
-        PrintInstruction(&instruction);
+        instruction instruction = (decodedIndex < decodedCount)
+            ? UnpackInstruction(&decodedInstructions[decodedIndex++], &processor)
+            : DecodeNextInstruction(&processor);
+        // Note (Aaron): Executing the instruction would raise the same fault, disassembly stops at it too
+        if (instruction.Address + instruction.Bits.ByteCount > processor.ProgramSize)
+        {
+            RaiseProcessorFault(&processor, Fault_InstructionStream, instruction.Address);
+            break;
+        }
+        PrintInstruction(output, &instruction);
 
         if (showClocks || simulateInstructions)
         {
-            printf(" ;");
+            OutputCString(output, " ;");
+        }
+
+        // Note (Aaron): The bus model, and the number of times a rep prefixed instruction repeats, are only known
+        // once it executes
+        B32 executed = FALSE;
+        U32 previousClockCount = processor.TotalClockCount;
+        Str8 result = {};
+        if (simulateInstructions && (processor.BusTiming || instruction.RepPrefix != Rep_None))
+        {
+            result = ExecuteInstruction(&processor, &instruction, &scratchArena);
+            executed = TRUE;
         }
 
         if (showClocks)
         {
-            PrintClocks(&processor, &instruction);
+            if (executed)
+            {
+                PrintExecutedClocks(output, processor.BusTiming, &instruction, processor.TotalClockCount - previousClockCount, previousClockCount);
+            }
+            else
+            {
+                PrintClocks(output, &processor, &instruction);
+            }
         }
 
         if (showClocks && simulateInstructions)
         {
-            printf(" |");
+            OutputCString(output, " |");
         }
 
         if (simulateInstructions)
         {
-            Str8 result = ExecuteInstruction(&processor, &instruction, &scratchArena);
-            printf("%.*s", (int)result.Length, result.Str);
+            if (!executed)
+            {
+                result = ExecuteInstruction(&processor, &instruction, &scratchArena);
+            }
+
+            // Note (Aaron): The trace output includes its null-terminator
+            if (result.Length && result.Str[result.Length - 1] == 0)
+            {
+                result.Length--;
+            }
+
+            OutputStr8(output, result);
             ArenaClear(&scratchArena);
         }
 
-        printf("\n");
+        OutputChar(output, '\n');
 
         END_TIMING(MainLoop)
         // TODO (Aaron): Test this. Will have to write an assembly specifically to do this as the listings provided
@@ -374,17 +1773,47 @@ int main(int argc, char const *argv[])
 
     if (simulateInstructions)
     {
-        printf("\n");
-        PrintRegisters(&processor);
-        printf("\n");
+        OutputChar(output, '\n');
+        if (processor.Breakpoints)
+        {
+            PrintStopReason(output, &processor);
+        }
+        PrintProcessorFault(output, &processor);
+        PrintRegisters(output, &processor);
+        OutputChar(output, '\n');
+
+        if (processor.Trace)
+        {
+            PrintTraceSummary(output, processor.Trace, traceFilename);
+        }
+
+        if (processor.Profile)
+        {
+            OutputChar(output, '\n');
+            PrintHotSpots(output, &processor, processor.Profile, hotSpotCount);
+            OutputChar(output, '\n');
+        }
+
+        // Note (Aaron): Dumps report errors with printf
+        FlushOutputBuffer(output);
 
         if (dumpMemoryToFile)
         {
             DumpMemoryToFile(&processor, MemoryDumpFilename);
         }
+
+        if (stateFilename)
+        {
+            DumpProcessorToFile(&processor, stateFilename);
+        }
+    }
+    else
+    {
+        PrintProcessorFault(output, &processor);
     }
 
-    printf("\n");
+    OutputChar(output, '\n');
+    FlushOutputBuffer(output);
 
     EndTimingsProfile();
     PrintProfileTimings();
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+
+#include "base_types.h"
+#include "base_arena.h"
+#include "base_threads.h"
+#include "sim8086.h"
+#include "sim8086_disassembly.h"
+
+
+// Note (Aaron): Decodes the chunk from each offset an instruction stream can enter it at. The stream from the
+// start of the chunk is decoded in full; the others stop as soon as they reach one of its instructions, as
+// from there on they are the same stream.
+static void DecodeChunkStreams(parallel_disassembly *disassembly, disassembly_chunk *chunk)
+{
+    processor_8086 decoder = *disassembly->Processor;
+    decoder.InstructionCache = 0;
+
+    U32 *streamIndex = disassembly->StreamIndex;
+    U32 address = chunk->StartAddress;
+    U32 count = 0;
+
+    while (address < chunk->EndAddress)
+    {
+        streamIndex[address] = ++count;
+        instruction instruction = FetchInstruction(&decoder, address);
+        address += instruction.Bits.ByteCount;
+    }
+
+    chunk->ExitAddress[0] = address;
+    chunk->InstructionCount[0] = count;
+
+    for (U32 entry = 1; entry < DISASSEMBLY_ENTRY_COUNT; ++entry)
+    {
+        address = chunk->StartAddress + entry;
+        count = 0;
+
+        while (address < chunk->EndAddress && !streamIndex[address])
+        {
+            instruction instruction = FetchInstruction(&decoder, address);
+            address += instruction.Bits.ByteCount;
+            ++count;
+        }
+
+        if (address < chunk->EndAddress)
+        {
+            count += chunk->InstructionCount[0] - (streamIndex[address] - 1);
+            address = chunk->ExitAddress[0];
+        }
+
+        chunk->ExitAddress[entry] = address;
+        chunk->InstructionCount[entry] = count;
+    }
+}
+
+
+// Note (Aaron): Decodes the chunk's instructions from the offset the program's instruction stream enters it at
+static void DecodeChunkInstructions(parallel_disassembly *disassembly, disassembly_chunk *chunk)
+{
+    processor_8086 decoder = *disassembly->Processor;
+    decoder.InstructionCache = 0;
+
+    packed_instruction *instructions = disassembly->Instructions + chunk->FirstInstruction;
+    U32 count = chunk->InstructionCount[chunk->EntryAddress - chunk->StartAddress];
+    U32 address = chunk->EntryAddress;
+
+    for (U32 i = 0; i < count; ++i)
+    {
+        instruction instruction = FetchInstruction(&decoder, address);
+        instructions[i] = PackInstruction(&instruction);
+        address += instruction.Bits.ByteCount;
+    }
+}
+
+
+static void DisassemblyWorkerProc(void *data)
+{
+    disassembly_worker *worker = (disassembly_worker *)data;
+    parallel_disassembly *disassembly = worker->Disassembly;
+
+    for (;;)
+    {
+        U32 chunkIndex = AtomicIncrementU32(&disassembly->NextChunk) - 1;
+        if (chunkIndex >= disassembly->ChunkCount)
+        {
+            break;
+        }
+
+        disassembly_chunk *chunk = &disassembly->Chunks[chunkIndex];
+        if (disassembly->Decoding)
+        {
+            DecodeChunkInstructions(disassembly, chunk);
+        }
+        else
+        {
+            DecodeChunkStreams(disassembly, chunk);
+        }
+    }
+}
+
+
+// Note (Aaron): The calling thread works through the chunks too, and finishes them alone if no threads
+// could be created.
+static void RunDisassemblyWorkers(parallel_disassembly *disassembly, disassembly_worker *workers, U32 workerCount)
+{
+    disassembly->NextChunk = 0;
+
+    workers[0].Disassembly = disassembly;
+
+    U32 threadCount = 1;
+    for (U32 workerIndex = 1; workerIndex < workerCount; ++workerIndex)
+    {
+        disassembly_worker *worker = &workers[threadCount];
+        worker->Disassembly = disassembly;
+        if (ThreadCreate(&worker->Thread, DisassemblyWorkerProc, worker))
+        {
+            ++threadCount;
+        }
+    }
+
+    DisassemblyWorkerProc(&workers[0]);
+
+    for (U32 workerIndex = 1; workerIndex < threadCount; ++workerIndex)
+    {
+        ThreadJoin(&workers[workerIndex].Thread);
+    }
+}
+
+
+// Note (Aaron): Decodes the program from the processor's instruction pointer into consecutive packed instructions
+// pushed onto 'arena', leaving the processor as the same number of DecodeNextInstruction() calls would. The
+// program is split into chunks that are decoded on 'threadCount' threads from every offset the previous chunk's
+// last instruction could end at, then stitched together by following the offsets. Decoding stops short of the
+// last few bytes of the program (and small programs aren't decoded at all); the caller decodes the rest with
+// DecodeNextInstruction(), so that instructions running past the end fail exactly as they otherwise would.
+global_function packed_instruction *DecodeProgramInParallel(processor_8086 *processor, memory_arena *arena, U32 threadCount, U32 *instructionCount)
+{
+    U32 startAddress = processor->IP;
+    U32 endAddress = (processor->ProgramSize >= MAX_INSTRUCTION_SIZE) ? processor->ProgramSize - MAX_INSTRUCTION_SIZE + 1 : 0;
+    U32 chunkCount = (endAddress > startAddress) ? (endAddress - startAddress) / DISASSEMBLY_CHUNK_SIZE : 0;
+    threadCount = Min(threadCount, chunkCount);
+
+    parallel_disassembly disassembly = {};
+    disassembly_worker *workers = 0;
+    if (threadCount > 1)
+    {
+        disassembly.Processor = processor;
+        disassembly.Chunks = (disassembly_chunk *)calloc(chunkCount, sizeof(disassembly_chunk));
+        disassembly.StreamIndex = (U32 *)calloc(endAddress, sizeof(U32));
+        workers = (disassembly_worker *)calloc(threadCount, sizeof(disassembly_worker));
+    }
+
+    packed_instruction *result = 0;
+    U32 count = 0;
+
+    if (disassembly.Chunks && disassembly.StreamIndex && workers)
+    {
+        disassembly.ChunkCount = chunkCount;
+        for (U32 chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+        {
+            disassembly_chunk *chunk = &disassembly.Chunks[chunkIndex];
+            chunk->StartAddress = startAddress + (chunkIndex * DISASSEMBLY_CHUNK_SIZE);
+            chunk->EndAddress = (chunkIndex + 1 < chunkCount) ? chunk->StartAddress + DISASSEMBLY_CHUNK_SIZE : endAddress;
+        }
+
+        RunDisassemblyWorkers(&disassembly, workers, threadCount);
+
+        // Note (Aaron): The program's stream enters the first chunk at its start and each following chunk where
+        // the stream through the previous chunk left it
+        U32 address = startAddress;
+        for (U32 chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+        {
+            disassembly_chunk *chunk = &disassembly.Chunks[chunkIndex];
+            U32 entry = address - chunk->StartAddress;
+            Assert(entry < DISASSEMBLY_ENTRY_COUNT);
+
+            chunk->EntryAddress = address;
+            chunk->FirstInstruction = count;
+            count += chunk->InstructionCount[entry];
+            address = chunk->ExitAddress[entry];
+        }
+
+        result = ArenaPushArray(arena, packed_instruction, count);
+        if (result)
+        {
+            disassembly.Instructions = result;
+            disassembly.Decoding = TRUE;
+            RunDisassemblyWorkers(&disassembly, workers, threadCount);
+
+            processor->InstructionCount += count;
+            if (count)
+            {
+                processor->PrevIP = result[count - 1].Address;
+            }
+            processor->IP = address;
+
+            if (processor->InstructionCache)
+            {
+                for (U32 i = 0; i < count; ++i)
+                {
+                    CacheInstruction(processor->InstructionCache, &result[i]);
+                }
+            }
+        }
+        else
+        {
+            count = 0;
+        }
+    }
+
+    free(disassembly.Chunks);
+    free(disassembly.StreamIndex);
+    free(workers);
+
+    *instructionCount = count;
+    return result;
+}
@@ -0,0 +1,57 @@
+#ifndef SIM8086_DISASSEMBLY_H
+#define SIM8086_DISASSEMBLY_H
+
+#include "base_types.h"
+#include "base_arena.h"
+#include "base_threads.h"
+#include "sim8086.h"
+
+// Note (Aaron): Programs smaller than two chunks are left to be decoded sequentially
+#define DISASSEMBLY_CHUNK_SIZE Kilobytes(16)
+
+// Note (Aaron): An instruction that crosses into a chunk ends at most this many bytes past the chunk's start
+#define DISASSEMBLY_ENTRY_COUNT MAX_INSTRUCTION_SIZE
+
+
+// Note (Aaron): Where a chunk's instruction stream ends up and how many instructions it decodes, for each
+// offset from the start of the chunk that the previous chunk's stream may enter it at.
+struct disassembly_chunk
+{
+    U32 StartAddress;
+    U32 EndAddress;
+
+    U32 ExitAddress[DISASSEMBLY_ENTRY_COUNT];
+    U32 InstructionCount[DISASSEMBLY_ENTRY_COUNT];
+
+    // Note (Aaron): Filled in once the chunks have been stitched together
+    U32 EntryAddress;
+    U32 FirstInstruction;
+};
+
+
+struct parallel_disassembly
+{
+    processor_8086 *Processor;
+    disassembly_chunk *Chunks;
+    U32 ChunkCount;
+    U32 volatile NextChunk;
+
+    // Note (Aaron): 1-based position of each instruction within its chunk's stream from the chunk start,
+    // indexed by address. Streams from other offsets join that stream at the first address it has.
+    U32 *StreamIndex;
+
+    packed_instruction *Instructions;
+    B32 Decoding;
+};
+
+
+struct disassembly_worker
+{
+    os_thread Thread;
+    parallel_disassembly *Disassembly;
+};
+
+
+global_function packed_instruction *DecodeProgramInParallel(processor_8086 *processor, memory_arena *arena, U32 threadCount, U32 *instructionCount);
+
+#endif // SIM8086_DISASSEMBLY_H
@@ -0,0 +1,377 @@
+#include "base_types.h"
+#include "sim8086.h"
+#include "sim8086_encoder.h"
+
+
+// Note (Aaron): Instruction bytes are written front to back into a buffer of at least MAX_INSTRUCTION_SIZE bytes
+struct instruction_encoder
+{
+    U8 *Bytes;
+    U32 ByteCount;
+};
+
+
+inline static void WriteEncodedByte(instruction_encoder *encoder, U8 value)
+{
+    assert_8086(encoder->ByteCount < MAX_INSTRUCTION_SIZE);
+    encoder->Bytes[encoder->ByteCount++] = value;
+}
+
+
+inline static void WriteEncodedWord(instruction_encoder *encoder, U16 value)
+{
+    WriteEncodedByte(encoder, (U8)(value & 0xff));
+    WriteEncodedByte(encoder, (U8)(value >> 8));
+}
+
+
+// Note (Aaron): The inverse of RegMemTables. Returns the value of the reg or r/m field that selects 'reg' in the
+// given table, or 0xff if it isn't in it.
+static U8 GetRegMemBits(U32 table, register_id reg)
+{
+    for (U8 bits = 0; bits < 8; ++bits)
+    {
+        if (RegMemTables[table][bits] == reg)
+        {
+            return bits;
+        }
+    }
+
+    return 0xff;
+}
+
+
+inline static B32 IsAccumulator(instruction_operand *operand)
+{
+    B32 result = (operand->Type == Operand_Register) && (operand->Register == Reg_al || operand->Register == Reg_ax);
+    return result;
+}
+
+
+// Note (Aaron): Does the immediate survive being stored as a byte and sign-extended back?
+inline static B32 FitsSignedByte(U16 value)
+{
+    B32 result = ((U16)(S16)(S8)(value & 0xff) == value);
+    return result;
+}
+
+
+// Note (Aaron): Writes the mod/reg/rm byte for an r/m operand, followed by its displacement or direct address.
+// Displacements take the fewest bytes they fit in and are left out when they are 0, as NASM does. [bp] has no
+// encoding without a displacement, so it gets an 8-bit one.
+static B32 WriteModRegRm(instruction_encoder *encoder, U8 regBits, instruction_operand *rm)
+{
+    if (rm->Type == Operand_Register)
+    {
+        U8 rmBits = GetRegMemBits(RegisterLookup[rm->Register].IsWide ? 1 : 0, rm->Register);
+        if (rmBits == 0xff)
+        {
+            return FALSE;
+        }
+
+        WriteEncodedByte(encoder, (U8)(0b11000000 | (regBits << 3) | rmBits));
+        return TRUE;
+    }
+
+    if (rm->Type != Operand_Memory)
+    {
+        return FALSE;
+    }
+
+    if (rm->Memory.Flags & Memory_HasDirectAddress)
+    {
+        WriteEncodedByte(encoder, (U8)((regBits << 3) | 0b110));
+        WriteEncodedWord(encoder, rm->Memory.DirectAddress);
+        return TRUE;
+    }
+
+    U8 rmBits = GetRegMemBits(2, rm->Memory.Register);
+    if (rmBits == 0xff)
+    {
+        return FALSE;
+    }
+
+    S16 displacement = (rm->Memory.Flags & Memory_HasDisplacement) ? rm->Memory.Displacement : 0;
+    if (displacement == 0 && rm->Memory.Register != Reg_bp)
+    {
+        WriteEncodedByte(encoder, (U8)((regBits << 3) | rmBits));
+    }
+    else if (displacement >= -128 && displacement <= 127)
+    {
+        WriteEncodedByte(encoder, (U8)(0b01000000 | (regBits << 3) | rmBits));
+        WriteEncodedByte(encoder, (U8)displacement);
+    }
+    else
+    {
+        WriteEncodedByte(encoder, (U8)(0b10000000 | (regBits << 3) | rmBits));
+        WriteEncodedWord(encoder, (U16)displacement);
+    }
+
+    return TRUE;
+}
+
+
+inline static void WriteImmediate(instruction_encoder *encoder, U16 value, B32 wide)
+{
+    if (wide)
+    {
+        WriteEncodedWord(encoder, value);
+    }
+    else
+    {
+        WriteEncodedByte(encoder, (U8)(value & 0xff));
+    }
+}
+
+
+static B32 EncodeMov(instruction_encoder *encoder, instruction_operand *dest, instruction_operand *source)
+{
+    B32 wide = IsOperandWide(dest);
+    U8 widthBit = wide ? 1 : 0;
+
+    if (source->Type == Operand_Immediate)
+    {
+        // immediate to register (0b1011wreg)
+        if (dest->Type == Operand_Register)
+        {
+            WriteEncodedByte(encoder, (U8)(0b10110000 | (widthBit << 3) | GetRegMemBits(widthBit, dest->Register)));
+            WriteImmediate(encoder, source->Immediate.Value, wide);
+            return TRUE;
+        }
+
+        // immediate to memory (0b1100011w)
+        WriteEncodedByte(encoder, (U8)(0b11000110 | widthBit));
+        if (!WriteModRegRm(encoder, 0b000, dest))
+        {
+            return FALSE;
+        }
+        WriteImmediate(encoder, source->Immediate.Value, wide);
+        return TRUE;
+    }
+
+    if (source->Type != Operand_Register && dest->Type != Operand_Register)
+    {
+        return FALSE;
+    }
+
+    // memory to accumulator (0b1010000w) and accumulator to memory (0b1010001w)
+    if (IsAccumulator(dest) && source->Type == Operand_Memory && (source->Memory.Flags & Memory_HasDirectAddress))
+    {
+        WriteEncodedByte(encoder, (U8)(0b10100000 | widthBit));
+        WriteEncodedWord(encoder, source->Memory.DirectAddress);
+        return TRUE;
+    }
+
+    if (IsAccumulator(source) && dest->Type == Operand_Memory && (dest->Memory.Flags & Memory_HasDirectAddress))
+    {
+        WriteEncodedByte(encoder, (U8)(0b10100010 | widthBit));
+        WriteEncodedWord(encoder, dest->Memory.DirectAddress);
+        return TRUE;
+    }
+
+    // register/memory to/from register (0b100010dw)
+    // Note (Aaron): Register to register moves put the destination in r/m
+    B32 destInReg = (source->Type == Operand_Memory);
+    instruction_operand *reg = destInReg ? dest : source;
+    instruction_operand *rm = destInReg ? source : dest;
+
+    WriteEncodedByte(encoder, (U8)(0b10001000 | ((destInReg ? 1 : 0) << 1) | widthBit));
+    return WriteModRegRm(encoder, GetRegMemBits(widthBit, reg->Register), rm);
+}
+
+
+static B32 EncodeArithmetic(instruction_encoder *encoder, operation_types opType, instruction_operand *dest, instruction_operand *source)
+{
+    U8 opBits = (opType == Op_add) ? 0b000
+              : (opType == Op_sub) ? 0b101
+              : 0b111;
+
+    B32 wide = IsOperandWide(dest);
+    U8 widthBit = wide ? 1 : 0;
+
+    if (source->Type == Operand_Immediate)
+    {
+        U16 value = source->Immediate.Value & (wide ? 0xffff : 0xff);
+        B32 signExtend = wide && FitsSignedByte(value);
+
+        // immediate to accumulator (0b00ooo10w)
+        // Note (Aaron): NASM prefers the sign-extended form for ax when the immediate fits in a byte
+        if (IsAccumulator(dest) && !signExtend)
+        {
+            WriteEncodedByte(encoder, (U8)((opBits << 3) | 0b100 | widthBit));
+            WriteImmediate(encoder, value, wide);
+            return TRUE;
+        }
+
+        // immediate to register/memory (0b100000sw)
+        WriteEncodedByte(encoder, (U8)(0b10000000 | ((signExtend ? 1 : 0) << 1) | widthBit));
+        if (!WriteModRegRm(encoder, opBits, dest))
+        {
+            return FALSE;
+        }
+        WriteImmediate(encoder, value, wide && !signExtend);
+        return TRUE;
+    }
+
+    if (source->Type != Operand_Register && dest->Type != Operand_Register)
+    {
+        return FALSE;
+    }
+
+    // reg/memory with register to either (0b00ooo0dw)
+    B32 destInReg = (source->Type == Operand_Memory);
+    instruction_operand *reg = destInReg ? dest : source;
+    instruction_operand *rm = destInReg ? source : dest;
+
+    WriteEncodedByte(encoder, (U8)((opBits << 3) | ((destInReg ? 1 : 0) << 1) | widthBit));
+    return WriteModRegRm(encoder, GetRegMemBits(widthBit, reg->Register), rm);
+}
+
+
+static U8 GetJumpOpcode(operation_types opType)
+{
+    switch (opType)
+    {
+        case Op_jo:     return 0b01110000;
+        case Op_jno:    return 0b01110001;
+        case Op_jb:     return 0b01110010;
+        case Op_jnb:    return 0b01110011;
+        case Op_je:     return 0b01110100;
+        case Op_jne:    return 0b01110101;
+        case Op_jbe:    return 0b01110110;
+        case Op_ja:     return 0b01110111;
+        case Op_js:     return 0b01111000;
+        case Op_jns:    return 0b01111001;
+        case Op_jp:     return 0b01111010;
+        case Op_jnp:    return 0b01111011;
+        case Op_jl:     return 0b01111100;
+        case Op_jnl:    return 0b01111101;
+        case Op_jle:    return 0b01111110;
+        case Op_jg:     return 0b01111111;
+        case Op_loopnz: return 0b11100000;
+        case Op_loopz:  return 0b11100001;
+        case Op_loop:   return 0b11100010;
+        case Op_jcxz:   return 0b11100011;
+        default:        return 0;
+    }
+}
+
+
+static U8 GetStringOpcode(operation_types opType)
+{
+    switch (opType)
+    {
+        case Op_movs:   return 0b10100100;
+        case Op_cmps:   return 0b10100110;
+        case Op_stos:   return 0b10101010;
+        case Op_lods:   return 0b10101100;
+        case Op_scas:   return 0b10101110;
+        default:        return 0;
+    }
+}
+
+
+// Note (Aaron): Encodes the instruction into 'buffer', which must hold at least MAX_INSTRUCTION_SIZE bytes, the way
+// NASM assembles it. Where an instruction has more than one encoding only NASM's is produced, so instructions decoded
+// from other encodings come back as equivalent instructions with different bytes. Far returns come back as near
+// returns, which the decoder doesn't tell apart. Returns the number of bytes written, or 0 if the instruction can't
+// be encoded.
+global_function U32 EncodeInstruction(instruction *instruction, U8 *buffer)
+{
+    instruction_encoder encoder = { buffer, 0 };
+    instruction_operand *dest = &instruction->Operands[0];
+    instruction_operand *source = &instruction->Operands[1];
+
+    B32 encoded = FALSE;
+    switch (instruction->OpType)
+    {
+        case Op_mov:
+        {
+            encoded = EncodeMov(&encoder, dest, source);
+            break;
+        }
+
+        case Op_add:
+        case Op_sub:
+        case Op_cmp:
+        {
+            encoded = EncodeArithmetic(&encoder, instruction->OpType, dest, source);
+            break;
+        }
+
+        case Op_jne:
+        case Op_je:
+        case Op_jl:
+        case Op_jle:
+        case Op_jb:
+        case Op_jbe:
+        case Op_jp:
+        case Op_jo:
+        case Op_js:
+        case Op_jnl:
+        case Op_jg:
+        case Op_jnb:
+        case Op_ja:
+        case Op_jnp:
+        case Op_jno:
+        case Op_jns:
+        case Op_loop:
+        case Op_loopz:
+        case Op_loopnz:
+        case Op_jcxz:
+        {
+            WriteEncodedByte(&encoder, GetJumpOpcode(instruction->OpType));
+            WriteEncodedByte(&encoder, (U8)(dest->Immediate.Value & 0xff));
+            encoded = TRUE;
+            break;
+        }
+
+        case Op_movs:
+        case Op_cmps:
+        case Op_scas:
+        case Op_lods:
+        case Op_stos:
+        {
+            if (instruction->RepPrefix != Rep_None)
+            {
+                WriteEncodedByte(&encoder, (instruction->RepPrefix == Rep_RepE) ? 0b11110011 : 0b11110010);
+            }
+
+            WriteEncodedByte(&encoder, (U8)(GetStringOpcode(instruction->OpType) | (instruction->WidthBit ? 1 : 0)));
+            encoded = TRUE;
+            break;
+        }
+
+        case Op_cld:
+        case Op_std:
+        {
+            WriteEncodedByte(&encoder, (instruction->OpType == Op_std) ? 0b11111101 : 0b11111100);
+            encoded = TRUE;
+            break;
+        }
+
+        case Op_ret:
+        {
+            // ret within segment (optionally adding immediate to SP)
+            if (dest->Type == Operand_Immediate)
+            {
+                WriteEncodedByte(&encoder, 0b11000010);
+                WriteEncodedWord(&encoder, dest->Immediate.Value);
+            }
+            else
+            {
+                WriteEncodedByte(&encoder, 0b11000011);
+            }
+
+            encoded = TRUE;
+            break;
+        }
+
+        default:
+        {
+            break;
+        }
+    }
+
+    return encoded ? encoder.ByteCount : 0;
+}
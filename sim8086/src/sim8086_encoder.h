@@ -0,0 +1,9 @@
+#ifndef SIM8086_ENCODER_H
+#define SIM8086_ENCODER_H
+
+#include "base_types.h"
+#include "sim8086.h"
+
+global_function U32 EncodeInstruction(instruction *instruction, U8 *buffer);
+
+#endif // SIM8086_ENCODER_H
@@ -0,0 +1,347 @@
+/* Note (Aaron):
+    Execution engines behind one interface, so that callers pick one by type rather than knowing how
+    each is set up and run, and a differential check that runs a candidate engine side by side with
+    ExecuteInstruction().
+
+    The check runs the candidate in steps of at least a given number of instructions (every engine
+    stops at the end of the block that reaches its instruction limit, so a step of 1 is a block), lets a
+    reference processor catch up to the same instruction count with ExecuteInstruction(), and compares
+    the two. Longer steps give engines that skip ahead through loops room to do so.
+
+    Both processors mark the memory pages they write, and only those pages are compared after each
+    step. The JIT writes memory from its generated code without marking pages, so all of memory is
+    compared once more at the end.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "base_memory.h"
+#include "base_arena.h"
+#include "sim8086.h"
+#include "sim8086_threaded.h"
+#include "sim8086_jit.h"
+#include "sim8086_engine.h"
+
+
+global_variable char const *EngineNames[]
+{
+    "interpreter",
+    "threaded",
+    "jit",
+};
+
+
+global_variable char const *DifferentialMismatchNames[]
+{
+    "none",
+    "instruction count",
+    "instruction pointer",
+    "register",
+    "flags",
+    "clock count",
+    "fault",
+    "memory",
+};
+
+
+global_function char const *GetDifferentialMismatchName(differential_mismatch mismatch)
+{
+    static_assert_8086(ArrayCount(DifferentialMismatchNames) == Mismatch_Count,
+                       "DifferentialMismatchNames does not contain names for all mismatches");
+
+    return (mismatch < Mismatch_Count) ? DifferentialMismatchNames[mismatch] : "unknown";
+}
+
+
+// Note (Aaron): The interpreter needs nothing beyond the processor. The other engines get a lookup entry per
+// address of memory plus room for their blocks. The JIT falls back to the threaded engine where it can't get
+// code memory (or isn't supported), so engine->Type may differ from 'type'.
+global_function B32 InitializeExecutionEngine(execution_engine *engine, engine_type type, U32 memorySize)
+{
+    *engine = {};
+    engine->Type = type;
+
+    if (type == Engine_Interpreter)
+    {
+        return TRUE;
+    }
+
+    U64 engineMemorySize = (sizeof(U32) * memorySize) + Megabytes((type == Engine_Threaded) ? 8 : 1);
+    engine->Arena = ArenaAllocate(engineMemorySize, engineMemorySize);
+    if (!ArenaIsValid(&engine->Arena))
+    {
+        return FALSE;
+    }
+
+    B32 initialized = (type == Engine_Threaded)
+        ? InitializeThreadedEngine(&engine->Threaded, &engine->Arena, memorySize)
+        : InitializeJitEngine(&engine->Jit, &engine->Arena, memorySize, Megabytes(16));
+
+    if (!initialized)
+    {
+        FreeExecutionEngine(engine);
+        return (type == Engine_Jit) && InitializeExecutionEngine(engine, Engine_Threaded, memorySize);
+    }
+
+    return TRUE;
+}
+
+
+global_function void FreeExecutionEngine(execution_engine *engine)
+{
+    if (engine->Type == Engine_Jit)
+    {
+        FreeJitEngine(&engine->Jit);
+    }
+
+    if (ArenaIsValid(&engine->Arena))
+    {
+        ArenaFree(&engine->Arena);
+    }
+
+    *engine = {};
+}
+
+
+// Note (Aaron): Runs the loaded program from its current state with ExecuteInstruction(), without producing
+// any trace output. Stops under the same conditions as the other engines.
+global_function B32 ExecuteInterpreter(processor_8086 *processor, B32 stopOnReturn, U64 instructionLimit)
+{
+    breakpoint_set *breakpoints = processor->Breakpoints;
+    B32 resumingFromBreakpoint = breakpoints && ResumeExecution(breakpoints, processor->IP);
+    U32 startInstructionCount = processor->InstructionCount;
+    while (!HasProcessorFinishedExecution(processor))
+    {
+        if (instructionLimit && (U64)(processor->InstructionCount - startInstructionCount) >= instructionLimit)
+        {
+            return FALSE;
+        }
+
+        if (breakpoints
+            && ShouldStopExecution(breakpoints, processor->IP, resumingFromBreakpoint && processor->InstructionCount == startInstructionCount))
+        {
+            return FALSE;
+        }
+
+        instruction instruction = DecodeNextInstruction(processor);
+        ExecuteInstruction(processor, &instruction, 0, TraceLevel_None);
+
+        if (instruction.OpType == Op_ret && stopOnReturn)
+        {
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+
+// Note (Aaron): Runs the loaded program until it finishes, a ret executes while stopOnReturn is set, at least
+// instructionLimit instructions have executed (0 means no limit), or it reaches a breakpoint or watchpoint.
+// Returns TRUE if the program halted.
+global_function B32 ExecuteEngine(execution_engine *engine, processor_8086 *processor, B32 stopOnReturn, U64 instructionLimit)
+{
+    switch (engine->Type)
+    {
+        case Engine_Threaded:
+        {
+            return ExecuteThreaded(&engine->Threaded, processor, stopOnReturn, instructionLimit);
+        }
+
+        case Engine_Jit:
+        {
+            return ExecuteJit(&engine->Jit, processor, stopOnReturn, instructionLimit);
+        }
+
+        default:
+        {
+            return ExecuteInterpreter(processor, stopOnReturn, instructionLimit);
+        }
+    }
+}
+
+
+static B32 RecordMismatch(differential_check *check, differential_mismatch mismatch, U32 index, U32 candidateValue, U32 referenceValue)
+{
+    check->Mismatch = mismatch;
+    check->MismatchIndex = index;
+    check->CandidateValue = candidateValue;
+    check->ReferenceValue = referenceValue;
+    return FALSE;
+}
+
+
+// Note (Aaron): Compares the pages marked in either bitmap and clears them, or every page without bitmaps
+static B32 CompareDirtyPages(processor_8086 *candidate, processor_8086 *reference, U64 *candidatePages, U64 *referencePages, differential_check *check)
+{
+    U32 pageCount = (candidate->MemorySize + DIRTY_PAGE_SIZE - 1) >> DIRTY_PAGE_SHIFT;
+    for (U32 page = 0; page < pageCount; ++page)
+    {
+        U64 pageBit = 1ull << (page & 63);
+        if (candidatePages && referencePages)
+        {
+            if (!((candidatePages[page >> 6] | referencePages[page >> 6]) & pageBit))
+            {
+                continue;
+            }
+
+            candidatePages[page >> 6] &= ~pageBit;
+            referencePages[page >> 6] &= ~pageBit;
+        }
+
+        U32 pageAddress = page << DIRTY_PAGE_SHIFT;
+        U32 pageSize = Min((U32)DIRTY_PAGE_SIZE, candidate->MemorySize - pageAddress);
+        check->ComparedPageCount++;
+
+        if (memcmp(candidate->Memory + pageAddress, reference->Memory + pageAddress, pageSize) != 0)
+        {
+            U32 address = pageAddress;
+            while (candidate->Memory[address] == reference->Memory[address])
+            {
+                ++address;
+            }
+
+            return RecordMismatch(check, Mismatch_Memory, address, candidate->Memory[address], reference->Memory[address]);
+        }
+    }
+
+    return TRUE;
+}
+
+
+static B32 CompareProcessors(processor_8086 *candidate, processor_8086 *reference, differential_check *check)
+{
+    if (candidate->InstructionCount != reference->InstructionCount)
+    {
+        return RecordMismatch(check, Mismatch_InstructionCount, 0, candidate->InstructionCount, reference->InstructionCount);
+    }
+
+    if (candidate->IP != reference->IP)
+    {
+        return RecordMismatch(check, Mismatch_IP, 0, candidate->IP, reference->IP);
+    }
+
+    for (U32 registerIndex = 0; registerIndex < ArrayCount(candidate->Registers); ++registerIndex)
+    {
+        if (candidate->Registers[registerIndex] != reference->Registers[registerIndex])
+        {
+            return RecordMismatch(check, Mismatch_Register, registerIndex,
+                                  candidate->Registers[registerIndex], reference->Registers[registerIndex]);
+        }
+    }
+
+    U8 candidateFlags = GetProcessorFlags(candidate);
+    U8 referenceFlags = GetProcessorFlags(reference);
+    if (candidateFlags != referenceFlags)
+    {
+        return RecordMismatch(check, Mismatch_Flags, 0, candidateFlags, referenceFlags);
+    }
+
+    if (candidate->TotalClockCount != reference->TotalClockCount)
+    {
+        return RecordMismatch(check, Mismatch_ClockCount, 0, candidate->TotalClockCount, reference->TotalClockCount);
+    }
+
+    if (candidate->Fault != reference->Fault || candidate->FaultAddress != reference->FaultAddress)
+    {
+        return RecordMismatch(check, Mismatch_Fault, 0, candidate->Fault, reference->Fault);
+    }
+
+    return TRUE;
+}
+
+
+// Note (Aaron): Runs the loaded program on 'engine' with the 'candidate' processor, checking it against
+// ExecuteInstruction() on the 'reference' processor, which must start in the same state (see
+// CopyProcessorState()). Registers, flags, the instruction pointer, instruction and clock counts, faults and the
+// memory written are compared after every step of at least stepInstructionCount instructions (1 compares after
+// every block), and execution stops at the first mismatch, recorded in 'check'. Otherwise stops under the same
+// conditions as ExecuteEngine(), apart from breakpoints which neither processor should have. Returns TRUE if the
+// program halted.
+global_function B32 ExecuteDifferential(execution_engine *engine, processor_8086 *candidate, processor_8086 *reference, U64 stepInstructionCount, B32 stopOnReturn, U64 instructionLimit, differential_check *check)
+{
+    assert_8086(candidate->MemorySize == reference->MemorySize);
+    assert_8086(!candidate->Breakpoints && !reference->Breakpoints);
+
+    *check = {};
+
+    // Note (Aaron): Without dirty page bitmaps all of memory is compared after every step instead
+    U32 pageWordCount = (((candidate->MemorySize + DIRTY_PAGE_SIZE - 1) >> DIRTY_PAGE_SHIFT) + 63) / 64;
+    U64 *candidatePages = (U64 *)calloc(pageWordCount, sizeof(U64));
+    U64 *referencePages = (U64 *)calloc(pageWordCount, sizeof(U64));
+    if (!candidatePages || !referencePages)
+    {
+        free(candidatePages);
+        free(referencePages);
+        candidatePages = 0;
+        referencePages = 0;
+    }
+
+    U64 *candidateDirtyPages = candidate->DirtyPages;
+    U64 *referenceDirtyPages = reference->DirtyPages;
+    candidate->DirtyPages = candidatePages;
+    reference->DirtyPages = referencePages;
+
+    B32 halted = FALSE;
+    B32 matched = CompareProcessors(candidate, reference, check);
+    U32 startInstructionCount = candidate->InstructionCount;
+
+    while (matched)
+    {
+        if (HasProcessorFinishedExecution(candidate))
+        {
+            halted = TRUE;
+            break;
+        }
+
+        U64 stepLimit = Max(stepInstructionCount, (U64)1);
+        if (instructionLimit)
+        {
+            U64 executedCount = (U64)(candidate->InstructionCount - startInstructionCount);
+            if (executedCount >= instructionLimit)
+            {
+                break;
+            }
+
+            stepLimit = Min(stepLimit, instructionLimit - executedCount);
+        }
+
+        check->StepAddress = candidate->IP;
+        B32 candidateHalted = ExecuteEngine(engine, candidate, stopOnReturn, stepLimit);
+        check->StepCount++;
+
+        while ((S32)(candidate->InstructionCount - reference->InstructionCount) > 0
+               && !HasProcessorFinishedExecution(reference))
+        {
+            instruction instruction = DecodeNextInstruction(reference);
+            ExecuteInstruction(reference, &instruction, 0, TraceLevel_None);
+
+            if (instruction.OpType == Op_ret && stopOnReturn)
+            {
+                break;
+            }
+        }
+
+        matched = CompareProcessors(candidate, reference, check)
+            && CompareDirtyPages(candidate, reference, candidatePages, referencePages, check);
+
+        if (candidateHalted)
+        {
+            halted = TRUE;
+            break;
+        }
+    }
+
+    if (matched)
+    {
+        CompareDirtyPages(candidate, reference, 0, 0, check);
+    }
+
+    candidate->DirtyPages = candidateDirtyPages;
+    reference->DirtyPages = referenceDirtyPages;
+    free(candidatePages);
+    free(referencePages);
+
+    return halted;
+}
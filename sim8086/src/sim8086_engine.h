@@ -0,0 +1,70 @@
+#ifndef SIM8086_ENGINE_H
+#define SIM8086_ENGINE_H
+
+#include "base_types.h"
+#include "base_arena.h"
+#include "sim8086.h"
+#include "sim8086_threaded.h"
+#include "sim8086_jit.h"
+
+enum engine_type
+{
+    Engine_Interpreter,
+    Engine_Threaded,
+    Engine_Jit,
+
+    Engine_Count,
+};
+
+
+// Note (Aaron): One of the ways of running a processor_8086. Whichever it is, it must leave the processor in
+// exactly the state ExecuteInstruction() would, see ExecuteDifferential().
+struct execution_engine
+{
+    engine_type Type;
+    memory_arena Arena;
+
+    threaded_engine Threaded;
+    jit_engine Jit;
+};
+
+
+// Note (Aaron): What differed first between a candidate engine and the interpreter, in the order it is checked
+enum differential_mismatch
+{
+    Mismatch_None,
+    Mismatch_InstructionCount,
+    Mismatch_IP,
+    Mismatch_Register,
+    Mismatch_Flags,
+    Mismatch_ClockCount,
+    Mismatch_Fault,
+    Mismatch_Memory,
+
+    Mismatch_Count,
+};
+
+
+struct differential_check
+{
+    U64 StepCount;
+    U64 ComparedPageCount;
+
+    // Note (Aaron): The first mismatch found, after which execution stops. MismatchIndex is the register index for
+    // Mismatch_Register and the address of the first byte that differs for Mismatch_Memory.
+    differential_mismatch Mismatch;
+    U32 StepAddress;                // Where the candidate's step that led to the mismatch started
+    U32 MismatchIndex;
+    U32 CandidateValue;
+    U32 ReferenceValue;
+};
+
+
+global_function B32 InitializeExecutionEngine(execution_engine *engine, engine_type type, U32 memorySize);
+global_function void FreeExecutionEngine(execution_engine *engine);
+global_function B32 ExecuteEngine(execution_engine *engine, processor_8086 *processor, B32 stopOnReturn, U64 instructionLimit);
+
+global_function B32 ExecuteDifferential(execution_engine *engine, processor_8086 *candidate, processor_8086 *reference, U64 stepInstructionCount, B32 stopOnReturn, U64 instructionLimit, differential_check *check);
+global_function char const *GetDifferentialMismatchName(differential_mismatch mismatch);
+
+#endif // SIM8086_ENGINE_H
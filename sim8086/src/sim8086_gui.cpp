@@ -1,7 +1,3 @@
-/*TODO (Aaron):
-    - Look into culling the scroll view under the memory window to see if we can reduce work?
-*/
-
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
 #include "imgui_impl_win32.h"
@@ -45,8 +41,11 @@ global_function void ShowMainMenuBar(application_state *applicationState)
             //  - Seems messy creating sim8086_application.h and making methods for this
 
             if (ImGui::MenuItem("Run program", "F5", false, false)) {}  // Disabled item
+            if (ImGui::MenuItem("Pause program", "F6", false, false)) {}  // Disabled item
             if (ImGui::MenuItem("Reset program", "F8", false, false)) {}  // Disabled item
             if (ImGui::MenuItem("Step instruction", "F10", false, false)) {}  // Disabled item
+            if (ImGui::MenuItem("Step back", "Shift+F10", false, false)) {}  // Disabled item
+            if (ImGui::MenuItem("Toggle breakpoint", "F9", false, false)) {}  // Disabled item
 
             ImGui::EndMenu();
         }
@@ -73,44 +72,101 @@ global_function void ShowMainMenuBar(application_state *applicationState)
 
 global_function void ShowDisassemblyWindow(application_state *applicationState, processor_8086 *processor, memory_arena *instructionArena)
 {
-    size_t instructionCount = instructionArena->Used / sizeof(instruction);
-    instruction *instructions = (instruction *)instructionArena->BasePtr;
+    size_t instructionCount = instructionArena->Used / sizeof(packed_instruction);
+    packed_instruction *instructions = (packed_instruction *)instructionArena->BasePtr;
 
     ImGuiWindowFlags windowFlags = ImGuiWindowFlags_NoCollapse;
     ImGui::Begin("Disassembly", NULL, windowFlags);
 
-    for (U32 i = 0; i < instructionCount; i++)
-    {
-        instruction currentInstruction = instructions[i];
+    // Note (Aaron): The processor shown while the simulation thread runs doesn't have breakpoints, but they can't
+    // change until it stops
+    breakpoint_set *breakpoints = &applicationState->Breakpoints;
 
-        if (processor->IP == currentInstruction.Address)
+    // Note (Aaron): Lines are shaded by their share of executed clocks, relative to the hottest line
+    execution_profile *profile = processor->Profile;
+    U32 hottestClockCount = 0;
+    if (profile && profile->TotalClockCount)
+    {
+        for (U32 i = 0; i < instructionCount; i++)
         {
-            ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 1.0f, 0.0f, 1.0f));
+            U32 address = instructions[i].Address;
+            if (address < profile->AddressCount && profile->ClockCounts[address] > hottestClockCount)
+            {
+                hottestClockCount = profile->ClockCounts[address];
+            }
         }
+    }
+
+    // Note (Aaron): Only the lines in view are built, mnemonics included
+    ImGuiListClipper clipper;
+    clipper.Begin((int)instructionCount);
+    while (clipper.Step())
+    {
+        for (U32 i = (U32)clipper.DisplayStart; i < (U32)clipper.DisplayEnd; i++)
+        {
+            // Note (Aaron): Lines in view are unpacked to be printed
+            instruction unpackedInstruction = UnpackInstruction(&instructions[i], processor);
+            instruction *currentInstruction = &unpackedInstruction;
+
+            U32 lineClockCount = (hottestClockCount && currentInstruction->Address < profile->AddressCount)
+                ? profile->ClockCounts[currentInstruction->Address]
+                : 0;
+            if (lineClockCount)
+            {
+                ImVec2 lineMin = ImGui::GetCursorScreenPos();
+                ImVec2 lineMax = ImVec2(lineMin.x + ImGui::GetContentRegionAvail().x, lineMin.y + ImGui::GetTextLineHeight());
+                F32 heat = (F32)lineClockCount / (F32)hottestClockCount;
+                ImGui::GetWindowDrawList()->AddRectFilled(lineMin, lineMax, ImGui::GetColorU32(ImVec4(1.0f, 0.25f, 0.0f, 0.1f + (0.5f * heat))));
+            }
 
-        const U8 BUFFER_SIZE = 64;
-        char buffer[BUFFER_SIZE];
+            // Note (Aaron): Breakpoints are marked between the line number and the address
+            if (breakpoints->AddressBits && HasBreakpoint(breakpoints, currentInstruction->Address))
+            {
+                ImVec2 lineMin = ImGui::GetCursorScreenPos();
+                F32 radius = ImGui::GetTextLineHeight() * 0.25f;
+                ImVec2 center = ImVec2(lineMin.x + 42.0f, lineMin.y + (ImGui::GetTextLineHeight() * 0.5f));
+                ImGui::GetWindowDrawList()->AddCircleFilled(center, radius, ImGui::GetColorU32(ImVec4(0.9f, 0.1f, 0.1f, 1.0f)));
+            }
+
+            if (processor->IP == currentInstruction->Address)
+            {
+                ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 1.0f, 0.0f, 1.0f));
+            }
 
-        snprintf(buffer, BUFFER_SIZE, "%i", i + 1);
-        if (ImGui::Selectable(buffer, applicationState->Disassembly_SelectedLine == i)) { applicationState->Disassembly_SelectedLine = i; }
+            const U8 BUFFER_SIZE = 64;
+            char buffer[BUFFER_SIZE];
 
-        snprintf(buffer, BUFFER_SIZE, "0x%.8x", currentInstruction.Address);
-        ImGui::SameLine(50);
-        ImGui::Text("%s", buffer);
+            snprintf(buffer, BUFFER_SIZE, "%i", i + 1);
+            if (ImGui::Selectable(buffer, applicationState->Disassembly_SelectedLine == i)) { applicationState->Disassembly_SelectedLine = i; }
 
-        ImGui::SameLine(160);
-        ImGui::Text("%s", currentInstruction.InstructionMnemonic.Str);
+            snprintf(buffer, BUFFER_SIZE, "0x%.8x", currentInstruction->Address);
+            ImGui::SameLine(50);
+            ImGui::TextUnformatted(buffer);
 
-        if (ImGui::IsItemHovered())
-        {
-            ImGui::SetTooltip("%s", instructions[i].BitsMnemonic.Str);
-        }
+            char mnemonic[INSTRUCTION_MNEMONIC_MAX_SIZE + 1];
+            mnemonic[FormatInstructionMnemonic(currentInstruction, mnemonic)] = 0;
+            ImGui::SameLine(160);
+            ImGui::TextUnformatted(mnemonic);
 
-        if (processor->IP == currentInstruction.Address)
-        {
-            ImGui::PopStyleColor(1);
-            // TODO (Aaron): Figure out why this isn't focusing the item
-            // ImGui::SetItemDefaultFocus();
+            if (ImGui::IsItemHovered())
+            {
+                char bitsMnemonic[INSTRUCTION_BITS_MNEMONIC_MAX_SIZE + 1];
+                bitsMnemonic[FormatInstructionBitsMnemonic(currentInstruction, bitsMnemonic)] = 0;
+                ImGui::SetTooltip("%s", bitsMnemonic);
+            }
+
+            if (lineClockCount)
+            {
+                ImGui::SameLine(400);
+                ImGui::Text("%5.1f%%", ((F64)lineClockCount / (F64)profile->TotalClockCount) * 100.0);
+            }
+
+            if (processor->IP == currentInstruction->Address)
+            {
+                ImGui::PopStyleColor(1);
+                // TODO (Aaron): Figure out why this isn't focusing the item
+                // ImGui::SetItemDefaultFocus();
+            }
         }
     }
 
@@ -202,9 +258,9 @@ global_function void ShowRegistersWindow(application_state *applicationState, pr
     }
 
     // flags
-    if (ImGui::BeginTable("flags", 6, tableFlags))
+    if (ImGui::BeginTable("flags", 7, tableFlags))
     {
-        register_flags flags[] ={ RegisterFlag_CF, RegisterFlag_PF, RegisterFlag_AF, RegisterFlag_ZF, RegisterFlag_SF, RegisterFlag_OF };
+        register_flags flags[] ={ RegisterFlag_CF, RegisterFlag_PF, RegisterFlag_AF, RegisterFlag_ZF, RegisterFlag_SF, RegisterFlag_OF, RegisterFlag_DF };
 
         ImGui::TableNextRow();
         for (int i = 0; i < ArrayCount(flags); i++)
@@ -221,73 +277,149 @@ global_function void ShowRegistersWindow(application_state *applicationState, pr
 }
 
 
+// Note (Aaron): Writes a line of the memory window, e.g. "0x00000010:  b8 01  00 00 ...", into 'buffer', which must
+// hold at least MEMORY_LINE_MAX_SIZE bytes
+#define MEMORY_LINE_BYTE_COUNT 16
+#define MEMORY_LINE_MAX_SIZE (13 + (MEMORY_LINE_BYTE_COUNT * 4))
+
+static void FormatMemoryLine(char *buffer, U8 *memory, U32 address)
+{
+    local_persist char const HexDigits[] = "0123456789abcdef";
+
+    char *at = buffer;
+    *at++ = '0';
+    *at++ = 'x';
+    for (int shift = 28; shift >= 0; shift -= 4)
+    {
+        *at++ = HexDigits[(address >> shift) & 0xf];
+    }
+    *at++ = ':';
+    *at++ = ' ';
+
+    for (int i = 0; i < MEMORY_LINE_BYTE_COUNT; ++i)
+    {
+        // separate 16 bit words
+        if (i % 2 == 0) { *at++ = ' '; }
+
+        U8 value = memory[address + i];
+        *at++ = HexDigits[value >> 4];
+        *at++ = HexDigits[value & 0xf];
+        *at++ = ' ';
+    }
+
+    *at = 0;
+}
+
+
 global_function void ShowMemoryWindow(application_state *applicationState, processor_8086 *processor)
 {
-    U8 bytesPerLine = 16;
-    U32 bytesDisplayed = Kilobytes(4);
-    U32 minimumBytesDisplayed = 512;
+    U32 bytesPerSegment = Kilobytes(4);
+    U32 lineCount = processor->MemorySize / MEMORY_LINE_BYTE_COUNT;
+    U32 maxStartAddress = processor->MemorySize - MEMORY_LINE_BYTE_COUNT;
 
     const U8 BUFFER_SIZE = 64;
     char buffer[BUFFER_SIZE];
-    U32 maxMemoryAddress = processor->MemorySize - 1;
 
     ImGuiWindowFlags windowFlags = ImGuiWindowFlags_None;
     ImGui::Begin("Memory", NULL, windowFlags);
 
+    // Note (Aaron): Memory_StartAddress follows the first line in view, the buttons move it a segment at a time
+    B32 scrollToStart = FALSE;
     if (ImGui::Button("Previous segment"))
     {
         // protect against underflow
-        if (applicationState->Memory_StartAddress < bytesDisplayed)
-        {
-            applicationState->Memory_StartAddress = 0;
-        }
-        else
-        {
-            U32 clampedValue = Clamp(0, applicationState->Memory_StartAddress - bytesDisplayed, maxMemoryAddress - minimumBytesDisplayed);
-            applicationState->Memory_StartAddress = clampedValue;
-        }
-
+        U32 startAddress = applicationState->Memory_StartAddress;
+        applicationState->Memory_StartAddress = (startAddress < bytesPerSegment) ? 0 : startAddress - bytesPerSegment;
+        scrollToStart = TRUE;
     }
 
     ImGui::SameLine(132);
 
     if (ImGui::Button("Next Segment"))
     {
-        U32 clampedValue = Clamp(0 + minimumBytesDisplayed, applicationState->Memory_StartAddress + bytesDisplayed, maxMemoryAddress);
-        applicationState->Memory_StartAddress = clampedValue;
+        applicationState->Memory_StartAddress = Min(applicationState->Memory_StartAddress + bytesPerSegment, maxStartAddress);
+        scrollToStart = TRUE;
     }
 
-    U64 startAddress = Clamp(0, applicationState->Memory_StartAddress, maxMemoryAddress - minimumBytesDisplayed);
-    U64 endAddress = Clamp(0 + minimumBytesDisplayed, applicationState->Memory_StartAddress + bytesDisplayed, maxMemoryAddress);
+    // Note (Aaron): Watchpoints can only be changed while the simulation thread isn't running
+    breakpoint_set *breakpoints = &applicationState->Breakpoints;
+    if (breakpoints->AddressBits && ImGui::CollapsingHeader("Watchpoints"))
+    {
+        ImGui::BeginDisabled(applicationState->Simulation.IsRunning);
+
+        ImGui::SetNextItemWidth(100);
+        ImGui::InputScalar("Address", ImGuiDataType_U32, &applicationState->Watch_Address, 0, 0, "%x", ImGuiInputTextFlags_CharsHexadecimal);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(60);
+        ImGui::InputScalar("Size", ImGuiDataType_U32, &applicationState->Watch_Size);
+        ImGui::SameLine();
+        ImGui::Checkbox("Read", &applicationState->Watch_Read);
+        ImGui::SameLine();
+        ImGui::Checkbox("Write", &applicationState->Watch_Write);
+        ImGui::SameLine();
+        if (ImGui::Button("Add"))
+        {
+            U8 access = (U8)((applicationState->Watch_Read ? WatchAccess_Read : 0) | (applicationState->Watch_Write ? WatchAccess_Write : 0));
+            AddWatchpoint(breakpoints, applicationState->Watch_Address, applicationState->Watch_Size, access);
+        }
+
+        for (U32 i = 0; i < breakpoints->WatchpointCount; ++i)
+        {
+            watchpoint *watchpoint = &breakpoints->Watchpoints[i];
+            snprintf(buffer, BUFFER_SIZE, "0x%.8x +%u %s%s",
+                     watchpoint->Address,
+                     watchpoint->Size,
+                     (watchpoint->Access & WatchAccess_Read) ? "r" : "",
+                     (watchpoint->Access & WatchAccess_Write) ? "w" : "");
+            ImGui::TextUnformatted(buffer);
+
+            ImGui::SameLine(200);
+            ImGui::PushID((int)i);
+            if (ImGui::SmallButton("Remove"))
+            {
+                RemoveWatchpoint(breakpoints, i);
+            }
+            ImGui::PopID();
+        }
+
+        ImGui::EndDisabled();
+        ImGui::Separator();
+    }
 
-    Assert((startAddress < endAddress) && "startAddress cannot be larger than endAddress");
-    Assert((startAddress >= 0) && "Invalid start address");
-    Assert((endAddress < processor->MemorySize) && "Invalid end address");
+    F32 lineHeight = ImGui::GetTextLineHeightWithSpacing();
+    U32 visibleLineCount = (U32)(ImGui::GetContentRegionAvail().y / lineHeight);
+    U32 endAddress = Min(applicationState->Memory_StartAddress + (visibleLineCount * MEMORY_LINE_BYTE_COUNT), processor->MemorySize);
 
-    snprintf(buffer, BUFFER_SIZE, "Range: 0x%.2" PRIu64 " - 0x%.2" PRIu64 "", startAddress, endAddress);
-    ImGui::Text("%s", buffer);
+    snprintf(buffer, BUFFER_SIZE, "Range: 0x%.8x - 0x%.8x", applicationState->Memory_StartAddress, endAddress);
+    ImGui::TextUnformatted(buffer);
     ImGui::Separator();
 
-    // loop over memory range displayed
-    for (U64 i = startAddress; i < endAddress; i += bytesPerLine)
+    // Note (Aaron): All of memory is one scrolling list, of which only the lines in view are built
+    ImGui::BeginChild("MemoryLines");
+    if (scrollToStart)
     {
-        // display address
-        snprintf(buffer, BUFFER_SIZE, "%.16" PRIu64 "", i);
-        ImGui::Text("0x%s:", buffer);
+        ImGui::SetScrollY((F32)(applicationState->Memory_StartAddress / MEMORY_LINE_BYTE_COUNT) * lineHeight);
+    }
 
-        F32 offset = 150;
-        for (int j = 0; j < bytesPerLine; ++j)
+    ImGuiListClipper clipper;
+    clipper.Begin((int)lineCount, lineHeight);
+    while (clipper.Step())
+    {
+        for (U32 line = (U32)clipper.DisplayStart; line < (U32)clipper.DisplayEnd; ++line)
         {
-            // advance offset to deliniate 32 bits
-            if (j % 2 == 0) { offset += 10; }
-
-            ImGui::SameLine(offset);
-            U8 value = processor->Memory[i + j];
-            ImGui::Text("%.2x", value);
-            offset += 20;
+            char memoryLine[MEMORY_LINE_MAX_SIZE];
+            FormatMemoryLine(memoryLine, processor->Memory, line * MEMORY_LINE_BYTE_COUNT);
+            ImGui::TextUnformatted(memoryLine);
         }
     }
 
+    // Note (Aaron): The scroll requested above only applies next frame
+    if (!scrollToStart)
+    {
+        applicationState->Memory_StartAddress = (U32)(ImGui::GetScrollY() / lineHeight) * MEMORY_LINE_BYTE_COUNT;
+    }
+
+    ImGui::EndChild();
     ImGui::End();
 }
 
@@ -362,11 +494,32 @@ global_function void ShowDiagnosticsWindow(application_state *applicationState,
         ImGui::Text("Instructions executed: %u", processor->InstructionCount);
         ImGui::Text("Estimated cycles: %u", processor->TotalClockCount);
 
-        if(applicationState->Diagnostics_ExecutionStalled)
+        if (processor->SnapshotHistory)
+        {
+            ImGui::Text("Snapshots: %u (%u pages)", processor->SnapshotHistory->SnapshotCount, processor->SnapshotHistory->PageSlotCount);
+        }
+
+        ImGui::Text("Breakpoints: %u, watchpoints: %u", applicationState->Breakpoints.BreakpointCount, applicationState->Breakpoints.WatchpointCount);
+
+        if (applicationState->Simulation.IsRunning)
+        {
+            ImGui::Text("Simulation: running (%.2f MIPS)", applicationState->Simulation_InstructionsPerSecond / 1000000.0);
+        }
+        else if (HasProcessorFinishedExecution(processor))
+        {
+            ImGui::Text("Simulation: finished");
+        }
+        else if (applicationState->Breakpoints.StopReason == StopReason_Breakpoint)
+        {
+            ImGui::Text("Simulation: stopped at breakpoint 0x%x", applicationState->Breakpoints.StopAddress);
+        }
+        else if (applicationState->Breakpoints.StopReason == StopReason_Watchpoint)
+        {
+            ImGui::Text("Simulation: stopped by watchpoint at 0x%x", applicationState->Breakpoints.StopAddress);
+        }
+        else
         {
-            ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.0f, 0.0f, 1.0f));
-            ImGui::Text("Execution timed out!");
-            ImGui::PopStyleColor(1);
+            ImGui::Text("Simulation: paused");
         }
         ImGui::Text("%s", "");
 
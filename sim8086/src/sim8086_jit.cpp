@@ -0,0 +1,996 @@
+/* Note (Aaron):
+    x86-64 JIT for sim8086. Basic blocks of 16-bit mov / add / sub / cmp, jne and loop instructions
+    are translated into native code. While a block runs, the simulated registers live in r8-r15.
+    Arithmetic instructions store their operands and result to processor_8086::LazyFlags, the same
+    as ExecuteInstruction() does, so flags are never computed inside a block.
+
+    The JIT must leave the processor in exactly the same state as ExecuteInstruction() would.
+    Anything it can't translate is handed back to the dispatcher and interpreted. That includes
+    8-bit operations, and memory accesses that are out of bounds or that write over cached
+    instructions, which are detected at run time. Each exit adds the static instruction and clock
+    counts of the ops executed so far in the block.
+
+    Register usage inside a block:
+        rdi - processor_8086 *
+        rsi - processor memory
+        rbp - remaining instruction budget, only checked when a block loops back to itself
+        r8-r15 - simulated registers AX, BX, CX, DX, SP, BP, SI, DI (zero extended)
+        rax, rcx, rdx - scratch
+*/
+
+#include <stddef.h>
+
+#if __linux__
+#include <sys/mman.h>
+#endif
+
+#if _WIN32
+#include <windows.h>
+#endif
+
+#include "base_memory.h"
+#include "base_arena.h"
+#include "sim8086.h"
+#include "sim8086_jit.h"
+
+
+typedef U32 jit_block_function(processor_8086 *processor, U8 *memory, S64 budget);
+
+// Note (Aaron): Worst case code size for a single block, including its exit stubs
+#define JIT_MAX_BLOCK_CODE_SIZE Kilobytes(16)
+
+// Note (Aaron): Granularity code memory is switched between writable and executable at. x86-64 pages are 4KB.
+#define JIT_CODE_PAGE_SIZE Kilobytes(4)
+
+#define JIT_HOST_RAX 0
+#define JIT_HOST_RCX 1
+#define JIT_HOST_RDX 2
+#define JIT_HOST_RBP 5
+#define JIT_HOST_RSI 6
+#define JIT_HOST_RDI 7
+#define JIT_HOST_R8  8
+
+
+struct jit_emitter
+{
+    U8 *At;
+};
+
+
+// Note (Aaron): Where a rel32 branch has to be patched to reach its exit stub
+struct jit_exit_stub
+{
+    U8 *PatchAt;
+    U32 IP;
+    U32 PrevIP;
+    B32 SetPrevIP;
+    U32 InstructionCount;
+    U32 ClockCount;
+    jit_exit_reason Reason;
+};
+
+
+#if JIT_SUPPORTED
+
+inline global_function void Emit8(jit_emitter *e, U8 value)
+{
+    *e->At++ = value;
+}
+
+
+inline global_function void Emit16(jit_emitter *e, U16 value)
+{
+    MemoryCopy(e->At, &value, sizeof(value));
+    e->At += sizeof(value);
+}
+
+
+inline global_function void Emit32(jit_emitter *e, U32 value)
+{
+    MemoryCopy(e->At, &value, sizeof(value));
+    e->At += sizeof(value);
+}
+
+
+inline global_function void Emit64(jit_emitter *e, U64 value)
+{
+    MemoryCopy(e->At, &value, sizeof(value));
+    e->At += sizeof(value);
+}
+
+
+inline global_function U8 ModRM(U8 mod, U8 reg, U8 rm)
+{
+    return (U8)((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+
+inline global_function U8 Rex(U8 reg, U8 rm)
+{
+    return (U8)(0x40 | ((reg >> 3) << 2) | (rm >> 3));
+}
+
+
+inline global_function U8 HostRegister(U8 registerIndex)
+{
+    return (U8)(JIT_HOST_R8 + registerIndex);
+}
+
+
+// Note (Aaron): Emits a rel32 branch / jump with a placeholder offset and returns where to patch it
+global_function U8 *EmitBranch32(jit_emitter *e, U8 conditionCode)
+{
+    if (conditionCode == 0xff)
+    {
+        Emit8(e, 0xe9);
+    }
+    else
+    {
+        Emit8(e, 0x0f);
+        Emit8(e, conditionCode);
+    }
+
+    U8 *patchAt = e->At;
+    Emit32(e, 0);
+    return patchAt;
+}
+
+
+inline global_function void PatchBranch32(U8 *patchAt, U8 *target)
+{
+    S32 offset = (S32)(target - (patchAt + 4));
+    MemoryCopy(patchAt, &offset, sizeof(offset));
+}
+
+
+// op r/m16, r16 and op r16, r/m16 register forms
+global_function void EmitAluRegReg16(jit_emitter *e, U8 opcode, U8 rm, U8 reg)
+{
+    Emit8(e, 0x66);
+    Emit8(e, Rex(reg, rm));
+    Emit8(e, opcode);
+    Emit8(e, ModRM(0b11, reg, rm));
+}
+
+
+// op [rsi + rax], r16
+global_function void EmitAluMemReg16(jit_emitter *e, U8 opcode, U8 reg)
+{
+    Emit8(e, 0x66);
+    Emit8(e, Rex(reg, 0));
+    Emit8(e, opcode);
+    Emit8(e, ModRM(0b00, reg, 0b100));
+    Emit8(e, 0x06);                     // SIB: base rsi, index rax, scale 1
+}
+
+
+// op word [rsi + rax], imm16
+global_function void EmitAluMemImm16(jit_emitter *e, U8 opcode, U8 extension, U16 immediate)
+{
+    Emit8(e, 0x66);
+    Emit8(e, opcode);
+    Emit8(e, ModRM(0b00, extension, 0b100));
+    Emit8(e, 0x06);
+    Emit16(e, immediate);
+}
+
+
+// op dword [rdi + disp32], imm32
+global_function void EmitProcessorImm32(jit_emitter *e, U8 opcode, U8 extension, U32 offset, U32 immediate)
+{
+    Emit8(e, opcode);
+    Emit8(e, ModRM(0b10, extension, JIT_HOST_RDI));
+    Emit32(e, offset);
+    Emit32(e, immediate);
+}
+
+
+global_function void EmitExitStub(jit_emitter *e, jit_engine *engine, jit_exit_stub *stub)
+{
+    EmitProcessorImm32(e, 0xc7, 0, offsetof(processor_8086, IP), stub->IP);
+    if (stub->SetPrevIP)
+    {
+        EmitProcessorImm32(e, 0xc7, 0, offsetof(processor_8086, PrevIP), stub->PrevIP);
+    }
+    if (stub->InstructionCount)
+    {
+        EmitProcessorImm32(e, 0x81, 0, offsetof(processor_8086, InstructionCount), stub->InstructionCount);
+    }
+    if (stub->ClockCount)
+    {
+        EmitProcessorImm32(e, 0x81, 0, offsetof(processor_8086, TotalClockCount), stub->ClockCount);
+    }
+
+    // mov eax, reason
+    Emit8(e, 0xb8);
+    Emit32(e, stub->Reason);
+
+    PatchBranch32(EmitBranch32(e, 0xff), engine->ExitCode);
+}
+
+
+// mov word [rdi + disp32], r16
+global_function void EmitStoreProcessor16(jit_emitter *e, U32 offset, U8 reg)
+{
+    Emit8(e, 0x66);
+    if (reg >= JIT_HOST_R8)
+    {
+        Emit8(e, Rex(reg, JIT_HOST_RDI));
+    }
+    Emit8(e, 0x89);
+    Emit8(e, ModRM(0b10, reg, JIT_HOST_RDI));
+    Emit32(e, offset);
+}
+
+
+// mov r32, r32 (host registers hold zero extended 16-bit values)
+global_function void EmitMoveRegister32(jit_emitter *e, U8 dest, U8 source)
+{
+    if (dest >= JIT_HOST_R8 || source >= JIT_HOST_R8)
+    {
+        Emit8(e, Rex(source, dest));
+    }
+    Emit8(e, 0x89);
+    Emit8(e, ModRM(0b11, source, dest));
+}
+
+
+// movzx r32, word [rsi + rax]
+global_function void EmitLoadMemory16(jit_emitter *e, U8 dest)
+{
+    if (dest >= JIT_HOST_R8)
+    {
+        Emit8(e, Rex(dest, 0));
+    }
+    Emit8(e, 0x0f);
+    Emit8(e, 0xb7);
+    Emit8(e, ModRM(0b00, dest, 0b100));
+    Emit8(e, 0x06);
+}
+
+
+// Note (Aaron): Leaves the effective address in eax, computed the same way as CalculateEffectiveAddress()
+global_function void EmitEffectiveAddress(jit_emitter *e, instruction_operand *operand)
+{
+    if (operand->Memory.Flags & Memory_HasDirectAddress)
+    {
+        Emit8(e, 0xb8);
+        Emit32(e, operand->Memory.DirectAddress);
+        return;
+    }
+
+    register_id base0 = operand->Memory.Register;
+    register_id base1 = Reg_unknown;
+    switch (operand->Memory.Register)
+    {
+        case Reg_bx_si: { base0 = Reg_bx; base1 = Reg_si; break; }
+        case Reg_bx_di: { base0 = Reg_bx; base1 = Reg_di; break; }
+        case Reg_bp_si: { base0 = Reg_bp; base1 = Reg_si; break; }
+        case Reg_bp_di: { base0 = Reg_bp; base1 = Reg_di; break; }
+        default: break;
+    }
+
+    // mov eax, base0 (host registers are zero extended)
+    U8 base0Host = HostRegister(RegisterLookup[base0].RegisterIndex);
+    Emit8(e, Rex(base0Host, JIT_HOST_RAX));
+    Emit8(e, 0x89);
+    Emit8(e, ModRM(0b11, base0Host, JIT_HOST_RAX));
+
+    if (base1 != Reg_unknown)
+    {
+        // add ax, base1 (registers are summed at 16 bits)
+        EmitAluRegReg16(e, 0x01, JIT_HOST_RAX, HostRegister(RegisterLookup[base1].RegisterIndex));
+    }
+
+    if ((operand->Memory.Flags & Memory_HasDisplacement) && operand->Memory.Displacement != 0)
+    {
+        // add eax, disp32
+        Emit8(e, 0x05);
+        Emit32(e, (U32)(S32)operand->Memory.Displacement);
+    }
+}
+
+
+global_function B32 IsJittableRegister(register_id reg)
+{
+    return RegisterLookup[reg].IsWide && RegisterLookup[reg].RegisterIndex < 8;
+}
+
+
+// Note (Aaron): Only 16-bit operations are translated, 8-bit operations are left to the interpreter
+global_function B32 IsJittable(instruction *instruction)
+{
+    switch (instruction->OpType)
+    {
+        case Op_mov:
+        case Op_add:
+        case Op_sub:
+        case Op_cmp:
+        {
+            instruction_operand *dest = &instruction->Operands[0];
+            instruction_operand *source = &instruction->Operands[1];
+
+            if (dest->Type == Operand_Register)
+            {
+                if (!IsJittableRegister(dest->Register)) { return FALSE; }
+            }
+            else if (dest->Type == Operand_Memory)
+            {
+                if (!(dest->Memory.Flags & Memory_IsWide)) { return FALSE; }
+                if (source->Type == Operand_Memory) { return FALSE; }
+            }
+            else
+            {
+                return FALSE;
+            }
+
+            if (source->Type == Operand_Register) { return IsJittableRegister(source->Register); }
+            if (source->Type == Operand_Memory) { return (source->Memory.Flags & Memory_IsWide) ? TRUE : FALSE; }
+            return source->Type == Operand_Immediate;
+        }
+
+        // Note (Aaron): Other jumps are left to the interpreter, which evaluates all of the flags
+        case Op_jne:
+        case Op_loop:
+        {
+            return TRUE;
+        }
+
+        default:
+        {
+            return FALSE;
+        }
+    }
+}
+
+
+global_function B32 IsJitTerminator(instruction *instruction)
+{
+    return instruction->OpType != Op_mov
+        && instruction->OpType != Op_add
+        && instruction->OpType != Op_sub
+        && instruction->OpType != Op_cmp;
+}
+
+
+global_function void EmitSharedExit(jit_emitter *e)
+{
+    for (U8 registerIndex = 0; registerIndex < 8; ++registerIndex)
+    {
+        // mov word [rdi + Registers + i * 2], r16
+        U8 host = HostRegister(registerIndex);
+        Emit8(e, 0x66);
+        Emit8(e, Rex(host, JIT_HOST_RDI));
+        Emit8(e, 0x89);
+        Emit8(e, ModRM(0b10, host, JIT_HOST_RDI));
+        Emit32(e, (U32)(offsetof(processor_8086, Registers) + (registerIndex * sizeof(U16))));
+    }
+
+#if _WIN32
+    Emit8(e, 0x5e);                     // pop rsi
+    Emit8(e, 0x5f);                     // pop rdi
+#endif
+    Emit8(e, 0x41); Emit8(e, 0x5f);     // pop r15
+    Emit8(e, 0x41); Emit8(e, 0x5e);     // pop r14
+    Emit8(e, 0x41); Emit8(e, 0x5d);     // pop r13
+    Emit8(e, 0x41); Emit8(e, 0x5c);     // pop r12
+    Emit8(e, 0x5d);                     // pop rbp
+    Emit8(e, 0xc3);                     // ret
+}
+
+
+global_function void EmitBlockEntry(jit_emitter *e)
+{
+    Emit8(e, 0x55);                     // push rbp
+    Emit8(e, 0x41); Emit8(e, 0x54);     // push r12
+    Emit8(e, 0x41); Emit8(e, 0x55);     // push r13
+    Emit8(e, 0x41); Emit8(e, 0x56);     // push r14
+    Emit8(e, 0x41); Emit8(e, 0x57);     // push r15
+
+#if _WIN32
+    Emit8(e, 0x57);                     // push rdi
+    Emit8(e, 0x56);                     // push rsi
+    Emit8(e, 0x48); Emit8(e, 0x89); Emit8(e, 0xcf);     // mov rdi, rcx
+    Emit8(e, 0x48); Emit8(e, 0x89); Emit8(e, 0xd6);     // mov rsi, rdx
+    Emit8(e, 0x4c); Emit8(e, 0x89); Emit8(e, 0xc5);     // mov rbp, r8
+#else
+    Emit8(e, 0x48); Emit8(e, 0x89); Emit8(e, 0xd5);     // mov rbp, rdx
+#endif
+
+    for (U8 registerIndex = 0; registerIndex < 8; ++registerIndex)
+    {
+        // movzx r32, word [rdi + Registers + i * 2]
+        U8 host = HostRegister(registerIndex);
+        Emit8(e, Rex(host, JIT_HOST_RDI));
+        Emit8(e, 0x0f);
+        Emit8(e, 0xb7);
+        Emit8(e, ModRM(0b10, host, JIT_HOST_RDI));
+        Emit32(e, (U32)(offsetof(processor_8086, Registers) + (registerIndex * sizeof(U16))));
+    }
+}
+
+
+// Note (Aaron): Code memory is never writable and executable at once, as hosts that deny that (SELinux, hardened
+// kernels) would refuse to map it. It starts out writable, see SetCodeMemoryExecutable().
+global_function U8 *AllocateCodeMemory(U64 size)
+{
+#if __linux__
+    void *result = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED)
+    {
+        result = 0;
+    }
+
+    return (U8 *)result;
+
+#elif _WIN32
+    void *result = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    return (U8 *)result;
+
+#endif
+
+    return 0;
+}
+
+
+global_function void FreeCodeMemory(U8 *code, U64 size)
+{
+#if __linux__
+    munmap(code, size);
+
+#elif _WIN32
+    VirtualFree(code, 0, MEM_RELEASE);
+
+#endif
+}
+
+
+// Note (Aaron): Switches the pages that 'size' bytes at 'start' fall in between writable and executable. Blocks
+// share pages, so a page is made writable again to emit the next block after the one before it.
+global_function B32 SetCodeMemoryExecutable(U8 *start, U64 size, B32 executable)
+{
+    U8 *pageStart = (U8 *)((U64)start & ~(U64)(JIT_CODE_PAGE_SIZE - 1));
+    U64 protectSize = ((U64)(start + size - pageStart) + JIT_CODE_PAGE_SIZE - 1) & ~(U64)(JIT_CODE_PAGE_SIZE - 1);
+
+#if __linux__
+    B32 result = mprotect(pageStart, protectSize, executable ? (PROT_READ | PROT_EXEC) : (PROT_READ | PROT_WRITE)) == 0;
+    return result;
+
+#elif _WIN32
+    DWORD previousProtection = 0;
+    B32 result = VirtualProtect(pageStart, protectSize, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previousProtection);
+    if (result && executable)
+    {
+        FlushInstructionCache(GetCurrentProcess(), pageStart, protectSize);
+    }
+    return result;
+
+#endif
+
+    return FALSE;
+}
+
+
+global_function B32 InitializeJitEngine(jit_engine *engine, memory_arena *arena, U32 memorySize, U64 codeSize)
+{
+    *engine = {};
+    ArenaClear(arena);
+
+    engine->BlockLookup = (U32 *)ArenaPushSizeZero(arena, sizeof(U32) * memorySize);
+    if (!engine->BlockLookup)
+    {
+        return FALSE;
+    }
+
+    engine->LookupSize = memorySize;
+    engine->BlockCapacity = (U32)((arena->Size - arena->Used) / sizeof(jit_block));
+    engine->Blocks = ArenaPushArray(arena, jit_block, engine->BlockCapacity);
+    if (!engine->Blocks || engine->BlockCapacity == 0)
+    {
+        return FALSE;
+    }
+
+    codeSize = (codeSize + JIT_CODE_PAGE_SIZE - 1) & ~(U64)(JIT_CODE_PAGE_SIZE - 1);
+    if (codeSize < (2 * JIT_MAX_BLOCK_CODE_SIZE))
+    {
+        return FALSE;
+    }
+
+    engine->Code = AllocateCodeMemory(codeSize);
+    if (!engine->Code)
+    {
+        return FALSE;
+    }
+
+    engine->CodeSize = codeSize;
+
+    jit_emitter e = { engine->Code };
+    engine->ExitCode = e.At;
+    EmitSharedExit(&e);
+    engine->BlockCodeStart = (U64)(e.At - engine->Code);
+    engine->CodeUsed = engine->BlockCodeStart;
+
+    if (!SetCodeMemoryExecutable(engine->Code, engine->CodeSize, TRUE))
+    {
+        FreeJitEngine(engine);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+global_function void FreeJitEngine(jit_engine *engine)
+{
+    if (engine->Code)
+    {
+        FreeCodeMemory(engine->Code, engine->CodeSize);
+    }
+
+    *engine = {};
+}
+
+
+global_function void FlushJitEngine(jit_engine *engine)
+{
+    for (U32 blockIndex = 0; blockIndex < engine->BlockCount; ++blockIndex)
+    {
+        engine->BlockLookup[engine->Blocks[blockIndex].StartAddress] = 0;
+    }
+
+    // Note (Aaron): Keep the shared exit sequence
+    engine->BlockCount = 0;
+    engine->CodeUsed = engine->BlockCodeStart;
+}
+
+
+global_function jit_block *CompileJitBlock(jit_engine *engine, processor_8086 *processor, U32 address)
+{
+    if (engine->BlockCount == engine->BlockCapacity
+        || (engine->CodeUsed + JIT_MAX_BLOCK_CODE_SIZE) > engine->CodeSize)
+    {
+        FlushJitEngine(engine);
+    }
+
+    jit_block *block = &engine->Blocks[engine->BlockCount++];
+    *block = {};
+    block->StartAddress = address;
+    engine->BlockLookup[address] = engine->BlockCount;
+
+    // gather the instructions that make up the block
+    // Note (Aaron): Breakpoints are only checked between blocks, so blocks end before them
+    breakpoint_set *breakpoints = processor->Breakpoints;
+    instruction instructions[JIT_MAX_BLOCK_OPS];
+    U32 instructionCount = 0;
+    U32 ip = address;
+    B32 terminated = FALSE;
+    B32 setsFlags = FALSE;
+    while (instructionCount < JIT_MAX_BLOCK_OPS && ip < processor->ProgramSize)
+    {
+        if (breakpoints && instructionCount > 0 && HasBreakpoint(breakpoints, ip))
+        {
+            break;
+        }
+
+        instruction instruction = FetchInstruction(processor, ip);
+        if (!IsJittable(&instruction))
+        {
+            break;
+        }
+
+        // Note (Aaron): Snapshots capture pages in SetMemory(), so memory writes are left to the interpreter
+        if (processor->SnapshotHistory
+            && instruction.Operands[0].Type == Operand_Memory && instruction.OpType != Op_cmp)
+        {
+            break;
+        }
+
+        // Note (Aaron): jne tests the result of an arithmetic instruction in this block. Otherwise the
+        // flags come from outside the block and the interpreter evaluates them.
+        if (instruction.OpType == Op_jne && !setsFlags)
+        {
+            break;
+        }
+
+        setsFlags |= (instruction.OpType == Op_add || instruction.OpType == Op_sub || instruction.OpType == Op_cmp);
+        instructions[instructionCount++] = instruction;
+        ip += instruction.Bits.ByteCount;
+
+        if (IsJitTerminator(&instruction))
+        {
+            terminated = TRUE;
+            break;
+        }
+    }
+
+    if (instructionCount == 0)
+    {
+        return block;
+    }
+
+    // Note (Aaron): If the pages can't be made writable the instruction at StartAddress is interpreted instead
+    U8 *code = engine->Code + engine->CodeUsed;
+    if (!SetCodeMemoryExecutable(code, JIT_MAX_BLOCK_CODE_SIZE, FALSE))
+    {
+        return block;
+    }
+
+    block->InstructionCount = instructionCount;
+    block->Code = code;
+
+    jit_emitter emitter = { block->Code };
+    jit_emitter *e = &emitter;
+
+    jit_exit_stub stubs[(JIT_MAX_BLOCK_OPS * 3) + 2];
+    U32 stubCount = 0;
+
+    EmitBlockEntry(e);
+    U8 *bodyStart = e->At;
+
+    U32 clockCount = 0;
+    for (U32 instructionIndex = 0; instructionIndex < instructionCount; ++instructionIndex)
+    {
+        instruction *instruction = &instructions[instructionIndex];
+        instruction_operand *dest = &instruction->Operands[0];
+        instruction_operand *source = &instruction->Operands[1];
+
+        // Note (Aaron): Side exits re-run this instruction through the interpreter
+        jit_exit_stub sideExit = {};
+        sideExit.IP = instruction->Address;
+        sideExit.SetPrevIP = (instructionIndex > 0);
+        sideExit.PrevIP = sideExit.SetPrevIP ? instructions[instructionIndex - 1].Address : 0;
+        sideExit.InstructionCount = instructionIndex;
+        sideExit.ClockCount = clockCount;
+        sideExit.Reason = JitExit_Interpret;
+
+        clockCount += instruction->ClockCount + instruction->EAClockCount;
+
+        if (!IsJitTerminator(instruction))
+        {
+            instruction_operand *memoryOperand = (dest->Type == Operand_Memory) ? dest
+                                               : (source->Type == Operand_Memory) ? source
+                                               : 0;
+            if (memoryOperand)
+            {
+                EmitEffectiveAddress(e, memoryOperand);
+
+                // cmp eax, MemorySize / jae side exit
+                Emit8(e, 0x3d);
+                Emit32(e, processor->MemorySize);
+                sideExit.PatchAt = EmitBranch32(e, 0x83);
+                stubs[stubCount++] = sideExit;
+
+                B32 writesMemory = (dest->Type == Operand_Memory && instruction->OpType != Op_cmp);
+                B32 readsMemory = (source->Type == Operand_Memory) || (dest->Type == Operand_Memory && instruction->OpType != Op_mov);
+                if (breakpoints && breakpoints->WatchpointCount)
+                {
+                    // Note (Aaron): Accesses to watched pages are left to the interpreter, which checks the watchpoints
+                    U8 access = (U8)((readsMemory ? WatchAccess_Read : 0) | (writesMemory ? WatchAccess_Write : 0));
+                    // mov rcx, WatchPageFlags
+                    Emit8(e, 0x48); Emit8(e, 0xb9);
+                    Emit64(e, (U64)breakpoints->WatchPageFlags);
+                    // mov edx, eax / shr edx, WATCH_PAGE_SHIFT
+                    Emit8(e, 0x89); Emit8(e, ModRM(0b11, JIT_HOST_RAX, JIT_HOST_RDX));
+                    Emit8(e, 0xc1); Emit8(e, ModRM(0b11, 5, JIT_HOST_RDX)); Emit8(e, WATCH_PAGE_SHIFT);
+                    // test byte [rcx + rdx], access / jnz side exit
+                    Emit8(e, 0xf6); Emit8(e, ModRM(0b00, 0, 0b100)); Emit8(e, (JIT_HOST_RDX << 3) | JIT_HOST_RCX);
+                    Emit8(e, access);
+                    sideExit.PatchAt = EmitBranch32(e, 0x85);
+                    stubs[stubCount++] = sideExit;
+                }
+
+                if (writesMemory && processor->InstructionCache)
+                {
+                    // Note (Aaron): Writes that would invalidate cached instructions are left to SetMemory()
+                    // mov rcx, &cache
+                    Emit8(e, 0x48); Emit8(e, 0xb9);
+                    Emit64(e, (U64)processor->InstructionCache);
+                    // cmp eax, [rcx + HighAddress] / jae skip
+                    Emit8(e, 0x3b);
+                    Emit8(e, ModRM(0b10, JIT_HOST_RAX, JIT_HOST_RCX));
+                    Emit32(e, offsetof(instruction_cache, HighAddress));
+                    Emit8(e, 0x73);
+                    U8 *skipAt = e->At;
+                    Emit8(e, 0);
+                    // lea edx, [rax + 2]
+                    Emit8(e, 0x8d); Emit8(e, 0x50); Emit8(e, 2);
+                    // cmp edx, [rcx + LowAddress] / ja side exit
+                    Emit8(e, 0x3b);
+                    Emit8(e, ModRM(0b10, JIT_HOST_RDX, JIT_HOST_RCX));
+                    Emit32(e, offsetof(instruction_cache, LowAddress));
+                    sideExit.PatchAt = EmitBranch32(e, 0x87);
+                    stubs[stubCount++] = sideExit;
+                    *skipAt = (U8)(e->At - (skipAt + 1));
+                }
+            }
+
+            if (instruction->OpType == Op_mov)
+            {
+                if (dest->Type == Operand_Register)
+                {
+                    U8 destHost = HostRegister(RegisterLookup[dest->Register].RegisterIndex);
+                    if (source->Type == Operand_Register)
+                    {
+                        EmitMoveRegister32(e, destHost, HostRegister(RegisterLookup[source->Register].RegisterIndex));
+                    }
+                    else if (source->Type == Operand_Memory)
+                    {
+                        EmitLoadMemory16(e, destHost);
+                    }
+                    else
+                    {
+                        // mov r32, imm32
+                        Emit8(e, Rex(0, destHost));
+                        Emit8(e, (U8)(0xb8 + (destHost & 7)));
+                        Emit32(e, source->Immediate.Value);
+                    }
+                }
+                else if (source->Type == Operand_Register)
+                {
+                    EmitAluMemReg16(e, 0x89, HostRegister(RegisterLookup[source->Register].RegisterIndex));
+                }
+                else
+                {
+                    EmitAluMemImm16(e, 0xc7, 0, source->Immediate.Value);
+                }
+
+                continue;
+            }
+
+            // Note (Aaron): Arithmetic is done on cx (dest) and dx (source) so that the operands can be
+            // stored for the lazy flags
+            if (dest->Type == Operand_Register)
+            {
+                EmitMoveRegister32(e, JIT_HOST_RCX, HostRegister(RegisterLookup[dest->Register].RegisterIndex));
+            }
+            else
+            {
+                EmitLoadMemory16(e, JIT_HOST_RCX);
+            }
+
+            if (source->Type == Operand_Register)
+            {
+                EmitMoveRegister32(e, JIT_HOST_RDX, HostRegister(RegisterLookup[source->Register].RegisterIndex));
+            }
+            else if (source->Type == Operand_Memory)
+            {
+                EmitLoadMemory16(e, JIT_HOST_RDX);
+            }
+            else
+            {
+                // mov edx, imm32
+                Emit8(e, 0xba);
+                Emit32(e, source->Immediate.Value);
+            }
+
+            U32 lazyFlagsOffset = offsetof(processor_8086, LazyFlags);
+            EmitStoreProcessor16(e, lazyFlagsOffset + offsetof(lazy_flags, Operand0), JIT_HOST_RCX);
+            EmitStoreProcessor16(e, lazyFlagsOffset + offsetof(lazy_flags, Operand1), JIT_HOST_RDX);
+
+            // add cx, dx / sub cx, dx
+            EmitAluRegReg16(e, (instruction->OpType == Op_add) ? 0x01 : 0x29, JIT_HOST_RCX, JIT_HOST_RDX);
+            EmitStoreProcessor16(e, lazyFlagsOffset + offsetof(lazy_flags, Result), JIT_HOST_RCX);
+
+            // mov word [rdi + LazyFlags.Op], (Op | IsWide << 8)
+            static_assert_8086(offsetof(lazy_flags, IsWide) == offsetof(lazy_flags, Op) + 1, "Op and IsWide are written together");
+            U16 lazyOp = (U16)(((instruction->OpType == Op_add) ? LazyFlags_Add : LazyFlags_Sub) | (TRUE << 8));
+            Emit8(e, 0x66);
+            Emit8(e, 0xc7);
+            Emit8(e, ModRM(0b10, 0, JIT_HOST_RDI));
+            Emit32(e, lazyFlagsOffset + offsetof(lazy_flags, Op));
+            Emit16(e, lazyOp);
+
+            if (instruction->OpType != Op_cmp)
+            {
+                if (dest->Type == Operand_Register)
+                {
+                    EmitMoveRegister32(e, HostRegister(RegisterLookup[dest->Register].RegisterIndex), JIT_HOST_RCX);
+                }
+                else
+                {
+                    EmitAluMemReg16(e, 0x89, JIT_HOST_RCX);
+                }
+            }
+
+            continue;
+        }
+
+        // control transfer (always the last instruction in the block)
+        U32 nextAddress = instruction->Address + instruction->Bits.ByteCount;
+        U32 targetAddress = nextAddress + (S8)(instruction->Operands[0].Immediate.Value & 0xff);
+
+        jit_exit_stub notTaken = {};
+        notTaken.IP = nextAddress;
+        notTaken.PrevIP = instruction->Address;
+        notTaken.SetPrevIP = TRUE;
+        notTaken.InstructionCount = instructionCount;
+        notTaken.ClockCount = clockCount;
+        notTaken.Reason = JitExit_Normal;
+
+        if (instruction->OpType == Op_jne)
+        {
+            // cmp word [rdi + LazyFlags.Result], 0 / je not taken
+            Emit8(e, 0x66);
+            Emit8(e, 0x83);
+            Emit8(e, ModRM(0b10, 7, JIT_HOST_RDI));
+            Emit32(e, offsetof(processor_8086, LazyFlags) + offsetof(lazy_flags, Result));
+            Emit8(e, 0);
+            notTaken.PatchAt = EmitBranch32(e, 0x84);
+            stubs[stubCount++] = notTaken;
+        }
+        else if (instruction->OpType == Op_loop)
+        {
+            // sub cx, 1 / jz not taken
+            U8 cxHost = HostRegister(RegisterLookup[Reg_cx].RegisterIndex);
+            Emit8(e, 0x66);
+            Emit8(e, Rex(0, cxHost));
+            Emit8(e, 0x83);
+            Emit8(e, ModRM(0b11, 5, cxHost));
+            Emit8(e, 1);
+            notTaken.PatchAt = EmitBranch32(e, 0x84);
+            stubs[stubCount++] = notTaken;
+        }
+
+        jit_exit_stub taken = notTaken;
+        taken.IP = targetAddress;
+
+        if (targetAddress == address && !(breakpoints && HasBreakpoint(breakpoints, address)))
+        {
+            // Note (Aaron): Loop back into this block natively while there is budget left
+            EmitProcessorImm32(e, 0x81, 0, offsetof(processor_8086, InstructionCount), instructionCount);
+            EmitProcessorImm32(e, 0x81, 0, offsetof(processor_8086, TotalClockCount), clockCount);
+
+            // sub rbp, instructionCount / jle budget exit
+            Emit8(e, 0x48); Emit8(e, 0x81); Emit8(e, ModRM(0b11, 5, JIT_HOST_RBP));
+            Emit32(e, instructionCount);
+            taken.InstructionCount = 0;
+            taken.ClockCount = 0;
+            taken.PatchAt = EmitBranch32(e, 0x8e);
+            stubs[stubCount++] = taken;
+
+            PatchBranch32(EmitBranch32(e, 0xff), bodyStart);
+        }
+        else
+        {
+            EmitExitStub(e, engine, &taken);
+        }
+    }
+
+    // fell out of the block without a control transfer
+    if (!terminated)
+    {
+        jit_exit_stub fallthrough = {};
+        fallthrough.IP = ip;
+        fallthrough.PrevIP = instructions[instructionCount - 1].Address;
+        fallthrough.SetPrevIP = TRUE;
+        fallthrough.InstructionCount = instructionCount;
+        fallthrough.ClockCount = clockCount;
+        fallthrough.Reason = JitExit_Normal;
+        EmitExitStub(e, engine, &fallthrough);
+    }
+
+    for (U32 stubIndex = 0; stubIndex < stubCount; ++stubIndex)
+    {
+        PatchBranch32(stubs[stubIndex].PatchAt, e->At);
+        EmitExitStub(e, engine, &stubs[stubIndex]);
+    }
+
+    assert_8086((U64)(e->At - block->Code) <= JIT_MAX_BLOCK_CODE_SIZE);
+    engine->CodeUsed += (U64)(e->At - block->Code);
+
+    if (!SetCodeMemoryExecutable(block->Code, JIT_MAX_BLOCK_CODE_SIZE, TRUE))
+    {
+        block->Code = 0;
+    }
+
+    return block;
+}
+
+
+// Note (Aaron): Runs the loaded program until it finishes, a ret executes while stopOnReturn is set,
+// at least instructionLimit instructions have executed (0 means no limit), or it reaches a breakpoint or
+// watchpoint (see breakpoint_set::StopReason). Requires the processor to have an instruction cache.
+// Returns TRUE if the program halted.
+global_function B32 ExecuteJit(jit_engine *engine, processor_8086 *processor, B32 stopOnReturn, U64 instructionLimit)
+{
+    instruction_cache *cache = processor->InstructionCache;
+    assert_8086(cache && "The JIT requires an instruction cache");
+    if (!cache)
+    {
+        return FALSE;
+    }
+
+    breakpoint_set *breakpoints = processor->Breakpoints;
+    U32 breakpointGeneration = breakpoints ? breakpoints->Generation : 0;
+    if (breakpointGeneration != engine->BreakpointGeneration)
+    {
+        FlushJitEngine(engine);
+        engine->BreakpointGeneration = breakpointGeneration;
+    }
+
+    B32 resumingFromBreakpoint = breakpoints && ResumeExecution(breakpoints, processor->IP);
+    U32 startInstructionCount = processor->InstructionCount;
+    B32 interpretNext = FALSE;
+
+    for (;;)
+    {
+        if (cache->InvalidationCount != engine->InvalidationCount)
+        {
+            FlushJitEngine(engine);
+            engine->InvalidationCount = cache->InvalidationCount;
+        }
+
+        if (HasProcessorFinishedExecution(processor))
+        {
+            return TRUE;
+        }
+
+        if (breakpoints
+            && ShouldStopExecution(breakpoints, processor->IP, resumingFromBreakpoint && processor->InstructionCount == startInstructionCount))
+        {
+            return FALSE;
+        }
+
+        U64 executedCount = (U64)(processor->InstructionCount - startInstructionCount);
+        if (instructionLimit && executedCount >= instructionLimit)
+        {
+            return FALSE;
+        }
+
+        if (!interpretNext)
+        {
+            U32 blockIndex = engine->BlockLookup[processor->IP];
+            jit_block *block = blockIndex
+                ? &engine->Blocks[blockIndex - 1]
+                : CompileJitBlock(engine, processor, processor->IP);
+
+            if (block->Code)
+            {
+                S64 budget = instructionLimit ? (S64)(instructionLimit - executedCount) : ((S64)1 << 62);
+                jit_block_function *function = (jit_block_function *)block->Code;
+                U32 reason = function(processor, processor->Memory, budget);
+
+                interpretNext = (reason == JitExit_Interpret);
+                continue;
+            }
+        }
+
+        interpretNext = FALSE;
+
+        instruction instruction = DecodeNextInstruction(processor);
+        ExecuteInstruction(processor, &instruction, 0, TraceLevel_None);
+
+        if (instruction.OpType == Op_ret && stopOnReturn)
+        {
+            return TRUE;
+        }
+    }
+}
+
+#else
+
+global_function B32 InitializeJitEngine(jit_engine *engine, memory_arena *arena, U32 memorySize, U64 codeSize)
+{
+    *engine = {};
+    return FALSE;
+}
+
+
+global_function void FreeJitEngine(jit_engine *engine)
+{
+    *engine = {};
+}
+
+
+global_function void FlushJitEngine(jit_engine *engine)
+{
+}
+
+
+global_function B32 ExecuteJit(jit_engine *engine, processor_8086 *processor, B32 stopOnReturn, U64 instructionLimit)
+{
+    assert_8086(FALSE && "The JIT is not supported on this platform");
+    return FALSE;
+}
+
+#endif // JIT_SUPPORTED
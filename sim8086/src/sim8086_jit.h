@@ -0,0 +1,67 @@
+#ifndef SIM8086_JIT_H
+#define SIM8086_JIT_H
+
+#include "base_types.h"
+#include "base_arena.h"
+#include "sim8086.h"
+
+// Note (Aaron): The JIT emits x86-64 machine code and is only available on x86-64 hosts
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#define JIT_MAX_BLOCK_OPS 64
+
+
+// Note (Aaron): Reasons a translated block hands control back to the dispatcher
+enum jit_exit_reason
+{
+    JitExit_Normal,             // Left the block through control flow, or ran out of budget
+    JitExit_Interpret,          // The instruction at IP can't run natively and must be interpreted
+};
+
+
+struct jit_block
+{
+    U32 StartAddress;
+    U32 InstructionCount;
+
+    // Note (Aaron): 0 if the instruction at StartAddress can't be translated
+    U8 *Code;
+};
+
+
+struct jit_engine
+{
+    // Note (Aaron): One entry per memory address; index into Blocks offset by 1, 0 if no block starts there
+    U32 *BlockLookup;
+    U32 LookupSize;
+
+    jit_block *Blocks;
+    U32 BlockCount;
+    U32 BlockCapacity;
+
+    // Note (Aaron): Executable memory, made writable only while a block is emitted into it. Starts with the shared
+    // exit sequence every block jumps to.
+    U8 *Code;
+    U64 CodeSize;
+    U64 CodeUsed;
+    U8 *ExitCode;
+    U64 BlockCodeStart;         // Note (Aaron): Offset of the first block, after the shared exit sequence
+
+    // Note (Aaron): Last observed instruction_cache::InvalidationCount. Blocks are rebuilt when it changes.
+    U32 InvalidationCount;
+    // Note (Aaron): Last observed breakpoint_set::Generation (0 without breakpoints). Blocks end at breakpoints
+    // and check watched pages, so they are rebuilt when it changes.
+    U32 BreakpointGeneration;
+};
+
+
+global_function B32 InitializeJitEngine(jit_engine *engine, memory_arena *arena, U32 memorySize, U64 codeSize);
+global_function void FreeJitEngine(jit_engine *engine);
+global_function void FlushJitEngine(jit_engine *engine);
+global_function B32 ExecuteJit(jit_engine *engine, processor_8086 *processor, B32 stopOnReturn, U64 instructionLimit);
+
+#endif // SIM8086_JIT_H
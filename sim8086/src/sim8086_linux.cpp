@@ -30,8 +30,10 @@
 #include "base_memory.c"
 #include "base_arena.c"
 #include "base_string.c"
+#include "base_threads.c"
 #include "sim8086.cpp"
 #include "sim8086_mnemonics.cpp"
+#include "sim8086_trace.cpp"
 
 
 // Note (Aaron): Adjustable values
@@ -137,6 +139,7 @@ global_function application_code LinuxLoadAppCode(char *soSourcePath, char *soTe
     {
         result.SetImGuiContext = 0;
         result.UpdateAndRender = 0;
+        result.UnloadApplication = 0;
 
         return result;
     }
@@ -184,22 +187,29 @@ global_function application_code LinuxLoadAppCode(char *soSourcePath, char *soTe
     {
         result.SetImGuiContext = (set_imgui_context *)dlsym(result.CodeSO, "SetImGuiContext");
         result.UpdateAndRender = (update_and_render *)dlsym(result.CodeSO, "UpdateAndRender");
+        result.UnloadApplication = (unload_application *)dlsym(result.CodeSO, "UnloadApplication");
 
-        result.IsValid = (result.SetImGuiContext && result.UpdateAndRender);
+        result.IsValid = (result.SetImGuiContext && result.UpdateAndRender && result.UnloadApplication);
     }
 
     if (!result.IsValid)
     {
         result.SetImGuiContext = 0;
         result.UpdateAndRender = 0;
+        result.UnloadApplication = 0;
     }
 
     return result;
 }
 
 
-global_function void LinuxUnloadAppCode(application_code *applicationCode)
+global_function void LinuxUnloadAppCode(application_code *applicationCode, application_state *applicationState)
 {
+    if (applicationCode->UnloadApplication)
+    {
+        applicationCode->UnloadApplication(applicationState);
+    }
+
     if (applicationCode->CodeSO)
     {
         dlclose(applicationCode->CodeSO);
@@ -209,6 +219,7 @@ global_function void LinuxUnloadAppCode(application_code *applicationCode)
     applicationCode->IsValid = FALSE;
     applicationCode->SetImGuiContext = 0;
     applicationCode->UpdateAndRender = 0;
+    applicationCode->UnloadApplication = 0;
 }
 
 
@@ -321,8 +332,7 @@ int main(int argc, char const *argv[])
 
     // initialize 8086
     processor_8086 processor = {};
-    processor.Memory = (U8 *)ArenaPushSize(&memory.Permanent.Arena, processor.MemorySize);
-    if (!processor.Memory)
+    if (!AllocateProcessorMemory(&processor))
     {
         Assert(FALSE && "Unable to allocate main memory for 8086");
         return 1;
@@ -352,7 +362,7 @@ int main(int argc, char const *argv[])
         U64 soWriteTime = LinuxGetLastWriteTime((char *)linuxContext.SOPath.Str);
         if (soWriteTime != applicationCode.LastWriteTime)
         {
-            LinuxUnloadAppCode(&applicationCode);
+            LinuxUnloadAppCode(&applicationCode, &applicationState);
             applicationCode = LinuxLoadAppCode((char *)linuxContext.SOPath.Str,
                                                (char *)linuxContext.SOTempPath.Str,
                                                (char *)linuxContext.SOLockPath.Str);
@@ -393,6 +403,7 @@ int main(int argc, char const *argv[])
     }
 
     // Cleanup
+    LinuxUnloadAppCode(&applicationCode, &applicationState);
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
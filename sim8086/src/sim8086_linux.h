@@ -24,6 +24,7 @@ typedef struct
 
     set_imgui_context *SetImGuiContext;
     update_and_render *UpdateAndRender;
+    unload_application *UnloadApplication;
 
     B32 IsValid;
 } application_code;
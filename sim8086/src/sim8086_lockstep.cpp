@@ -0,0 +1,586 @@
+/* Note (Aaron):
+    Lockstep engine. Executes one instruction stream for up to LOCKSTEP_MAX_LANES processors that
+    are running the same program from different initial states. Instructions are decoded once by the
+    first lane in the group and translated with TranslateToThreadedOp(), then register operations are
+    applied to every lane with vector operations over the structure-of-arrays register file. Memory
+    operands are resolved per lane, as every lane has its own memory.
+
+    Lanes only stay in the group while they agree on the instruction pointer. When a conditional jump
+    splits the group the larger side keeps executing in lockstep and the others are written back to
+    their processor_8086 and finished on their own with ExecuteInstruction().
+
+    Every lane must end up in exactly the same state as if it had been run by ExecuteInstruction().
+*/
+
+#include "base_memory.h"
+#include "sim8086.h"
+#include "sim8086_threaded.h"
+#include "sim8086_lockstep.h"
+
+#if LOCKSTEP_AVX2
+#include <immintrin.h>
+#endif
+
+
+// +------------------------------+
+// Note (Aaron): Lane vectors, one 16-bit value per lane
+
+#if LOCKSTEP_AVX2
+typedef __m256i lane_u16;
+
+inline global_function lane_u16 LaneLoad(U16 const *values) { return _mm256_load_si256((__m256i const *)values); }
+inline global_function void LaneStore(U16 *values, lane_u16 a) { _mm256_store_si256((__m256i *)values, a); }
+inline global_function lane_u16 LaneSet1(U16 value) { return _mm256_set1_epi16((short)value); }
+inline global_function lane_u16 LaneAdd(lane_u16 a, lane_u16 b) { return _mm256_add_epi16(a, b); }
+inline global_function lane_u16 LaneSub(lane_u16 a, lane_u16 b) { return _mm256_sub_epi16(a, b); }
+inline global_function lane_u16 LaneAnd(lane_u16 a, lane_u16 b) { return _mm256_and_si256(a, b); }
+inline global_function lane_u16 LaneOr(lane_u16 a, lane_u16 b) { return _mm256_or_si256(a, b); }
+inline global_function lane_u16 LaneAndNot(lane_u16 a, lane_u16 b) { return _mm256_andnot_si256(b, a); }
+inline global_function lane_u16 LaneShiftLeft(lane_u16 a, U8 count) { return _mm256_sll_epi16(a, _mm_cvtsi32_si128(count)); }
+inline global_function lane_u16 LaneShiftRight(lane_u16 a, U8 count) { return _mm256_srl_epi16(a, _mm_cvtsi32_si128(count)); }
+
+#else
+struct lane_u16
+{
+    U16 E[LOCKSTEP_MAX_LANES];
+};
+
+#define LANE_FOR_EACH(expression) \
+    lane_u16 result; \
+    for (U32 lane = 0; lane < LOCKSTEP_MAX_LANES; ++lane) { result.E[lane] = (U16)(expression); } \
+    return result
+
+inline global_function lane_u16 LaneLoad(U16 const *values) { LANE_FOR_EACH(values[lane]); }
+inline global_function void LaneStore(U16 *values, lane_u16 a) { for (U32 lane = 0; lane < LOCKSTEP_MAX_LANES; ++lane) { values[lane] = a.E[lane]; } }
+inline global_function lane_u16 LaneSet1(U16 value) { LANE_FOR_EACH(value); }
+inline global_function lane_u16 LaneAdd(lane_u16 a, lane_u16 b) { LANE_FOR_EACH(a.E[lane] + b.E[lane]); }
+inline global_function lane_u16 LaneSub(lane_u16 a, lane_u16 b) { LANE_FOR_EACH(a.E[lane] - b.E[lane]); }
+inline global_function lane_u16 LaneAnd(lane_u16 a, lane_u16 b) { LANE_FOR_EACH(a.E[lane] & b.E[lane]); }
+inline global_function lane_u16 LaneOr(lane_u16 a, lane_u16 b) { LANE_FOR_EACH(a.E[lane] | b.E[lane]); }
+inline global_function lane_u16 LaneAndNot(lane_u16 a, lane_u16 b) { LANE_FOR_EACH(a.E[lane] & ~b.E[lane]); }
+inline global_function lane_u16 LaneShiftLeft(lane_u16 a, U8 count) { LANE_FOR_EACH(a.E[lane] << count); }
+inline global_function lane_u16 LaneShiftRight(lane_u16 a, U8 count) { LANE_FOR_EACH(a.E[lane] >> count); }
+
+#undef LANE_FOR_EACH
+#endif
+
+
+// Note (Aaron): Mirror GetRegisterValue() / SetRegisterValue() for 8 and 16-bit registers across all lanes
+inline global_function lane_u16 ReadLaneRegister(lockstep_engine *engine, U8 index, U16 mask, U8 shift)
+{
+    return LaneShiftRight(LaneAnd(LaneLoad(engine->Registers[index]), LaneSet1(mask)), shift);
+}
+
+
+inline global_function void WriteLaneRegister(lockstep_engine *engine, U8 index, U16 mask, U8 shift, lane_u16 value)
+{
+    lane_u16 maskVector = LaneSet1(mask);
+    lane_u16 kept = LaneAndNot(LaneLoad(engine->Registers[index]), maskVector);
+    LaneStore(engine->Registers[index], LaneOr(kept, LaneAnd(LaneShiftLeft(value, shift), maskVector)));
+}
+
+
+// Note (Aaron): Returns a bit per lane for which 'values' is 0
+inline global_function U32 GetLaneZeroMask(lane_u16 value)
+{
+    alignas(32) U16 values[LOCKSTEP_MAX_LANES];
+    LaneStore(values, value);
+
+    U32 result = 0;
+    for (U32 lane = 0; lane < LOCKSTEP_MAX_LANES; ++lane)
+    {
+        result |= (values[lane] == 0) ? (1u << lane) : 0;
+    }
+
+    return result;
+}
+
+
+inline global_function U32 CountLanes(U32 lanes)
+{
+    U32 result = 0;
+    for (; lanes; lanes &= lanes - 1)
+    {
+        ++result;
+    }
+
+    return result;
+}
+
+
+inline global_function U32 GetFirstLane(U32 lanes)
+{
+    assert_8086(lanes != 0);
+
+    U32 result = 0;
+    while (!(lanes & (1u << result)))
+    {
+        ++result;
+    }
+
+    return result;
+}
+
+
+// +------------------------------+
+// Note (Aaron): Moving lanes in and out of the group
+
+global_function void GatherLane(lockstep_engine *engine, U32 lane)
+{
+    processor_8086 *processor = &engine->Lanes[lane];
+
+    // Note (Aaron): Materializing the flags leaves every lane with the same (empty) lazy operation
+    engine->Flags[lane] = GetProcessorFlags(processor);
+
+    for (U32 registerIndex = 0; registerIndex < ArrayCount(processor->Registers); ++registerIndex)
+    {
+        engine->Registers[registerIndex][lane] = processor->Registers[registerIndex];
+    }
+
+    engine->InstructionCount[lane] = processor->InstructionCount;
+    engine->TotalClockCount[lane] = processor->TotalClockCount;
+}
+
+
+// Note (Aaron): Adds the instructions and clocks the group executed since the last sync to every lane
+global_function void SyncLaneCounts(lockstep_engine *engine)
+{
+    for (U32 lane = 0; lane < LOCKSTEP_MAX_LANES; ++lane)
+    {
+        engine->InstructionCount[lane] += engine->PendingInstructionCount;
+        engine->TotalClockCount[lane] += engine->PendingClockCount;
+    }
+
+    engine->PendingInstructionCount = 0;
+    engine->PendingClockCount = 0;
+}
+
+
+// Note (Aaron): Writes a lane's state back to its processor. Counts must have been synced.
+global_function void ScatterLane(lockstep_engine *engine, U32 lane, U32 ip)
+{
+    processor_8086 *processor = &engine->Lanes[lane];
+
+    for (U32 registerIndex = 0; registerIndex < ArrayCount(processor->Registers); ++registerIndex)
+    {
+        processor->Registers[registerIndex] = engine->Registers[registerIndex][lane];
+    }
+
+    processor->Flags = engine->Flags[lane];
+    processor->LazyFlags.Operand0 = engine->FlagsOperand0[lane];
+    processor->LazyFlags.Operand1 = engine->FlagsOperand1[lane];
+    processor->LazyFlags.Result = engine->FlagsResult[lane];
+    processor->LazyFlags.Op = engine->FlagsOp;
+    processor->LazyFlags.IsWide = engine->FlagsIsWide;
+
+    processor->IP = ip;
+    processor->PrevIP = engine->PrevIP;
+    processor->InstructionCount = engine->InstructionCount[lane];
+    processor->TotalClockCount = engine->TotalClockCount[lane];
+}
+
+
+// Note (Aaron): Removes 'lanes' from the group. Each lane continues from the group's IP, plus 'jumpOffset'
+// if the lane is also in 'jumpLanes'.
+global_function void DivergeLanes(lockstep_engine *engine, U32 lanes, U32 jumpLanes, S8 jumpOffset)
+{
+    SyncLaneCounts(engine);
+
+    for (U32 lane = 0; lane < engine->LaneCount; ++lane)
+    {
+        if (lanes & (1u << lane))
+        {
+            ScatterLane(engine, lane, engine->IP + ((jumpLanes & (1u << lane)) ? jumpOffset : 0));
+        }
+    }
+
+    engine->ActiveLanes &= ~lanes;
+    engine->DivergenceCount++;
+}
+
+
+// +------------------------------+
+// Note (Aaron): Per lane operand access
+
+inline global_function U32 LaneEffectiveAddress(lockstep_engine *engine, U32 lane, threaded_memory_operand *memory)
+{
+    if (memory->IsDirect)
+    {
+        return memory->DirectAddress;
+    }
+
+    // Note (Aaron): Same as ThreadedEffectiveAddress(), base registers are summed at 16 bits
+    U16 base = engine->Registers[memory->BaseIndex0][lane];
+    if (memory->BaseIndex1 != THREADED_NO_REGISTER)
+    {
+        base += engine->Registers[memory->BaseIndex1][lane];
+    }
+
+    U32 effectiveAddress = base;
+    effectiveAddress += memory->Displacement;
+
+    return effectiveAddress;
+}
+
+
+// Note (Aaron): Returns a bit per lane in the group that takes the jump. The loop instructions
+// decrement CX in every lane.
+global_function U32 EvaluateLaneJumps(lockstep_engine *engine, threaded_op *op)
+{
+    U8 cxIndex = RegisterLookup[Reg_cx].RegisterIndex;
+
+    if (op->Type == ThreadedOp_Jne && engine->FlagsOp != LazyFlags_None)
+    {
+        return ~GetLaneZeroMask(LaneLoad(engine->FlagsResult)) & engine->ActiveLanes;
+    }
+
+    if (op->Type == ThreadedOp_Loop)
+    {
+        lane_u16 cx = LaneSub(LaneLoad(engine->Registers[cxIndex]), LaneSet1(1));
+        LaneStore(engine->Registers[cxIndex], cx);
+
+        return ~GetLaneZeroMask(cx) & engine->ActiveLanes;
+    }
+
+    // Note (Aaron): Everything else is evaluated per lane by the same code the interpreter uses
+    operation_types opType = (op->Type == ThreadedOp_Jne) ? Op_jne : (operation_types)op->JumpType;
+    U32 result = 0;
+    for (U32 lane = 0; lane < engine->LaneCount; ++lane)
+    {
+        if (!(engine->ActiveLanes & (1u << lane)))
+        {
+            continue;
+        }
+
+        processor_8086 laneFlags = {};
+        laneFlags.Flags = engine->Flags[lane];
+        laneFlags.LazyFlags.Operand0 = engine->FlagsOperand0[lane];
+        laneFlags.LazyFlags.Operand1 = engine->FlagsOperand1[lane];
+        laneFlags.LazyFlags.Result = engine->FlagsResult[lane];
+        laneFlags.LazyFlags.Op = engine->FlagsOp;
+        laneFlags.LazyFlags.IsWide = engine->FlagsIsWide;
+        laneFlags.Registers[cxIndex] = engine->Registers[cxIndex][lane];
+
+        if (EvaluateJumpCondition(&laneFlags, opType))
+        {
+            result |= (1u << lane);
+        }
+
+        engine->Registers[cxIndex][lane] = laneFlags.Registers[cxIndex];
+    }
+
+    return result;
+}
+
+
+// Note (Aaron): Executes a mov / add / sub / cmp for every lane in the group. Returns TRUE if any lane
+// wrote to memory occupied by the program, or faulted.
+global_function B32 ExecuteLaneArithmetic(lockstep_engine *engine, threaded_op *op)
+{
+    // Note (Aaron): Ops are grouped in fives as mov, add, sub and cmp, with variants Reg/Reg, Reg/Imm,
+    // Reg/Mem, Mem/Reg and Mem/Imm
+    U32 group = op->Type / 5;
+    U32 variant = op->Type % 5;
+    B32 isMov = (group == 0);
+    B32 isCmp = (group == 3);
+    B32 destIsMemory = (variant >= 3);
+
+    alignas(32) U16 memoryValues[LOCKSTEP_MAX_LANES] = {};
+    U32 effectiveAddresses[LOCKSTEP_MAX_LANES] = {};
+    B32 faulted = FALSE;
+
+    if (variant >= 2)
+    {
+        for (U32 lane = 0; lane < engine->LaneCount; ++lane)
+        {
+            if (!(engine->ActiveLanes & (1u << lane)))
+            {
+                continue;
+            }
+
+            effectiveAddresses[lane] = LaneEffectiveAddress(engine, lane, &op->Memory);
+
+            // Note (Aaron): mov doesn't read the memory it's about to overwrite
+            if (!(isMov && destIsMemory))
+            {
+                memoryValues[lane] = GetMemory(&engine->Lanes[lane], effectiveAddresses[lane], op->Memory.IsWide);
+                faulted |= (engine->Lanes[lane].Fault != Fault_None);
+            }
+        }
+    }
+
+    lane_u16 value0 = destIsMemory
+        ? LaneLoad(memoryValues)
+        : ReadLaneRegister(engine, op->DestIndex, op->DestMask, op->DestShift);
+
+    lane_u16 value1;
+    if (variant == 0 || variant == 3)
+    {
+        value1 = ReadLaneRegister(engine, op->SourceIndex, op->SourceMask, op->SourceShift);
+    }
+    else if (variant == 1 || variant == 4)
+    {
+        value1 = LaneSet1(op->Immediate);
+    }
+    else
+    {
+        value1 = LaneLoad(memoryValues);
+    }
+
+    lane_u16 widthMask = LaneSet1(op->WidthMask);
+    lane_u16 result = isMov ? value1
+        : (group == 1) ? LaneAnd(LaneAdd(value0, value1), widthMask)
+        : LaneAnd(LaneSub(value0, value1), widthMask);
+
+    if (!isMov)
+    {
+        LaneStore(engine->FlagsOperand0, value0);
+        LaneStore(engine->FlagsOperand1, value1);
+        LaneStore(engine->FlagsResult, result);
+        engine->FlagsOp = (group == 1) ? LazyFlags_Add : LazyFlags_Sub;
+        engine->FlagsIsWide = op->IsWide;
+    }
+
+    if (isCmp)
+    {
+        return faulted;
+    }
+
+    if (!destIsMemory)
+    {
+        WriteLaneRegister(engine, op->DestIndex, op->DestMask, op->DestShift, result);
+        return faulted;
+    }
+
+    LaneStore(memoryValues, result);
+
+    B32 wroteProgram = FALSE;
+    for (U32 lane = 0; lane < engine->LaneCount; ++lane)
+    {
+        if (!(engine->ActiveLanes & (1u << lane)))
+        {
+            continue;
+        }
+
+        processor_8086 *processor = &engine->Lanes[lane];
+        SetMemory(processor, effectiveAddresses[lane], memoryValues[lane], op->Memory.IsWide);
+        wroteProgram |= (effectiveAddresses[lane] < processor->ProgramSize);
+        faulted |= (processor->Fault != Fault_None);
+    }
+
+    return wroteProgram || faulted;
+}
+
+
+// Note (Aaron): Runs an instruction the engine has no lane operation for through ExecuteInstruction()
+// in each lane, then takes the lanes that still agree on the instruction pointer (and haven't faulted) back
+// into the group.
+global_function void InterpretLanes(lockstep_engine *engine, U32 address)
+{
+    SyncLaneCounts(engine);
+
+    U32 groupLanes = engine->ActiveLanes;
+    U32 leader = GetFirstLane(groupLanes);
+    for (U32 lane = 0; lane < engine->LaneCount; ++lane)
+    {
+        if (!(groupLanes & (1u << lane)))
+        {
+            continue;
+        }
+
+        processor_8086 *processor = &engine->Lanes[lane];
+        ScatterLane(engine, lane, address);
+
+        instruction instruction = DecodeNextInstruction(processor);
+        ExecuteInstruction(processor, &instruction, 0, TraceLevel_None);
+        GatherLane(engine, lane);
+    }
+
+    engine->FlagsOp = LazyFlags_None;
+    engine->PrevIP = address;
+    engine->IP = engine->Lanes[leader].IP;
+
+    U32 divergedLanes = 0;
+    for (U32 lane = 0; lane < engine->LaneCount; ++lane)
+    {
+        if ((groupLanes & (1u << lane)) && (engine->Lanes[lane].IP != engine->IP || engine->Lanes[lane].Fault != Fault_None))
+        {
+            divergedLanes |= (1u << lane);
+        }
+    }
+
+    // Note (Aaron): The diverged lanes' processors are already up to date
+    if (divergedLanes)
+    {
+        engine->ActiveLanes &= ~divergedLanes;
+        engine->DivergenceCount++;
+    }
+}
+
+
+// +------------------------------+
+
+// Note (Aaron): Same loop as a headless interpreter run
+global_function B32 RunLaneScalar(lockstep_engine *engine, processor_8086 *processor, B32 stopOnReturn, U64 instructionLimit, U32 startInstructionCount)
+{
+    while (!HasProcessorFinishedExecution(processor))
+    {
+        if (instructionLimit && (U64)(processor->InstructionCount - startInstructionCount) >= instructionLimit)
+        {
+            return FALSE;
+        }
+
+        instruction instruction = DecodeNextInstruction(processor);
+        ExecuteInstruction(processor, &instruction, 0, TraceLevel_None);
+        engine->ScalarInstructionCount++;
+
+        if (stopOnReturn && instruction.OpType == Op_ret)
+        {
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+
+// Note (Aaron): Runs every lane until its program finishes, a ret executes while stopOnReturn is set,
+// or it has executed at least instructionLimit instructions (0 means no limit). Every lane should have
+// the same program loaded. Lanes that don't start at the same instruction pointer and with the same
+// program as lane 0 are run on their own. Returns TRUE if every lane halted.
+global_function B32 ExecuteLockstep(lockstep_engine *engine, processor_8086 *lanes, U32 laneCount, B32 stopOnReturn, U64 instructionLimit)
+{
+    assert_8086(laneCount > 0 && laneCount <= LOCKSTEP_MAX_LANES);
+    laneCount = Min(laneCount, LOCKSTEP_MAX_LANES);
+
+    *engine = {};
+    engine->Lanes = lanes;
+    engine->LaneCount = laneCount;
+    engine->IP = lanes[0].IP;
+    engine->PrevIP = lanes[0].PrevIP;
+
+    U32 startInstructionCounts[LOCKSTEP_MAX_LANES] = {};
+    for (U32 lane = 0; lane < laneCount; ++lane)
+    {
+        processor_8086 *processor = &lanes[lane];
+        startInstructionCounts[lane] = processor->InstructionCount;
+
+        B32 sameProgram = (lane == 0)
+            || (processor->IP == lanes[0].IP
+                && processor->ProgramSize == lanes[0].ProgramSize
+                && memcmp(processor->Memory, lanes[0].Memory, processor->ProgramSize) == 0);
+
+        if (sameProgram)
+        {
+            GatherLane(engine, lane);
+            engine->ActiveLanes |= (1u << lane);
+        }
+    }
+
+    U32 finishedLanes = 0;
+    U64 stepCount = 0;
+    for (;;)
+    {
+        U32 leader = GetFirstLane(engine->ActiveLanes);
+        processor_8086 *leaderProcessor = &lanes[leader];
+
+        if (engine->IP >= leaderProcessor->ProgramSize)
+        {
+            finishedLanes = engine->ActiveLanes;
+            break;
+        }
+
+        if (instructionLimit && stepCount >= instructionLimit)
+        {
+            break;
+        }
+
+        instruction instruction = FetchInstruction(leaderProcessor, engine->IP);
+        threaded_op op;
+        ++stepCount;
+        engine->LockstepInstructionCount++;
+
+        if (!TranslateToThreadedOp(&instruction, &op))
+        {
+            InterpretLanes(engine, instruction.Address);
+            if (!engine->ActiveLanes)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        engine->PrevIP = op.Address;
+        engine->IP = op.NextAddress;
+        engine->PendingInstructionCount++;
+        engine->PendingClockCount += op.ClockCount;
+
+        if (op.Type < ThreadedOp_Jne)
+        {
+            // Note (Aaron): The other lanes may now be running different code, so the group can't continue
+            if (ExecuteLaneArithmetic(engine, &op))
+            {
+                DivergeLanes(engine, engine->ActiveLanes, 0, 0);
+                break;
+            }
+
+            continue;
+        }
+
+        if (op.Type == ThreadedOp_Ret)
+        {
+            if (stopOnReturn)
+            {
+                finishedLanes = engine->ActiveLanes;
+                break;
+            }
+
+            continue;
+        }
+
+        if (op.Type == ThreadedOp_Jne || op.Type == ThreadedOp_Loop || op.Type == ThreadedOp_Jump)
+        {
+            U32 jumpLanes = EvaluateLaneJumps(engine, &op);
+            U32 stayLanes = engine->ActiveLanes & ~jumpLanes;
+
+            // Note (Aaron): The larger side of a split keeps executing in lockstep
+            if (jumpLanes && stayLanes)
+            {
+                B32 keepJumping = CountLanes(jumpLanes) >= CountLanes(stayLanes);
+                DivergeLanes(engine, keepJumping ? stayLanes : jumpLanes, jumpLanes, op.JumpOffset);
+            }
+
+            if (engine->ActiveLanes == jumpLanes)
+            {
+                engine->IP += op.JumpOffset;
+            }
+
+            continue;
+        }
+
+        // Note (Aaron): Decoded but not simulated (ThreadedOp_Nop)
+    }
+
+    SyncLaneCounts(engine);
+    for (U32 lane = 0; lane < laneCount; ++lane)
+    {
+        if (engine->ActiveLanes & (1u << lane))
+        {
+            ScatterLane(engine, lane, engine->IP);
+        }
+    }
+
+    B32 result = TRUE;
+    for (U32 lane = 0; lane < laneCount; ++lane)
+    {
+        if (finishedLanes & (1u << lane))
+        {
+            continue;
+        }
+
+        result &= RunLaneScalar(engine, &lanes[lane], stopOnReturn, instructionLimit, startInstructionCounts[lane]);
+    }
+
+    return result;
+}
@@ -0,0 +1,61 @@
+#ifndef SIM8086_LOCKSTEP_H
+#define SIM8086_LOCKSTEP_H
+
+#include "base_types.h"
+#include "sim8086.h"
+
+// Note (Aaron): AVX2 is used when the compiler targets it (e.g. -mavx2 or /arch:AVX2). Otherwise lane
+// operations are loops over the lanes, which the compiler is free to vectorize with what it has.
+#ifndef LOCKSTEP_AVX2
+#if defined(__AVX2__)
+#define LOCKSTEP_AVX2 1
+#else
+#define LOCKSTEP_AVX2 0
+#endif
+#endif
+
+// Note (Aaron): 16 lanes of 16-bit registers fill one 256-bit vector
+#define LOCKSTEP_MAX_LANES 16
+
+
+// Note (Aaron): Runs the same program on several processors (lanes) at once. Lanes that share an
+// instruction pointer have the instruction decoded once and executed for all of them, with their
+// registers stored structure-of-arrays so arithmetic is a vector operation across lanes. Lanes whose
+// branches go a different way than the rest leave the group and finish with ExecuteInstruction().
+struct lockstep_engine
+{
+    // Note (Aaron): Registers[register index][lane], in processor_8086::Registers order
+    alignas(32) U16 Registers[8][LOCKSTEP_MAX_LANES];
+
+    // Note (Aaron): lazy_flags per lane. The operation and its width are the same in every lane.
+    alignas(32) U16 FlagsOperand0[LOCKSTEP_MAX_LANES];
+    alignas(32) U16 FlagsOperand1[LOCKSTEP_MAX_LANES];
+    alignas(32) U16 FlagsResult[LOCKSTEP_MAX_LANES];
+    lazy_flags_op FlagsOp;
+    B8 FlagsIsWide;
+    U8 Flags[LOCKSTEP_MAX_LANES];
+
+    // Note (Aaron): Counts are only added to each lane when lanes leave the group
+    U32 InstructionCount[LOCKSTEP_MAX_LANES];
+    U32 TotalClockCount[LOCKSTEP_MAX_LANES];
+    U32 PendingInstructionCount;
+    U32 PendingClockCount;
+
+    // Note (Aaron): Shared by every lane in the group
+    U32 IP;
+    U32 PrevIP;
+
+    processor_8086 *Lanes;
+    U32 LaneCount;
+    U32 ActiveLanes;                // Bit per lane executing in lockstep
+
+    // Note (Aaron): Statistics for the last ExecuteLockstep() call
+    U64 LockstepInstructionCount;   // Instructions decoded once and executed by every lane in the group
+    U64 ScalarInstructionCount;     // Instructions executed by lanes on their own
+    U32 DivergenceCount;
+};
+
+
+global_function B32 ExecuteLockstep(lockstep_engine *engine, processor_8086 *lanes, U32 laneCount, B32 stopOnReturn, U64 instructionLimit);
+
+#endif // SIM8086_LOCKSTEP_H
@@ -4,62 +4,80 @@
 #include "base_arena.h"
 #include "base_string.h"
 #include "sim8086.h"
+#include "sim8086_mnemonics.h"
 
 
-global_variable char const *OperationMnemonics[]
+// Note (Aaron): Lengths are stored with the strings so they can be copied without scanning for the terminator
+struct mnemonic_string
 {
-    "mov",
-    "add",
-    "sub",
-    "cmp",
-    "jne",
-    "je",
-    "jl",
-    "jle",
-    "jb",
-    "jbe",
-    "jp",
-    "jo",
-    "js",
-    "jnl",
-    "jg",
-    "jnb",
-    "ja",
-    "jnp",
-    "jno",
-    "jns",
-    "LOOP",
-    "LOOPZ",
-    "LOOPNZ",
-    "JCXZ",
-    "ret",
-    "unknown",
+    char const *Str;
+    U32 Length;
 };
 
+#define MNEMONIC_STRING(s) { s, sizeof(s) - 1 }
 
-global_variable char const *RegisterMnemonics[]
+
+global_variable mnemonic_string OperationMnemonics[]
+{
+    MNEMONIC_STRING("mov"),
+    MNEMONIC_STRING("add"),
+    MNEMONIC_STRING("sub"),
+    MNEMONIC_STRING("cmp"),
+    MNEMONIC_STRING("jne"),
+    MNEMONIC_STRING("je"),
+    MNEMONIC_STRING("jl"),
+    MNEMONIC_STRING("jle"),
+    MNEMONIC_STRING("jb"),
+    MNEMONIC_STRING("jbe"),
+    MNEMONIC_STRING("jp"),
+    MNEMONIC_STRING("jo"),
+    MNEMONIC_STRING("js"),
+    MNEMONIC_STRING("jnl"),
+    MNEMONIC_STRING("jg"),
+    MNEMONIC_STRING("jnb"),
+    MNEMONIC_STRING("ja"),
+    MNEMONIC_STRING("jnp"),
+    MNEMONIC_STRING("jno"),
+    MNEMONIC_STRING("jns"),
+    MNEMONIC_STRING("LOOP"),
+    MNEMONIC_STRING("LOOPZ"),
+    MNEMONIC_STRING("LOOPNZ"),
+    MNEMONIC_STRING("JCXZ"),
+    MNEMONIC_STRING("movs"),
+    MNEMONIC_STRING("cmps"),
+    MNEMONIC_STRING("scas"),
+    MNEMONIC_STRING("lods"),
+    MNEMONIC_STRING("stos"),
+    MNEMONIC_STRING("cld"),
+    MNEMONIC_STRING("std"),
+    MNEMONIC_STRING("unknown"),
+    MNEMONIC_STRING("ret"),
+};
+
+
+global_variable mnemonic_string RegisterMnemonics[]
 {
-    "al",
-    "cl",
-    "dl",
-    "bl",
-    "ah",
-    "ch",
-    "dh",
-    "bh",
-    "ax",
-    "cx",
-    "dx",
-    "bx",
-    "sp",
-    "bp",
-    "si",
-    "di",
-    "bx + si",
-    "bx + di",
-    "bp + si",
-    "bp + di",
-    "unknown",
+    MNEMONIC_STRING("al"),
+    MNEMONIC_STRING("cl"),
+    MNEMONIC_STRING("dl"),
+    MNEMONIC_STRING("bl"),
+    MNEMONIC_STRING("ah"),
+    MNEMONIC_STRING("ch"),
+    MNEMONIC_STRING("dh"),
+    MNEMONIC_STRING("bh"),
+    MNEMONIC_STRING("ax"),
+    MNEMONIC_STRING("cx"),
+    MNEMONIC_STRING("dx"),
+    MNEMONIC_STRING("bx"),
+    MNEMONIC_STRING("sp"),
+    MNEMONIC_STRING("bp"),
+    MNEMONIC_STRING("si"),
+    MNEMONIC_STRING("di"),
+    MNEMONIC_STRING("bx + si"),
+    MNEMONIC_STRING("bx + di"),
+    MNEMONIC_STRING("bp + si"),
+    MNEMONIC_STRING("bp + di"),
+    MNEMONIC_STRING("unknown"),
 };
 
 
@@ -73,6 +91,7 @@ global_variable char const *RegisterFlagMnemonics[]
     "ZF",
     "SF",
     "OF",
+    "DF",
 };
 
 
@@ -82,7 +101,7 @@ global_function char const *GetOpMnemonic(operation_types op)
 
     if(op < Op_count)
     {
-        Result = OperationMnemonics[op];
+        Result = OperationMnemonics[op].Str;
     }
 
     return Result;
@@ -95,7 +114,7 @@ global_function char const *GetRegisterMnemonic(register_id regMemId)
 
     if(regMemId < Reg_mem_id_count)
     {
-        Result = RegisterMnemonics[regMemId];
+        Result = RegisterMnemonics[regMemId].Str;
     }
 
     return Result;
@@ -118,6 +137,8 @@ global_function const char *GetRegisterFlagMnemonic(register_flags flag)
             return RegisterFlagMnemonics[4];
         case RegisterFlag_OF:
             return RegisterFlagMnemonics[5];
+        case RegisterFlag_DF:
+            return RegisterFlagMnemonics[6];
         default:
             Assert(FALSE && "Unhandled register flag enum");
             return "";
@@ -125,151 +146,222 @@ global_function const char *GetRegisterFlagMnemonic(register_flags flag)
 }
 
 
-global_function Str8 GetInstructionMnemonic(instruction *instruction, memory_arena *arena)
+inline static char *EmitMnemonic(char *at, mnemonic_string string)
+{
+    MemoryCopy(at, string.Str, string.Length);
+    return at + string.Length;
+}
+
+
+// Note (Aaron): Operand values are at most 16 bits wide, so never more than 5 digits
+inline static char *EmitDecimal(char *at, S32 value)
 {
-    U8 *startPtr = (U8 *)ArenaPushCStringf(arena, FALSE, (char *)"%s ", GetOpMnemonic(instruction->OpType));
-    const char *Separator = "";
+    *at = '-';
+    at += (value < 0);
+
+    U32 magnitude = (value < 0) ? (U32)0 - (U32)value : (U32)value;
+    U32 digitCount = 1 + (magnitude >= 10) + (magnitude >= 100) + (magnitude >= 1000) + (magnitude >= 10000);
+
+    for (U32 i = digitCount; i > 0; --i)
+    {
+        at[i - 1] = (char)('0' + (magnitude % 10));
+        magnitude /= 10;
+    }
+
+    return at + digitCount;
+}
 
+
+// Note (Aaron): The bits of every nibble value, most significant first
+global_variable char const NibbleBits[] =
+    "0000" "0001" "0010" "0011" "0100" "0101" "0110" "0111"
+    "1000" "1001" "1010" "1011" "1100" "1101" "1110" "1111";
+
+
+inline static char *EmitBits(char *at, U8 byte)
+{
+    MemoryCopy(at, NibbleBits + ((byte >> 4) * 4), 4);
+    MemoryCopy(at + 4, NibbleBits + ((byte & 0xf) * 4), 4);
+    return at + 8;
+}
+
+
+// Note (Aaron): Writes the instruction as NASM syntax into 'buffer', which must hold at least
+// INSTRUCTION_MNEMONIC_MAX_SIZE bytes. Returns the length written; no null-terminator is appended.
+global_function U32 FormatInstructionMnemonic(instruction *instruction, char *buffer)
+{
+    local_persist mnemonic_string const Separator = MNEMONIC_STRING(", ");
+    local_persist mnemonic_string const WidthHints[2] = { MNEMONIC_STRING("byte "), MNEMONIC_STRING("word ") };
+    local_persist mnemonic_string const DisplacementSigns[2] = { MNEMONIC_STRING(" + "), MNEMONIC_STRING(" - ") };
+    local_persist mnemonic_string const RepPrefixes[3] = { MNEMONIC_STRING("rep "), MNEMONIC_STRING("repe "), MNEMONIC_STRING("repne ") };
+
+    char *at = buffer;
+    B32 isString = IsStringOperation(instruction->OpType);
+    if (instruction->RepPrefix == Rep_RepNE)
+    {
+        at = EmitMnemonic(at, RepPrefixes[2]);
+    }
+    else if (instruction->RepPrefix == Rep_RepE)
+    {
+        B32 testsZero = (instruction->OpType == Op_cmps || instruction->OpType == Op_scas);
+        at = EmitMnemonic(at, RepPrefixes[testsZero ? 1 : 0]);
+    }
+
+    if (instruction->OpType < Op_count)
+    {
+        at = EmitMnemonic(at, OperationMnemonics[instruction->OpType]);
+    }
+
+    // Note (Aaron): String instructions have no operands, their width is a suffix instead
+    if (isString)
+    {
+        *at++ = instruction->WidthBit ? 'w' : 'b';
+    }
+    *at++ = ' ';
+
+    B32 needsSeparator = FALSE;
     for (int i = 0; i < ArrayCount(instruction->Operands); ++i)
     {
-        instruction_operand operand = instruction->Operands[i];
+        instruction_operand *operand = &instruction->Operands[i];
 
         // skip empty operands
-        if(operand.Type == Operand_None)
+        if (operand->Type == Operand_None)
         {
             continue;
         }
 
-        if (GetStringLength((char *)Separator) > 0)
+        if (needsSeparator)
         {
-            ArenaPushCStringf(arena, FALSE, (char *)"%s", Separator);
+            at = EmitMnemonic(at, Separator);
         }
-        Separator = ", ";
+        needsSeparator = TRUE;
 
-        switch (operand.Type)
+        switch (operand->Type)
         {
-            case Operand_None:
-            {
-                break;
-            }
-
             case Operand_Memory:
             {
                 // prepend width hint if necessary
-                if (operand.Memory.Flags & Memory_PrependWidth)
+                if (operand->Memory.Flags & Memory_PrependWidth)
                 {
-                    if (operand.Memory.Flags & Memory_IsWide)
-                    {
-                        ArenaPushCStringf(arena, FALSE, (char *)"%s", (char *)"word ");
-                    }
-                    else
-                    {
-                        ArenaPushCStringf(arena, FALSE, (char *)"%s", "byte ");
-                    }
-
+                    at = EmitMnemonic(at, WidthHints[(operand->Memory.Flags & Memory_IsWide) ? 1 : 0]);
                 }
 
+                *at++ = '[';
+
                 // print direct address
-                if (operand.Memory.Flags & Memory_HasDirectAddress)
+                if (operand->Memory.Flags & Memory_HasDirectAddress)
                 {
-                    ArenaPushCStringf(arena, FALSE, (char *)"[%i]", operand.Memory.DirectAddress);
+                    at = EmitDecimal(at, operand->Memory.DirectAddress);
+                    *at++ = ']';
                     break;
                 }
 
                 // print memory with optional displacement
-                ArenaPushCStringf(arena, FALSE, (char *)"[");
-                ArenaPushCStringf(arena, FALSE, (char *)GetRegisterMnemonic(operand.Memory.Register));
+                if (operand->Memory.Register < Reg_mem_id_count)
+                {
+                    at = EmitMnemonic(at, RegisterMnemonics[operand->Memory.Register]);
+                }
 
-                if (operand.Memory.Flags & Memory_HasDisplacement)
+                if (operand->Memory.Flags & Memory_HasDisplacement)
                 {
-                    if (operand.Memory.Displacement >= 0)
-                    {
-                        ArenaPushCStringf(arena, FALSE, (char *)" + %i", operand.Memory.Displacement);
-                    }
-                    else
-                    {
-                        ArenaPushCStringf(arena, FALSE, (char *)" - %i", operand.Memory.Displacement);
-                    }
+                    S32 displacement = operand->Memory.Displacement;
+                    at = EmitMnemonic(at, DisplacementSigns[displacement < 0]);
+                    at = EmitDecimal(at, (displacement < 0) ? -displacement : displacement);
                 }
 
-                ArenaPushCStringf(arena, FALSE, (char *)"]");
+                *at++ = ']';
                 break;
             }
 
             case Operand_Register:
             {
-                ArenaPushCStringf(arena, FALSE, (char *)GetRegisterMnemonic(operand.Register));
+                if (operand->Register < Reg_mem_id_count)
+                {
+                    at = EmitMnemonic(at, RegisterMnemonics[operand->Register]);
+                }
                 break;
             }
 
             case Operand_Immediate:
             {
-                if (operand.Immediate.Flags & Immediate_IsJump)
+                if (operand->Immediate.Flags & Immediate_IsJump)
                 {
-                    S8 offset = (S8)(operand.Immediate.Value & 0xff);
+                    S8 offset = (S8)(operand->Immediate.Value & 0xff);
 
                     // Note (Aaron): Offset the value to accommodate a NASM syntax peculiarity.
                     // NASM expects an offset value from the start of the instruction rather than
                     // the end (which is how the instructions are encoded).
                     offset += instruction->Bits.ByteCount;
 
-                    if (offset >= 0)
-                    {
-                        ArenaPushCStringf(arena, FALSE, (char *)"$+%i", offset);
-                    }
-                    else
-                    {
-                        ArenaPushCStringf(arena, FALSE, (char *)"$%i", offset);
-                    }
+                    *at = '$';
+                    at[1] = '+';
+                    at += 1 + (offset >= 0);
+                    at = EmitDecimal(at, offset);
                     break;
                 }
 
                 // TODO (Aaron): Test this more
-                bool isSigned = operand.Immediate.Flags & Immediate_IsSigned;
-                ArenaPushCStringf(arena, FALSE, (char *)"%i",
-                             (isSigned
-                                 ? (S16) operand.Immediate.Value
-                                 : (U16) operand.Immediate.Value));
+                bool isSigned = operand->Immediate.Flags & Immediate_IsSigned;
+                at = EmitDecimal(at, isSigned
+                                 ? (S16)operand->Immediate.Value
+                                 : (U16)operand->Immediate.Value);
                 break;
             }
 
             default:
             {
-                ArenaPushCStringf(arena, FALSE, (char *)"?");
+                *at++ = '?';
             }
         }
     }
 
-    U64 length = arena->PositionPtr - startPtr;
-    Str8 result = String8(startPtr, length);
+    return (U32)(at - buffer);
+}
+
 
-    // Note (Aaron): Append the null-terminator character
-    ArenaPushSizeZero(arena, 1);
+// Note (Aaron): Writes the instruction's bytes as groups of 8 bits, each followed by a space, into 'buffer',
+// which must hold at least INSTRUCTION_BITS_MNEMONIC_MAX_SIZE bytes. Returns the length written; no
+// null-terminator is appended.
+global_function U32 FormatInstructionBitsMnemonic(instruction *instruction, char *buffer)
+{
+    char *at = buffer;
+    for (U8 i = 0; i < instruction->Bits.ByteCount; ++i)
+    {
+        at = EmitBits(at, instruction->Bits.Bytes[i]);
+        *at++ = ' ';
+    }
 
-    return result;
+    return (U32)(at - buffer);
 }
 
 
-global_function Str8 GetInstructionBitsMnemonic(instruction *inst, memory_arena *arena)
+// Note (Aaron): Copies formatted text into the arena with a null-terminator, which the returned string's
+// length doesn't include
+static Str8 PushMnemonic(memory_arena *arena, char *text, U32 length)
 {
-    U8 *startPtr = arena->PositionPtr;
-    for (U8 i = 0; i < inst->Bits.ByteCount; ++i)
-    {
-        for (U8 j = 0; j < 8; j++)
-        {
-            U8 mask = 128 >> j;
-            U8 bit = (inst->Bits.Bytes[i] & mask) >> (7 - j);
-            ArenaPushCString(arena, FALSE, bit == 1 ? (char *)"1": (char *)"0");
-        }
+    text[length] = 0;
 
-        ArenaPushCString(arena, FALSE, (char *)" ");
+    U8 *str = (U8 *)ArenaPushData(arena, length + 1, (U8 *)text);
+    if (!str)
+    {
+        return {};
     }
 
-    // Note (Aaron): Append the null-terminator character
-    ArenaPushSizeZero(arena, 1);
+    return String8(str, length);
+}
 
-    U64 length = arena->PositionPtr - startPtr;
-    Str8 result = String8(startPtr, length);
 
-    return result;
+global_function Str8 GetInstructionMnemonic(instruction *instruction, memory_arena *arena)
+{
+    char buffer[INSTRUCTION_MNEMONIC_MAX_SIZE + 1];
+    U32 length = FormatInstructionMnemonic(instruction, buffer);
+    return PushMnemonic(arena, buffer, length);
+}
+
+
+global_function Str8 GetInstructionBitsMnemonic(instruction *instruction, memory_arena *arena)
+{
+    char buffer[INSTRUCTION_BITS_MNEMONIC_MAX_SIZE + 1];
+    U32 length = FormatInstructionBitsMnemonic(instruction, buffer);
+    return PushMnemonic(arena, buffer, length);
 }
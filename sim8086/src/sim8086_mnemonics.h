@@ -5,10 +5,18 @@
 #include "base_memory.h"
 #include "sim8086.h"
 
+// Note (Aaron): e.g. "unknown word [bx + si - 32768], word [bx + si - 32768]" with room to spare
+#define INSTRUCTION_MNEMONIC_MAX_SIZE 64
+
+// Note (Aaron): 8 bits and a space per instruction byte
+#define INSTRUCTION_BITS_MNEMONIC_MAX_SIZE (MAX_INSTRUCTION_SIZE * 9)
+
 global_function char const *GetOpMnemonic(operation_types op);
 global_function char const *GetRegisterMnemonic(register_id regMemId);
 global_function const char *GetRegisterFlagMnemonic(register_flags flag);
+global_function U32 FormatInstructionMnemonic(instruction *instruction, char *buffer);
+global_function U32 FormatInstructionBitsMnemonic(instruction *instruction, char *buffer);
 global_function Str8 GetInstructionMnemonic(instruction *instruction, memory_arena *arena);
-global_function char *GetInstructionBitsMnemonic(instruction inst, memory_arena *arena);
+global_function Str8 GetInstructionBitsMnemonic(instruction *instruction, memory_arena *arena);
 
 #endif // SIM8086_MNEMONICS_H
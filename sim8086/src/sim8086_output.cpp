@@ -0,0 +1,155 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "base_memory.h"
+#include "base_arena.h"
+#include "base_string.h"
+#include "sim8086_output.h"
+
+
+global_function B32 InitializeOutputBuffer(output_buffer *output, memory_arena *arena, U64 size, FILE *stream)
+{
+    *output = {};
+    output->Data = (U8 *)ArenaPushSize(arena, size);
+    if (!output->Data)
+    {
+        return FALSE;
+    }
+
+    output->Size = size;
+    output->Stream = stream;
+    return TRUE;
+}
+
+
+global_function void FlushOutputBuffer(output_buffer *output)
+{
+    if (output->Used)
+    {
+        fwrite(output->Data, 1, output->Used, output->Stream);
+        fflush(output->Stream);
+        output->Used = 0;
+    }
+}
+
+
+// Note (Aaron): Makes room for 'byteCount' more bytes, flushing if necessary
+inline global_function U8 *ReserveOutput(output_buffer *output, U64 byteCount)
+{
+    if (output->Used + byteCount > output->Size)
+    {
+        FlushOutputBuffer(output);
+    }
+
+    Assert(byteCount <= output->Size && "Output larger than the output buffer");
+    return output->Data + output->Used;
+}
+
+
+global_function void OutputChar(output_buffer *output, char c)
+{
+    U8 *at = ReserveOutput(output, 1);
+    *at = (U8)c;
+    output->Used++;
+}
+
+
+global_function void OutputStr8(output_buffer *output, Str8 string)
+{
+    U64 remaining = string.Length;
+    U8 *source = string.Str;
+
+    // Note (Aaron): Strings longer than the buffer are written in pieces
+    while (remaining)
+    {
+        U64 chunkSize = Min(remaining, output->Size);
+        U8 *at = ReserveOutput(output, chunkSize);
+        MemoryCopy(at, source, chunkSize);
+        output->Used += chunkSize;
+        source += chunkSize;
+        remaining -= chunkSize;
+    }
+}
+
+
+global_function void OutputCString(output_buffer *output, char const *str)
+{
+    OutputStr8(output, String8((U8 *)str, strlen(str)));
+}
+
+
+global_function void OutputU32(output_buffer *output, U32 value)
+{
+    // Note (Aaron): Digits are produced last to first
+    U8 digits[10];
+    U32 digitCount = 0;
+    do
+    {
+        digits[digitCount++] = (U8)('0' + (value % 10));
+        value /= 10;
+    } while (value);
+
+    U8 *at = ReserveOutput(output, digitCount);
+    for (U32 i = 0; i < digitCount; ++i)
+    {
+        at[i] = digits[digitCount - 1 - i];
+    }
+
+    output->Used += digitCount;
+}
+
+
+global_function void OutputS32(output_buffer *output, S32 value)
+{
+    if (value < 0)
+    {
+        OutputChar(output, '-');
+        OutputU32(output, (U32)0 - (U32)value);
+        return;
+    }
+
+    OutputU32(output, (U32)value);
+}
+
+
+// Note (Aaron): Lowercase, without a prefix, padded with zeros to 'minDigitCount' digits
+global_function void OutputHex(output_buffer *output, U32 value, U32 minDigitCount)
+{
+    U32 digitCount = 1;
+    while (digitCount < 8 && (value >> (digitCount * 4)))
+    {
+        ++digitCount;
+    }
+
+    digitCount = Max(digitCount, Min(minDigitCount, (U32)8));
+
+    U8 *at = ReserveOutput(output, digitCount);
+    for (U32 i = 0; i < digitCount; ++i)
+    {
+        at[i] = (U8)"0123456789abcdef"[(value >> ((digitCount - 1 - i) * 4)) & 0xf];
+    }
+
+    output->Used += digitCount;
+}
+
+
+// Note (Aaron): For text that isn't worth formatting by hand, e.g. summaries with floating point values
+global_function void OutputFormat(output_buffer *output, char const *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(0, 0, fmt, args);
+    va_end(args);
+
+    if (length <= 0)
+    {
+        return;
+    }
+
+    U8 *at = ReserveOutput(output, (U64)length + 1);
+    va_start(args, fmt);
+    vsnprintf((char *)at, (U64)length + 1, fmt, args);
+    va_end(args);
+
+    output->Used += (U64)length;
+}
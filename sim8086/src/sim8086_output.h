@@ -0,0 +1,33 @@
+#ifndef SIM8086_OUTPUT_H
+#define SIM8086_OUTPUT_H
+
+#include <stdio.h>
+
+#include "base_types.h"
+#include "base_arena.h"
+#include "base_string.h"
+
+
+// Note (Aaron): Text is formatted straight into one large buffer and written out with a single call
+// when it fills up or is flushed, instead of going through stdio a few characters at a time.
+struct output_buffer
+{
+    U8 *Data;
+    U64 Size;
+    U64 Used;
+    FILE *Stream;
+};
+
+
+global_function B32 InitializeOutputBuffer(output_buffer *output, memory_arena *arena, U64 size, FILE *stream);
+global_function void FlushOutputBuffer(output_buffer *output);
+
+global_function void OutputChar(output_buffer *output, char c);
+global_function void OutputCString(output_buffer *output, char const *str);
+global_function void OutputStr8(output_buffer *output, Str8 string);
+global_function void OutputU32(output_buffer *output, U32 value);
+global_function void OutputS32(output_buffer *output, S32 value);
+global_function void OutputHex(output_buffer *output, U32 value, U32 minDigitCount = 1);
+global_function void OutputFormat(output_buffer *output, char const *fmt, ...);
+
+#endif // SIM8086_OUTPUT_H
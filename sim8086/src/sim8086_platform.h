@@ -10,6 +10,7 @@
 #include "base_arena.h"
 #include "base_string.h"
 #include "sim8086.h"
+#include "sim8086_simulation.h"
 
 
 // SIM8086_SLOW:
@@ -38,20 +39,28 @@ struct application_memory
 
     union
     {
-        memory_arena_def Defs[5] = {
+        memory_arena_def Defs[9] = {
             { Megabytes(2), {0}, "Permanent"},
             { Megabytes(1), {0}, "Scratch"},
-            { Megabytes(1), {0}, "Instructions"},
-            { Megabytes(1), {0}, "InstructionStrings"},
+            { Megabytes(32), {0}, "Instructions"},
             { Megabytes(1), {0}, "Output"},
+            { Megabytes(12), {0}, "InstructionCache"},
+            { Megabytes(16), {0}, "Snapshots"},
+            { Megabytes(16), {0}, "Profile"},
+            { Megabytes(2), {0}, "Simulation"},
+            { Kilobytes(256), {0}, "Breakpoints"},
         };
         struct
         {
             memory_arena_def Permanent;
             memory_arena_def Scratch;
             memory_arena_def Instructions;
-            memory_arena_def InstructionStrings;
             memory_arena_def Output;
+            memory_arena_def InstructionCache;
+            memory_arena_def Snapshots;
+            memory_arena_def Profile;
+            memory_arena_def Simulation;
+            memory_arena_def Breakpoints;
         };
     };
 
@@ -70,18 +79,30 @@ typedef struct
     U32 LoadedProgramInstructionCount;
     U32 LoadedProgramCycleCount;
     Str8List OutputList;
+    instruction_cache InstructionCache;
+    snapshot_history SnapshotHistory;
+    execution_profile Profile;
+    breakpoint_set Breakpoints;
+    simulation_worker Simulation;
+    simulation_state SimulationState;           // Note (Aaron): Last state received from the simulation thread
+    F64 Simulation_RateTime;
+    U32 Simulation_RateInstructionCount;
+    F64 Simulation_InstructionsPerSecond;
 
     // GUI
     ImGuiIO *IO;
     ImVec4 ClearColor;
     U32 Disassembly_SelectedLine;
     U32 Memory_StartAddress;
+    U32 Watch_Address;
+    U32 Watch_Size;
+    bool Watch_Read;
+    bool Watch_Write;
     F32 OutputWindowLastScrollY;
     F32 OutputWindowLastMaxScrollY;
 
     // Diagnostics
     bool Diagnostics_ShowWindow;
-    bool Diagnostics_ExecutionStalled;
 
 } application_state;
 
@@ -93,6 +114,10 @@ typedef SET_IMGUI_CONTEXT(set_imgui_context);
 #define UPDATE_AND_RENDER(name) void name(application_state *applicationState, application_memory *memory, processor_8086 *processor)
 typedef UPDATE_AND_RENDER(update_and_render);
 
+// Note (Aaron): Called before the application code is unloaded, e.g. to stop threads running it
+#define UNLOAD_APPLICATION(name) void name(application_state *applicationState)
+typedef UNLOAD_APPLICATION(unload_application);
+
 C_LINKAGE_END
 
 #endif // SIM8086_PLATFORM_H
@@ -0,0 +1,227 @@
+#include <inttypes.h>
+
+#include "base_types.h"
+#include "base_memory.h"
+#include "base_arena.h"
+#include "base_string.h"
+#include "base_threads.h"
+#include "sim8086.h"
+#include "sim8086_channel.h"
+#include "sim8086_simulation.h"
+
+
+global_function B32 InitializeSimulationWorker(simulation_worker *worker, memory_arena *arena, U64 channelSize, U64 scratchSize)
+{
+    *worker = {};
+    if (!InitializeChannel(&worker->Channel, arena, channelSize))
+    {
+        return FALSE;
+    }
+
+    U8 *scratchMemory = (U8 *)ArenaPushSize(arena, scratchSize);
+    if (!scratchMemory)
+    {
+        return FALSE;
+    }
+
+    ArenaInitialize(&worker->Scratch, scratchSize, scratchSize, scratchMemory);
+    return TRUE;
+}
+
+
+global_function void GetSimulationState(processor_8086 *processor, simulation_state *state)
+{
+    MemoryCopy(state->Registers, processor->Registers, sizeof(state->Registers));
+    state->Flags = GetProcessorFlags(processor);
+    state->IP = processor->IP;
+    state->PrevIP = processor->PrevIP;
+    state->InstructionCount = processor->InstructionCount;
+    state->TotalClockCount = processor->TotalClockCount;
+}
+
+
+// Note (Aaron): Fills in what the UI shows of a processor from the simulation thread's last published state
+global_function void ApplySimulationState(processor_8086 *view, simulation_state *state)
+{
+    MemoryCopy(view->Registers, state->Registers, sizeof(view->Registers));
+    view->Flags = state->Flags;
+    view->LazyFlags = {};
+    view->IP = state->IP;
+    view->PrevIP = state->PrevIP;
+    view->InstructionCount = state->InstructionCount;
+    view->TotalClockCount = state->TotalClockCount;
+}
+
+
+static void PublishSimulationState(simulation_worker *worker)
+{
+    message_channel *channel = &worker->Channel;
+
+    if (worker->SkippedOutputCount && GetChannelFreeSize(channel) > SIMULATION_CHANNEL_RESERVE_SIZE)
+    {
+        Str8 notice = ArenaPushStr8f(&worker->Scratch, (char *)"... %" PRIu32 " lines of output skipped", worker->SkippedOutputCount);
+        if (WriteChannelMessage(channel, SimulationMessage_Output, notice.Str, (U32)notice.Length))
+        {
+            worker->SkippedOutputCount = 0;
+        }
+        ArenaClear(&worker->Scratch);
+    }
+
+    simulation_state state = {};
+    GetSimulationState(worker->Processor, &state);
+    WriteChannelMessage(channel, SimulationMessage_State, &state, sizeof(state));
+}
+
+
+static void SendStopReason(simulation_worker *worker)
+{
+    processor_8086 *processor = worker->Processor;
+    breakpoint_set *breakpoints = processor->Breakpoints;
+
+    Str8 message = {};
+    if (breakpoints->StopReason == StopReason_Breakpoint)
+    {
+        message = ArenaPushStr8f(&worker->Scratch, (char *)"stopped at breakpoint 0x%x", breakpoints->StopAddress);
+    }
+    else
+    {
+        B32 isWrite = (breakpoints->StopAccess == WatchAccess_Write);
+        message = ArenaPushStr8f(&worker->Scratch, (char *)"stopped by watchpoint: %s 0x%x %s [0x%x] at 0x%x",
+                                 isWrite ? "write of" : "read of",
+                                 breakpoints->StopValue,
+                                 isWrite ? "to" : "from",
+                                 breakpoints->StopAddress,
+                                 processor->PrevIP);
+    }
+
+    WriteChannelMessage(&worker->Channel, SimulationMessage_Output, message.Str, (U32)message.Length);
+    ArenaClear(&worker->Scratch);
+}
+
+
+static void SendProcessorFault(simulation_worker *worker)
+{
+    processor_8086 *processor = worker->Processor;
+    Str8 message = ArenaPushStr8f(&worker->Scratch, (char *)"stopped by fault: %s [0x%x] at 0x%x",
+                                  GetProcessorFaultName(processor->Fault),
+                                  processor->FaultAddress,
+                                  processor->PrevIP);
+
+    WriteChannelMessage(&worker->Channel, SimulationMessage_Output, message.Str, (U32)message.Length);
+    ArenaClear(&worker->Scratch);
+}
+
+
+// Note (Aaron): Executes the program in slices, publishing state between them, until it finishes, reaches a
+// breakpoint or watchpoint, or a stop is requested. Trace output is sent while the channel has room for it and
+// counted as skipped otherwise; the simulation never waits for the UI to catch up.
+static void SimulationThreadProc(void *data)
+{
+    simulation_worker *worker = (simulation_worker *)data;
+    processor_8086 *processor = worker->Processor;
+    message_channel *channel = &worker->Channel;
+
+    breakpoint_set *breakpoints = processor->Breakpoints;
+    B32 resumingFromBreakpoint = breakpoints && ResumeExecution(breakpoints, processor->IP);
+    U32 startInstructionCount = processor->InstructionCount;
+    B32 reachedBreakpoint = FALSE;
+
+    while (!reachedBreakpoint && !AtomicLoadU32(&worker->StopRequested) && !HasProcessorFinishedExecution(processor))
+    {
+        for (U32 i = 0; i < SIMULATION_SLICE_INSTRUCTION_COUNT && !HasProcessorFinishedExecution(processor); ++i)
+        {
+            if (breakpoints
+                && ShouldStopExecution(breakpoints, processor->IP, resumingFromBreakpoint && processor->InstructionCount == startInstructionCount))
+            {
+                reachedBreakpoint = TRUE;
+                break;
+            }
+
+            if (processor->SnapshotHistory)
+            {
+                UpdateSnapshots(processor->SnapshotHistory, processor);
+            }
+
+            instruction inst = DecodeNextInstruction(processor);
+
+            if (GetChannelFreeSize(channel) < SIMULATION_CHANNEL_RESERVE_SIZE + SIMULATION_MAX_MESSAGE_SIZE)
+            {
+                ExecuteInstruction(processor, &inst, 0, TraceLevel_None);
+                ++worker->SkippedOutputCount;
+                continue;
+            }
+
+            Str8 output = ExecuteInstruction(processor, &inst, &worker->Scratch);
+            if (output.Length > SIMULATION_MAX_MESSAGE_SIZE
+                || !WriteChannelMessage(channel, SimulationMessage_Output, output.Str, (U32)output.Length))
+            {
+                ++worker->SkippedOutputCount;
+            }
+            ArenaClear(&worker->Scratch);
+        }
+
+        PublishSimulationState(worker);
+    }
+
+    if (reachedBreakpoint)
+    {
+        SendStopReason(worker);
+    }
+    else if (worker->Processor->Fault != Fault_None)
+    {
+        SendProcessorFault(worker);
+    }
+
+    AtomicStoreU32(&worker->HasStopped, TRUE);
+}
+
+
+global_function B32 StartSimulation(simulation_worker *worker, processor_8086 *processor)
+{
+    if (worker->IsRunning)
+    {
+        return TRUE;
+    }
+
+    worker->Processor = processor;
+    worker->StopRequested = FALSE;
+    worker->HasStopped = FALSE;
+    worker->SkippedOutputCount = 0;
+
+    if (!ThreadCreate(&worker->Thread, SimulationThreadProc, worker))
+    {
+        return FALSE;
+    }
+
+    worker->IsRunning = TRUE;
+    return TRUE;
+}
+
+
+// Note (Aaron): Messages sent before the thread stopped are all in the channel once this returns TRUE
+global_function B32 HasSimulationStopped(simulation_worker *worker)
+{
+    B32 result = worker->IsRunning && AtomicLoadU32(&worker->HasStopped);
+    return result;
+}
+
+
+global_function void JoinSimulation(simulation_worker *worker)
+{
+    if (worker->IsRunning)
+    {
+        ThreadJoin(&worker->Thread);
+        worker->IsRunning = FALSE;
+    }
+}
+
+
+// Note (Aaron): Returns once the thread has finished its current slice
+global_function void StopSimulation(simulation_worker *worker)
+{
+    if (worker->IsRunning)
+    {
+        AtomicStoreU32(&worker->StopRequested, TRUE);
+        JoinSimulation(worker);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef SIM8086_SIMULATION_H
+#define SIM8086_SIMULATION_H
+
+#include "base_types.h"
+#include "base_arena.h"
+#include "base_threads.h"
+#include "sim8086.h"
+#include "sim8086_channel.h"
+
+// Note (Aaron): Instructions executed between publishing state and checking for a pause
+#define SIMULATION_SLICE_INSTRUCTION_COUNT 4096
+
+// Note (Aaron): Trace output stops being sent while the channel has less room than this, so that state
+// updates always get through
+#define SIMULATION_CHANNEL_RESERVE_SIZE Kilobytes(4)
+
+#define SIMULATION_MAX_MESSAGE_SIZE Kilobytes(1)
+
+
+enum simulation_message_type : U32
+{
+    SimulationMessage_Output,       // A line of trace output
+    SimulationMessage_State,        // A simulation_state
+};
+
+
+// Note (Aaron): The part of the processor the UI shows while the simulation thread owns it
+struct simulation_state
+{
+    U16 Registers[8];
+    U8 Flags;
+    U32 IP;
+    U32 PrevIP;
+    U32 InstructionCount;
+    U32 TotalClockCount;
+};
+
+
+// Note (Aaron): Runs a processor on its own thread until it finishes or is asked to stop. The thread owns the
+// processor (and its instruction cache, snapshots, profile and breakpoints) from StartSimulation() until
+// JoinSimulation(). Meanwhile it sends trace output and its state through Channel.
+struct simulation_worker
+{
+    os_thread Thread;
+    processor_8086 *Processor;
+    memory_arena Scratch;
+    message_channel Channel;
+
+    B32 IsRunning;                  // Note (Aaron): The thread has been started and not yet joined
+    U32 volatile StopRequested;
+    U32 volatile HasStopped;
+
+    // Note (Aaron): Owned by the simulation thread while it runs
+    U32 SkippedOutputCount;
+};
+
+
+global_function B32 InitializeSimulationWorker(simulation_worker *worker, memory_arena *arena, U64 channelSize, U64 scratchSize);
+global_function B32 StartSimulation(simulation_worker *worker, processor_8086 *processor);
+global_function B32 HasSimulationStopped(simulation_worker *worker);
+global_function void JoinSimulation(simulation_worker *worker);
+global_function void StopSimulation(simulation_worker *worker);
+global_function void GetSimulationState(processor_8086 *processor, simulation_state *state);
+global_function void ApplySimulationState(processor_8086 *view, simulation_state *state);
+
+#endif // SIM8086_SIMULATION_H
@@ -0,0 +1,1350 @@
+/* Note (Aaron):
+    Direct-threaded basic block engine. Decoded instructions are compiled into blocks of ops with
+    their operands already resolved to register indices, masks and effective address parts. Blocks
+    end at control transfers, are executed by jumping straight from one op's handler to the next,
+    and are chained to the blocks that follow them. Blocks that loop back to their own start a number
+    of times that can be worked out on entry skip straight through all but their last iteration.
+
+    The engine must leave the processor in exactly the same state as ExecuteInstruction() would,
+    including the lazily evaluated flags. Instructions it doesn't understand are handed to
+    ExecuteInstruction().
+*/
+
+#include "base_memory.h"
+#include "base_arena.h"
+#include "sim8086.h"
+#include "sim8086_threaded.h"
+
+
+global_function B32 InitializeThreadedEngine(threaded_engine *engine, memory_arena *arena, U32 memorySize)
+{
+    *engine = {};
+    ArenaClear(arena);
+
+    engine->BlockLookup = (U32 *)ArenaPushSizeZero(arena, sizeof(U32) * memorySize);
+    if (!engine->BlockLookup)
+    {
+        return FALSE;
+    }
+
+    engine->LookupSize = memorySize;
+
+    // Note (Aaron): The remainder of the arena is split between blocks and their ops, assuming
+    // blocks average 8 ops.
+    U64 remainingSize = arena->Size - arena->Used;
+    engine->BlockCapacity = (U32)(remainingSize / (sizeof(threaded_block) + (8 * sizeof(threaded_op))));
+    engine->OpCapacity = engine->BlockCapacity * 8;
+
+    engine->Blocks = ArenaPushArray(arena, threaded_block, engine->BlockCapacity);
+    engine->Ops = ArenaPushArray(arena, threaded_op, engine->OpCapacity);
+    if (!engine->Blocks || !engine->Ops || engine->OpCapacity < (THREADED_MAX_BLOCK_OPS + 1))
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+global_function void FlushThreadedEngine(threaded_engine *engine)
+{
+    for (U32 blockIndex = 0; blockIndex < engine->BlockCount; ++blockIndex)
+    {
+        engine->BlockLookup[engine->Blocks[blockIndex].StartAddress] = 0;
+    }
+
+    engine->BlockCount = 0;
+    engine->OpCount = 0;
+    engine->Generation++;
+}
+
+
+global_function void TranslateMemoryOperand(instruction_operand *operand, threaded_memory_operand *result)
+{
+    *result = {};
+    result->IsWide = (operand->Memory.Flags & Memory_IsWide) ? TRUE : FALSE;
+    result->BaseIndex1 = THREADED_NO_REGISTER;
+
+    if (operand->Memory.Flags & Memory_HasDirectAddress)
+    {
+        result->IsDirect = TRUE;
+        result->DirectAddress = operand->Memory.DirectAddress;
+        return;
+    }
+
+    if (operand->Memory.Flags & Memory_HasDisplacement)
+    {
+        result->Displacement = operand->Memory.Displacement;
+    }
+
+    switch (operand->Memory.Register)
+    {
+        case Reg_bx_si:
+        {
+            result->BaseIndex0 = RegisterLookup[Reg_bx].RegisterIndex;
+            result->BaseIndex1 = RegisterLookup[Reg_si].RegisterIndex;
+            break;
+        }
+        case Reg_bx_di:
+        {
+            result->BaseIndex0 = RegisterLookup[Reg_bx].RegisterIndex;
+            result->BaseIndex1 = RegisterLookup[Reg_di].RegisterIndex;
+            break;
+        }
+        case Reg_bp_si:
+        {
+            result->BaseIndex0 = RegisterLookup[Reg_bp].RegisterIndex;
+            result->BaseIndex1 = RegisterLookup[Reg_si].RegisterIndex;
+            break;
+        }
+        case Reg_bp_di:
+        {
+            result->BaseIndex0 = RegisterLookup[Reg_bp].RegisterIndex;
+            result->BaseIndex1 = RegisterLookup[Reg_di].RegisterIndex;
+            break;
+        }
+        default:
+        {
+            result->BaseIndex0 = RegisterLookup[operand->Memory.Register].RegisterIndex;
+            break;
+        }
+    }
+}
+
+
+// Note (Aaron): Returns FALSE for instructions the engine can't run, which are then interpreted
+global_function B32 TranslateToThreadedOp(instruction *instruction, threaded_op *op)
+{
+    *op = {};
+    op->Address = instruction->Address;
+    op->NextAddress = instruction->Address + instruction->Bits.ByteCount;
+    op->ClockCount = instruction->ClockCount + instruction->EAClockCount;
+
+    switch (instruction->OpType)
+    {
+        case Op_mov:
+        case Op_add:
+        case Op_sub:
+        case Op_cmp:
+        {
+            instruction_operand *dest = &instruction->Operands[0];
+            instruction_operand *source = &instruction->Operands[1];
+
+            U32 variant = 0;
+            if (dest->Type == Operand_Register)
+            {
+                if (source->Type == Operand_Register) { variant = 0; }
+                else if (source->Type == Operand_Immediate) { variant = 1; }
+                else if (source->Type == Operand_Memory) { variant = 2; }
+                else { return FALSE; }
+            }
+            else if (dest->Type == Operand_Memory)
+            {
+                if (source->Type == Operand_Register) { variant = 3; }
+                else if (source->Type == Operand_Immediate) { variant = 4; }
+                else { return FALSE; }
+            }
+            else
+            {
+                return FALSE;
+            }
+
+            U32 group = (instruction->OpType == Op_mov) ? ThreadedOp_MovRegReg
+                      : (instruction->OpType == Op_add) ? ThreadedOp_AddRegReg
+                      : (instruction->OpType == Op_sub) ? ThreadedOp_SubRegReg
+                      : ThreadedOp_CmpRegReg;
+            op->Type = (threaded_op_type)(group + variant);
+
+            op->IsWide = IsOperandWide(dest) ? TRUE : FALSE;
+            op->WidthMask = op->IsWide ? 0xffff : 0xff;
+
+            if (dest->Type == Operand_Register)
+            {
+                op->DestIndex = RegisterLookup[dest->Register].RegisterIndex;
+                op->DestMask = RegisterLookup[dest->Register].Mask;
+                op->DestShift = GetRegisterShift(RegisterLookup[dest->Register]);
+            }
+            else
+            {
+                TranslateMemoryOperand(dest, &op->Memory);
+            }
+
+            if (source->Type == Operand_Register)
+            {
+                op->SourceIndex = RegisterLookup[source->Register].RegisterIndex;
+                op->SourceMask = RegisterLookup[source->Register].Mask;
+                op->SourceShift = GetRegisterShift(RegisterLookup[source->Register]);
+            }
+            else if (source->Type == Operand_Immediate)
+            {
+                op->Immediate = source->Immediate.Value & op->WidthMask;
+            }
+            else
+            {
+                TranslateMemoryOperand(source, &op->Memory);
+            }
+
+            return TRUE;
+        }
+
+        case Op_jne:
+        {
+            op->Type = ThreadedOp_Jne;
+            op->JumpOffset = (S8)(instruction->Operands[0].Immediate.Value & 0xff);
+            return TRUE;
+        }
+
+        case Op_loop:
+        {
+            op->Type = ThreadedOp_Loop;
+            op->DestIndex = RegisterLookup[Reg_cx].RegisterIndex;
+            op->DestMask = RegisterLookup[Reg_cx].Mask;
+            op->JumpOffset = (S8)(instruction->Operands[0].Immediate.Value & 0xff);
+            return TRUE;
+        }
+
+        case Op_ret:
+        {
+            op->Type = ThreadedOp_Ret;
+            return TRUE;
+        }
+
+        case Op_je:
+        case Op_jl:
+        case Op_jle:
+        case Op_jb:
+        case Op_jbe:
+        case Op_jp:
+        case Op_jo:
+        case Op_js:
+        case Op_jnl:
+        case Op_jg:
+        case Op_jnb:
+        case Op_ja:
+        case Op_jnp:
+        case Op_jno:
+        case Op_jns:
+        case Op_loopz:
+        case Op_loopnz:
+        case Op_jcxz:
+        {
+            op->Type = ThreadedOp_Jump;
+            op->JumpType = (U8)instruction->OpType;
+            op->JumpOffset = (S8)(instruction->Operands[0].Immediate.Value & 0xff);
+            return TRUE;
+        }
+
+        // Note (Aaron): String instructions repeat a varying number of times and touch memory through SI and DI,
+        // and the direction flag they read is only changed by cld / std. All of them are interpreted.
+        case Op_movs:
+        case Op_cmps:
+        case Op_scas:
+        case Op_lods:
+        case Op_stos:
+        case Op_cld:
+        case Op_std:
+        {
+            return FALSE;
+        }
+
+        // Note (Aaron): Unknown instructions are interpreted too, as one that runs past the end of the program faults
+        case Op_unknown:
+        {
+            return FALSE;
+        }
+
+        default:
+        {
+            op->Type = ThreadedOp_Nop;
+            return TRUE;
+        }
+    }
+}
+
+
+// Note (Aaron): Arithmetic ops come in groups of Reg/Reg, Reg/Imm, Reg/Mem, Mem/Reg, Mem/Imm
+inline global_function B32 IsThreadedArithmeticOp(threaded_op *op)
+{
+    return op->Type <= ThreadedOp_CmpMemImm;
+}
+
+
+inline global_function B32 DoesThreadedOpAccessMemory(threaded_op *op)
+{
+    return IsThreadedArithmeticOp(op) && ((op->Type - ThreadedOp_MovRegReg) % 5) >= 2;
+}
+
+
+inline global_function B32 DoesThreadedOpWriteRegister(threaded_op *op)
+{
+    return op->Type < ThreadedOp_CmpRegReg && ((op->Type - ThreadedOp_MovRegReg) % 5) <= 2;
+}
+
+
+inline global_function B32 DoesThreadedOpWriteMemory(threaded_op *op)
+{
+    return op->Type < ThreadedOp_CmpRegReg && ((op->Type - ThreadedOp_MovRegReg) % 5) >= 3;
+}
+
+
+// Note (Aaron): Registers an arithmetic op reads, including through their 8-bit halves and as memory bases.
+// A mov into a register doesn't read it.
+inline global_function U8 GetThreadedOpReadMask(threaded_op *op)
+{
+    U8 readMask = 0;
+    U32 operandKind = (op->Type - ThreadedOp_MovRegReg) % 5;
+
+    if (operandKind <= 2 && op->Type >= ThreadedOp_AddRegReg)
+    {
+        readMask |= (U8)(1 << op->DestIndex);
+    }
+
+    if (operandKind == 0 || operandKind == 3)
+    {
+        readMask |= (U8)(1 << op->SourceIndex);
+    }
+
+    if (DoesThreadedOpAccessMemory(op) && !op->Memory.IsDirect)
+    {
+        readMask |= (U8)(1 << op->Memory.BaseIndex0);
+        if (op->Memory.BaseIndex1 != THREADED_NO_REGISTER)
+        {
+            readMask |= (U8)(1 << op->Memory.BaseIndex1);
+        }
+    }
+
+    return readMask;
+}
+
+
+// Note (Aaron): Wide add / sub of an immediate moves a register by a constant stride
+inline global_function B32 IsThreadedStrideOp(threaded_op *op)
+{
+    return op->IsWide && (op->Type == ThreadedOp_AddRegImm || op->Type == ThreadedOp_SubRegImm);
+}
+
+
+inline global_function U16 GetThreadedStride(threaded_op *op)
+{
+    return (op->Type == ThreadedOp_AddRegImm) ? op->Immediate : (U16)(0 - op->Immediate);
+}
+
+
+// Note (Aaron): Fills in block->Loop, see threaded_loop
+global_function void AnalyzeThreadedLoop(threaded_block *block)
+{
+    threaded_loop *loop = &block->Loop;
+    *loop = {};
+
+    threaded_op *branch = &block->Ops[block->OpCount - 1];
+    if ((branch->Type != ThreadedOp_Jne && branch->Type != ThreadedOp_Loop)
+        || (U32)(branch->NextAddress + branch->JumpOffset) != block->StartAddress)
+    {
+        return;
+    }
+
+    U8 writtenMask = 0;
+    U8 readMask = 0;
+    U32 flagOpIndex = 0;
+    B32 setsFlags = FALSE;
+    B32 isClosedForm = TRUE;
+    U32 clockCount = branch->ClockCount;
+
+    U32 bodyOpCount = block->OpCount - 1;
+    for (U32 opIndex = 0; opIndex < bodyOpCount; ++opIndex)
+    {
+        threaded_op *op = &block->Ops[opIndex];
+        if (!IsThreadedArithmeticOp(op) && op->Type != ThreadedOp_Nop)
+        {
+            return;
+        }
+
+        clockCount += op->ClockCount;
+
+        if (IsThreadedArithmeticOp(op))
+        {
+            readMask |= GetThreadedOpReadMask(op);
+        }
+
+        if (IsThreadedArithmeticOp(op) && op->Type >= ThreadedOp_AddRegReg)
+        {
+            flagOpIndex = opIndex;
+            setsFlags = TRUE;
+        }
+
+        if (DoesThreadedOpWriteRegister(op))
+        {
+            U8 registerBit = (U8)(1 << op->DestIndex);
+            writtenMask |= registerBit;
+
+            if (IsThreadedStrideOp(op))
+            {
+                loop->Strides[op->DestIndex] += GetThreadedStride(op);
+            }
+            else
+            {
+                loop->VaryingMask |= registerBit;
+                isClosedForm = FALSE;
+            }
+        }
+
+        if (DoesThreadedOpWriteMemory(op))
+        {
+            loop->WritesMemory = TRUE;
+            isClosedForm = FALSE;
+        }
+    }
+
+    // Note (Aaron): Memory operands must move by a constant stride too, so that the addresses a number of
+    // iterations will access can be checked up front
+    for (U32 opIndex = 0; opIndex < bodyOpCount; ++opIndex)
+    {
+        threaded_op *op = &block->Ops[opIndex];
+        if (DoesThreadedOpAccessMemory(op) && !op->Memory.IsDirect)
+        {
+            U8 baseMask = (U8)(1 << op->Memory.BaseIndex0);
+            if (op->Memory.BaseIndex1 != THREADED_NO_REGISTER)
+            {
+                baseMask |= (U8)(1 << op->Memory.BaseIndex1);
+            }
+
+            if (baseMask & loop->VaryingMask)
+            {
+                return;
+            }
+        }
+    }
+
+    if (branch->Type == ThreadedOp_Loop)
+    {
+        // Note (Aaron): cx is only brought up to date once the skipped iterations have run, so the body can't
+        // see it change either
+        if ((writtenMask | readMask) & (1 << branch->DestIndex))
+        {
+            return;
+        }
+
+        loop->CounterIndex = branch->DestIndex;
+    }
+    else
+    {
+        if (!setsFlags)
+        {
+            return;
+        }
+
+        // Note (Aaron): The jne falls through once the register compared reaches its target, or the register
+        // added to or subtracted from reaches 0
+        threaded_op *flagOp = &block->Ops[flagOpIndex];
+        if (!flagOp->IsWide || (loop->VaryingMask & (1 << flagOp->DestIndex)))
+        {
+            return;
+        }
+
+        loop->TargetIndex = THREADED_NO_REGISTER;
+        if (flagOp->Type == ThreadedOp_CmpRegReg)
+        {
+            if (writtenMask & (1 << flagOp->SourceIndex))
+            {
+                return;
+            }
+            loop->TargetIndex = flagOp->SourceIndex;
+        }
+        else if (flagOp->Type == ThreadedOp_CmpRegImm)
+        {
+            loop->TargetValue = flagOp->Immediate;
+        }
+        else if (!IsThreadedStrideOp(flagOp))
+        {
+            return;
+        }
+
+        loop->CounterIndex = flagOp->DestIndex;
+        for (U32 opIndex = 0; opIndex <= flagOpIndex; ++opIndex)
+        {
+            threaded_op *op = &block->Ops[opIndex];
+            if (IsThreadedStrideOp(op) && op->DestIndex == loop->CounterIndex)
+            {
+                loop->CounterOffset += GetThreadedStride(op);
+            }
+        }
+    }
+
+    loop->IsCounted = TRUE;
+    loop->IsClosedForm = isClosedForm;
+    loop->ClockCount = clockCount;
+}
+
+
+global_function threaded_block *CompileThreadedBlock(threaded_engine *engine, processor_8086 *processor, U32 address)
+{
+    if (engine->BlockCount == engine->BlockCapacity
+        || (engine->OpCount + THREADED_MAX_BLOCK_OPS + 1) > engine->OpCapacity)
+    {
+        FlushThreadedEngine(engine);
+    }
+
+    threaded_block *block = &engine->Blocks[engine->BlockCount++];
+    *block = {};
+    block->StartAddress = address;
+    block->Ops = &engine->Ops[engine->OpCount];
+
+    // Note (Aaron): Breakpoints are only checked between blocks, so blocks end before them. Watchpoints stop
+    // execution after the instruction that hit them, so blocks end after each memory access while there are any.
+    breakpoint_set *breakpoints = processor->Breakpoints;
+    B32 endAfterMemoryAccess = breakpoints && breakpoints->WatchpointCount;
+    B32 accessedMemory = FALSE;
+
+    U32 ip = address;
+    U32 prevAddress = processor->PrevIP;
+    for (;;)
+    {
+        threaded_op *op = &block->Ops[block->OpCount++];
+
+        if (block->OpCount > THREADED_MAX_BLOCK_OPS
+            || ip >= processor->ProgramSize
+            || accessedMemory
+            || (breakpoints && ip != address && HasBreakpoint(breakpoints, ip)))
+        {
+            *op = {};
+            op->Type = ThreadedOp_Exit;
+            op->Address = prevAddress;
+            op->NextAddress = ip;
+            break;
+        }
+
+        instruction instruction = FetchInstruction(processor, ip);
+        if (!TranslateToThreadedOp(&instruction, op))
+        {
+            *op = {};
+            op->Type = ThreadedOp_Interpret;
+            op->Address = ip;
+            break;
+        }
+
+        if (op->Type == ThreadedOp_Jne
+            || op->Type == ThreadedOp_Loop
+            || op->Type == ThreadedOp_Ret
+            || op->Type == ThreadedOp_Jump)
+        {
+            break;
+        }
+
+        accessedMemory = endAfterMemoryAccess
+            && (instruction.Operands[0].Type == Operand_Memory || instruction.Operands[1].Type == Operand_Memory);
+
+        prevAddress = ip;
+        ip = op->NextAddress;
+    }
+
+    AnalyzeThreadedLoop(block);
+
+    engine->OpCount += block->OpCount;
+    engine->BlockLookup[address] = engine->BlockCount;
+
+    return block;
+}
+
+
+inline global_function U32 ThreadedEffectiveAddress(U16 *registers, threaded_memory_operand *memory)
+{
+    if (memory->IsDirect)
+    {
+        return memory->DirectAddress;
+    }
+
+    // Note (Aaron): Base registers are summed at 16 bits before the displacement is applied,
+    // matching GetRegisterValue() and CalculateEffectiveAddress()
+    U16 base = registers[memory->BaseIndex0];
+    if (memory->BaseIndex1 != THREADED_NO_REGISTER)
+    {
+        base += registers[memory->BaseIndex1];
+    }
+
+    U32 effectiveAddress = base;
+    effectiveAddress += memory->Displacement;
+
+    return effectiveAddress;
+}
+
+
+// Note (Aaron): Mirror GetRegisterValue() / SetRegisterValue() for 8 and 16-bit registers
+inline global_function U16 ReadThreadedRegister(U16 *registers, U8 index, U16 mask, U8 shift)
+{
+    return (U16)((registers[index] & mask) >> shift);
+}
+
+
+inline global_function void WriteThreadedRegister(U16 *registers, U8 index, U16 mask, U8 shift, U16 value)
+{
+    registers[index] = (U16)((registers[index] & ~mask) | ((value << shift) & mask));
+}
+
+
+#if THREADED_COMPUTED_GOTO
+#define THREADED_HANDLER(name)  Handler_##name:
+#define THREADED_NEXT()         ++op; goto *op->Handler
+#else
+#define THREADED_HANDLER(name)  case ThreadedOp_##name:
+#define THREADED_NEXT()         ++op; continue
+#endif
+
+#define THREADED_READ_DEST()        ReadThreadedRegister(registers, op->DestIndex, op->DestMask, op->DestShift)
+#define THREADED_READ_SOURCE()      ReadThreadedRegister(registers, op->SourceIndex, op->SourceMask, op->SourceShift)
+#define THREADED_WRITE_DEST(value)  WriteThreadedRegister(registers, op->DestIndex, op->DestMask, op->DestShift, (value))
+
+// Note (Aaron): Common bookkeeping that DecodeNextInstruction() / ExecuteInstruction() do per instruction
+#define THREADED_RETIRE()       processor->InstructionCount++; processor->TotalClockCount += op->ClockCount
+
+// Note (Aaron): A memory access outside of memory raised a fault, execution stops after its instruction
+#define THREADED_CHECK_FAULT() \
+    if (processor->Fault != Fault_None) \
+    { \
+        processor->PrevIP = op->Address; \
+        processor->IP = op->NextAddress; \
+        goto BlockEnd; \
+    }
+
+// Note (Aaron): Memory writes may have overwritten instructions in this (or any other) block
+#define THREADED_CHECK_INVALIDATION() \
+    if (cache->InvalidationCount != engine->InvalidationCount) \
+    { \
+        processor->PrevIP = op->Address; \
+        processor->IP = op->NextAddress; \
+        goto BlockEnd; \
+    }
+
+
+// Note (Aaron): How many times a counted loop goes around from the current state, 0 if it never stops
+global_function U32 GetThreadedLoopIterationCount(threaded_block *block, U16 *registers)
+{
+    threaded_loop *loop = &block->Loop;
+    U16 counter = registers[loop->CounterIndex];
+
+    if (block->Ops[block->OpCount - 1].Type == ThreadedOp_Loop)
+    {
+        // Note (Aaron): cx is decremented before it is tested, so 0 goes around 65536 times
+        return counter ? counter : 0x10000;
+    }
+
+    // Note (Aaron): On iteration k (from 0) the jne sees counter + CounterOffset + (k * stride), so solve
+    // k * stride = distance (mod 2^16) for the smallest k. Only the odd part of the stride can be inverted,
+    // and the distance must be a multiple of the rest for there to be a solution at all.
+    U16 target = (loop->TargetIndex != THREADED_NO_REGISTER) ? registers[loop->TargetIndex] : loop->TargetValue;
+    U16 distance = (U16)(target - counter - loop->CounterOffset);
+    U16 stride = loop->Strides[loop->CounterIndex];
+    if (!stride)
+    {
+        return distance ? 0 : 1;
+    }
+
+    U32 shift = 0;
+    while (!((stride >> shift) & 1))
+    {
+        ++shift;
+    }
+
+    if (distance & ((1 << shift) - 1))
+    {
+        return 0;
+    }
+
+    // Note (Aaron): Newton's iteration for the inverse of an odd number, each step doubles the number of correct
+    // low bits starting from the 3 the number itself gets right
+    U32 odd = stride >> shift;
+    U32 inverse = odd;
+    for (U32 step = 0; step < 3; ++step)
+    {
+        inverse *= 2 - (odd * inverse);
+    }
+
+    U32 iteration = (((U32)distance >> shift) * inverse) & (0xffff >> shift);
+    return iteration + 1;
+}
+
+
+// Note (Aaron): Checks that every memory access of the block's next iterationCount iterations stays inside memory
+// and clear of the block's own instructions, and returns the range they write
+global_function B32 CheckThreadedLoopMemory(threaded_block *block, processor_8086 *processor, U32 iterationCount, U32 *writeStart, U32 *writeEnd)
+{
+    threaded_loop *loop = &block->Loop;
+    U16 *registers = processor->Registers;
+    U32 blockEnd = block->Ops[block->OpCount - 1].NextAddress;
+
+    // Note (Aaron): What the ops before the current one add to each register in an iteration
+    U16 offsets[ArrayCount(loop->Strides)] = {};
+
+    S64 lowestWrite = processor->MemorySize;
+    S64 highestWrite = 0;
+
+    for (U32 opIndex = 0; opIndex + 1 < block->OpCount; ++opIndex)
+    {
+        threaded_op *op = &block->Ops[opIndex];
+        if (DoesThreadedOpAccessMemory(op))
+        {
+            threaded_memory_operand *memory = &op->Memory;
+            S64 low = memory->DirectAddress;
+            S64 high = memory->DirectAddress;
+
+            if (!memory->IsDirect)
+            {
+                U16 base = (U16)(registers[memory->BaseIndex0] + offsets[memory->BaseIndex0]);
+                U16 stride = loop->Strides[memory->BaseIndex0];
+                if (memory->BaseIndex1 != THREADED_NO_REGISTER)
+                {
+                    base += (U16)(registers[memory->BaseIndex1] + offsets[memory->BaseIndex1]);
+                    stride += loop->Strides[memory->BaseIndex1];
+                }
+
+                // Note (Aaron): The bases are summed at 16 bits, so they mustn't wrap around over the iterations
+                S64 lastBase = (S64)base + ((S64)(S16)stride * (iterationCount - 1));
+                if (lastBase < 0 || lastBase > 0xffff)
+                {
+                    return FALSE;
+                }
+
+                low = ((lastBase < base) ? lastBase : base) + memory->Displacement;
+                high = ((lastBase > base) ? lastBase : base) + memory->Displacement;
+            }
+
+            high += memory->IsWide ? 2 : 1;
+            if (low < 0 || high > processor->MemorySize)
+            {
+                return FALSE;
+            }
+
+            if (DoesThreadedOpWriteMemory(op))
+            {
+                if (low < blockEnd && high > block->StartAddress)
+                {
+                    return FALSE;
+                }
+
+                lowestWrite = (low < lowestWrite) ? low : lowestWrite;
+                highestWrite = (high > highestWrite) ? high : highestWrite;
+            }
+        }
+
+        if (IsThreadedStrideOp(op))
+        {
+            offsets[op->DestIndex] += GetThreadedStride(op);
+        }
+    }
+
+    *writeStart = (U32)lowestWrite;
+    *writeEnd = (U32)((highestWrite > lowestWrite) ? highestWrite : lowestWrite);
+    return TRUE;
+}
+
+
+inline global_function U16 ReadThreadedLoopMemory(U8 *memory, U32 address, B32 wide)
+{
+    return wide ? *(U16 *)(memory + address) : (U16)memory[address];
+}
+
+
+inline global_function void WriteThreadedLoopMemory(U8 *memory, U32 address, U16 value, B32 wide)
+{
+    if (wide)
+    {
+        *(U16 *)(memory + address) = value;
+    }
+    else
+    {
+        memory[address] = (U8)value;
+    }
+}
+
+
+// Note (Aaron): Runs the body of a counted loop iterationCount times as one tight kernel. Flags aren't set, as
+// nothing inside the loop but its branch reads them and the branch outcome is already known, and memory is
+// accessed directly as CheckThreadedLoopMemory() has already checked every address.
+global_function void RunThreadedLoop(threaded_block *block, processor_8086 *processor, U32 iterationCount)
+{
+    threaded_loop *loop = &block->Loop;
+    U16 *registers = processor->Registers;
+
+    if (loop->IsClosedForm)
+    {
+        for (U32 registerIndex = 0; registerIndex < ArrayCount(loop->Strides); ++registerIndex)
+        {
+            registers[registerIndex] += (U16)(loop->Strides[registerIndex] * iterationCount);
+        }
+        return;
+    }
+
+    U8 *memory = processor->Memory;
+    threaded_op *bodyEnd = block->Ops + (block->OpCount - 1);
+
+    for (U32 iteration = 0; iteration < iterationCount; ++iteration)
+    {
+        for (threaded_op *op = block->Ops; op < bodyEnd; ++op)
+        {
+            switch (op->Type)
+            {
+                case ThreadedOp_MovRegReg: { THREADED_WRITE_DEST(THREADED_READ_SOURCE()); break; }
+                case ThreadedOp_MovRegImm: { THREADED_WRITE_DEST(op->Immediate); break; }
+                case ThreadedOp_MovRegMem:
+                {
+                    U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+                    THREADED_WRITE_DEST(ReadThreadedLoopMemory(memory, effectiveAddress, op->Memory.IsWide));
+                    break;
+                }
+                case ThreadedOp_MovMemReg:
+                {
+                    U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+                    WriteThreadedLoopMemory(memory, effectiveAddress, THREADED_READ_SOURCE(), op->Memory.IsWide);
+                    break;
+                }
+                case ThreadedOp_MovMemImm:
+                {
+                    U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+                    WriteThreadedLoopMemory(memory, effectiveAddress, op->Immediate, op->Memory.IsWide);
+                    break;
+                }
+
+                case ThreadedOp_AddRegReg: { THREADED_WRITE_DEST(THREADED_READ_DEST() + THREADED_READ_SOURCE()); break; }
+                case ThreadedOp_AddRegImm: { THREADED_WRITE_DEST(THREADED_READ_DEST() + op->Immediate); break; }
+                case ThreadedOp_AddRegMem:
+                {
+                    U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+                    THREADED_WRITE_DEST(THREADED_READ_DEST() + ReadThreadedLoopMemory(memory, effectiveAddress, op->Memory.IsWide));
+                    break;
+                }
+                case ThreadedOp_AddMemReg:
+                {
+                    U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+                    U16 value = ReadThreadedLoopMemory(memory, effectiveAddress, op->Memory.IsWide);
+                    WriteThreadedLoopMemory(memory, effectiveAddress, value + THREADED_READ_SOURCE(), op->Memory.IsWide);
+                    break;
+                }
+                case ThreadedOp_AddMemImm:
+                {
+                    U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+                    U16 value = ReadThreadedLoopMemory(memory, effectiveAddress, op->Memory.IsWide);
+                    WriteThreadedLoopMemory(memory, effectiveAddress, value + op->Immediate, op->Memory.IsWide);
+                    break;
+                }
+
+                case ThreadedOp_SubRegReg: { THREADED_WRITE_DEST(THREADED_READ_DEST() - THREADED_READ_SOURCE()); break; }
+                case ThreadedOp_SubRegImm: { THREADED_WRITE_DEST(THREADED_READ_DEST() - op->Immediate); break; }
+                case ThreadedOp_SubRegMem:
+                {
+                    U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+                    THREADED_WRITE_DEST(THREADED_READ_DEST() - ReadThreadedLoopMemory(memory, effectiveAddress, op->Memory.IsWide));
+                    break;
+                }
+                case ThreadedOp_SubMemReg:
+                {
+                    U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+                    U16 value = ReadThreadedLoopMemory(memory, effectiveAddress, op->Memory.IsWide);
+                    WriteThreadedLoopMemory(memory, effectiveAddress, value - THREADED_READ_SOURCE(), op->Memory.IsWide);
+                    break;
+                }
+                case ThreadedOp_SubMemImm:
+                {
+                    U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+                    U16 value = ReadThreadedLoopMemory(memory, effectiveAddress, op->Memory.IsWide);
+                    WriteThreadedLoopMemory(memory, effectiveAddress, value - op->Immediate, op->Memory.IsWide);
+                    break;
+                }
+
+                // Note (Aaron): cmp and nop only set flags and advance the instruction pointer
+                default:
+                {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+
+// Note (Aaron): Called on entering a counted loop. Runs all but its last iteration through RunThreadedLoop(),
+// charging each of them the instructions and clocks of the whole block, and leaves the last one to the block's
+// handlers so that the flags, PrevIP and IP come out exactly as they would have. Loops that a breakpoint,
+// watchpoint, snapshot or trace needs to see go around one iteration at a time as before, as do loops whose
+// memory accesses couldn't be checked up front. Stops short of instructionBudget instructions (0 means no
+// limit) exactly where going around one block at a time would have.
+global_function void FastForwardThreadedLoop(threaded_block *block, processor_8086 *processor, U64 instructionBudget)
+{
+    breakpoint_set *breakpoints = processor->Breakpoints;
+    if (processor->SnapshotHistory
+        || processor->Trace
+        || (breakpoints && (breakpoints->WatchpointCount || HasBreakpoint(breakpoints, block->StartAddress))))
+    {
+        return;
+    }
+
+    U32 iterationCount = GetThreadedLoopIterationCount(block, processor->Registers);
+    if (iterationCount < 2)
+    {
+        return;
+    }
+
+    // Note (Aaron): The limit is checked between blocks, so execution stops after the iteration that reaches it
+    // either way
+    U32 skipCount = iterationCount - 1;
+    U64 iterationBudget = (instructionBudget + block->OpCount - 1) / block->OpCount;
+    if (instructionBudget && skipCount >= iterationBudget)
+    {
+        skipCount = (U32)(iterationBudget - 1);
+    }
+
+    U32 writeStart = 0;
+    U32 writeEnd = 0;
+    if (!skipCount || !CheckThreadedLoopMemory(block, processor, skipCount, &writeStart, &writeEnd))
+    {
+        return;
+    }
+
+    RunThreadedLoop(block, processor, skipCount);
+
+    threaded_loop *loop = &block->Loop;
+    if (block->Ops[block->OpCount - 1].Type == ThreadedOp_Loop)
+    {
+        processor->Registers[loop->CounterIndex] -= (U16)skipCount;
+    }
+
+    if (loop->WritesMemory)
+    {
+        InvalidateInstructionCache(processor->InstructionCache, writeStart, writeEnd - writeStart);
+        if (processor->DirtyPages)
+        {
+            MarkDirtyPages(processor->DirtyPages, writeStart, writeEnd - writeStart, processor->MemorySize);
+        }
+    }
+
+    processor->InstructionCount += skipCount * block->OpCount;
+    processor->TotalClockCount += skipCount * loop->ClockCount;
+}
+
+
+// Note (Aaron): Runs the loaded program until it finishes, a ret executes while stopOnReturn is set,
+// at least instructionLimit instructions have executed (0 means no limit), or it reaches a breakpoint or
+// watchpoint (see breakpoint_set::StopReason). Requires the processor to have an instruction cache.
+// Returns TRUE if the program halted.
+global_function B32 ExecuteThreaded(threaded_engine *engine, processor_8086 *processor, B32 stopOnReturn, U64 instructionLimit)
+{
+#if THREADED_COMPUTED_GOTO
+    // Note (Aaron): Order must match threaded_op_type
+    local_persist void *handlers[ThreadedOp_Count] =
+    {
+        &&Handler_MovRegReg, &&Handler_MovRegImm, &&Handler_MovRegMem, &&Handler_MovMemReg, &&Handler_MovMemImm,
+        &&Handler_AddRegReg, &&Handler_AddRegImm, &&Handler_AddRegMem, &&Handler_AddMemReg, &&Handler_AddMemImm,
+        &&Handler_SubRegReg, &&Handler_SubRegImm, &&Handler_SubRegMem, &&Handler_SubMemReg, &&Handler_SubMemImm,
+        &&Handler_CmpRegReg, &&Handler_CmpRegImm, &&Handler_CmpRegMem, &&Handler_CmpMemReg, &&Handler_CmpMemImm,
+        &&Handler_Jne,
+        &&Handler_Loop,
+        &&Handler_Ret,
+        &&Handler_Nop,
+        &&Handler_Jump,
+        &&Handler_Exit,
+        &&Handler_Interpret,
+    };
+#endif
+
+    instruction_cache *cache = processor->InstructionCache;
+    assert_8086(cache && "The threaded engine requires an instruction cache");
+    if (!cache)
+    {
+        return FALSE;
+    }
+
+    breakpoint_set *breakpoints = processor->Breakpoints;
+    U32 breakpointGeneration = breakpoints ? breakpoints->Generation : 0;
+    if (breakpointGeneration != engine->BreakpointGeneration)
+    {
+        FlushThreadedEngine(engine);
+        engine->BreakpointGeneration = breakpointGeneration;
+    }
+
+    B32 resumingFromBreakpoint = breakpoints && ResumeExecution(breakpoints, processor->IP);
+
+    U16 *registers = processor->Registers;
+    U32 startInstructionCount = processor->InstructionCount;
+    threaded_block *block = 0;
+
+    for (;;)
+    {
+        if (cache->InvalidationCount != engine->InvalidationCount)
+        {
+            FlushThreadedEngine(engine);
+            engine->InvalidationCount = cache->InvalidationCount;
+            block = 0;
+        }
+
+        if (HasProcessorFinishedExecution(processor))
+        {
+            return TRUE;
+        }
+
+        if (breakpoints
+            && ShouldStopExecution(breakpoints, processor->IP, resumingFromBreakpoint && processor->InstructionCount == startInstructionCount))
+        {
+            return FALSE;
+        }
+
+        if (instructionLimit && (U64)(processor->InstructionCount - startInstructionCount) >= instructionLimit)
+        {
+            return FALSE;
+        }
+
+        // find the next block, preferring the ones chained to the previous block
+        U32 ip = processor->IP;
+        threaded_block *next = 0;
+        if (block)
+        {
+            if (block->Successors[0] && block->Successors[0]->StartAddress == ip) { next = block->Successors[0]; }
+            else if (block->Successors[1] && block->Successors[1]->StartAddress == ip) { next = block->Successors[1]; }
+        }
+
+        if (!next)
+        {
+            U32 generation = engine->Generation;
+            U32 blockIndex = engine->BlockLookup[ip];
+            next = blockIndex ? &engine->Blocks[blockIndex - 1] : CompileThreadedBlock(engine, processor, ip);
+
+            if (block && generation == engine->Generation)
+            {
+                block->Successors[block->Successors[0] ? 1 : 0] = next;
+            }
+        }
+
+        block = next;
+
+#if THREADED_COMPUTED_GOTO
+        if (!block->IsBound)
+        {
+            for (U32 opIndex = 0; opIndex < block->OpCount; ++opIndex)
+            {
+                block->Ops[opIndex].Handler = handlers[block->Ops[opIndex].Type];
+            }
+            block->IsBound = TRUE;
+        }
+#endif
+
+        if (block->Loop.IsCounted)
+        {
+            U64 instructionBudget = instructionLimit ? instructionLimit - (U64)(processor->InstructionCount - startInstructionCount) : 0;
+            FastForwardThreadedLoop(block, processor, instructionBudget);
+        }
+
+        threaded_op *op = block->Ops;
+
+#if THREADED_COMPUTED_GOTO
+        goto *op->Handler;
+#else
+        for (;;)
+        {
+            switch (op->Type)
+            {
+#endif
+        // mov
+        THREADED_HANDLER(MovRegReg)
+        {
+            U16 value = THREADED_READ_SOURCE();
+            THREADED_WRITE_DEST(value);
+            THREADED_RETIRE();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(MovRegImm)
+        {
+            THREADED_WRITE_DEST(op->Immediate);
+            THREADED_RETIRE();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(MovRegMem)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            THREADED_WRITE_DEST(GetMemory(processor, effectiveAddress, op->Memory.IsWide));
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(MovMemReg)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            SetMemory(processor, effectiveAddress, THREADED_READ_SOURCE(), op->Memory.IsWide);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_CHECK_INVALIDATION();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(MovMemImm)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            SetMemory(processor, effectiveAddress, op->Immediate, op->Memory.IsWide);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_CHECK_INVALIDATION();
+            THREADED_NEXT();
+        }
+
+        // add
+        THREADED_HANDLER(AddRegReg)
+        {
+            U16 value0 = THREADED_READ_DEST();
+            U16 value1 = THREADED_READ_SOURCE();
+            U16 result = (U16)((value0 + value1) & op->WidthMask);
+            THREADED_WRITE_DEST(result);
+            SetLazyFlags(processor, LazyFlags_Add, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(AddRegImm)
+        {
+            U16 value0 = THREADED_READ_DEST();
+            U16 value1 = op->Immediate;
+            U16 result = (U16)((value0 + value1) & op->WidthMask);
+            THREADED_WRITE_DEST(result);
+            SetLazyFlags(processor, LazyFlags_Add, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(AddRegMem)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            U16 value0 = THREADED_READ_DEST();
+            U16 value1 = GetMemory(processor, effectiveAddress, op->Memory.IsWide);
+            U16 result = (U16)((value0 + value1) & op->WidthMask);
+            THREADED_WRITE_DEST(result);
+            SetLazyFlags(processor, LazyFlags_Add, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(AddMemReg)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            U16 value0 = GetMemory(processor, effectiveAddress, op->Memory.IsWide);
+            U16 value1 = THREADED_READ_SOURCE();
+            U16 result = (U16)((value0 + value1) & op->WidthMask);
+            SetMemory(processor, effectiveAddress, result, op->Memory.IsWide);
+            SetLazyFlags(processor, LazyFlags_Add, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_CHECK_INVALIDATION();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(AddMemImm)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            U16 value0 = GetMemory(processor, effectiveAddress, op->Memory.IsWide);
+            U16 value1 = op->Immediate;
+            U16 result = (U16)((value0 + value1) & op->WidthMask);
+            SetMemory(processor, effectiveAddress, result, op->Memory.IsWide);
+            SetLazyFlags(processor, LazyFlags_Add, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_CHECK_INVALIDATION();
+            THREADED_NEXT();
+        }
+
+        // sub
+        THREADED_HANDLER(SubRegReg)
+        {
+            U16 value0 = THREADED_READ_DEST();
+            U16 value1 = THREADED_READ_SOURCE();
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            THREADED_WRITE_DEST(result);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(SubRegImm)
+        {
+            U16 value0 = THREADED_READ_DEST();
+            U16 value1 = op->Immediate;
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            THREADED_WRITE_DEST(result);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(SubRegMem)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            U16 value0 = THREADED_READ_DEST();
+            U16 value1 = GetMemory(processor, effectiveAddress, op->Memory.IsWide);
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            THREADED_WRITE_DEST(result);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(SubMemReg)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            U16 value0 = GetMemory(processor, effectiveAddress, op->Memory.IsWide);
+            U16 value1 = THREADED_READ_SOURCE();
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            SetMemory(processor, effectiveAddress, result, op->Memory.IsWide);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_CHECK_INVALIDATION();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(SubMemImm)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            U16 value0 = GetMemory(processor, effectiveAddress, op->Memory.IsWide);
+            U16 value1 = op->Immediate;
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            SetMemory(processor, effectiveAddress, result, op->Memory.IsWide);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_CHECK_INVALIDATION();
+            THREADED_NEXT();
+        }
+
+        // cmp
+        THREADED_HANDLER(CmpRegReg)
+        {
+            U16 value0 = THREADED_READ_DEST();
+            U16 value1 = THREADED_READ_SOURCE();
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(CmpRegImm)
+        {
+            U16 value0 = THREADED_READ_DEST();
+            U16 value1 = op->Immediate;
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(CmpRegMem)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            U16 value0 = THREADED_READ_DEST();
+            U16 value1 = GetMemory(processor, effectiveAddress, op->Memory.IsWide);
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(CmpMemReg)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            U16 value0 = GetMemory(processor, effectiveAddress, op->Memory.IsWide);
+            U16 value1 = THREADED_READ_SOURCE();
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(CmpMemImm)
+        {
+            U32 effectiveAddress = ThreadedEffectiveAddress(registers, &op->Memory);
+            U16 value0 = GetMemory(processor, effectiveAddress, op->Memory.IsWide);
+            U16 value1 = op->Immediate;
+            U16 result = (U16)((value0 - value1) & op->WidthMask);
+            SetLazyFlags(processor, LazyFlags_Sub, op->IsWide, value0, value1, result);
+            THREADED_RETIRE();
+            THREADED_CHECK_FAULT();
+            THREADED_NEXT();
+        }
+
+        // control transfer
+        THREADED_HANDLER(Jne)
+        {
+            processor->PrevIP = op->Address;
+            processor->IP = op->NextAddress;
+            if (!GetRegisterFlag(processor, RegisterFlag_ZF))
+            {
+                processor->IP += op->JumpOffset;
+            }
+            THREADED_RETIRE();
+            goto BlockEnd;
+        }
+        THREADED_HANDLER(Loop)
+        {
+            U16 cx = (U16)((registers[op->DestIndex] & op->DestMask) - 1);
+            registers[op->DestIndex] = cx & op->DestMask;
+
+            processor->PrevIP = op->Address;
+            processor->IP = op->NextAddress;
+            if (cx != 0)
+            {
+                processor->IP += op->JumpOffset;
+            }
+            THREADED_RETIRE();
+            goto BlockEnd;
+        }
+        THREADED_HANDLER(Ret)
+        {
+            processor->PrevIP = op->Address;
+            processor->IP = op->NextAddress;
+            THREADED_RETIRE();
+            if (stopOnReturn)
+            {
+                return TRUE;
+            }
+            goto BlockEnd;
+        }
+        THREADED_HANDLER(Nop)
+        {
+            THREADED_RETIRE();
+            THREADED_NEXT();
+        }
+        THREADED_HANDLER(Jump)
+        {
+            processor->PrevIP = op->Address;
+            processor->IP = op->NextAddress;
+            if (EvaluateJumpCondition(processor, (operation_types)op->JumpType))
+            {
+                processor->IP += op->JumpOffset;
+            }
+            THREADED_RETIRE();
+            goto BlockEnd;
+        }
+
+        // block exits
+        THREADED_HANDLER(Exit)
+        {
+            processor->PrevIP = op->Address;
+            processor->IP = op->NextAddress;
+            goto BlockEnd;
+        }
+        THREADED_HANDLER(Interpret)
+        {
+            processor->IP = op->Address;
+            instruction instruction = DecodeNextInstruction(processor);
+            ExecuteInstruction(processor, &instruction, 0, TraceLevel_None);
+
+            // Note (Aaron): The interpreted instruction may have gone anywhere, so don't chain from it
+            block = 0;
+            goto BlockEnd;
+        }
+#if !THREADED_COMPUTED_GOTO
+                default:
+                {
+                    assert_8086(FALSE && "Unhandled threaded op");
+                    goto BlockEnd;
+                }
+            }
+        }
+#endif
+
+BlockEnd:
+        ;
+    }
+}
+
+#undef THREADED_HANDLER
+#undef THREADED_NEXT
+#undef THREADED_RETIRE
+#undef THREADED_READ_DEST
+#undef THREADED_READ_SOURCE
+#undef THREADED_WRITE_DEST
+#undef THREADED_CHECK_FAULT
+#undef THREADED_CHECK_INVALIDATION
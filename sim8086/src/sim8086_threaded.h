@@ -0,0 +1,168 @@
+#ifndef SIM8086_THREADED_H
+#define SIM8086_THREADED_H
+
+#include "base_types.h"
+#include "base_arena.h"
+#include "sim8086.h"
+
+// Note (Aaron): Computed goto ("labels as values") is a GCC / Clang extension. Other compilers
+// fall back to a switch inside a loop.
+#ifndef THREADED_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define THREADED_COMPUTED_GOTO 1
+#else
+#define THREADED_COMPUTED_GOTO 0
+#endif
+#endif
+
+#define THREADED_MAX_BLOCK_OPS 64
+#define THREADED_NO_REGISTER 0xff
+
+
+// Note (Aaron): Operations are specialized on their operand kinds so that executing them never
+// has to re-examine operand types. Order within each group must stay Reg/Reg, Reg/Imm, Reg/Mem,
+// Mem/Reg, Mem/Imm as TranslateToThreadedOp() indexes into them.
+enum threaded_op_type : U8
+{
+    ThreadedOp_MovRegReg,
+    ThreadedOp_MovRegImm,
+    ThreadedOp_MovRegMem,
+    ThreadedOp_MovMemReg,
+    ThreadedOp_MovMemImm,
+
+    ThreadedOp_AddRegReg,
+    ThreadedOp_AddRegImm,
+    ThreadedOp_AddRegMem,
+    ThreadedOp_AddMemReg,
+    ThreadedOp_AddMemImm,
+
+    ThreadedOp_SubRegReg,
+    ThreadedOp_SubRegImm,
+    ThreadedOp_SubRegMem,
+    ThreadedOp_SubMemReg,
+    ThreadedOp_SubMemImm,
+
+    ThreadedOp_CmpRegReg,
+    ThreadedOp_CmpRegImm,
+    ThreadedOp_CmpRegMem,
+    ThreadedOp_CmpMemReg,
+    ThreadedOp_CmpMemImm,
+
+    ThreadedOp_Jne,
+    ThreadedOp_Loop,
+    ThreadedOp_Ret,
+    ThreadedOp_Nop,             // Decoded but not simulated; only advances the instruction pointer
+    ThreadedOp_Jump,            // Any other conditional jump or loop, evaluated with EvaluateJumpCondition()
+
+    ThreadedOp_Exit,            // Ends a block that reached its op limit, the end of the program or a breakpoint
+    ThreadedOp_Interpret,       // Hands the instruction at Address to ExecuteInstruction()
+
+    ThreadedOp_Count,
+};
+
+
+struct threaded_memory_operand
+{
+    U32 DirectAddress;
+    S16 Displacement;
+    U8 BaseIndex0;              // Index into processor_8086::Registers
+    U8 BaseIndex1;              // THREADED_NO_REGISTER if there is only one base register
+    B8 IsDirect;
+    B8 IsWide;
+};
+
+
+struct threaded_op
+{
+    void *Handler;              // Note (Aaron): Label address bound on first execution (computed goto only)
+    threaded_op_type Type;
+
+    U8 DestIndex;
+    U8 SourceIndex;
+    U8 DestShift;               // 8 for high byte registers
+    U8 SourceShift;
+    U16 DestMask;
+    U16 SourceMask;
+    U16 WidthMask;              // 0xff or 0xffff depending on the width of the operation
+    B8 IsWide;
+    U16 Immediate;
+    S8 JumpOffset;
+    U8 JumpType;                // operation_types of a ThreadedOp_Jump
+    U16 ClockCount;             // Includes the effective address clocks
+
+    threaded_memory_operand Memory;
+
+    // Note (Aaron): For ThreadedOp_Exit, Address is the last instruction executed in the block and
+    // NextAddress is where execution resumes.
+    U32 Address;
+    U32 NextAddress;
+};
+
+
+// Note (Aaron): Set for a block that branches back to its own start, whose other ops only do arithmetic on
+// registers and memory, and whose branch is decided by a counter that moves by a constant stride per iteration
+// (cx for a loop, otherwise the register the last add / sub / cmp before the jne compares). How many times it
+// goes around can then be worked out on entry, see FastForwardThreadedLoop().
+struct threaded_loop
+{
+    B32 IsCounted;
+    B32 IsClosedForm;           // Only add / sub immediates to registers, so iterations can be skipped outright
+    B32 WritesMemory;
+
+    U8 CounterIndex;
+    U8 TargetIndex;             // Register the jne's counter is compared against, THREADED_NO_REGISTER for TargetValue
+    U16 TargetValue;
+    U16 CounterOffset;          // Added to the jne's counter up to and including the op that sets the flags
+
+    // Note (Aaron): Added to each register per iteration by wide add / sub with an immediate. Registers in
+    // VaryingMask are written some other way and have no stride.
+    U16 Strides[8];
+    U8 VaryingMask;
+
+    U32 ClockCount;             // Of one iteration, including the branch
+};
+
+
+struct threaded_block
+{
+    U32 StartAddress;
+    U32 OpCount;
+    threaded_op *Ops;
+    B32 IsBound;
+
+    threaded_loop Loop;
+
+    // Note (Aaron): Blocks that were executed after this one, so that hot paths skip the lookup table
+    threaded_block *Successors[2];
+};
+
+
+struct threaded_engine
+{
+    // Note (Aaron): One entry per memory address; index into Blocks offset by 1, 0 if no block starts there
+    U32 *BlockLookup;
+    U32 LookupSize;
+
+    threaded_block *Blocks;
+    U32 BlockCount;
+    U32 BlockCapacity;
+
+    threaded_op *Ops;
+    U32 OpCount;
+    U32 OpCapacity;
+
+    // Note (Aaron): Last observed instruction_cache::InvalidationCount. Blocks are rebuilt when it changes.
+    U32 InvalidationCount;
+    // Note (Aaron): Incremented on every flush, used to avoid chaining blocks across a flush
+    U32 Generation;
+    // Note (Aaron): Last observed breakpoint_set::Generation (0 without breakpoints). Blocks end at breakpoints
+    // and after memory accesses while watchpoints are set, so they are rebuilt when it changes.
+    U32 BreakpointGeneration;
+};
+
+
+global_function B32 InitializeThreadedEngine(threaded_engine *engine, memory_arena *arena, U32 memorySize);
+global_function void FlushThreadedEngine(threaded_engine *engine);
+global_function B32 ExecuteThreaded(threaded_engine *engine, processor_8086 *processor, B32 stopOnReturn, U64 instructionLimit);
+
+#endif // SIM8086_THREADED_H
@@ -0,0 +1,539 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "base_types.h"
+#include "base_memory.h"
+#include "base_arena.h"
+#include "base_threads.h"
+#include "sim8086.h"
+#include "sim8086_trace.h"
+
+
+global_variable const U8 TraceFileSignature[8] = { 'S', 'I', 'M', '8', '0', '8', '6', 'T' };
+
+// Note (Aaron): Enough for a record's flags, IP and registers, or its clocks and fault
+#define TRACE_MAX_RECORD_PART_SIZE 64
+
+
+inline static U32 ZigZagEncode(S32 value)
+{
+    U32 result = ((U32)value << 1) ^ (U32)(value >> 31);
+    return result;
+}
+
+
+inline static S32 ZigZagDecode(U32 value)
+{
+    S32 result = (S32)(value >> 1) ^ -(S32)(value & 1);
+    return result;
+}
+
+
+// Note (Aaron): Returns the number of bytes written, at most 5
+inline static U32 EncodeVarint(U8 *at, U32 value)
+{
+    U32 byteCount = 0;
+    while (value >= 0x80)
+    {
+        at[byteCount++] = (U8)(value | 0x80);
+        value >>= 7;
+    }
+
+    at[byteCount++] = (U8)value;
+    return byteCount;
+}
+
+
+// +------------------------------+
+// Note (Aaron): Recording
+
+static void TraceWriterProc(void *data)
+{
+    trace_recorder *recorder = (trace_recorder *)data;
+    if (fwrite(recorder->WriterData, 1, recorder->WriterSize, recorder->File) != recorder->WriterSize)
+    {
+        recorder->WriteFailed = TRUE;
+    }
+}
+
+
+static void WaitForTraceWriter(trace_recorder *recorder)
+{
+    if (recorder->WriterRunning)
+    {
+        ThreadJoin(&recorder->WriterThread);
+        recorder->WriterRunning = FALSE;
+    }
+}
+
+
+// Note (Aaron): Hands the full buffer to the writer thread once it has finished with the other one. The buffer
+// is written out on this thread if the writer thread can't be started.
+static void SwapTraceBuffers(trace_recorder *recorder)
+{
+    WaitForTraceWriter(recorder);
+
+    recorder->WriterData = recorder->Buffers[recorder->BufferIndex];
+    recorder->WriterSize = recorder->BufferUsed;
+    recorder->ByteCount += recorder->BufferUsed;
+    if (ThreadCreate(&recorder->WriterThread, TraceWriterProc, recorder))
+    {
+        recorder->WriterRunning = TRUE;
+    }
+    else
+    {
+        TraceWriterProc(recorder);
+    }
+
+    recorder->BufferIndex ^= 1;
+    recorder->BufferUsed = 0;
+}
+
+
+// Note (Aaron): Makes room for 'byteCount' more bytes, swapping buffers if necessary
+inline static U8 *ReserveTraceBytes(trace_recorder *recorder, U64 byteCount)
+{
+    if (recorder->BufferUsed + byteCount > TRACE_BUFFER_SIZE)
+    {
+        SwapTraceBuffers(recorder);
+    }
+
+    return recorder->Buffers[recorder->BufferIndex] + recorder->BufferUsed;
+}
+
+
+static void WriteTraceBytes(trace_recorder *recorder, U8 const *data, U64 byteCount)
+{
+    // Note (Aaron): Writes larger than the rest of the buffer are split across buffers
+    while (byteCount)
+    {
+        U64 chunkSize = Min(byteCount, (U64)TRACE_BUFFER_SIZE - recorder->BufferUsed);
+        if (chunkSize == 0)
+        {
+            SwapTraceBuffers(recorder);
+            continue;
+        }
+
+        MemoryCopy(recorder->Buffers[recorder->BufferIndex] + recorder->BufferUsed, data, chunkSize);
+        recorder->BufferUsed += chunkSize;
+        data += chunkSize;
+        byteCount -= chunkSize;
+    }
+}
+
+
+global_function B32 InitializeTraceRecorder(trace_recorder *recorder, memory_arena *arena)
+{
+    *recorder = {};
+    recorder->Buffers[0] = (U8 *)ArenaPushSize(arena, TRACE_BUFFER_SIZE);
+    recorder->Buffers[1] = (U8 *)ArenaPushSize(arena, TRACE_BUFFER_SIZE);
+
+    B32 result = recorder->Buffers[0] && recorder->Buffers[1];
+    return result;
+}
+
+
+// Note (Aaron): Creates the trace file and writes the processor's current state into it, which the records
+// that follow are changes to
+global_function B32 StartTrace(trace_recorder *recorder, processor_8086 *processor, char const *filename)
+{
+    recorder->File = fopen(filename, "wb");
+    if (!recorder->File)
+    {
+        return FALSE;
+    }
+
+    trace_file_header header = {};
+    MemoryCopy(header.Signature, TraceFileSignature, sizeof(header.Signature));
+    header.Version = TRACE_FILE_VERSION;
+
+    if (fwrite(&header, sizeof(header), 1, recorder->File) != 1
+        || !WriteProcessorDump(processor, recorder->File))
+    {
+        fclose(recorder->File);
+        recorder->File = 0;
+        return FALSE;
+    }
+
+    recorder->BufferIndex = 0;
+    recorder->BufferUsed = 0;
+    recorder->WriterRunning = FALSE;
+    recorder->WriteFailed = FALSE;
+
+    MemoryCopy(recorder->Registers, processor->Registers, sizeof(recorder->Registers));
+    recorder->Flags = GetProcessorFlags(processor);
+    recorder->IP = processor->IP;
+    recorder->ClockCount = 0;
+    recorder->WriteEnd = 0;
+    recorder->Fault = processor->Fault;
+    recorder->PendingWriteCount = 0;
+
+    recorder->RecordCount = 0;
+    recorder->StateByteCount = (U64)ftell(recorder->File);
+    recorder->ByteCount = recorder->StateByteCount;
+    return TRUE;
+}
+
+
+// Note (Aaron): Notes a range of memory the current instruction writes to. The bytes are copied into the trace
+// once the instruction has finished, so only its final values are recorded. Writes outside of memory fault,
+// and aren't recorded.
+global_function void RecordTraceWrite(trace_recorder *recorder, U32 address, U32 byteCount, U32 memorySize)
+{
+    if ((U64)address + byteCount > memorySize)
+    {
+        return;
+    }
+
+    U32 end = address + byteCount;
+    if (recorder->PendingWriteCount)
+    {
+        trace_write *last = &recorder->PendingWrites[recorder->PendingWriteCount - 1];
+        U32 lastEnd = last->Address + last->ByteCount;
+        if ((address <= lastEnd && end >= last->Address)
+            || recorder->PendingWriteCount == TRACE_MAX_PENDING_WRITES)
+        {
+            // Note (Aaron): Min / Max aren't parenthesized, so they're kept out of the arithmetic
+            U32 newAddress = Min(last->Address, address);
+            U32 newEnd = Max(lastEnd, end);
+            if (newEnd > memorySize)
+            {
+                newEnd = memorySize;
+            }
+
+            last->Address = newAddress;
+            last->ByteCount = newEnd - newAddress;
+            return;
+        }
+    }
+
+    recorder->PendingWrites[recorder->PendingWriteCount++] = { address, byteCount };
+}
+
+
+// Note (Aaron): Records the instruction that has just been executed, as the changes it made since the last one
+global_function void RecordTraceInstruction(trace_recorder *recorder, processor_8086 *processor, U32 clockCount)
+{
+    U8 flags = GetProcessorFlags(processor);
+    U8 recordFlags = 0;
+
+    S32 ipChange = (S32)(processor->IP - recorder->IP);
+    if (ipChange >= 1 && ipChange <= TraceRecord_IPStepMask)
+    {
+        recordFlags |= (U8)ipChange;
+    }
+
+    U8 registerMask = 0;
+    for (U32 i = 0; i < ArrayCount(processor->Registers); ++i)
+    {
+        if (processor->Registers[i] != recorder->Registers[i])
+        {
+            registerMask |= (U8)(1 << i);
+        }
+    }
+
+    B32 faulted = (processor->Fault != Fault_None && processor->Fault != recorder->Fault);
+
+    if (registerMask)                       { recordFlags |= TraceRecord_Registers; }
+    if (flags != recorder->Flags)           { recordFlags |= TraceRecord_Flags; }
+    if (recorder->PendingWriteCount)        { recordFlags |= TraceRecord_Writes; }
+    if (clockCount != recorder->ClockCount) { recordFlags |= TraceRecord_Clocks; }
+    if (faulted)                            { recordFlags |= TraceRecord_Fault; }
+
+    U8 *start = ReserveTraceBytes(recorder, TRACE_MAX_RECORD_PART_SIZE);
+    U8 *at = start;
+    *at++ = recordFlags;
+
+    if (!(recordFlags & TraceRecord_IPStepMask))
+    {
+        at += EncodeVarint(at, ZigZagEncode(ipChange));
+    }
+
+    if (registerMask)
+    {
+        *at++ = registerMask;
+        for (U32 i = 0; i < ArrayCount(processor->Registers); ++i)
+        {
+            if (registerMask & (1 << i))
+            {
+                S16 change = (S16)(processor->Registers[i] - recorder->Registers[i]);
+                at += EncodeVarint(at, ZigZagEncode(change));
+            }
+        }
+    }
+
+    if (flags != recorder->Flags)
+    {
+        *at++ = flags;
+    }
+
+    if (recorder->PendingWriteCount)
+    {
+        at += EncodeVarint(at, recorder->PendingWriteCount);
+    }
+
+    recorder->BufferUsed += (U64)(at - start);
+
+    for (U32 i = 0; i < recorder->PendingWriteCount; ++i)
+    {
+        trace_write *write = &recorder->PendingWrites[i];
+
+        start = ReserveTraceBytes(recorder, TRACE_MAX_RECORD_PART_SIZE);
+        at = start;
+        at += EncodeVarint(at, ZigZagEncode((S32)(write->Address - recorder->WriteEnd)));
+        at += EncodeVarint(at, write->ByteCount);
+        recorder->BufferUsed += (U64)(at - start);
+
+        WriteTraceBytes(recorder, processor->Memory + write->Address, write->ByteCount);
+        recorder->WriteEnd = write->Address + write->ByteCount;
+    }
+
+    start = ReserveTraceBytes(recorder, TRACE_MAX_RECORD_PART_SIZE);
+    at = start;
+    if (clockCount != recorder->ClockCount)
+    {
+        at += EncodeVarint(at, clockCount);
+    }
+
+    if (faulted)
+    {
+        *at++ = (U8)processor->Fault;
+        at += EncodeVarint(at, processor->FaultAddress);
+    }
+
+    recorder->BufferUsed += (U64)(at - start);
+
+    MemoryCopy(recorder->Registers, processor->Registers, sizeof(recorder->Registers));
+    recorder->Flags = flags;
+    recorder->IP = processor->IP;
+    recorder->ClockCount = clockCount;
+    recorder->Fault = processor->Fault;
+    recorder->PendingWriteCount = 0;
+    recorder->RecordCount++;
+}
+
+
+// Note (Aaron): Writes out what is left of the trace and closes the file. Returns FALSE if any of it couldn't
+// be written.
+global_function B32 FinishTrace(trace_recorder *recorder)
+{
+    if (!recorder->File)
+    {
+        return FALSE;
+    }
+
+    WaitForTraceWriter(recorder);
+
+    recorder->WriterData = recorder->Buffers[recorder->BufferIndex];
+    recorder->WriterSize = recorder->BufferUsed;
+    recorder->ByteCount += recorder->BufferUsed;
+    TraceWriterProc(recorder);
+    recorder->BufferUsed = 0;
+
+    B32 result = !recorder->WriteFailed && !ferror(recorder->File);
+    result = (fclose(recorder->File) == 0) && result;
+    recorder->File = 0;
+
+    return result;
+}
+
+
+// +------------------------------+
+// Note (Aaron): Reading
+
+static B32 ReadTraceVarint(trace_reader *reader, U32 *value)
+{
+    U32 result = 0;
+    for (U32 shift = 0; shift < 35; shift += 7)
+    {
+        if (reader->Position >= reader->Size)
+        {
+            return FALSE;
+        }
+
+        U8 byte = reader->Data[reader->Position++];
+        result |= (U32)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+inline static B32 ReadTraceByte(trace_reader *reader, U8 *value)
+{
+    if (reader->Position >= reader->Size)
+    {
+        return FALSE;
+    }
+
+    *value = reader->Data[reader->Position++];
+    return TRUE;
+}
+
+
+// Note (Aaron): 'data' holds the whole trace file. Loads the state the trace starts from into the processor.
+global_function B32 StartTraceReader(trace_reader *reader, processor_8086 *processor, U8 const *data, U64 size)
+{
+    *reader = {};
+
+    trace_file_header header = {};
+    if (size < sizeof(header))
+    {
+        return FALSE;
+    }
+
+    MemoryCopy(&header, data, sizeof(header));
+    if (memcmp(header.Signature, TraceFileSignature, sizeof(header.Signature)) != 0
+        || header.Version != TRACE_FILE_VERSION)
+    {
+        return FALSE;
+    }
+
+    // Note (Aaron): Instructions are decoded from memory at IP while replaying, so it has to be inside of it
+    U64 dumpSize = 0;
+    if (!LoadProcessorFromDump(processor, data + sizeof(header), size - sizeof(header), &dumpSize)
+        || processor->IP >= processor->MemorySize)
+    {
+        return FALSE;
+    }
+
+    reader->Data = data;
+    reader->Size = size;
+    reader->Position = sizeof(header) + dumpSize;
+    return TRUE;
+}
+
+
+// Note (Aaron): Applies the next record to the processor. Returns FALSE at the end of the trace, or if the
+// record is cut short or doesn't make sense, which HasTraceReaderFinished() tells apart.
+global_function B32 ReadTraceRecord(trace_reader *reader, processor_8086 *processor, trace_record *record)
+{
+    *record = {};
+    record->Address = processor->IP;
+
+    U8 recordFlags = 0;
+    if (!ReadTraceByte(reader, &recordFlags))
+    {
+        return FALSE;
+    }
+
+    U32 ipStep = recordFlags & TraceRecord_IPStepMask;
+    if (!ipStep)
+    {
+        U32 value = 0;
+        if (!ReadTraceVarint(reader, &value))
+        {
+            return FALSE;
+        }
+
+        ipStep = (U32)ZigZagDecode(value);
+    }
+
+    processor->IP += ipStep;
+
+    if (recordFlags & TraceRecord_Registers)
+    {
+        if (!ReadTraceByte(reader, &record->ChangedRegisters))
+        {
+            return FALSE;
+        }
+
+        for (U32 i = 0; i < ArrayCount(processor->Registers); ++i)
+        {
+            U32 value = 0;
+            if ((record->ChangedRegisters & (1 << i)) && !ReadTraceVarint(reader, &value))
+            {
+                return FALSE;
+            }
+
+            processor->Registers[i] = (U16)(processor->Registers[i] + ZigZagDecode(value));
+        }
+    }
+
+    if (recordFlags & TraceRecord_Flags)
+    {
+        if (!ReadTraceByte(reader, &processor->Flags))
+        {
+            return FALSE;
+        }
+
+        processor->LazyFlags = {};
+        record->ChangedFlags = TRUE;
+    }
+
+    if (recordFlags & TraceRecord_Writes)
+    {
+        if (!ReadTraceVarint(reader, &record->WriteCount))
+        {
+            return FALSE;
+        }
+
+        for (U32 i = 0; i < record->WriteCount; ++i)
+        {
+            U32 offset = 0;
+            U32 byteCount = 0;
+            if (!ReadTraceVarint(reader, &offset) || !ReadTraceVarint(reader, &byteCount))
+            {
+                return FALSE;
+            }
+
+            U32 address = reader->WriteEnd + (U32)ZigZagDecode(offset);
+            if (byteCount == 0
+                || (U64)address + byteCount > processor->MemorySize
+                || reader->Position + byteCount > reader->Size)
+            {
+                return FALSE;
+            }
+
+            MemoryCopy(processor->Memory + address, reader->Data + reader->Position, byteCount);
+            reader->Position += byteCount;
+            reader->WriteEnd = address + byteCount;
+            record->WriteByteCount += byteCount;
+        }
+    }
+
+    if ((recordFlags & TraceRecord_Clocks) && !ReadTraceVarint(reader, &reader->ClockCount))
+    {
+        return FALSE;
+    }
+
+    if (recordFlags & TraceRecord_Fault)
+    {
+        U8 fault = 0;
+        U32 faultAddress = 0;
+        if (!ReadTraceByte(reader, &fault) || !ReadTraceVarint(reader, &faultAddress)
+            || fault == Fault_None || fault > Fault_InstructionStream)
+        {
+            return FALSE;
+        }
+
+        RaiseProcessorFault(processor, (processor_fault)fault, faultAddress);
+    }
+
+    // Note (Aaron): Only the instruction that ends the trace by faulting can leave IP outside of memory
+    if (processor->IP >= processor->MemorySize && processor->Fault == Fault_None)
+    {
+        return FALSE;
+    }
+
+    processor->PrevIP = record->Address;
+    processor->InstructionCount++;
+    processor->TotalClockCount += reader->ClockCount;
+
+    record->NextIP = processor->IP;
+    record->ClockCount = reader->ClockCount;
+    record->Fault = processor->Fault;
+    return TRUE;
+}
+
+
+global_function B32 HasTraceReaderFinished(trace_reader *reader)
+{
+    B32 result = (reader->Position >= reader->Size);
+    return result;
+}
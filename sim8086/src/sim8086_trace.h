@@ -0,0 +1,123 @@
+#ifndef SIM8086_TRACE_H
+#define SIM8086_TRACE_H
+
+#include <stdio.h>
+
+#include "base_types.h"
+#include "base_arena.h"
+#include "base_threads.h"
+#include "sim8086.h"
+
+#define TRACE_FILE_VERSION 1
+
+// Note (Aaron): Records are written into one buffer while the other is written out on a background thread
+#define TRACE_BUFFER_SIZE Megabytes(4)
+
+// Note (Aaron): Writes an instruction makes to neighbouring addresses are merged into one. Past this many
+// separate writes the last one is widened to cover the rest.
+#define TRACE_MAX_PENDING_WRITES 16
+
+
+// Note (Aaron): A trace file is this header, followed by a processor dump (see WriteProcessorDump()) of the
+// state the trace starts from, followed by one record per executed instruction up to the end of the file.
+struct trace_file_header
+{
+    U8 Signature[8];
+    U32 Version;
+    U32 Reserved;
+};
+
+
+// Note (Aaron): Each record starts with a byte of these flags and is followed by the parts they say are
+// present, in this order. Changes are recorded against the state left by the previous record. Varints
+// are unsigned LEB128, and signed values are zigzag encoded into them so that small changes stay small.
+enum trace_record_flags : U8
+{
+    TraceRecord_IPStepMask = 0x07,  // IP moved forward by 1-7 bytes. If 0, a signed varint change follows.
+    TraceRecord_Registers = 0x08,   // U8 mask of the changed registers, then a signed varint change of each
+    TraceRecord_Flags = 0x10,       // U8 flags
+    TraceRecord_Writes = 0x20,      // Varint write count, then for each a signed varint offset from the end
+                                    // of the previous write, a varint byte count and the bytes written
+    TraceRecord_Clocks = 0x40,      // Varint clocks, when they differ from the previous record's
+    TraceRecord_Fault = 0x80,       // U8 processor_fault, then a varint fault address
+};
+
+
+struct trace_write
+{
+    U32 Address;
+    U32 ByteCount;
+};
+
+
+// Note (Aaron): Records the instructions a processor executes into a trace file. Set as the processor's
+// Trace once the trace has been started.
+struct trace_recorder
+{
+    FILE *File;
+    U8 *Buffers[2];
+    U32 BufferIndex;
+    U64 BufferUsed;
+
+    // Note (Aaron): The buffer that is being written out, if any
+    os_thread WriterThread;
+    B32 WriterRunning;
+    U8 *WriterData;
+    U64 WriterSize;
+    B32 WriteFailed;
+
+    // Note (Aaron): The state as of the last record
+    U16 Registers[8];
+    U8 Flags;
+    U32 IP;
+    U32 ClockCount;
+    U32 WriteEnd;
+    processor_fault Fault;
+
+    trace_write PendingWrites[TRACE_MAX_PENDING_WRITES];
+    U32 PendingWriteCount;
+
+    U64 RecordCount;
+    U64 ByteCount;                  // Of the whole file, including the StateByteCount of the header and state
+    U64 StateByteCount;
+};
+
+
+// Note (Aaron): Reads back the records of a trace file held in memory, applying them to a processor
+struct trace_reader
+{
+    U8 const *Data;
+    U64 Size;
+    U64 Position;
+
+    // Note (Aaron): The state as of the last record read
+    U32 ClockCount;
+    U32 WriteEnd;
+};
+
+
+// Note (Aaron): What a record changed, besides applying it to the processor
+struct trace_record
+{
+    U32 Address;                    // Of the instruction executed
+    U32 NextIP;
+    U8 ChangedRegisters;            // Bit per register, in processor_8086::Registers order
+    B32 ChangedFlags;
+    U32 WriteCount;
+    U32 WriteByteCount;
+    U32 ClockCount;
+    processor_fault Fault;
+};
+
+
+global_function B32 InitializeTraceRecorder(trace_recorder *recorder, memory_arena *arena);
+global_function B32 StartTrace(trace_recorder *recorder, processor_8086 *processor, char const *filename);
+global_function void RecordTraceWrite(trace_recorder *recorder, U32 address, U32 byteCount, U32 memorySize);
+global_function void RecordTraceInstruction(trace_recorder *recorder, processor_8086 *processor, U32 clockCount);
+global_function B32 FinishTrace(trace_recorder *recorder);
+
+global_function B32 StartTraceReader(trace_reader *reader, processor_8086 *processor, U8 const *data, U64 size);
+global_function B32 ReadTraceRecord(trace_reader *reader, processor_8086 *processor, trace_record *record);
+global_function B32 HasTraceReaderFinished(trace_reader *reader);
+
+#endif // SIM8086_TRACE_H
@@ -76,8 +76,10 @@
 #include "base_types.c"
 #include "base_memory.c"
 #include "base_string.c"
+#include "base_threads.c"
 #include "sim8086.cpp"
 #include "sim8086_mnemonics.cpp"
+#include "sim8086_trace.cpp"
 
 
 // Note (Aaron): Adjustable values
@@ -201,22 +203,29 @@ global_function application_code Win32LoadAppCode(char *sourceDLLPath, char *tem
     {
         result.SetImGuiContext = (set_imgui_context *)GetProcAddress(result.CodeDLL, "SetImGuiContext");
         result.UpdateAndRender = (update_and_render *)GetProcAddress(result.CodeDLL, "UpdateAndRender");
+        result.UnloadApplication = (unload_application *)GetProcAddress(result.CodeDLL, "UnloadApplication");
 
-        result.IsValid = (result.SetImGuiContext && result.UpdateAndRender);
+        result.IsValid = (result.SetImGuiContext && result.UpdateAndRender && result.UnloadApplication);
     }
 
     if(!result.IsValid)
     {
         result.SetImGuiContext = 0;
         result.UpdateAndRender = 0;
+        result.UnloadApplication = 0;
     }
 
     return result;
 }
 
 
-global_function void Win32UnloadCode(application_code *applicationCode)
+global_function void Win32UnloadCode(application_code *applicationCode, application_state *applicationState)
 {
+    if (applicationCode->UnloadApplication)
+    {
+        applicationCode->UnloadApplication(applicationState);
+    }
+
     if (applicationCode->CodeDLL)
     {
         FreeLibrary(applicationCode->CodeDLL);
@@ -226,6 +235,7 @@ global_function void Win32UnloadCode(application_code *applicationCode)
     applicationCode->IsValid = FALSE;
     applicationCode->SetImGuiContext = 0;
     applicationCode->UpdateAndRender = 0;
+    applicationCode->UnloadApplication = 0;
 }
 
 
@@ -439,8 +449,7 @@ int CALLBACK WinMain(
 
     // initialize 8086
     processor_8086 processor = {};
-    processor.Memory = (U8 *)ArenaPushSize(&memory.Permanent.Arena, processor.MemorySize);
-    if (!processor.Memory)
+    if (!AllocateProcessorMemory(&processor))
     {
         Assert(FALSE && "Unable to allocate main memory for 8086");
         return 1;
@@ -493,7 +502,7 @@ int CALLBACK WinMain(
         FILETIME dllWriteTime = Win32GetLastWriteTime((char *)win32Context.DLLPath.Str);
         if (CompareFileTime(&dllWriteTime, &applicationCode.LastWriteTime))
         {
-            Win32UnloadCode(&applicationCode);
+            Win32UnloadCode(&applicationCode, &applicationState);
             // TODO (Aaron): Why was it 75 specifically?
             Sleep(75);
             applicationCode = Win32LoadAppCode((char *)win32Context.DLLPath.Str,
@@ -523,6 +532,7 @@ int CALLBACK WinMain(
         SwapBuffers(g_MainWindow.hDC);
     }
 
+    Win32UnloadCode(&applicationCode, &applicationState);
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplWin32_Shutdown();
     ImGui::DestroyContext(guiContext);
@@ -0,0 +1,102 @@
+// Measures instruction decode throughput (MB/s of instruction stream) for 8086 listings.
+// Usage: test_decode_throughput [listing] [listing] ...
+
+#include "base_inc.h"
+
+#include "base_memory.c"
+#include "base_arena.c"
+#include "base_string.c"
+#include "base_threads.c"
+#include "sim8086.cpp"
+#include "sim8086_mnemonics.cpp"
+#include "sim8086_trace.cpp"
+
+#define REPETITION_TESTER_IMPLEMENTATION
+#include "repetition_tester.h"
+
+
+// Note (Aaron): Decodes the whole listing front to back without executing it, so the
+// decode path is the only thing being timed.
+global_function void DecodeListing(repetition_tester *tester, processor_8086 *processor)
+{
+    processor->IP = 0;
+    processor->InstructionCount = 0;
+
+    U64 decodedByteCount = 0;
+    BeginTime(tester);
+    while (processor->IP < processor->ProgramSize)
+    {
+        instruction instruction = DecodeNextInstruction(processor);
+        decodedByteCount += instruction.Bits.ByteCount;
+    }
+    EndTime(tester);
+
+    CountBytes(tester, decodedByteCount);
+}
+
+
+int main(int argCount, char const *args[])
+{
+    if (argCount < 2)
+    {
+        fprintf(stderr, "Usage: %s [8086 machine code file] ...\n", args[0]);
+        return 0;
+    }
+
+    InitializeTesterGlobals();
+
+    processor_8086 processor = {};
+    processor.MemorySize = Megabytes(1);
+    processor.Memory = (U8 *)calloc(processor.MemorySize, sizeof(U8));
+    if (!processor.Memory)
+    {
+        fprintf(stderr, "[ERROR]: Unable to allocate main memory for 8086\n");
+        return 1;
+    }
+
+    for (int argIndex = 1; argIndex < argCount; ++argIndex)
+    {
+        const char *filename = args[argIndex];
+        FILE *file = fopen(filename, "rb");
+        if (!file)
+        {
+            fprintf(stderr, "[ERROR]: Unable to open '%s'\n", filename);
+            continue;
+        }
+
+        MemorySet(processor.Memory, 0, processor.MemorySize);
+        processor.ProgramSize = (U32)fread(processor.Memory, 1, processor.MemorySize, file);
+        fclose(file);
+
+        if (processor.ProgramSize == 0)
+        {
+            fprintf(stderr, "[ERROR]: '%s' is empty\n", filename);
+            continue;
+        }
+
+        // Note (Aaron): The byte count has to match on every repetition, so measure it once up front.
+        U64 targetByteCount = 0;
+        processor.IP = 0;
+        while (processor.IP < processor.ProgramSize)
+        {
+            instruction instruction = DecodeNextInstruction(&processor);
+            targetByteCount += instruction.Bits.ByteCount;
+        }
+
+        printf("\n--- %s (%u bytes) ---\n", filename, processor.ProgramSize);
+
+        repetition_tester tester = {};
+        NewTestWave(&tester, targetByteCount, TesterGlobals.CPUTimerFrequency, TesterGlobals.SecondsToTry);
+        while (IsTesting(&tester))
+        {
+            DecodeListing(&tester, &processor);
+        }
+
+        F64 megabytesPerSecond = tester.Results.Min.DerivedValues[StatValue_GBPerSecond] * 1024.0;
+        printf("Decode throughput: %.2f MB/s\n", megabytesPerSecond);
+    }
+
+    free(processor.Memory);
+
+    return 0;
+}
@@ -0,0 +1,458 @@
+// Checks that decoding and re-encoding 8086 instructions round-trips, in one process and on all cores.
+// Usage: test_round_trip [--threads count] [--fuzz count] [--seed value] [listing] [listing] ...
+//
+// Every instruction in a listing must encode back to exactly the bytes it was decoded from, so listings must be
+// assembled by NASM (e.g. the Performance-Aware Programming listings used by test-suite.sh). Fuzzing decodes
+// random byte streams instead; those instructions must survive being packed for the instruction cache, and encode
+// to bytes that decode back to the same instruction and encode to the same bytes again.
+
+#include "base_inc.h"
+
+#include <inttypes.h>
+
+#include "base_memory.c"
+#include "base_arena.c"
+#include "base_string.c"
+#include "base_threads.c"
+#include "sim8086.cpp"
+#include "sim8086_mnemonics.cpp"
+#include "sim8086_trace.cpp"
+#include "sim8086_encoder.cpp"
+#define PLATFORM_METRICS_IMPLEMENTATION
+#define PROFILER 0
+#include "platform_metrics.h"
+
+
+// Note (Aaron): Bytes of random instructions decoded per fuzzed stream
+#define FUZZ_STREAM_SIZE 256
+
+// Note (Aaron): Failures reported per listing or fuzzing thread, the rest are only counted
+#define MAX_REPORTED_FAILURES 8
+
+
+struct round_trip_test
+{
+    char const **Listings;
+    U32 ListingCount;
+    U32 volatile NextListing;
+
+    U32 FuzzStreamCount;
+    U32 volatile NextFuzzStream;
+    U32 Seed;
+
+    U64 volatile PassCount;
+    U64 volatile FailCount;
+};
+
+
+struct round_trip_worker
+{
+    os_thread Thread;
+    round_trip_test *Test;
+    U32 WorkerIndex;
+
+    processor_8086 Processor;
+};
+
+
+// Note (Aaron): xorshift32, seeded per worker so that runs are repeatable for a given seed and thread count
+inline static U32 NextRandom(U32 *state)
+{
+    U32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+static void PrintBytes(char *buffer, U8 *bytes, U32 byteCount)
+{
+    buffer[0] = 0;
+    for (U32 i = 0; i < byteCount; ++i)
+    {
+        buffer += sprintf(buffer, (i == 0) ? "%02x" : " %02x", bytes[i]);
+    }
+}
+
+
+static void ReportFailure(char const *source, instruction *inst, U8 *encoded, U32 encodedByteCount, char const *reason)
+{
+    char expected[MAX_INSTRUCTION_SIZE * 3 + 1];
+    char actual[MAX_INSTRUCTION_SIZE * 3 + 1];
+    PrintBytes(expected, inst->Bits.Bytes, inst->Bits.ByteCount);
+    PrintBytes(actual, encoded, encodedByteCount);
+
+    char mnemonic[INSTRUCTION_MNEMONIC_MAX_SIZE + 1];
+    mnemonic[FormatInstructionMnemonic(inst, mnemonic)] = 0;
+
+    fprintf(stderr, "[FAILED]: %s at 0x%x: %s (%s): decoded from [%s], encoded to [%s]\n",
+            source,
+            inst->Address,
+            mnemonic,
+            reason,
+            expected,
+            actual);
+}
+
+
+static B32 AreOperandsEquivalent(instruction_operand *a, instruction_operand *b, U16 immediateMask)
+{
+    if (a->Type != b->Type)
+    {
+        return FALSE;
+    }
+
+    switch (a->Type)
+    {
+        case Operand_Register:
+        {
+            return a->Register == b->Register;
+        }
+
+        case Operand_Memory:
+        {
+            U8 flagsA = a->Memory.Flags & (Memory_HasDirectAddress | Memory_IsWide);
+            U8 flagsB = b->Memory.Flags & (Memory_HasDirectAddress | Memory_IsWide);
+            if (flagsA != flagsB)
+            {
+                return FALSE;
+            }
+
+            if (flagsA & Memory_HasDirectAddress)
+            {
+                return a->Memory.DirectAddress == b->Memory.DirectAddress;
+            }
+
+            // Note (Aaron): [bp + 0] and [bx] have displacements the encoding is free to drop or add
+            S16 displacementA = (a->Memory.Flags & Memory_HasDisplacement) ? a->Memory.Displacement : 0;
+            S16 displacementB = (b->Memory.Flags & Memory_HasDisplacement) ? b->Memory.Displacement : 0;
+            return (a->Memory.Register == b->Memory.Register) && (displacementA == displacementB);
+        }
+
+        case Operand_Immediate:
+        {
+            return (a->Immediate.Value & immediateMask) == (b->Immediate.Value & immediateMask);
+        }
+
+        default:
+        {
+            return TRUE;
+        }
+    }
+}
+
+
+// Note (Aaron): Instructions are equivalent when they execute the same way, whichever encoding they came from.
+// Immediates are compared at the width they're used at, since byte immediates may or may not be sign-extended.
+static B32 AreInstructionsEquivalent(instruction *a, instruction *b)
+{
+    if (a->OpType != b->OpType || a->RepPrefix != b->RepPrefix)
+    {
+        return FALSE;
+    }
+
+    if (IsStringOperation(a->OpType))
+    {
+        return a->WidthBit == b->WidthBit;
+    }
+
+    U16 immediateMask = (a->Operands[0].Type == Operand_Immediate) ? 0xffff
+                      : IsOperandWide(&a->Operands[0]) ? 0xffff
+                      : 0xff;
+    if (a->Operands[0].Type == Operand_Immediate && (a->Operands[0].Immediate.Flags & Immediate_IsJump))
+    {
+        immediateMask = 0xff;
+    }
+
+    B32 result = AreOperandsEquivalent(&a->Operands[0], &b->Operands[0], immediateMask)
+              && AreOperandsEquivalent(&a->Operands[1], &b->Operands[1], immediateMask);
+    return result;
+}
+
+
+// Note (Aaron): Decodes a single instruction from 'bytes', which are padded with zeroes so that decoding never
+// runs past them
+static instruction DecodeEncodedInstruction(U8 *bytes, U32 byteCount)
+{
+    U8 memory[MAX_INSTRUCTION_SIZE * 2] = {};
+    MemoryCopy(memory, bytes, byteCount);
+
+    processor_8086 processor = {};
+    processor.Memory = memory;
+    processor.MemorySize = sizeof(memory);
+    processor.ProgramSize = sizeof(memory);
+
+    instruction result = FetchInstruction(&processor, 0);
+    return result;
+}
+
+
+static void CheckListing(round_trip_worker *worker, char const *filename)
+{
+    round_trip_test *test = worker->Test;
+    processor_8086 *processor = &worker->Processor;
+
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "[ERROR]: Unable to open '%s'\n", filename);
+        AtomicAddU64(&test->FailCount, 1);
+        return;
+    }
+
+    MemorySet(processor->Memory, 0, processor->MemorySize);
+    processor->ProgramSize = (U32)fread(processor->Memory, 1, processor->MemorySize, file);
+    processor->IP = 0;
+    fclose(file);
+
+    U64 passCount = 0;
+    U64 failCount = 0;
+    while (processor->IP < processor->ProgramSize)
+    {
+        instruction inst = DecodeNextInstruction(processor);
+
+        U8 encoded[MAX_INSTRUCTION_SIZE] = {};
+        U32 encodedByteCount = (inst.OpType != Op_unknown) ? EncodeInstruction(&inst, encoded) : 0;
+
+        char const *reason = 0;
+        if (encodedByteCount == 0)
+        {
+            reason = "can't be encoded";
+        }
+        else if (encodedByteCount != inst.Bits.ByteCount
+                 || memcmp(encoded, inst.Bits.Bytes, encodedByteCount) != 0)
+        {
+            reason = "encoded bytes differ";
+        }
+
+        if (reason)
+        {
+            if (failCount < MAX_REPORTED_FAILURES)
+            {
+                ReportFailure(filename, &inst, encoded, encodedByteCount, reason);
+            }
+            ++failCount;
+        }
+        else
+        {
+            ++passCount;
+        }
+    }
+
+    printf("%s: %" PRIu64 " instructions, %s\n", filename, passCount + failCount, failCount ? "FAILED" : "passed");
+
+    AtomicAddU64(&test->PassCount, passCount);
+    AtomicAddU64(&test->FailCount, failCount);
+}
+
+
+static void FuzzStream(round_trip_worker *worker, U32 streamIndex)
+{
+    round_trip_test *test = worker->Test;
+    processor_8086 *processor = &worker->Processor;
+
+    // Note (Aaron): Each stream has its own seed, so a failing stream can be found again from its index
+    U32 random = (test->Seed ^ (streamIndex * 0x9e3779b9)) | 1;
+    for (U32 i = 0; i < FUZZ_STREAM_SIZE; ++i)
+    {
+        processor->Memory[i] = (U8)NextRandom(&random);
+    }
+
+    // Note (Aaron): The stream is padded so that an instruction starting near its end can be decoded in full
+    MemorySet(processor->Memory + FUZZ_STREAM_SIZE, 0, MAX_INSTRUCTION_SIZE);
+    processor->ProgramSize = FUZZ_STREAM_SIZE + MAX_INSTRUCTION_SIZE;
+    processor->IP = 0;
+
+    U64 passCount = 0;
+    U64 failCount = 0;
+    while (processor->IP < FUZZ_STREAM_SIZE)
+    {
+        instruction inst = DecodeNextInstruction(processor);
+        if (inst.OpType == Op_unknown)
+        {
+            continue;
+        }
+
+        U8 encoded[MAX_INSTRUCTION_SIZE] = {};
+        U32 encodedByteCount = EncodeInstruction(&inst, encoded);
+
+        // Note (Aaron): The instruction cache stores instructions packed, so they have to come back the same
+        packed_instruction packed = PackInstruction(&inst);
+        instruction unpacked = UnpackInstruction(&packed, processor);
+
+        char const *reason = 0;
+        if (!AreInstructionsEquivalent(&inst, &unpacked)
+            || unpacked.ClockCount != inst.ClockCount
+            || unpacked.EAClockCount != inst.EAClockCount
+            || unpacked.Bits.ByteCount != inst.Bits.ByteCount
+            || memcmp(unpacked.Bits.Bytes, inst.Bits.Bytes, inst.Bits.ByteCount) != 0)
+        {
+            reason = "packing loses information";
+        }
+        else if (encodedByteCount == 0)
+        {
+            reason = "can't be encoded";
+        }
+        else
+        {
+            instruction decoded = DecodeEncodedInstruction(encoded, encodedByteCount);
+
+            U8 reencoded[MAX_INSTRUCTION_SIZE] = {};
+            U32 reencodedByteCount = EncodeInstruction(&decoded, reencoded);
+
+            if (decoded.Bits.ByteCount != encodedByteCount)
+            {
+                reason = "encoded bytes decode to a different length";
+            }
+            else if (!AreInstructionsEquivalent(&inst, &decoded))
+            {
+                reason = "encoded bytes decode to a different instruction";
+            }
+            else if (reencodedByteCount != encodedByteCount || memcmp(encoded, reencoded, encodedByteCount) != 0)
+            {
+                reason = "encoding isn't stable";
+            }
+        }
+
+        if (reason)
+        {
+            if (AtomicLoadU64(&test->FailCount) + failCount < MAX_REPORTED_FAILURES)
+            {
+                char source[64];
+                sprintf(source, "fuzz stream %u", streamIndex);
+                ReportFailure(source, &inst, encoded, encodedByteCount, reason);
+            }
+            ++failCount;
+        }
+        else
+        {
+            ++passCount;
+        }
+    }
+
+    AtomicAddU64(&test->PassCount, passCount);
+    AtomicAddU64(&test->FailCount, failCount);
+}
+
+
+// Note (Aaron): Workers take listings, then fuzzed streams, until there are none left
+static void RoundTripThreadProc(void *data)
+{
+    round_trip_worker *worker = (round_trip_worker *)data;
+    round_trip_test *test = worker->Test;
+
+    for (;;)
+    {
+        U32 listingIndex = AtomicIncrementU32(&test->NextListing) - 1;
+        if (listingIndex >= test->ListingCount)
+        {
+            break;
+        }
+
+        CheckListing(worker, test->Listings[listingIndex]);
+    }
+
+    for (;;)
+    {
+        U32 streamIndex = AtomicIncrementU32(&test->NextFuzzStream) - 1;
+        if (streamIndex >= test->FuzzStreamCount)
+        {
+            break;
+        }
+
+        FuzzStream(worker, streamIndex);
+    }
+}
+
+
+int main(int argCount, char const *args[])
+{
+    if (argCount < 2)
+    {
+        fprintf(stderr, "Usage: %s [--threads count] [--fuzz count] [--seed value] [8086 machine code file] ...\n", args[0]);
+        return 0;
+    }
+
+    round_trip_test test = {};
+    test.Listings = (char const **)calloc((size_t)argCount, sizeof(char const *));
+    test.Seed = 0x8086;
+    U32 threadCount = GetLogicalCoreCount();
+
+    for (int argIndex = 1; argIndex < argCount; ++argIndex)
+    {
+        char const *arg = args[argIndex];
+        B32 hasValue = (argIndex + 1 < argCount);
+
+        if (strcmp(arg, "--threads") == 0 && hasValue)
+        {
+            threadCount = (U32)strtoul(args[++argIndex], 0, 0);
+        }
+        else if (strcmp(arg, "--fuzz") == 0 && hasValue)
+        {
+            test.FuzzStreamCount = (U32)strtoul(args[++argIndex], 0, 0);
+        }
+        else if (strcmp(arg, "--seed") == 0 && hasValue)
+        {
+            test.Seed = (U32)strtoul(args[++argIndex], 0, 0);
+        }
+        else
+        {
+            test.Listings[test.ListingCount++] = arg;
+        }
+    }
+
+    if (threadCount == 0)
+    {
+        threadCount = 1;
+    }
+
+    round_trip_worker *workers = (round_trip_worker *)calloc(threadCount, sizeof(round_trip_worker));
+    for (U32 i = 0; i < threadCount; ++i)
+    {
+        round_trip_worker *worker = &workers[i];
+        worker->Test = &test;
+        worker->WorkerIndex = i;
+        worker->Processor.MemorySize = Megabytes(1);
+        worker->Processor.Memory = (U8 *)calloc(worker->Processor.MemorySize, sizeof(U8));
+        if (!worker->Processor.Memory)
+        {
+            fprintf(stderr, "[ERROR]: Unable to allocate main memory for thread %u\n", i);
+            return 1;
+        }
+    }
+
+    U64 startTime = ReadOSTimer();
+
+    // Note (Aaron): The main thread is the first worker
+    for (U32 i = 1; i < threadCount; ++i)
+    {
+        if (!ThreadCreate(&workers[i].Thread, RoundTripThreadProc, &workers[i]))
+        {
+            fprintf(stderr, "[ERROR]: Unable to create thread %u\n", i);
+            return 1;
+        }
+    }
+
+    RoundTripThreadProc(&workers[0]);
+
+    for (U32 i = 1; i < threadCount; ++i)
+    {
+        ThreadJoin(&workers[i].Thread);
+    }
+
+    U64 elapsed = ReadOSTimer() - startTime;
+    F64 seconds = (F64)elapsed / (F64)GetOSTimerFrequency();
+    U64 roundTripCount = test.PassCount + test.FailCount;
+
+    printf("\nThreads: %u, fuzzed streams: %u, seed: 0x%x\n", threadCount, test.FuzzStreamCount, test.Seed);
+    printf("PASSED: %" PRIu64 "\n", test.PassCount);
+    printf("FAILED: %" PRIu64 "\n", test.FailCount);
+    printf("Round trips: %" PRIu64 " in %.2f ms (%.0f per second)\n",
+           roundTripCount,
+           seconds * 1000.0,
+           (seconds > 0.0) ? (F64)roundTripCount / seconds : 0.0);
+
+    return test.FailCount ? 1 : 0;
+}
@@ -0,0 +1,422 @@
+// Reads back a binary execution trace recorded by 'sim8086 --exec --trace path'.
+// Usage: trace_analyzer [--hot count] [--state count path] trace
+//
+// The trace is mapped into memory and replayed from the state it starts from. Reports the instructions and clocks
+// it took, where the clocks went, the instruction mix, and how often registers, flags and memory changed. With
+// --state, replay stops after 'count' instructions and that state is saved to 'path' as a processor dump, which
+// sim8086 can load in place of a program.
+
+#include "base_inc.h"
+
+#if __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "base_memory.c"
+#include "base_arena.c"
+#include "base_string.c"
+#include "base_threads.c"
+#include "sim8086.cpp"
+#include "sim8086_mnemonics.cpp"
+#include "sim8086_trace.cpp"
+#define PLATFORM_METRICS_IMPLEMENTATION
+#define PROFILER 0
+#include "platform_metrics.h"
+
+
+#define DEFAULT_HOT_SPOT_COUNT 10
+
+
+struct trace_statistics
+{
+    U64 InstructionCount;
+    U64 ClockCount;
+    U64 JumpCount;                  // Instructions that didn't continue at the next one
+    U64 RegisterChangeCounts[8];
+    U64 FlagChangeCount;
+    U64 WritingInstructionCount;
+    U64 WriteCount;
+    U64 WriteByteCount;
+
+    U64 OpExecutionCounts[Op_count];
+    U64 OpClockCounts[Op_count];
+
+    // Note (Aaron): Indexed by instruction address, instructions only execute from the loaded program
+    U32 AddressCount;
+    U32 *ExecutionCounts;
+    U64 *ClockCounts;
+};
+
+
+struct hot_spot
+{
+    U32 Address;
+    U64 ClockCount;
+};
+
+
+static int CompareHotSpots(void const *a, void const *b)
+{
+    U64 clocksA = ((hot_spot const *)a)->ClockCount;
+    U64 clocksB = ((hot_spot const *)b)->ClockCount;
+    return (clocksA < clocksB) ? 1 : (clocksA > clocksB) ? -1 : 0;
+}
+
+
+// Note (Aaron): Maps the whole file read-only. Returns 0 if it can't be opened or is empty.
+static U8 *MapFile(char const *filename, U64 *size)
+{
+#if __linux__
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+    {
+        return 0;
+    }
+
+    struct stat status = {};
+    U8 *result = 0;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        void *data = mmap(0, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data != MAP_FAILED)
+        {
+            // Note (Aaron): Records are read front to back
+            madvise(data, (size_t)status.st_size, MADV_SEQUENTIAL);
+            result = (U8 *)data;
+            *size = (U64)status.st_size;
+        }
+    }
+
+    close(file);
+    return result;
+
+#elif _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+
+    LARGE_INTEGER fileSize = {};
+    U8 *result = 0;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping)
+        {
+            result = (U8 *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            *size = (U64)fileSize.QuadPart;
+            CloseHandle(mapping);
+        }
+    }
+
+    CloseHandle(file);
+    return result;
+
+#endif
+}
+
+
+static void UnmapFile(U8 *data, U64 size)
+{
+#if __linux__
+    munmap(data, (size_t)size);
+#elif _WIN32
+    UnmapViewOfFile(data);
+#endif
+}
+
+
+static void RecordStatistics(trace_statistics *statistics, instruction *instruction, trace_record *record)
+{
+    statistics->InstructionCount++;
+    statistics->ClockCount += record->ClockCount;
+    statistics->OpExecutionCounts[instruction->OpType]++;
+    statistics->OpClockCounts[instruction->OpType] += record->ClockCount;
+
+    if (record->NextIP != record->Address + instruction->Bits.ByteCount)
+    {
+        statistics->JumpCount++;
+    }
+
+    for (U32 i = 0; i < ArrayCount(statistics->RegisterChangeCounts); ++i)
+    {
+        if (record->ChangedRegisters & (1 << i))
+        {
+            statistics->RegisterChangeCounts[i]++;
+        }
+    }
+
+    statistics->FlagChangeCount += record->ChangedFlags ? 1 : 0;
+
+    if (record->WriteCount)
+    {
+        statistics->WritingInstructionCount++;
+        statistics->WriteCount += record->WriteCount;
+        statistics->WriteByteCount += record->WriteByteCount;
+    }
+
+    if (record->Address < statistics->AddressCount)
+    {
+        statistics->ExecutionCounts[record->Address]++;
+        statistics->ClockCounts[record->Address] += record->ClockCount;
+    }
+}
+
+
+static void PrintRegisters(processor_8086 *processor)
+{
+    register_id toDisplay[] = { Reg_ax, Reg_bx, Reg_cx, Reg_dx, Reg_sp, Reg_bp, Reg_si, Reg_di };
+
+    printf("Registers:\n");
+    for (int i = 0; i < ArrayCount(toDisplay); ++i)
+    {
+        U16 value = GetRegisterValue(processor, toDisplay[i]);
+        if (value)
+        {
+            printf("\t%s: %04x (%u)\n", GetRegisterMnemonic(toDisplay[i]), value, value);
+        }
+    }
+
+    printf("\tip: %04x (%u)\n", processor->IP, processor->IP);
+
+    // Note (Aaron): Flags are left out when none are set, as sim8086 does
+    U8 flags = GetProcessorFlags(processor);
+    if (!flags)
+    {
+        printf("    \n");
+        return;
+    }
+
+    printf("     flags:->%s%s%s%s%s%s%s\n",
+           (flags & RegisterFlag_CF) ? "C" : "",
+           (flags & RegisterFlag_PF) ? "P" : "",
+           (flags & RegisterFlag_AF) ? "A" : "",
+           (flags & RegisterFlag_ZF) ? "Z" : "",
+           (flags & RegisterFlag_SF) ? "S" : "",
+           (flags & RegisterFlag_OF) ? "O" : "",
+           (flags & RegisterFlag_DF) ? "D" : "");
+}
+
+
+// Note (Aaron): 'processor' holds the state at the end of the replay, its program is what the hot spots ran
+static void PrintStatistics(trace_statistics *statistics, processor_8086 *processor, U32 hotSpotCount)
+{
+    F64 totalClocks = statistics->ClockCount ? (F64)statistics->ClockCount : 1.0;
+    F64 totalInstructions = statistics->InstructionCount ? (F64)statistics->InstructionCount : 1.0;
+
+    printf("instructions: %llu, clocks: %llu (%.2f per instruction)\n",
+           (unsigned long long)statistics->InstructionCount, (unsigned long long)statistics->ClockCount,
+           (F64)statistics->ClockCount / totalInstructions);
+    printf("jumps taken: %llu (%.1f%%)\n",
+           (unsigned long long)statistics->JumpCount, ((F64)statistics->JumpCount / totalInstructions) * 100.0);
+    printf("flag changes: %llu (%.1f%%)\n",
+           (unsigned long long)statistics->FlagChangeCount, ((F64)statistics->FlagChangeCount / totalInstructions) * 100.0);
+    printf("memory writes: %llu instructions wrote %llu bytes in %llu ranges\n",
+           (unsigned long long)statistics->WritingInstructionCount,
+           (unsigned long long)statistics->WriteByteCount, (unsigned long long)statistics->WriteCount);
+
+    printf("register changes:");
+    register_id registers[] = { Reg_ax, Reg_bx, Reg_cx, Reg_dx, Reg_sp, Reg_bp, Reg_si, Reg_di };
+    for (U32 i = 0; i < ArrayCount(registers); ++i)
+    {
+        U8 registerIndex = RegisterLookup[registers[i]].RegisterIndex;
+        printf(" %s %llu", GetRegisterMnemonic(registers[i]), (unsigned long long)statistics->RegisterChangeCounts[registerIndex]);
+    }
+    printf("\n\n");
+
+    hot_spot *hotSpots = (hot_spot *)malloc(sizeof(hot_spot) * (statistics->AddressCount + 1));
+    if (!hotSpots)
+    {
+        printf("ERROR: Unable to allocate memory for the hot spot report\n");
+        return;
+    }
+
+    U32 spotCount = 0;
+    for (U32 address = 0; address < statistics->AddressCount; ++address)
+    {
+        if (statistics->ExecutionCounts[address])
+        {
+            hotSpots[spotCount++] = { address, statistics->ClockCounts[address] };
+        }
+    }
+
+    qsort(hotSpots, spotCount, sizeof(hot_spot), CompareHotSpots);
+
+    printf("hot spots:\n");
+    printf("  address      executions          clocks   share  instruction\n");
+    for (U32 i = 0; i < spotCount && i < hotSpotCount; ++i)
+    {
+        U32 address = hotSpots[i].Address;
+        instruction instruction = FetchInstruction(processor, address);
+        char mnemonic[INSTRUCTION_MNEMONIC_MAX_SIZE] = {};
+        FormatInstructionMnemonic(&instruction, mnemonic);
+
+        printf("  0x%.8x  %10u  %14llu  %5.1f%%  %s\n",
+               address,
+               statistics->ExecutionCounts[address],
+               (unsigned long long)statistics->ClockCounts[address],
+               ((F64)statistics->ClockCounts[address] / totalClocks) * 100.0,
+               mnemonic);
+    }
+
+    printf("\ninstruction mix:\n");
+    for (U32 opType = 0; opType < Op_count; ++opType)
+    {
+        if (!statistics->OpExecutionCounts[opType])
+        {
+            continue;
+        }
+
+        printf("  %-8s %10llu  %5.1f%%  %14llu clocks  %5.1f%%\n",
+               GetOpMnemonic((operation_types)opType),
+               (unsigned long long)statistics->OpExecutionCounts[opType],
+               ((F64)statistics->OpExecutionCounts[opType] / totalInstructions) * 100.0,
+               (unsigned long long)statistics->OpClockCounts[opType],
+               ((F64)statistics->OpClockCounts[opType] / totalClocks) * 100.0);
+    }
+
+    free(hotSpots);
+}
+
+
+int main(int argCount, char const *args[])
+{
+    if (argCount < 2)
+    {
+        fprintf(stderr, "Usage: %s [--hot count] [--state count path] [trace file]\n", args[0]);
+        return 0;
+    }
+
+    char const *traceFilename = 0;
+    char const *stateFilename = 0;
+    U64 stateInstructionCount = 0;
+    U32 hotSpotCount = DEFAULT_HOT_SPOT_COUNT;
+
+    for (int argIndex = 1; argIndex < argCount; ++argIndex)
+    {
+        char const *arg = args[argIndex];
+
+        if (strcmp(arg, "--hot") == 0 && argIndex + 1 < argCount)
+        {
+            hotSpotCount = (U32)strtoul(args[++argIndex], 0, 0);
+        }
+        else if (strcmp(arg, "--state") == 0 && argIndex + 2 < argCount)
+        {
+            stateInstructionCount = strtoull(args[++argIndex], 0, 0);
+            stateFilename = args[++argIndex];
+        }
+        else
+        {
+            traceFilename = arg;
+        }
+    }
+
+    if (!traceFilename)
+    {
+        fprintf(stderr, "[ERROR]: No trace file given\n");
+        return 1;
+    }
+
+    U64 traceSize = 0;
+    U8 *trace = MapFile(traceFilename, &traceSize);
+    if (!trace)
+    {
+        fprintf(stderr, "[ERROR]: Unable to open '%s'\n", traceFilename);
+        return 1;
+    }
+
+    processor_8086 processor = {};
+    if (!AllocateProcessorMemory(&processor))
+    {
+        fprintf(stderr, "[ERROR]: Unable to allocate main memory for 8086\n");
+        return 1;
+    }
+
+    trace_reader reader = {};
+    if (!StartTraceReader(&reader, &processor, trace, traceSize))
+    {
+        fprintf(stderr, "[ERROR]: '%s' is not a sim8086 trace, or its starting state is corrupt\n", traceFilename);
+        return 1;
+    }
+
+    trace_statistics statistics = {};
+    statistics.AddressCount = processor.ProgramSize;
+    statistics.ExecutionCounts = (U32 *)calloc(statistics.AddressCount + 1, sizeof(U32));
+    statistics.ClockCounts = (U64 *)calloc(statistics.AddressCount + 1, sizeof(U64));
+    if (!statistics.ExecutionCounts || !statistics.ClockCounts)
+    {
+        fprintf(stderr, "[ERROR]: Unable to allocate memory for the statistics\n");
+        return 1;
+    }
+
+    U64 startPosition = reader.Position;
+    U64 startTime = ReadOSTimer();
+
+    // Note (Aaron): Instructions are decoded from memory as it was before they executed, as the trace only
+    // records their effects
+    while (!HasTraceReaderFinished(&reader) && (!stateFilename || statistics.InstructionCount < stateInstructionCount))
+    {
+        // Note (Aaron): Records after a fault can't be decoded if it left IP outside of memory
+        instruction instruction = {};
+        if (processor.IP < processor.MemorySize)
+        {
+            instruction = FetchInstruction(&processor, processor.IP);
+        }
+
+        trace_record record = {};
+        if (processor.IP >= processor.MemorySize || !ReadTraceRecord(&reader, &processor, &record))
+        {
+            fprintf(stderr, "[ERROR]: Trace is corrupt after %llu instructions\n", (unsigned long long)statistics.InstructionCount);
+            return 1;
+        }
+
+        RecordStatistics(&statistics, &instruction, &record);
+    }
+
+    F64 seconds = (F64)(ReadOSTimer() - startTime) / (F64)GetOSTimerFrequency();
+    U64 recordByteCount = reader.Position - startPosition;
+
+    printf("; %s:\n", traceFilename);
+    printf("replayed %llu bytes of records (%.2f bytes per instruction) after %llu bytes of starting state in %.2fms\n\n",
+           (unsigned long long)recordByteCount,
+           statistics.InstructionCount ? (F64)recordByteCount / (F64)statistics.InstructionCount : 0.0,
+           (unsigned long long)startPosition, seconds * 1000.0);
+
+    PrintStatistics(&statistics, &processor, hotSpotCount);
+    printf("\n");
+
+    if (stateFilename && statistics.InstructionCount < stateInstructionCount)
+    {
+        fprintf(stderr, "[ERROR]: Trace ends after %llu instructions\n", (unsigned long long)statistics.InstructionCount);
+        return 1;
+    }
+
+    if (processor.Fault == Fault_MemoryAccess)
+    {
+        printf("Stopped by fault: %s [0x%x] at 0x%x\n", GetProcessorFaultName(processor.Fault), processor.FaultAddress, processor.PrevIP);
+    }
+    else if (processor.Fault != Fault_None)
+    {
+        printf("Stopped by fault: %s at 0x%x\n", GetProcessorFaultName(processor.Fault), processor.FaultAddress);
+    }
+
+    printf("State after %llu instructions:\n", (unsigned long long)statistics.InstructionCount);
+    PrintRegisters(&processor);
+
+    B32 result = TRUE;
+    if (stateFilename)
+    {
+        result = DumpProcessorToFile(&processor, stateFilename);
+    }
+
+    free(statistics.ExecutionCounts);
+    free(statistics.ClockCounts);
+    FreeProcessorMemory(&processor);
+    UnmapFile(trace, traceSize);
+
+    return result ? 0 : 1;
+}
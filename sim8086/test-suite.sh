@@ -5,10 +5,14 @@
 
 # Requirements:
 # - 'bin/sim8086' (relative to this sctipt)
+# - 'bin/trace_analyzer' (built by build-trace-analyzer.sh)
 # - All Performance-Aware Programming listings included in the test suite placed in 'listings/' (relative to this sctipt)
 # - 'nasm' accessible from PATH variable
 # - All platform metrics and timings printouts be disabled in the sim8086 output
 
+# Note: 'bin/test_round_trip' (built by build-test-round-trip.sh) checks the same listings in a single process
+# without nasm, and also fuzzes the decoder, e.g. 'bin/test_round_trip --fuzz 100000 listings/listing_00*'
+
 PASSED=0
 FAILED=0
 
@@ -34,6 +38,45 @@ TestListing() {
     echo "------------------------"
 }
 
+# Checks the threaded and jit engines against the interpreter, comparing after every block and after
+# longer steps that let the threaded engine fast-forward loops
+TestEngines() {
+    PROGRAM=$1
+    echo "Checking engines on '$PROGRAM':"
+    echo
+    for ENGINE in threaded jit; do
+        for STEP in 1 4096; do
+            if bin/sim8086_debug --differential $STEP --engine $ENGINE "$PROGRAM" > output.txt; then
+                ((PASSED++))
+            else
+                ((FAILED++))
+                grep -A 1 "^differential" output.txt
+                echo "                   FAILED ($ENGINE, step $STEP)"
+            fi
+        done
+    done
+    echo "------------------------"
+}
+
+# Records a trace of the program and checks that replaying all of it ends in the state the simulation did
+TestTrace() {
+    PROGRAM=$1
+    echo "Checking trace of '$PROGRAM':"
+    echo
+    rm -f output.trace output.state output.replayed
+    bin/sim8086_debug --exec --trace output.trace --save-state output.state "$PROGRAM" > output.txt
+    COUNT=$(bin/trace_analyzer output.trace | sed -n 's/^instructions: \([0-9]*\),.*/\1/p')
+    if [ -n "$COUNT" ] \
+        && bin/trace_analyzer --state "$COUNT" output.replayed output.trace > output.txt \
+        && cmp -s output.state output.replayed; then
+        ((PASSED++))
+    else
+        ((FAILED++))
+        echo "                   FAILED"
+    fi
+    echo "------------------------"
+}
+
 # Run tests
 TestListing listings/listing_0037_single_register_mov
 TestListing listings/listing_0038_many_register_mov
@@ -51,10 +94,54 @@ TestListing listings/listing_0053_add_loop_challenge
 TestListing listings/listing_0054_draw_rectangle
 TestListing listings/listing_0056_estimating_cycles
 
+# Note: Loops whose body reads the counter, through cx and through cl
+#   mov cx, 5 / mov bx, 0 / L: add bx, cx / loop L
+#   mov cx, 5 / mov bx, 0 / L: add bl, cl / loop L
+printf '\xb9\x05\x00\xbb\x00\x00\x01\xcb\xe2\xfc' > loop_reads_cx
+printf '\xb9\x05\x00\xbb\x00\x00\x02\xd9\xe2\xfc' > loop_reads_cl
+
+# Note: String instructions, forwards and backwards, overlapping, stopping early and not running at all
+#   std / mov di, 0x8000 / mov ax, 0x55 / mov cx, 200 / rep stosb
+#   cld / mov di, 0x2000 / mov ax, 0x1234 / mov cx, 0x40 / rep stosw
+#   mov si, 0 / mov di, 0x1000 / mov cx, 0x20 / cld / rep movsb
+#   std / mov si, 0x3e / mov di, 0x103e / mov cx, 0x10 / rep movsw
+#   cld / mov di, 0x3000 / mov al, 7 / stosb / mov si, 0x3000 / mov di, 0x3001 / mov cx, 0x40 / rep movsb
+#   cld / mov si, 0 / mov di, 0x4000 / mov cx, 8 / rep movsb / mov byte [0x4004], 0xff /
+#       mov si, 0 / mov di, 0x4000 / mov cx, 8 / repe cmpsb
+#   cld / mov di, 0 / mov al, 0xb9 / mov cx, 0x20 / repne scasb
+#   mov cx, 0 / mov di, 0x5000 / mov al, 1 / rep stosb / mov si, 0 / rep movsb / repe cmpsb / repne scasb
+printf '\xfd\xbf\x00\x80\xb8\x55\x00\xb9\xc8\x00\xf3\xaa' > stos_down
+printf '\xfc\xbf\x00\x20\xb8\x34\x12\xb9\x40\x00\xf3\xab' > stos_up
+printf '\xbe\x00\x00\xbf\x00\x10\xb9\x20\x00\xfc\xf3\xa4' > movs_up
+printf '\xfd\xbe\x3e\x00\xbf\x3e\x10\xb9\x10\x00\xf3\xa5' > movs_down
+printf '\xfc\xbf\x00\x30\xb0\x07\xaa\xbe\x00\x30\xbf\x01\x30\xb9\x40\x00\xf3\xa4' > movs_overlap
+printf '\xfc\xbe\x00\x00\xbf\x00\x40\xb9\x08\x00\xf3\xa4\xc6\x06\x04\x40\xff' > cmps_early
+printf '\xbe\x00\x00\xbf\x00\x40\xb9\x08\x00\xf3\xa6' >> cmps_early
+printf '\xfc\xbf\x00\x00\xb0\xb9\xb9\x20\x00\xf2\xae' > scas_early
+printf '\xb9\x00\x00\xbf\x00\x50\xb0\x01\xf3\xaa\xbe\x00\x00\xf3\xa4\xf3\xa6\xf2\xae' > cx_zero
+STRING_PROGRAMS="stos_down stos_up movs_up movs_down movs_overlap cmps_early scas_early cx_zero"
+
+TestEngines listings/listing_0041_add_sub_cmp_jnz
+TestEngines listings/listing_0052_memory_add_loop
+TestEngines listings/listing_0053_add_loop_challenge
+TestEngines listings/listing_0054_draw_rectangle
+TestEngines loop_reads_cx
+TestEngines loop_reads_cl
+for PROGRAM in $STRING_PROGRAMS; do
+    TestEngines $PROGRAM
+done
+
+TestTrace listings/listing_0052_memory_add_loop
+TestTrace listings/listing_0054_draw_rectangle
+for PROGRAM in $STRING_PROGRAMS; do
+    TestTrace $PROGRAM
+done
+
 # Output results
 echo
 echo "PASSED: $PASSED"
 echo "FAILED: $FAILED"
 
 # Clean up
-rm -f output.asm output
+rm -f output.asm output output.txt output.trace output.state output.replayed
+rm -f loop_reads_cx loop_reads_cl $STRING_PROGRAMS